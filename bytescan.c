@@ -0,0 +1,565 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file bytescan.c
+    Fast scanning for the bytes that the cleaning engine acts upon.
+
+    Most text consists of long runs of ordinary characters between the
+    handful of bytes that the engine cares about. The vectorised scanners
+    compare a whole register's worth of input against each of those
+    bytes at once, and only drop down to examining individual bytes once
+    a register containing a match has been found.
+
+    On x86 targets every scanner variant is compiled into the program,
+    each with the instruction set it needs enabled through a function
+    attribute, regardless of the options the rest of the program was
+    compiled with. The best variant that the processor supports is
+    selected once at start-up and called through a function pointer. The
+    vector code relies on GCC-compatible intrinsics; other compilers and
+    processors get the portable table-driven scanner.
+
+    The same selection decides how the first block of a file is examined
+    to tell whether it holds text at all. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stddef.h>
+#include <setjmp.h>
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) \
+    || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#   define SCAN_X86
+#   include <immintrin.h>
+#   if defined(__clang__) || __GNUC__ >= 6
+#       define SCAN_X86_AVX512
+#   endif
+#endif
+
+#include "options.h"
+#include "bytescan.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Constant for ASCII tab character */
+#define CHAR_TAB 9
+
+/** Constant for ASCII LF character */
+#define CHAR_LF 10
+
+/** Constant for ASCII CR character */
+#define CHAR_CR 13
+
+/** Constant for DOS EOF character */
+#define CHAR_EOF 26
+
+/** Constant for ASCII space character */
+#define CHAR_SPACE 32
+
+/** Constant for ASCII backspace character, the first of the run of
+    control characters that text may contain */
+#define CHAR_BS 8
+
+/** Number of control characters in the run starting at #CHAR_BS: BS,
+    TAB, LF, VT, FF and CR */
+#define TEXT_CONTROL_RUN 6
+
+/** Constant for ASCII escape character, which starts terminal control
+    sequences in text */
+#define CHAR_ESC 27
+
+/** Highest value of an ASCII control character, not counting DEL */
+#define CHAR_CONTROL_MAX 31
+
+/** Returned by a binary byte counter when it finds a null character */
+#define FOUND_NUL ((size_t)-1)
+
+/** A span is binary if more than one byte in this many is a control
+    character that text does not contain */
+#define BINARY_CONTROL_SHARE 16
+
+/** Lookup table flagging the bytes searched for by #scan_special_bytes */
+static const unsigned char SPECIAL_BYTE[256] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, /* 0x00: TAB LF CR */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, /* 0x10: ctrl-Z */
+    1                                               /* 0x20: space */
+};
+
+/** Portable scanner, examining one byte at a time.
+
+    @param p Start of the span.
+    @param end End of the span.
+    @return A pointer to the first special byte, or @a end. */
+static const unsigned char *scan_scalar(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    while(p < end && !SPECIAL_BYTE[*p])
+    {
+        p++;
+    }
+    return p;
+}
+
+/** Lookup table flagging the control characters that text does not
+    contain; that is, all but BS, TAB, LF, VT, FF, CR, ctrl-Z and ESC */
+static const unsigned char BINARY_BYTE[CHAR_CONTROL_MAX + 1] =
+{
+    1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 1, 1, /* 0x00 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1  /* 0x10 */
+};
+
+/** Portable binary byte counter, examining one byte at a time.
+
+    @param p Start of the span.
+    @param end End of the span.
+    @return The number of control characters in the span that text does
+    not contain, or #FOUND_NUL if it contains a null character. */
+static size_t count_binary_scalar(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    /* count: Number of binary bytes found so far */
+    size_t count = 0;
+
+    for(; p < end; p++)
+    {
+        if(*p == 0)
+        {
+            return FOUND_NUL;
+        }
+        if(*p <= CHAR_CONTROL_MAX)
+        {
+            count += BINARY_BYTE[*p];
+        }
+    }
+    return count;
+}
+
+#ifdef SCAN_X86
+
+/** Flags the special bytes in a 16-byte vector.
+
+    @param v The input bytes.
+    @return A vector holding @c 0xff for each special byte in @a v and
+    @c 0 elsewhere. */
+static __attribute__((target("sse2"))) __m128i classify_sse2(__m128i v)
+{
+    return _mm_or_si128(
+        _mm_or_si128(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_SPACE)),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_TAB))),
+        _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_LF)),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_CR))),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_EOF))));
+}
+
+/** SSE2 scanner, examining 16 bytes at a time, or 64 bytes at a time
+    once past the first register. Short runs between words are common,
+    so the first register is checked on its own before entering the
+    unrolled loop.
+
+    @param p Start of the span.
+    @param end End of the span.
+    @return A pointer to the first special byte, or @a end. */
+static __attribute__((target("sse2"))) const unsigned char *scan_sse2(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    /* mask: Bit mask of special bytes within a register */
+    int mask;
+
+    if(end - p >= 16)
+    {
+        mask = _mm_movemask_epi8(classify_sse2(
+            _mm_loadu_si128((const __m128i *)p)));
+        if(mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    while(end - p >= 64)
+    {
+        /* a, b, c, d: Special byte flags for each 16-byte register */
+        __m128i a = classify_sse2(_mm_loadu_si128((const __m128i *)p));
+        __m128i b = classify_sse2(_mm_loadu_si128((const __m128i *)(p + 16)));
+        __m128i c = classify_sse2(_mm_loadu_si128((const __m128i *)(p + 32)));
+        __m128i d = classify_sse2(_mm_loadu_si128((const __m128i *)(p + 48)));
+
+        if(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b),
+            _mm_or_si128(c, d))))
+        {
+            if((mask = _mm_movemask_epi8(a)) != 0)
+            {
+                return p + __builtin_ctz(mask);
+            }
+            if((mask = _mm_movemask_epi8(b)) != 0)
+            {
+                return p + 16 + __builtin_ctz(mask);
+            }
+            if((mask = _mm_movemask_epi8(c)) != 0)
+            {
+                return p + 32 + __builtin_ctz(mask);
+            }
+            return p + 48 + __builtin_ctz(_mm_movemask_epi8(d));
+        }
+        p += 64;
+    }
+
+    while(end - p >= 16)
+    {
+        mask = _mm_movemask_epi8(classify_sse2(
+            _mm_loadu_si128((const __m128i *)p)));
+        if(mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return scan_scalar(p, end);
+}
+
+/** SSE2 binary byte counter, examining 16 bytes at a time. Only the
+    first block of each file is examined, so nothing wider is used.
+
+    @param p Start of the span.
+    @param end End of the span.
+    @return The number of control characters in the span that text does
+    not contain, or #FOUND_NUL if it contains a null character. */
+static __attribute__((target("sse2"))) size_t count_binary_sse2(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    /* count: Number of binary bytes found so far */
+    /* rest: Count for the bytes after the last whole register */
+    size_t count = 0;
+    size_t rest;
+
+    while(end - p >= 16)
+    {
+        /* v: The next 16 input bytes */
+        /* run: The input bytes less BS, wrapping below zero */
+        /* control: Flags the control characters */
+        /* text: Flags the control characters found in text */
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i run = _mm_sub_epi8(v, _mm_set1_epi8(CHAR_BS));
+        __m128i control = _mm_cmpeq_epi8(
+            _mm_min_epu8(v, _mm_set1_epi8(CHAR_CONTROL_MAX)), v);
+        __m128i text = _mm_or_si128(
+            _mm_cmpeq_epi8(
+                _mm_min_epu8(run, _mm_set1_epi8(TEXT_CONTROL_RUN - 1)), run),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_EOF)),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(CHAR_ESC))));
+
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())))
+        {
+            return FOUND_NUL;
+        }
+        count += __builtin_popcount(
+            _mm_movemask_epi8(_mm_andnot_si128(text, control)));
+        p += 16;
+    }
+    rest = count_binary_scalar(p, end);
+    return (rest == FOUND_NUL) ? FOUND_NUL : count + rest;
+}
+
+
+/** Flags the special bytes in a 32-byte vector.
+
+    @param v The input bytes.
+    @return A vector holding @c 0xff for each special byte in @a v and
+    @c 0 elsewhere. */
+static __attribute__((target("avx2"))) __m256i classify_avx2(__m256i v)
+{
+    return _mm256_or_si256(
+        _mm256_or_si256(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CHAR_SPACE)),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CHAR_TAB))),
+        _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CHAR_LF)),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CHAR_CR))),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(CHAR_EOF))));
+}
+
+/** AVX2 scanner, examining 64 bytes (two registers) at a time. Spans
+    too short for that are handed to the SSE2 scanner.
+
+    @param p Start of the span.
+    @param end End of the span.
+    @return A pointer to the first special byte, or @a end. */
+static __attribute__((target("avx2"))) const unsigned char *scan_avx2(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    /* The first 16 bytes are checked on their own, since most runs
+       between words end well within them. */
+    if(end - p >= 16)
+    {
+        /* mask: Bit mask of special bytes within the register */
+        int mask = _mm_movemask_epi8(classify_sse2(
+            _mm_loadu_si128((const __m128i *)p)));
+
+        if(mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    while(end - p >= 64)
+    {
+        /* a, b: Special byte flags for each 32-byte register */
+        /* mask: Bit mask of special bytes within a register */
+        __m256i a = classify_avx2(_mm256_loadu_si256((const __m256i *)p));
+        __m256i b = classify_avx2(_mm256_loadu_si256((const __m256i *)(p + 32)));
+        unsigned int mask;
+
+        if(!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b)))
+        {
+            mask = (unsigned int)_mm256_movemask_epi8(a);
+            if(mask)
+            {
+                return p + __builtin_ctz(mask);
+            }
+            return p + 32
+                + __builtin_ctz((unsigned int)_mm256_movemask_epi8(b));
+        }
+        p += 64;
+    }
+    return scan_sse2(p, end);
+}
+
+#ifdef SCAN_X86_AVX512
+
+/** AVX-512 scanner, examining 64 bytes (one register) at a time. Spans
+    too short for that are handed to the SSE2 scanner.
+
+    @param p Start of the span.
+    @param end End of the span.
+    @return A pointer to the first special byte, or @a end. */
+static __attribute__((target("avx512f,avx512bw")))
+const unsigned char *scan_avx512(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    /* The first 16 bytes are checked on their own, for the same reason
+       as in the AVX2 scanner. */
+    if(end - p >= 16)
+    {
+        /* mask: Bit mask of special bytes within the register */
+        int mask = _mm_movemask_epi8(classify_sse2(
+            _mm_loadu_si128((const __m128i *)p)));
+
+        if(mask)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+
+    while(end - p >= 64)
+    {
+        /* v: The next 64 input bytes */
+        /* mask: Bit mask of special bytes within the register */
+        __m512i v = _mm512_loadu_si512((const void *)p);
+        __mmask64 mask =
+            _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(CHAR_SPACE))
+            | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(CHAR_TAB))
+            | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(CHAR_LF))
+            | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(CHAR_CR))
+            | _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(CHAR_EOF));
+
+        if(mask)
+        {
+            return p + __builtin_ctzll(mask);
+        }
+        p += 64;
+    }
+    return scan_sse2(p, end);
+}
+
+#endif /* SCAN_X86_AVX512 */
+
+#endif /* SCAN_X86 */
+
+/** The selected scanner variant */
+static simd_mode_t scan_variant = SM_AUTO;
+
+/** Points to the selected scanner variant */
+static const unsigned char *(*scan_impl)(
+    const unsigned char *p,
+    const unsigned char *end) = scan_scalar;
+
+/** Points to the binary byte counter for the selected scanner variant */
+static size_t (*count_binary_impl)(
+    const unsigned char *p,
+    const unsigned char *end) = count_binary_scalar;
+
+#ifdef HAVE_PTHREAD_H
+
+/** Makes sure that the default variant is selected once only, even if
+    several threads scan at once */
+static pthread_once_t default_scanner_once = PTHREAD_ONCE_INIT;
+
+#else
+
+/** Set once the default variant has been selected */
+static int default_scanner_selected = FALSE;
+
+#endif /* HAVE_PTHREAD_H */
+
+int byte_scanner_supported(simd_mode_t variant)
+{
+#   ifdef SCAN_X86
+        __builtin_cpu_init();
+#   endif
+    switch(variant)
+    {
+        case SM_AUTO:
+        case SM_SCALAR:
+            return TRUE;
+#       ifdef SCAN_X86
+        case SM_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SM_AVX2:
+            return __builtin_cpu_supports("avx2");
+#       endif
+#       ifdef SCAN_X86_AVX512
+        case SM_AVX512:
+            return __builtin_cpu_supports("avx512bw");
+#       endif
+        default:
+            return FALSE;
+    }
+}
+
+/** Points the scanner at a variant, without making sure that the
+    default variant has been selected first.
+
+    @param variant The variant to use, or #SM_AUTO to select the widest
+    variant that the processor supports.
+    @return Non-zero on success; zero if @a variant is not supported. */
+static int set_byte_scanner(simd_mode_t variant)
+{
+    if(variant == SM_AUTO)
+    {
+        /* Pick the widest variant that this processor can run */
+        variant = SM_AVX512;
+        while(!byte_scanner_supported(variant))
+        {
+            variant--;
+        }
+    }
+    else if(!byte_scanner_supported(variant))
+    {
+        return FALSE;
+    }
+
+    switch(variant)
+    {
+#       ifdef SCAN_X86
+        case SM_SSE2:
+            scan_impl = scan_sse2;
+            count_binary_impl = count_binary_sse2;
+            break;
+        case SM_AVX2:
+            scan_impl = scan_avx2;
+            count_binary_impl = count_binary_sse2;
+            break;
+#       endif
+#       ifdef SCAN_X86_AVX512
+        case SM_AVX512:
+            scan_impl = scan_avx512;
+            count_binary_impl = count_binary_sse2;
+            break;
+#       endif
+        default:
+            scan_impl = scan_scalar;
+            count_binary_impl = count_binary_scalar;
+            break;
+    }
+    scan_variant = variant;
+    return TRUE;
+}
+
+/** Selects the best supported variant. */
+static void select_default_scanner(void)
+{
+    set_byte_scanner(SM_AUTO);
+}
+
+/** Selects the default variant if no variant has been selected yet.
+    With threads, the first caller selects it while any others wait. */
+static void init_byte_scanner(void)
+{
+#   ifdef HAVE_PTHREAD_H
+        pthread_once(&default_scanner_once, select_default_scanner);
+#   else
+        if(!default_scanner_selected)
+        {
+            select_default_scanner();
+            default_scanner_selected = TRUE;
+        }
+#   endif /* HAVE_PTHREAD_H */
+}
+
+int select_byte_scanner(simd_mode_t variant)
+{
+    /* Select the default first, so that it cannot later replace this
+       selection */
+    init_byte_scanner();
+    return set_byte_scanner(variant);
+}
+
+simd_mode_t selected_byte_scanner(void)
+{
+    return scan_variant;
+}
+
+const unsigned char *scan_special_bytes(
+    const unsigned char *p,
+    const unsigned char *end)
+{
+    init_byte_scanner();
+    return scan_impl(p, end);
+}
+
+int looks_binary(const unsigned char *p, const unsigned char *end)
+{
+    /* count: Number of control characters that text does not contain */
+    size_t count;
+
+    init_byte_scanner();
+    count = count_binary_impl(p, end);
+    return count == FOUND_NUL
+        || count * BINARY_CONTROL_SHARE > (size_t)(end - p);
+}
@@ -0,0 +1,77 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file bytescan.h
+    Fast scanning for the bytes that the cleaning engine acts upon.
+
+    Please include @c options.h before including this header. */
+
+#ifndef BYTESCAN_H
+#define BYTESCAN_H
+
+/** Finds the first byte in a span that the cleaning engine may need to
+    act upon; i.e. a space, tab, LF, CR or ctrl-Z character. Depending
+    on the scanner variant in use, the span is examined up to 64 bytes at
+    a time.
+
+    @param p Start of the span.
+    @param end End of the span (one past the last byte).
+    @return A pointer to the first such byte, or @a end if the span
+    contains none. */
+extern const unsigned char *scan_special_bytes(
+    const unsigned char *p,
+    const unsigned char *end);
+
+/** Decides whether a span taken from the start of a file holds binary
+    data rather than text. It does if it contains a null character, or
+    if more than one byte in 16 is a control character other than BS,
+    TAB, LF, VT, FF, CR, ctrl-Z or ESC. Bytes with the top bit set are
+    taken to be text, so UTF-8 and the 8-bit character sets pass.
+
+    @param p Start of the span.
+    @param end End of the span (one past the last byte).
+    @return Non-zero if the span holds binary data. */
+extern int looks_binary(
+    const unsigned char *p,
+    const unsigned char *end);
+
+/** Checks whether the processor can run a scanner variant.
+
+    @param variant The variant to check.
+    @return Non-zero if @a variant is built into the program and the
+    processor supports the instructions it needs; zero otherwise.
+    #SM_AUTO and #SM_SCALAR are always supported. */
+extern int byte_scanner_supported(simd_mode_t variant);
+
+/** Selects the scanner variant used by #scan_special_bytes. This should
+    be called once at start-up, before any threads are created; if it is
+    not called, the best supported variant is selected once when
+    #scan_special_bytes or #looks_binary is first invoked, which is safe
+    to do from several threads at once.
+
+    @param variant The variant to use, or #SM_AUTO to select the widest
+    variant that the processor supports.
+    @return Non-zero on success; zero if @a variant is not supported, in
+    which case the previous selection stays in effect. */
+extern int select_byte_scanner(simd_mode_t variant);
+
+/** Reports the scanner variant currently in use.
+
+    @return The variant most recently chosen by #select_byte_scanner, or
+    #SM_AUTO if no selection has been made yet. */
+extern simd_mode_t selected_byte_scanner(void);
+
+#endif /* !BYTESCAN_H */
@@ -0,0 +1,218 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleanbuf.c
+    Cleaning of text that is already held in memory. Each piece of text
+    is fed to the engine as a single span, and the engine writes
+    straight into the caller's output buffer. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "cleanstr.h"
+#include "options.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+#include "cleanbuf.h"
+
+/** Longest end-of-line sequence that may be written, in bytes */
+#define MAX_EOL_LEN 2
+
+/** Number of bytes that may be written at the end of the text beyond
+    those accounted for by the input: a final end-of-line sequence, a
+    second one before an appended ctrl-Z, and the ctrl-Z itself. */
+#define MAX_TRAILER_LEN (2 * MAX_EOL_LEN + 1)
+
+/** Points a sink at a caller's output buffer. The sink cannot be
+    drained, so filling it up is an error.
+
+    @param sink The sink to set up.
+    @param out The output buffer.
+    @param out_size Size of @a out, in bytes. */
+static void init_buffer_sink(
+    struct clean_sink *sink,
+    void *out,
+    size_t out_size)
+{
+    sink->buf = out;
+    sink->len = 0;
+    sink->size = out_size;
+    sink->flush = NULL;
+    sink->handle = NULL;
+}
+
+/** Adds two output lengths, saturating at @c (size_t)-1.
+
+    @param a The first length.
+    @param b The second length.
+    @return The sum. */
+static size_t add_bound(size_t a, size_t b)
+{
+    return (a > (size_t)-1 - b) ? (size_t)-1 : a + b;
+}
+
+size_t clean_buffer_bound(
+    const struct cleantxt_ctx *ctx,
+    size_t in_len)
+{
+    /* growth: The most bytes that one input byte can turn into. A tab
+       may be expanded into a whole tab stop of spaces, and a one-byte
+       end-of-line sequence may become CR+LF. Runs of spaces never
+       grow. */
+    size_t growth = (ctx->tab_size > MAX_EOL_LEN)
+        ? (size_t)ctx->tab_size
+        : MAX_EOL_LEN;
+
+    if(in_len > ((size_t)-1 - MAX_TRAILER_LEN) / growth)
+    {
+        return (size_t)-1;
+    }
+    return in_len * growth + MAX_TRAILER_LEN;
+}
+
+clean_buffer_status_t clean_buffer(
+    struct cleantxt_ctx *ctx,
+    const void *in,
+    size_t in_len,
+    void *out,
+    size_t out_size,
+    size_t *out_len,
+    clean_stream_result_t *result)
+{
+    /* sink: Writes into the output buffer, which cannot be drained */
+    /* status: Outcome of the engine */
+    struct clean_sink sink;
+    clean_engine_status_t status;
+
+    *out_len = 0;
+    if(ctx->tab_size < 1 || ctx->tab_min < 1)
+    {
+        return CB_BAD_CONFIG;
+    }
+
+    init_buffer_sink(&sink, out, out_size);
+    clean_engine_init(&ctx->eng, ctx);
+    status = clean_engine_feed(&ctx->eng, in, in_len, &sink);
+    if(status == CE_OK)
+    {
+        status = clean_engine_finish(&ctx->eng, &sink);
+    }
+    *out_len = sink.len;
+    if(status != CE_OK)
+    {
+        return CB_OUTPUT_TOO_SMALL;
+    }
+    if(result)
+    {
+        *result = ctx->eng.result;
+    }
+    return CB_OK;
+}
+
+clean_buffer_status_t clean_push_start(struct cleantxt_ctx *ctx)
+{
+    if(ctx->tab_size < 1 || ctx->tab_min < 1)
+    {
+        return CB_BAD_CONFIG;
+    }
+    clean_engine_init(&ctx->eng, ctx);
+    return CB_OK;
+}
+
+size_t clean_push_bound(
+    const struct cleantxt_ctx *ctx,
+    size_t in_len)
+{
+    /* eng: The engine state left by earlier pieces */
+    /* held: The most bytes that the held-back whitespace can produce */
+    const struct clean_engine *eng = &ctx->eng;
+    size_t held;
+
+    if(eng->stopped)
+    {
+        /* Everything after a significant ctrl-Z is discarded; only the
+           trailer remains to be written when the text is finished. */
+        return MAX_TRAILER_LEN;
+    }
+
+    /* A held-back gap is filled with at most one byte per column. After
+       an end-of-line sequence, the gap starts from the left margin. A CR
+       at the end of the last piece has not been collected yet. */
+    held = eng->collected_newlines > 0
+        ? eng->in_col
+        : eng->in_col - eng->out_col;
+    if(eng->collected_newlines + eng->pending_cr
+        > ((size_t)-1 - held) / MAX_EOL_LEN)
+    {
+        return (size_t)-1;
+    }
+    held += (eng->collected_newlines + eng->pending_cr) * MAX_EOL_LEN;
+    return add_bound(held, clean_buffer_bound(ctx, in_len));
+}
+
+clean_buffer_status_t clean_push(
+    struct cleantxt_ctx *ctx,
+    const void *in,
+    size_t in_len,
+    void *out,
+    size_t out_size,
+    size_t *out_len)
+{
+    /* sink: Writes into the output buffer */
+    struct clean_sink sink;
+
+    *out_len = 0;
+    if(out_size < clean_push_bound(ctx, in_len))
+    {
+        return CB_OUTPUT_TOO_SMALL;
+    }
+    init_buffer_sink(&sink, out, out_size);
+
+    /* The output buffer is big enough for the worst case, so the engine
+       cannot run out of room. */
+    clean_engine_feed(&ctx->eng, in, in_len, &sink);
+    *out_len = sink.len;
+    return CB_OK;
+}
+
+clean_buffer_status_t clean_push_finish(
+    struct cleantxt_ctx *ctx,
+    void *out,
+    size_t out_size,
+    size_t *out_len,
+    clean_stream_result_t *result)
+{
+    /* sink: Writes into the output buffer */
+    struct clean_sink sink;
+
+    *out_len = 0;
+    if(out_size < clean_push_bound(ctx, 0))
+    {
+        return CB_OUTPUT_TOO_SMALL;
+    }
+    init_buffer_sink(&sink, out, out_size);
+    clean_engine_finish(&ctx->eng, &sink);
+    *out_len = sink.len;
+    if(result)
+    {
+        *result = ctx->eng.result;
+    }
+    return CB_OK;
+}
@@ -0,0 +1,150 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleanbuf.h
+    Cleaning of text that is already held in memory.
+
+    These functions clean a source buffer into a caller-supplied output
+    buffer without going through stdio, and report problems through
+    their return value rather than a long jump. #clean_buffer cleans a
+    whole text at once. The @c clean_push functions clean a text that
+    arrives in pieces, such as reads from a socket: the state between
+    pieces is kept in the context, so nothing ever blocks waiting for
+    more input. */
+
+#ifndef CLEANBUF_H
+#define CLEANBUF_H
+
+#include <stddef.h>
+
+/** Return status codes for #clean_buffer */
+typedef enum
+{
+    CB_OK = 0,              /**< The text was cleaned successfully */
+    CB_OUTPUT_TOO_SMALL,    /**< The cleaned text did not fit in the
+                                 output buffer */
+    CB_BAD_CONFIG           /**< The context's tab size or minimum tab
+                                 gap is not a positive integer */
+} clean_buffer_status_t;
+
+struct cleantxt_ctx;
+
+/** Computes the largest number of bytes that cleaning @a in_len bytes
+    of text could produce with a given configuration. An output buffer
+    of this size is always big enough for #clean_buffer.
+
+    @param ctx The cleaning context. Only its configuration is read.
+    @param in_len Length of the text to be cleaned, in bytes.
+    @return The worst-case output length, or @c (size_t)-1 if it would
+    not fit in a @c size_t. */
+extern size_t clean_buffer_bound(
+    const struct cleantxt_ctx *ctx,
+    size_t in_len);
+
+/** Cleans a buffer of text into another buffer. The two buffers must
+    not overlap.
+
+    @param ctx The cleaning context, which supplies the configuration
+    and holds the text's state while it is cleaned.
+    @param in The text to clean.
+    @param in_len Length of @a in, in bytes.
+    @param out The buffer that receives the cleaned text.
+    @param out_size Size of @a out, in bytes.
+    @param out_len The length of the cleaned text is stored here. If the
+    output buffer proves too small, then the number of bytes that were
+    written before it filled up is stored instead.
+    @param result If not @c NULL, then #CSR_STREAM_MODIFIED or
+    #CSR_STREAM_UNMODIFIED is stored here on success, according to
+    whether the cleaned text differs from the input.
+    @return One of the following is returned:
+    @li #CB_OK on success.
+    @li #CB_OUTPUT_TOO_SMALL if @a out could not hold the cleaned text;
+    a buffer of #clean_buffer_bound bytes never is.
+    @li #CB_BAD_CONFIG if the configuration in @a ctx is invalid. */
+extern clean_buffer_status_t clean_buffer(
+    struct cleantxt_ctx *ctx,
+    const void *in,
+    size_t in_len,
+    void *out,
+    size_t out_size,
+    size_t *out_len,
+    clean_stream_result_t *result);
+
+/** Prepares a context for cleaning a text that will be pushed to it in
+    pieces with #clean_push.
+
+    @param ctx The cleaning context.
+    @return #CB_OK on success, or #CB_BAD_CONFIG if the configuration in
+    @a ctx is invalid. */
+extern clean_buffer_status_t clean_push_start(struct cleantxt_ctx *ctx);
+
+/** Computes the largest number of bytes that pushing @a in_len more
+    bytes of text could produce. This depends on the whitespace that is
+    being held back from earlier pieces, which is written out as soon as
+    the next non-whitespace character arrives. With @a in_len of zero,
+    this covers #clean_push_finish.
+
+    @param ctx The cleaning context, as prepared by #clean_push_start.
+    Only read.
+    @param in_len Length of the next piece of text, in bytes.
+    @return The worst-case output length, or @c (size_t)-1 if it would
+    not fit in a @c size_t. */
+extern size_t clean_push_bound(
+    const struct cleantxt_ctx *ctx,
+    size_t in_len);
+
+/** Cleans the next piece of a text. Whitespace at the end of the piece
+    is held back in @a ctx until it is known whether it is trailing
+    whitespace, so the output may lag behind the input.
+
+    @param ctx The cleaning context, as prepared by #clean_push_start.
+    @param in The next piece of text.
+    @param in_len Length of @a in, in bytes.
+    @param out The buffer that receives the cleaned text.
+    @param out_size Size of @a out, in bytes.
+    @param out_len The number of bytes written to @a out is stored here.
+    @return #CB_OK on success, or #CB_OUTPUT_TOO_SMALL if @a out_size is
+    less than #clean_push_bound for the piece. In the latter case
+    nothing is consumed, so the piece may be pushed again with a larger
+    buffer, or in smaller parts. */
+extern clean_buffer_status_t clean_push(
+    struct cleantxt_ctx *ctx,
+    const void *in,
+    size_t in_len,
+    void *out,
+    size_t out_size,
+    size_t *out_len);
+
+/** Signals the end of a text that was pushed in pieces, writing out any
+    final end-of-line sequence and ctrl-Z character that the
+    configuration calls for.
+
+    @param ctx The cleaning context.
+    @param out The buffer that receives the cleaned text.
+    @param out_size Size of @a out, in bytes.
+    @param out_len The number of bytes written to @a out is stored here.
+    @param result As for #clean_buffer.
+    @return #CB_OK on success, or #CB_OUTPUT_TOO_SMALL if @a out_size is
+    less than #clean_push_bound with no further input, in which case
+    the call may be repeated with a larger buffer. */
+extern clean_buffer_status_t clean_push_finish(
+    struct cleantxt_ctx *ctx,
+    void *out,
+    size_t out_size,
+    size_t *out_len,
+    clean_stream_result_t *result);
+
+#endif /* !CLEANBUF_H */
@@ -0,0 +1,56 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleanctx.c
+    Cleaning context: the configuration and per-stream state that drive
+    the cleaning functions. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "cleanstr.h"
+#include "options.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+
+void cleantxt_ctx_init(struct cleantxt_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(struct cleantxt_ctx));
+    ctx->tab_size = DEFAULT_TAB_SIZE;
+    ctx->tab_min = DEFAULT_TAB_MIN;
+    ctx->whitespace_mode = DEFAULT_WHITESPACE_MODE;
+    ctx->eol_mode = DEFAULT_EOL_MODE;
+}
+
+void cleantxt_ctx_from_options(
+    struct cleantxt_ctx *ctx,
+    const struct cleantxt_options *opts)
+{
+    cleantxt_ctx_init(ctx);
+    ctx->tab_size = opts->tab_size;
+    ctx->tab_min = opts->tab_min;
+    ctx->whitespace_mode = opts->whitespace_mode;
+    ctx->eol_mode = opts->eol_mode;
+    ctx->stop_at_ctrl_z = opts->stop_at_ctrl_z;
+    ctx->add_ctrl_z = opts->add_ctrl_z;
+    ctx->remove_ctrl_z = opts->remove_ctrl_z;
+    ctx->pipeline = opts->pipeline;
+}
@@ -0,0 +1,75 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleanctx.h
+    Cleaning context: the configuration and per-stream state that drive
+    the cleaning functions.
+
+    Every cleaning function takes its settings from a context passed to
+    it, rather than from the global #options structure, so streams may be
+    cleaned with different settings at the same time. A context may only
+    be used by one thread at a time; give each thread its own copy. */
+
+#ifndef CLEANCTX_H
+#define CLEANCTX_H
+
+/** Configuration and state for cleaning text streams */
+struct cleantxt_ctx
+{
+    /** The size of the tab margins */
+    int tab_size;
+    /** The minimum length whitespace gaps for filling with tabs */
+    int tab_min;
+    /** The whitespace fill mode */
+    whitespace_mode_t whitespace_mode;
+    /** The character sequence to use for end-of-line */
+    eol_mode_t eol_mode;
+    /** If this flag is set, then a ctrl-Z character signifies the end
+        of the input stream. */
+    unsigned int stop_at_ctrl_z:1;
+    /** If this flag is set, then a ctrl-Z character should be appended
+        to the end of the stream. */
+    unsigned int add_ctrl_z:1;
+    /** If this flag is set, then any ctrl-Z characters encountered will
+        be silently discarded from the input. */
+    unsigned int remove_ctrl_z:1;
+    /** If this flag is set, then streams are read and written on
+        threads of their own while they are cleaned. */
+    unsigned int pipeline:1;
+    /** Number of threads that a large regular file may be cleaned with:
+        zero for one per online processor, or one to clean every stream
+        on the calling thread. */
+    int threads;
+    /** Engine state for the stream currently being cleaned. The
+        cleaning functions reset this at the start of each stream. */
+    struct clean_engine eng;
+};
+
+/** Initialises a context with the default configuration.
+
+    @param ctx The context to initialise. */
+extern void cleantxt_ctx_init(struct cleantxt_ctx *ctx);
+
+/** Initialises a context with the configuration given on the command
+    line.
+
+    @param ctx The context to initialise.
+    @param opts The options parsed by #parse_options. */
+extern void cleantxt_ctx_from_options(
+    struct cleantxt_ctx *ctx,
+    const struct cleantxt_options *opts);
+
+#endif /* !CLEANCTX_H */
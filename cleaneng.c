@@ -0,0 +1,617 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleaneng.c
+    Block-oriented text-cleaning engine.
+
+    This is a restatement of the original character-at-a-time algorithm
+    (collect a run of whitespace, then flush it when the next
+    non-whitespace character arrives) as a resumable state machine.
+    Runs of ordinary characters are located with #scan_special_bytes
+    and copied to the sink in one go, and whitespace is written out with
+    block fills rather than one character at a time. The output is
+    byte-for-byte identical to that of the original algorithm.
+
+    The inner loop is written once, in @c cleankrn.h, and instantiated
+    for each combination of end-of-line mode, whitespace mode, ctrl-Z
+    handling and power-of-two tab size. #clean_engine_init picks the
+    instance to use, so the loop never tests options that cannot change
+    during a stream. */
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "cleanstr.h"
+#include "options.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+#include "bytescan.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Constant for ASCII tab character */
+#define CHAR_TAB 9
+
+/** Constant for ASCII LF character */
+#define CHAR_LF 10
+
+/** Constant for ASCII CR character */
+#define CHAR_CR 13
+
+/** Constant for DOS EOF character */
+#define CHAR_EOF 26
+
+/** Constant for ASCII space character */
+#define CHAR_SPACE 32
+
+/** Computes the column position of the next tab stop.
+
+    @param column The column position on the line where the search for
+    the next tab stop should begin. @c 0 refers to the first column of
+    the line. Note that this expression may be evaluated multiple times.
+    @param tab_size The size of the tab stops. Note that this expression
+    may be evaluated multiple times.
+    @return The column position of the next tab stop after @a column. */
+#define NEXT_TAB_STOP(column, tab_size) \
+    ((column) + (tab_size) - (column) % (tab_size))
+
+/** Records that the stream has been modified, noting the offset of the
+    first input byte affected if this is the first modification found.
+
+    @param eng The engine state. Note that this expression may be
+    evaluated multiple times.
+    @param offset Offset within the stream of the input affected. */
+#define MARK_MODIFIED(eng, offset) \
+    do \
+    { \
+        if((eng)->result != CSR_STREAM_MODIFIED) \
+        { \
+            (eng)->result = CSR_STREAM_MODIFIED; \
+            (eng)->modified_at = (offset); \
+        } \
+    } \
+    while(0)
+
+/** Finds the offset within the stream of the whitespace held back in
+    an engine on the current line; i.e. just after the last
+    non-whitespace character or end-of-line sequence.
+
+    @param eng The engine state. Note that this expression may be
+    evaluated multiple times. */
+#define WHITESPACE_START(eng) \
+    ((eng)->collected_newlines > 0 ? (eng)->line_start : (eng)->pending_start)
+
+/** End-of-line strings for end-of-line modes. Each element in this
+    array should correspond to the equivalent indexed value in
+    #eol_mode_t. */
+static const char *const EOL_STR[] =
+{
+    "\n",
+    "\r",
+    "\r\n"
+};
+
+/** Lengths of the strings in #EOL_STR */
+static const size_t EOL_LEN[] =
+{
+    1,
+    1,
+    2
+};
+
+/** Drains a sink whose buffer has filled up, so that more text can be
+    appended to it.
+
+    @param sink The sink to drain.
+    @return #CE_OK on success, or #CE_SINK_ERROR if the sink cannot be
+    drained. */
+static clean_engine_status_t drain_full_sink(struct clean_sink *sink)
+{
+    if(!sink->flush)
+    {
+        /* Even a sink with no room at all is full, although there is
+           nothing in it to flush. */
+        return CE_SINK_ERROR;
+    }
+    return sink->flush(sink);
+}
+
+/** Appends a block of bytes to a sink, draining it as often as needed.
+
+    @param sink The sink to write to.
+    @param data The bytes to append.
+    @param len Number of bytes to append.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+static clean_engine_status_t sink_write(
+    struct clean_sink *sink,
+    const unsigned char *data,
+    size_t len)
+{
+    while(len > sink->size - sink->len)
+    {
+        /* chunk: Number of bytes that will fit in the sink's buffer */
+        size_t chunk = sink->size - sink->len;
+
+        memcpy(sink->buf + sink->len, data, chunk);
+        sink->len += chunk;
+        data += chunk;
+        len -= chunk;
+        if(drain_full_sink(sink) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+    }
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+    return CE_OK;
+}
+
+/** Appends @a count copies of the byte @a c to a sink, draining it as
+    often as needed.
+
+    @param sink The sink to write to.
+    @param c The byte value to append.
+    @param count Number of copies of @a c to append.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+static clean_engine_status_t sink_fill(
+    struct clean_sink *sink,
+    int c,
+    unsigned long count)
+{
+    while(count > sink->size - sink->len)
+    {
+        /* chunk: Number of bytes that will fit in the sink's buffer */
+        size_t chunk = sink->size - sink->len;
+
+        memset(sink->buf + sink->len, c, chunk);
+        sink->len += chunk;
+        count -= chunk;
+        if(drain_full_sink(sink) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+    }
+    memset(sink->buf + sink->len, c, count);
+    sink->len += count;
+    return CE_OK;
+}
+
+/** Appends @a count end-of-line sequences to a sink, using the given
+    end-of-line mode.
+
+    @param eol_mode The end-of-line mode to use.
+    @param sink The sink to write to.
+    @param count Number of end-of-line sequences to append.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+static clean_engine_status_t sink_eol_mode(
+    eol_mode_t eol_mode,
+    struct clean_sink *sink,
+    unsigned long count)
+{
+    if(eol_mode != EM_CRLF)
+    {
+        return sink_fill(sink, EOL_STR[eol_mode][0], count);
+    }
+    while(count > 0)
+    {
+        if(sink_write(sink, (const unsigned char *)EOL_STR[EM_CRLF],
+            EOL_LEN[EM_CRLF]) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+        count--;
+    }
+    return CE_OK;
+}
+
+/** Appends @a count end-of-line sequences to a sink.
+
+    @param eng The engine whose end-of-line mode is used.
+    @param sink The sink to write to.
+    @param count Number of end-of-line sequences to append.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+static clean_engine_status_t sink_eols(
+    const struct clean_engine *eng,
+    struct clean_sink *sink,
+    unsigned long count)
+{
+    return sink_eol_mode(eng->eol_mode, sink, count);
+}
+
+/** Collects an end-of-line sequence found in the input. The kernels
+    have their own specialised copies of this function; this one is used
+    when the stream ends.
+
+    @param eng The engine state.
+    @param eol_type The type of end-of-line sequence found.
+    @param offset Offset within the stream of the sequence. */
+static void collect_eol(
+    struct clean_engine *eng,
+    eol_mode_t eol_type,
+    unsigned long offset)
+{
+    if(eng->collected_spaces > 0 || eng->collected_tabs > 0)
+    {
+        /* If there are any trailing tabs or spaces, they will be
+           deleted. */
+        eng->collected_spaces = 0;
+        eng->collected_tabs = 0;
+        MARK_MODIFIED(eng, WHITESPACE_START(eng));
+    }
+
+    if(eol_type != eng->eol_mode)
+    {
+        /* If the EOL sequence encountered is different to the one we
+           are outputting, then it will get transformed. */
+        MARK_MODIFIED(eng, offset);
+    }
+
+    /* Move the input column position back to the start and collect
+       the EOL sequence. */
+    eng->line_start = offset + EOL_LEN[eol_type];
+    if(eng->collected_newlines == 0)
+    {
+        eng->first_eol_end = eng->line_start;
+    }
+    eng->in_col = 0;
+    eng->collected_newlines++;
+}
+
+/* Instantiate a kernel for every combination of the options that the
+   inner loop depends on. */
+
+#define KRN_NAME feed_lf_sp
+#define KRN_EOL EM_LF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_sp_p2
+#define KRN_EOL EM_LF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_sp_z
+#define KRN_EOL EM_LF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_sp_z_p2
+#define KRN_EOL EM_LF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_tab
+#define KRN_EOL EM_LF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_tab_p2
+#define KRN_EOL EM_LF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_tab_z
+#define KRN_EOL EM_LF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_lf_tab_z_p2
+#define KRN_EOL EM_LF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_sp
+#define KRN_EOL EM_CR
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_sp_p2
+#define KRN_EOL EM_CR
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_sp_z
+#define KRN_EOL EM_CR
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_sp_z_p2
+#define KRN_EOL EM_CR
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_tab
+#define KRN_EOL EM_CR
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_tab_p2
+#define KRN_EOL EM_CR
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_tab_z
+#define KRN_EOL EM_CR
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_cr_tab_z_p2
+#define KRN_EOL EM_CR
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_sp
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_sp_p2
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_sp_z
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_sp_z_p2
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_SPACE
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_tab
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_tab_p2
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z FALSE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_tab_z
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 FALSE
+#include "cleankrn.h"
+
+#define KRN_NAME feed_crlf_tab_z_p2
+#define KRN_EOL EM_CRLF
+#define KRN_WM WM_TAB
+#define KRN_CTRL_Z TRUE
+#define KRN_TAB_POW2 TRUE
+#include "cleankrn.h"
+
+/** Kernel functions, indexed by end-of-line mode, whitespace mode,
+    whether ctrl-Z characters are significant and whether the tab size
+    is a power of two. */
+static const clean_engine_kernel_t KERNELS[3][2][2][2] =
+{
+    {
+        {
+            { feed_lf_sp, feed_lf_sp_p2 },
+            { feed_lf_sp_z, feed_lf_sp_z_p2 }
+        },
+        {
+            { feed_lf_tab, feed_lf_tab_p2 },
+            { feed_lf_tab_z, feed_lf_tab_z_p2 }
+        }
+    },
+    {
+        {
+            { feed_cr_sp, feed_cr_sp_p2 },
+            { feed_cr_sp_z, feed_cr_sp_z_p2 }
+        },
+        {
+            { feed_cr_tab, feed_cr_tab_p2 },
+            { feed_cr_tab_z, feed_cr_tab_z_p2 }
+        }
+    },
+    {
+        {
+            { feed_crlf_sp, feed_crlf_sp_p2 },
+            { feed_crlf_sp_z, feed_crlf_sp_z_p2 }
+        },
+        {
+            { feed_crlf_tab, feed_crlf_tab_p2 },
+            { feed_crlf_tab_z, feed_crlf_tab_z_p2 }
+        }
+    }
+};
+
+void clean_engine_init(
+    struct clean_engine *eng,
+    const struct cleantxt_ctx *ctx)
+{
+    /* pow2: Set if the tab size is a power of two */
+    int pow2;
+
+    memset(eng, 0, sizeof(struct clean_engine));
+    eng->whitespace_mode = ctx->whitespace_mode;
+    eng->eol_mode = ctx->eol_mode;
+    eng->tab_size = ctx->tab_size;
+    eng->tab_min = ctx->tab_min;
+    eng->stop_at_ctrl_z = ctx->stop_at_ctrl_z;
+    eng->add_ctrl_z = ctx->add_ctrl_z;
+    eng->remove_ctrl_z = ctx->remove_ctrl_z;
+    eng->result = CSR_STREAM_UNMODIFIED;
+
+    /* Work out the mask and shift that find tab stops, in case the tab
+       size is a power of two */
+    pow2 = (eng->tab_size & (eng->tab_size - 1)) == 0;
+    eng->tab_mask = eng->tab_size - 1;
+    while((1UL << eng->tab_shift) < eng->tab_size)
+    {
+        eng->tab_shift++;
+    }
+
+    /* Pick the kernel that suits the options for this stream */
+    eng->kernel = KERNELS[eng->eol_mode][eng->whitespace_mode]
+        [eng->remove_ctrl_z || eng->stop_at_ctrl_z][pow2];
+}
+
+clean_engine_status_t clean_engine_feed(
+    struct clean_engine *eng,
+    const unsigned char *in,
+    size_t in_len,
+    struct clean_sink *sink)
+{
+    /* status: Outcome of the kernel */
+    clean_engine_status_t status;
+
+    if(eng->stopped)
+    {
+        /* A significant ctrl-Z has already been reached; anything past
+           it is discarded. */
+        return CE_OK;
+    }
+    status = eng->kernel(eng, in, in_len, sink);
+    eng->in_offset += in_len;
+    return status;
+}
+
+clean_engine_status_t clean_engine_finish(
+    struct clean_engine *eng,
+    struct clean_sink *sink)
+{
+    if(!eng->stopped)
+    {
+        if(eng->pending_cr)
+        {
+            /* A CR at the very end of the stream is a CR-only
+               end-of-line sequence. */
+            eng->pending_cr = FALSE;
+            collect_eol(eng, EM_CR, eng->in_offset - 1);
+        }
+
+        if(eng->out_col > 0)
+        {
+            /* If at least one non-whitespace character exists on the
+               current line, then write a final EOL sequence to the
+               output stream. This helps eliminate a common problem
+               where shell interpreters and compilers (like gcc)
+               complain about a missing newline character on the end of
+               the last line of the file, or worse yet completely ignore
+               the last line of the file. If the input stream is empty,
+               or contains only whitespace, then the output stream will
+               remain blank. */
+            if(sink_eols(eng, sink, 1) != CE_OK)
+            {
+                return CE_SINK_ERROR;
+            }
+
+            if(eng->collected_newlines != 1
+                || eng->collected_spaces != 0
+                || eng->collected_tabs != 0)
+            {
+                /* If there is any whitespace other than a single EOL
+                   sequence following the last non-whitespace character,
+                   then this will be filtered out. */
+                MARK_MODIFIED(eng, eng->collected_newlines > 0
+                    ? eng->first_eol_end
+                    : eng->pending_start);
+            }
+        }
+        eng->collected_spaces = 0;
+        eng->collected_tabs = 0;
+        eng->collected_newlines = 0;
+    }
+
+    /* End of stream was reached. Note that out_col still refers to the
+       last line holding non-whitespace characters, whose EOL sequence
+       was written out above. */
+    if((eng->add_ctrl_z && eng->last_c != CHAR_EOF) || eng->stop_at_ctrl_z)
+    {
+        if(eng->out_col > 0 && eng->stop_at_ctrl_z)
+        {
+            if(sink_eols(eng, sink, 1) != CE_OK)
+            {
+                return CE_SINK_ERROR;
+            }
+        }
+        if(sink_fill(sink, CHAR_EOF, 1) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+        MARK_MODIFIED(eng, eng->in_offset);
+    }
+    eng->stopped = TRUE;
+    return CE_OK;
+}
+
+clean_engine_status_t clean_sink_flush(struct clean_sink *sink)
+{
+    if(sink->len == 0)
+    {
+        return CE_OK;
+    }
+    if(!sink->flush)
+    {
+        return CE_SINK_ERROR;
+    }
+    return sink->flush(sink);
+}
@@ -0,0 +1,183 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleaneng.h
+    Block-oriented text-cleaning engine.
+
+    The engine is an explicit state machine that consumes input in
+    arbitrarily sized in-memory spans and appends the filtered text to an
+    output sink. All state that the original character-at-a-time
+    algorithm kept on the stack (column positions, collected whitespace,
+    a CR awaiting its possible LF) lives in a #clean_engine structure, so
+    processing may be suspended at any span boundary and resumed later. */
+
+#ifndef CLEANENG_H
+#define CLEANENG_H
+
+#include <stddef.h>
+
+/** Return status codes for the engine functions */
+typedef enum
+{
+    CE_OK = 0,      /**< The operation completed successfully */
+    CE_SINK_ERROR   /**< The output sink could not accept more data */
+} clean_engine_status_t;
+
+/** Output sink that receives filtered text from the engine. Text is
+    accumulated in @a buf; whenever @a buf fills up, @a flush is invoked
+    to drain it. */
+struct clean_sink
+{
+    /** Output buffer */
+    unsigned char *buf;
+    /** Number of bytes currently held in @a buf */
+    size_t len;
+    /** Capacity of @a buf, in bytes */
+    size_t size;
+    /** Drains the sink's buffer. On success, it must reset @a len to
+        zero and return #CE_OK; otherwise it returns #CE_SINK_ERROR. If
+        set to @c NULL, then the sink cannot be drained and filling it
+        up is treated as an error. */
+    clean_engine_status_t (*flush)(struct clean_sink *sink);
+    /** Opaque value for use by @a flush */
+    void *handle;
+};
+
+struct clean_engine;
+struct cleantxt_ctx;
+
+/** Specialised inner loop of the engine, as selected by
+    #clean_engine_init for the stream's options. The parameters and
+    return value are as for #clean_engine_feed. */
+typedef clean_engine_status_t (*clean_engine_kernel_t)(
+    struct clean_engine *eng,
+    const unsigned char *in,
+    size_t in_len,
+    struct clean_sink *sink);
+
+/** State of the cleaning engine for a single stream */
+struct clean_engine
+{
+    /** The whitespace fill mode */
+    whitespace_mode_t whitespace_mode;
+    /** The character sequence to use for end-of-line */
+    eol_mode_t eol_mode;
+    /** The size of the tab margins */
+    unsigned long tab_size;
+    /** The minimum length whitespace gaps for filling with tabs */
+    unsigned long tab_min;
+    /** Ctrl-Z characters signify the end of the input stream */
+    unsigned int stop_at_ctrl_z:1;
+    /** A ctrl-Z character should be appended to the end of the stream */
+    unsigned int add_ctrl_z:1;
+    /** Ctrl-Z characters are discarded from the input */
+    unsigned int remove_ctrl_z:1;
+    /** One less than the tab size; used when the tab size is a power
+        of two */
+    unsigned long tab_mask;
+    /** Base-2 logarithm of the tab size; used when the tab size is a
+        power of two */
+    unsigned int tab_shift;
+    /** The inner loop specialised for the above configuration */
+    clean_engine_kernel_t kernel;
+
+    /** Column position on the current line in the input stream,
+        including any whitespace that has been collected. */
+    unsigned long in_col;
+    /** Column position on the current line in the output stream */
+    unsigned long out_col;
+    /** Number of collected spaces not yet written out */
+    unsigned long collected_spaces;
+    /** Number of collected tabs not yet written out */
+    unsigned long collected_tabs;
+    /** Number of collected end-of-line sequences not yet written out */
+    unsigned long collected_newlines;
+    /** The most recent non-whitespace character seen, or @c 0 if none */
+    int last_c;
+    /** Set if the last input span ended with a CR character, whose
+        meaning depends on whether the next span starts with a LF. */
+    unsigned int pending_cr:1;
+    /** Set once a significant ctrl-Z has ended the stream; any further
+        input is ignored. */
+    unsigned int stopped:1;
+    /** Whether the stream content has been modified so far */
+    clean_stream_result_t result;
+    /** Offset within the stream where the first modification begins;
+        only meaningful once @a result is #CSR_STREAM_MODIFIED. This is
+        the start of the run of whitespace and end-of-line sequences
+        that needs rewriting, the offset of a ctrl-Z character that is
+        removed, or the end of the stream if something must be appended
+        there. */
+    unsigned long modified_at;
+    /** Offset within the stream of the first input byte fed through
+        the engine's next span */
+    unsigned long in_offset;
+    /** Offset within the stream of the whitespace held back in the
+        engine; i.e. just after the last non-whitespace character */
+    unsigned long pending_start;
+    /** Offset within the stream just after the first end-of-line
+        sequence held back in the engine */
+    unsigned long first_eol_end;
+    /** Offset within the stream just after the most recent end-of-line
+        sequence */
+    unsigned long line_start;
+};
+
+/** Prepares an engine for a new stream, taking its configuration from
+    a cleaning context and selecting the kernel that suits it.
+
+    @param eng The engine to initialise.
+    @param ctx The context whose configuration is to be used. Only its
+    configuration is read; its own engine state is not touched. */
+extern void clean_engine_init(
+    struct clean_engine *eng,
+    const struct cleantxt_ctx *ctx);
+
+/** Filters a span of input through the engine. Whitespace at the end of
+    the span is held back in @a eng until it is known whether it is
+    trailing whitespace, so output may lag behind input.
+
+    @param eng The engine state, as prepared by #clean_engine_init.
+    @param in The input span.
+    @param in_len Length of the input span in bytes.
+    @param sink The sink that filtered text will be appended to.
+    @return #CE_OK on success, or #CE_SINK_ERROR if the sink could not be
+    drained. In the latter case the engine state is undefined. */
+extern clean_engine_status_t clean_engine_feed(
+    struct clean_engine *eng,
+    const unsigned char *in,
+    size_t in_len,
+    struct clean_sink *sink);
+
+/** Signals the end of the input stream, writing out any final
+    end-of-line sequence and ctrl-Z character that the options call for.
+    Text in the sink is not flushed; that is left to the caller.
+
+    @param eng The engine state.
+    @param sink The sink that filtered text will be appended to.
+    @return #CE_OK on success, or #CE_SINK_ERROR if the sink could not be
+    drained. */
+extern clean_engine_status_t clean_engine_finish(
+    struct clean_engine *eng,
+    struct clean_sink *sink);
+
+/** Drains any text held in a sink's buffer via its flush function.
+
+    @param sink The sink to drain.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+extern clean_engine_status_t clean_sink_flush(struct clean_sink *sink);
+
+#endif /* !CLEANENG_H */
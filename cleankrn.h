@@ -0,0 +1,332 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleankrn.h
+    Template for the cleaning engine's inner loop.
+
+    This is not a standalone header. @c cleaneng.c includes it once for
+    each combination of options that the inner loop depends on, so that
+    every test on those options is made against a constant and the
+    optimiser can discard the code for modes that are not in use. Before
+    each inclusion, the following macros must be defined:
+
+    - @c KRN_NAME: Name of the kernel function to define.
+    - @c KRN_EOL: The #eol_mode_t value for the end-of-line sequence.
+    - @c KRN_WM: The #whitespace_mode_t value for whitespace filling.
+    - @c KRN_CTRL_Z: Non-zero if ctrl-Z characters are to be removed or
+      treated as end-of-file; zero if they are ordinary characters.
+    - @c KRN_TAB_POW2: Non-zero if the tab size is a power of two, in
+      which case tab stops are found with a mask and a shift rather than
+      a division.
+
+    All of these macros are undefined again at the end of this file. */
+
+/** Forms the name of a helper function private to this kernel */
+#define KRN_FN(name) KRN_PASTE(name, KRN_NAME)
+
+/** Helper for #KRN_FN, needed so that @c KRN_NAME is expanded first */
+#define KRN_PASTE(a, b) KRN_PASTE2(a, b)
+
+/** Helper for #KRN_PASTE that performs the token pasting */
+#define KRN_PASTE2(a, b) a##_##b
+
+/** Computes the offset within the stream of a position in the span */
+#define KRN_OFFSET(ptr) (eng->in_offset + (unsigned long)((ptr) - in))
+
+#if KRN_TAB_POW2
+/** Computes the column position of the next tab stop after @a column */
+#   define KRN_NEXT_TAB_STOP(column) (((column) | eng->tab_mask) + 1)
+/** Computes the number of whole tab stops in @a width columns */
+#   define KRN_TAB_STOPS(width) ((width) >> eng->tab_shift)
+#else
+#   define KRN_NEXT_TAB_STOP(column) NEXT_TAB_STOP(column, eng->tab_size)
+#   define KRN_TAB_STOPS(width) ((width) / eng->tab_size)
+#endif /* KRN_TAB_POW2 */
+
+/** Flushes the collected sequence of whitespace to the sink. On return,
+    no whitespace is held in the engine and the output column position
+    has caught up with the input column position.
+
+    @param eng The engine state.
+    @param sink The sink to write to.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+static clean_engine_status_t KRN_FN(flush_whitespace)(
+    struct clean_engine *eng,
+    struct clean_sink *sink)
+{
+    /* out_col: Output column position as the gap is filled */
+    /* tabs_out: Number of tab characters written to fill the gap */
+    /* spaces_out: Number of space characters written to fill the gap */
+    unsigned long out_col = eng->out_col;
+    unsigned long tabs_out = 0;
+    unsigned long spaces_out;
+
+    /* Flush out any accumulated end-of-line sequences, using the character
+       sequence that the user specified on the command line. */
+    if(eng->collected_newlines > 0)
+    {
+        if(sink_eol_mode(KRN_EOL, sink, eng->collected_newlines) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+        out_col = 0;
+    }
+
+    /* If tab characters are enabled, we output as many tab characters
+       as possible to save disk space. Only expand tabs if the
+       whitespace gap is at least the minimum threshold for tab
+       insertion. Every tab after the first advances by a whole tab
+       stop, so the number of tabs can be computed directly. */
+    if(KRN_WM == WM_TAB
+        && eng->in_col - out_col >= eng->tab_min
+        && KRN_NEXT_TAB_STOP(out_col) <= eng->in_col)
+    {
+        out_col = KRN_NEXT_TAB_STOP(out_col);
+        tabs_out = 1 + KRN_TAB_STOPS(eng->in_col - out_col);
+        out_col += (tabs_out - 1) * eng->tab_size;
+        if(sink_fill(sink, CHAR_TAB, tabs_out) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+    }
+
+    /* Fill up the rest of the gap with space characters */
+    spaces_out = eng->in_col - out_col;
+    if(sink_fill(sink, CHAR_SPACE, spaces_out) != CE_OK)
+    {
+        return CE_SINK_ERROR;
+    }
+
+    /* If the whitespace gap was reformatted, then the stream was
+       modified. */
+    if(spaces_out != eng->collected_spaces || tabs_out != eng->collected_tabs)
+    {
+        MARK_MODIFIED(eng, WHITESPACE_START(eng));
+    }
+
+    eng->out_col = eng->in_col;
+    eng->collected_spaces = 0;
+    eng->collected_tabs = 0;
+    eng->collected_newlines = 0;
+    return CE_OK;
+}
+
+/** Collects an end-of-line sequence found in the input.
+
+    @param eng The engine state.
+    @param eol_type The type of end-of-line sequence found.
+    @param offset Offset within the stream of the sequence. */
+static void KRN_FN(collect_eol)(
+    struct clean_engine *eng,
+    eol_mode_t eol_type,
+    unsigned long offset)
+{
+    if(eng->collected_spaces > 0 || eng->collected_tabs > 0)
+    {
+        /* If there are any trailing tabs or spaces, they will be
+           deleted. */
+        eng->collected_spaces = 0;
+        eng->collected_tabs = 0;
+        MARK_MODIFIED(eng, WHITESPACE_START(eng));
+    }
+
+    if(eol_type != KRN_EOL)
+    {
+        /* If the EOL sequence encountered is different to the one we
+           are outputting, then it will get transformed. */
+        MARK_MODIFIED(eng, offset);
+    }
+
+    /* Move the input column position back to the start and collect
+       the EOL sequence. */
+    eng->line_start = offset + EOL_LEN[eol_type];
+    if(eng->collected_newlines == 0)
+    {
+        eng->first_eol_end = eng->line_start;
+    }
+    eng->in_col = 0;
+    eng->collected_newlines++;
+}
+
+/** Filters a span of input through the engine; see #clean_engine_feed.
+
+    @param eng The engine state.
+    @param in The input span.
+    @param in_len Length of the input span in bytes.
+    @param sink The sink that filtered text will be appended to.
+    @return #CE_OK on success, or #CE_SINK_ERROR on failure. */
+static clean_engine_status_t KRN_NAME(
+    struct clean_engine *eng,
+    const unsigned char *in,
+    size_t in_len,
+    struct clean_sink *sink)
+{
+    /* p: Current position in the input span */
+    /* end: End of the input span */
+    const unsigned char *p = in;
+    const unsigned char *end = in + in_len;
+
+    if(eng->pending_cr && p < end)
+    {
+        /* The previous span ended with a CR character. Now that we can
+           see the next character, determine which kind of end-of-line
+           sequence it was. */
+        eng->pending_cr = FALSE;
+        if(*p == CHAR_LF)
+        {
+            KRN_FN(collect_eol)(eng, EM_CRLF, eng->in_offset - 1);
+            p++;
+        }
+        else
+        {
+            KRN_FN(collect_eol)(eng, EM_CR, eng->in_offset - 1);
+        }
+    }
+
+    while(p < end)
+    {
+        /* c: Current character in the input span */
+        int c;
+
+        if(eng->collected_newlines == 0 && eng->in_col == eng->out_col)
+        {
+            /* run: End of the run of ordinary characters starting at p */
+            const unsigned char *run = p;
+
+            /* No whitespace is being held back, so a run of ordinary
+               characters can be copied straight to the output. A ctrl-Z
+               is only significant with some options; otherwise it is
+               skipped over as an ordinary character. */
+            for(;;)
+            {
+                run = scan_special_bytes(run, end);
+                if(KRN_CTRL_Z || run == end || *run != CHAR_EOF)
+                {
+                    break;
+                }
+                run++;
+            }
+            eng->pending_start = KRN_OFFSET(run);
+            if(run > p)
+            {
+                if(sink_write(sink, p, run - p) != CE_OK)
+                {
+                    return CE_SINK_ERROR;
+                }
+                eng->out_col += run - p;
+                eng->in_col = eng->out_col;
+                eng->last_c = run[-1];
+                p = run;
+                if(p == end)
+                {
+                    break;
+                }
+            }
+        }
+
+        c = *p++;
+        switch(c)
+        {
+            case CHAR_SPACE:
+                /* Collect up individual spaces */
+                eng->in_col++;
+                eng->collected_spaces++;
+                break;
+            case CHAR_TAB:
+                /* Collect up tabs, compute number of spaces required to fill. */
+                eng->in_col = KRN_NEXT_TAB_STOP(eng->in_col);
+                eng->collected_tabs++;
+                if(eng->collected_spaces > 0)
+                {
+                    /* If there are any spaces that precede this tab,
+                       then either they will get substituted with a tab
+                       character, or the tab character will get expanded
+                       into spaces. Either way, the stream is being
+                       modified. */
+                    MARK_MODIFIED(eng, WHITESPACE_START(eng));
+                }
+                break;
+            case CHAR_CR:
+                /* Encountered a CR character. Check if the next
+                   character in the stream is a LF character; if the span
+                   ends here, the decision is deferred to the next one. */
+                if(p == end)
+                {
+                    eng->pending_cr = TRUE;
+                }
+                else if(*p == CHAR_LF)
+                {
+                    KRN_FN(collect_eol)(eng, EM_CRLF, KRN_OFFSET(p - 1));
+                    p++;
+                }
+                else
+                {
+                    KRN_FN(collect_eol)(eng, EM_CR, KRN_OFFSET(p - 1));
+                }
+                break;
+            case CHAR_LF:
+                /* Found a LF-only end-of-line sequence */
+                KRN_FN(collect_eol)(eng, EM_LF, KRN_OFFSET(p - 1));
+                break;
+            default:
+                /* Found a non-whitespace character. Flush all pending
+                   whitespace to the output stream. */
+                if(KRN_FN(flush_whitespace)(eng, sink) != CE_OK)
+                {
+                    return CE_SINK_ERROR;
+                }
+                eng->last_c = c;
+                if(KRN_CTRL_Z && c == CHAR_EOF)
+                {
+                    /* Deleted a ctrl-z character. In the case of
+                       stop_at_ctrl_z, it gets re-added by
+                       clean_engine_finish(). If ctrl-z characters mark
+                       explicit end-of-file, then marking the stream as
+                       modified (even if no changes were made up to
+                       this point) causes any content that might be past
+                       the ctrl-z character to be consistently
+                       discarded. */
+                    MARK_MODIFIED(eng, KRN_OFFSET(p - 1));
+                    if(eng->stop_at_ctrl_z)
+                    {
+                        eng->stopped = TRUE;
+                        return CE_OK;
+                    }
+                    break;
+                }
+                if(sink_write(sink, p - 1, 1) != CE_OK)
+                {
+                    return CE_SINK_ERROR;
+                }
+                eng->out_col++;
+                eng->in_col = eng->out_col;
+                break;
+        }
+    }
+    return CE_OK;
+}
+
+#undef KRN_FN
+#undef KRN_OFFSET
+#undef KRN_PASTE
+#undef KRN_PASTE2
+#undef KRN_NEXT_TAB_STOP
+#undef KRN_TAB_STOPS
+#undef KRN_NAME
+#undef KRN_EOL
+#undef KRN_WM
+#undef KRN_CTRL_Z
+#undef KRN_TAB_POW2
@@ -0,0 +1,630 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleanpar.c
+    Parallel cleaning of a single large regular file.
+
+    Column positions are reset by every end-of-line sequence, so once the
+    engine has seen a LF and the next character is not whitespace, the
+    only state it carries is the end-of-line sequences it has collected
+    since the last line with text on it. The file is split at such
+    points into chunks, and each chunk is cleaned by a fresh engine. Each
+    chunk's engine is also fed the first character of the following
+    chunk, which makes it write out the end-of-line sequences that it
+    collected; that character is then taken back out of its output.
+
+    Each worker thread cleans one chunk at a time into its own output
+    buffer. Chunks are written to the output stream strictly in order:
+    a worker whose buffer fills up, or that finishes its chunk, waits
+    for its predecessor to be written first. Only the engine of the
+    chunk that reaches the end of the stream, or a significant ctrl-Z,
+    is finished, so the end-of-file rules are applied exactly once. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include "cleanstr.h"
+#include "options.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+#include "cleanpar.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Constant for ASCII tab character */
+#define CHAR_TAB 9
+
+/** Constant for ASCII LF character */
+#define CHAR_LF 10
+
+/** Constant for ASCII CR character */
+#define CHAR_CR 13
+
+/** Constant for DOS EOF character */
+#define CHAR_EOF 26
+
+/** Constant for ASCII space character */
+#define CHAR_SPACE 32
+
+/** Size of each worker's input buffer, in bytes */
+#define PAR_INPUT_BUFFER_SIZE 65536
+
+/** Largest number of threads that a single stream is cleaned with */
+#define PAR_MAX_THREADS 64
+
+#ifdef HAVE_PTHREAD_H
+#   define PAR_LOCK(run) pthread_mutex_lock(&(run)->lock)
+#   define PAR_UNLOCK(run) pthread_mutex_unlock(&(run)->lock)
+#   define PAR_WAIT(run) pthread_cond_wait(&(run)->turn_changed, &(run)->lock)
+#   define PAR_BROADCAST(run) pthread_cond_broadcast(&(run)->turn_changed)
+#else
+/* With only one worker, every chunk's turn has come by the time its
+   worker asks, so there is never anything to wait for. */
+#   define PAR_LOCK(run) ((void)0)
+#   define PAR_UNLOCK(run) ((void)0)
+#   define PAR_WAIT(run) ((void)0)
+#   define PAR_BROADCAST(run) ((void)0)
+#endif /* HAVE_PTHREAD_H */
+
+/** State shared by the workers cleaning a stream */
+struct par_run
+{
+    /** The cleaning context that each chunk's engine is configured from */
+    const struct cleantxt_ctx *ctx;
+    /** File descriptor of the input file */
+    int in_fd;
+    /** Offset within the input file where the stream starts */
+    off_t in_start;
+    /** Length of the stream, in bytes */
+    off_t in_len;
+    /** Nominal length of each chunk, in bytes */
+    off_t chunk_size;
+    /** Number of chunks */
+    unsigned long chunk_count;
+    /** The output stream */
+    FILE *out_stream;
+    /** Index of the next chunk to hand out to a worker */
+    unsigned long next_chunk;
+    /** Index of the chunk whose output is to be written next */
+    unsigned long turn;
+    /** Set once the end of the output has been written, or an error has
+        occurred; nothing more is written after that. */
+    int ended;
+    /** The @c errno value of the first error, or zero if none */
+    int error;
+    /** Set if the first error occurred while reading the input */
+    int read_error;
+    /** Offset within the stream where reading failed */
+    off_t error_offset;
+    /** Engine state of the chunk that ended the stream */
+    struct clean_engine last_eng;
+    /** Whether the chunks written so far were modified */
+    clean_stream_result_t result;
+    /** Offset within the stream of the first modification */
+    unsigned long modified_at;
+#ifdef HAVE_PTHREAD_H
+    /** Guards @a next_chunk, @a turn, @a ended and the error fields */
+    pthread_mutex_t lock;
+    /** Signalled whenever @a turn advances or @a ended is set */
+    pthread_cond_t turn_changed;
+#endif /* HAVE_PTHREAD_H */
+};
+
+/** State of one worker */
+struct par_worker
+{
+    /** The shared state */
+    struct par_run *run;
+    /** Index of the chunk being cleaned */
+    unsigned long chunk;
+    /** Input buffer, #PAR_INPUT_BUFFER_SIZE bytes long */
+    unsigned char *in_buf;
+    /** Output buffer */
+    unsigned char *out_buf;
+    /** Size of @a out_buf, in bytes */
+    size_t out_size;
+};
+
+/** Determines whether a character may start a chunk; i.e. whether it
+    is neither whitespace nor a ctrl-Z character.
+
+    @param c The character.
+    @return Non-zero if @a c is an ordinary character. */
+static int is_ordinary(int c)
+{
+    return c != CHAR_SPACE && c != CHAR_TAB && c != CHAR_LF
+        && c != CHAR_CR && c != CHAR_EOF;
+}
+
+/** Records an error and stops the run. Only the first error is kept.
+
+    @param run The shared state.
+    @param errnum The @c errno value describing the error.
+    @param read_error Set if the error occurred while reading the input.
+    @param offset Offset within the stream where reading failed. */
+static void record_error(
+    struct par_run *run,
+    int errnum,
+    int read_error,
+    off_t offset)
+{
+    PAR_LOCK(run);
+    if(!run->error)
+    {
+        run->error = errnum;
+        run->read_error = read_error;
+        run->error_offset = offset;
+    }
+    run->ended = TRUE;
+    PAR_BROADCAST(run);
+    PAR_UNLOCK(run);
+}
+
+/** Reads part of the stream.
+
+    @param run The shared state.
+    @param buf Receives the bytes read.
+    @param offset Offset within the stream of the first byte to read.
+    @param len Number of bytes to read; these must all lie within the
+    stream.
+    @return @c TRUE on success, or @c FALSE if an error was recorded. */
+static int read_input(
+    struct par_run *run,
+    unsigned char *buf,
+    off_t offset,
+    size_t len)
+{
+    while(len > 0)
+    {
+        /* n: Number of bytes read */
+        ssize_t n = pread(run->in_fd, buf, len, run->in_start + offset);
+
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            /* A premature end-of-file means the file shrank while it
+               was being read. */
+            record_error(run, n < 0 ? errno : EIO, TRUE, offset);
+            return FALSE;
+        }
+        buf += n;
+        offset += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/** Finds where a chunk starts: the first point at or after its nominal
+    start that follows a LF character and precedes an ordinary
+    character. The first chunk always starts at the start of the stream.
+
+    @param w The worker.
+    @param chunk Index of the chunk.
+    @param start Receives the offset within the stream where the chunk
+    starts; this is the length of the stream if there is no such point.
+    @return @c TRUE on success, or @c FALSE if an error was recorded. */
+static int find_chunk_start(
+    struct par_worker *w,
+    unsigned long chunk,
+    off_t *start)
+{
+    /* run: The shared state */
+    /* pos: Offset of the first byte in the input buffer */
+    struct par_run *run = w->run;
+    off_t pos;
+
+    if(chunk == 0)
+    {
+        *start = 0;
+        return TRUE;
+    }
+    pos = (off_t)chunk * run->chunk_size;
+    if(pos >= run->in_len)
+    {
+        *start = run->in_len;
+        return TRUE;
+    }
+
+    /* Look for a LF from the byte before the nominal start. Successive
+       reads overlap by one byte, so that a LF at the end of one read is
+       paired with the character after it. */
+    pos--;
+    while(pos < run->in_len - 1)
+    {
+        /* len: Number of bytes read */
+        /* lf: Current LF character in the input buffer */
+        size_t len = PAR_INPUT_BUFFER_SIZE;
+        unsigned char *lf;
+
+        if((off_t)len > run->in_len - pos)
+        {
+            len = run->in_len - pos;
+        }
+        if(!read_input(run, w->in_buf, pos, len))
+        {
+            return FALSE;
+        }
+        for(lf = memchr(w->in_buf, CHAR_LF, len - 1); lf;
+            lf = memchr(lf + 1, CHAR_LF, w->in_buf + len - 1 - (lf + 1)))
+        {
+            if(is_ordinary(lf[1]))
+            {
+                *start = pos + (lf + 1 - w->in_buf);
+                return TRUE;
+            }
+        }
+        pos += len - 1;
+    }
+    *start = run->in_len;
+    return TRUE;
+}
+
+/** Waits until it is the turn of a worker's chunk to be written.
+
+    @param w The worker.
+    @return @c TRUE once the chunk may be written, or @c FALSE if the run
+    has ended, in which case its output is to be discarded. */
+static int wait_for_turn(struct par_worker *w)
+{
+    /* run: The shared state */
+    /* ok: Whether the chunk may be written */
+    struct par_run *run = w->run;
+    int ok;
+
+    PAR_LOCK(run);
+    while(run->turn != w->chunk && !run->ended)
+    {
+        PAR_WAIT(run);
+    }
+    ok = !run->ended;
+    PAR_UNLOCK(run);
+    return ok;
+}
+
+/** Drains a worker's sink into the output stream, first waiting for the
+    turn of its chunk.
+
+    @param sink The sink to drain.
+    @return #CE_OK on success, or #CE_SINK_ERROR if writing failed or
+    the run has ended. */
+static clean_engine_status_t flush_in_turn(struct clean_sink *sink)
+{
+    /* w: The worker that owns the sink */
+    struct par_worker *w = sink->handle;
+
+    if(!wait_for_turn(w))
+    {
+        return CE_SINK_ERROR;
+    }
+    if(fwrite(sink->buf, 1, sink->len, w->run->out_stream) < sink->len)
+    {
+        record_error(w->run, errno, FALSE, 0);
+        return CE_SINK_ERROR;
+    }
+    sink->len = 0;
+    return CE_OK;
+}
+
+/** Cleans a worker's current chunk and writes it out in turn.
+
+    @param w The worker. */
+static void clean_chunk(struct par_worker *w)
+{
+    /* run: The shared state */
+    /* eng: Engine state for the chunk */
+    /* sink: Collects the chunk's output in the worker's buffer */
+    /* start: Offset within the stream where the chunk starts */
+    /* end: Offset within the stream where the next chunk starts */
+    /* pos: Offset within the stream of the next byte to clean */
+    /* last: Set if the chunk runs to the end of the stream */
+    struct par_run *run = w->run;
+    struct clean_engine eng;
+    struct clean_sink sink;
+    off_t start;
+    off_t end;
+    off_t pos;
+    int last;
+
+    if(!find_chunk_start(w, w->chunk, &start)
+        || !find_chunk_start(w, w->chunk + 1, &end))
+    {
+        return;
+    }
+    if(start >= end && w->chunk > 0)
+    {
+        /* The chunk is empty; a single long line took up all of the
+           space it was allotted. */
+        if(wait_for_turn(w))
+        {
+            PAR_LOCK(run);
+            run->turn++;
+            PAR_BROADCAST(run);
+            PAR_UNLOCK(run);
+        }
+        return;
+    }
+    last = end >= run->in_len;
+
+    clean_engine_init(&eng, run->ctx);
+    eng.in_offset = start;
+    sink.buf = w->out_buf;
+    sink.len = 0;
+    sink.size = w->out_size;
+    sink.flush = flush_in_turn;
+    sink.handle = w;
+
+    for(pos = start; pos < end && !eng.stopped; )
+    {
+        /* len: Number of bytes to clean from the input buffer */
+        size_t len = PAR_INPUT_BUFFER_SIZE;
+
+        if((off_t)len > end - pos)
+        {
+            len = end - pos;
+        }
+        if(!read_input(run, w->in_buf, pos, len)
+            || clean_engine_feed(&eng, w->in_buf, len, &sink) != CE_OK)
+        {
+            return;
+        }
+        pos += len;
+    }
+
+    if(!last && !eng.stopped)
+    {
+        /* The next chunk starts with an ordinary character, which makes
+           the engine write out any end-of-line sequences that it has
+           collected, followed by the character itself. That character
+           belongs to the next chunk, so take it back out again. */
+        if(!read_input(run, w->in_buf, end, 1)
+            || clean_engine_feed(&eng, w->in_buf, 1, &sink) != CE_OK)
+        {
+            return;
+        }
+        sink.len--;
+    }
+
+    if(clean_sink_flush(&sink) != CE_OK
+        || ((last || eng.stopped)
+            && (clean_engine_finish(&eng, &sink) != CE_OK
+                || clean_sink_flush(&sink) != CE_OK)))
+    {
+        return;
+    }
+    if(!wait_for_turn(w))
+    {
+        /* The chunk produced no output at all, and the run has ended
+           before its turn came. */
+        return;
+    }
+
+    PAR_LOCK(run);
+    if(eng.result == CSR_STREAM_MODIFIED
+        && run->result == CSR_STREAM_UNMODIFIED)
+    {
+        /* Chunks are accounted for in order, so this is the first
+           modification in the stream. */
+        run->result = CSR_STREAM_MODIFIED;
+        run->modified_at = eng.modified_at;
+    }
+    if(last || eng.stopped)
+    {
+        /* This chunk ended the stream; any chunks after it are
+           discarded. */
+        run->last_eng = eng;
+        run->ended = TRUE;
+    }
+    run->turn++;
+    PAR_BROADCAST(run);
+    PAR_UNLOCK(run);
+}
+
+/** Cleans chunks until there are none left, or the run has ended.
+
+    @param arg Points to the worker's #par_worker.
+    @return @c NULL. */
+static void *par_worker_main(void *arg)
+{
+    /* w: The worker */
+    /* run: The shared state */
+    struct par_worker *w = arg;
+    struct par_run *run = w->run;
+
+    PAR_LOCK(run);
+    while(!run->ended && run->next_chunk < run->chunk_count)
+    {
+        w->chunk = run->next_chunk++;
+        PAR_UNLOCK(run);
+        clean_chunk(w);
+        PAR_LOCK(run);
+    }
+    PAR_UNLOCK(run);
+    return NULL;
+}
+
+unsigned long clean_parallel_threads(const struct cleantxt_ctx *ctx)
+{
+#   ifdef HAVE_PTHREAD_H
+        /* threads: Number of threads */
+        long threads = ctx->threads;
+
+        if(threads <= 0)
+        {
+#           ifdef _SC_NPROCESSORS_ONLN
+                threads = sysconf(_SC_NPROCESSORS_ONLN);
+#           else
+                threads = 1;
+#           endif /* _SC_NPROCESSORS_ONLN */
+        }
+        if(threads < 1)
+        {
+            threads = 1;
+        }
+        return threads > PAR_MAX_THREADS ? PAR_MAX_THREADS : threads;
+#   else
+        (void)ctx;
+        return 1;
+#   endif /* HAVE_PTHREAD_H */
+}
+
+clean_stream_result_t clean_stream_parallel(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    off_t in_len,
+    FILE *out_stream,
+    size_t chunk_size,
+    jmp_buf *jmp_if_error)
+{
+    /* run: The shared state */
+    /* workers: State of each worker; the first is this thread */
+    /* worker_count: Number of workers with buffers */
+    /* i: Index of the current worker */
+    struct par_run run;
+    struct par_worker *workers;
+    unsigned long worker_count;
+    unsigned long i;
+#   ifdef HAVE_PTHREAD_H
+        /* threads: Threads running the workers after the first */
+        /* started: Number of threads started */
+        pthread_t *threads;
+        unsigned long started;
+#   endif /* HAVE_PTHREAD_H */
+
+    memset(&run, 0, sizeof(run));
+    run.ctx = ctx;
+    run.in_fd = fileno(in_stream);
+    run.in_start = ftell(in_stream);
+    run.in_len = in_len;
+    run.chunk_size = chunk_size > 0 ? (off_t)chunk_size : 1;
+    run.chunk_count = (in_len + run.chunk_size - 1) / run.chunk_size;
+    if(run.chunk_count == 0)
+    {
+        /* An empty stream still needs its end-of-file rules applied */
+        run.chunk_count = 1;
+    }
+    run.out_stream = out_stream;
+    run.result = CSR_STREAM_UNMODIFIED;
+
+    worker_count = clean_parallel_threads(ctx);
+    if(worker_count > run.chunk_count)
+    {
+        worker_count = run.chunk_count;
+    }
+    workers = calloc(worker_count, sizeof(struct par_worker));
+    if(!workers)
+    {
+        errno = ENOMEM;
+        longjmp(*jmp_if_error, TRUE);
+    }
+    for(i = 0; i < worker_count; i++)
+    {
+        workers[i].run = &run;
+        /* Leave some room for the chunk to grow, and for the search for
+           its end to run past its nominal length. */
+        workers[i].out_size = run.chunk_size + run.chunk_size / 2 + 16;
+        workers[i].in_buf = malloc(PAR_INPUT_BUFFER_SIZE);
+        workers[i].out_buf = malloc(workers[i].out_size);
+        if(!workers[i].in_buf || !workers[i].out_buf)
+        {
+            free(workers[i].in_buf);
+            free(workers[i].out_buf);
+            break;
+        }
+    }
+    worker_count = i;
+    if(worker_count == 0)
+    {
+        free(workers);
+        errno = ENOMEM;
+        longjmp(*jmp_if_error, TRUE);
+    }
+
+#   ifdef HAVE_PTHREAD_H
+        pthread_mutex_init(&run.lock, NULL);
+        pthread_cond_init(&run.turn_changed, NULL);
+        threads = malloc(worker_count * sizeof(pthread_t));
+        started = 0;
+        if(threads)
+        {
+            while(started + 1 < worker_count
+                && pthread_create(&threads[started], NULL,
+                    par_worker_main, &workers[started + 1]) == 0)
+            {
+                started++;
+            }
+        }
+#   endif /* HAVE_PTHREAD_H */
+
+    /* This thread works as well */
+    par_worker_main(&workers[0]);
+
+#   ifdef HAVE_PTHREAD_H
+        for(i = 0; i < started; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+        pthread_cond_destroy(&run.turn_changed);
+        pthread_mutex_destroy(&run.lock);
+#   endif /* HAVE_PTHREAD_H */
+
+    for(i = 0; i < worker_count; i++)
+    {
+        free(workers[i].in_buf);
+        free(workers[i].out_buf);
+    }
+    free(workers);
+
+    if(run.error)
+    {
+        if(run.read_error)
+        {
+            /* Retry the failed read through stdio, so that the error is
+               recorded in the stream's error indicator for the caller's
+               benefit. */
+            fseek(in_stream, run.in_start + run.error_offset, SEEK_SET);
+            fgetc(in_stream);
+        }
+        errno = run.error;
+        longjmp(*jmp_if_error, TRUE);
+    }
+
+    fseek(in_stream, run.in_start + in_len, SEEK_SET);
+    ctx->eng = run.last_eng;
+    ctx->eng.result = run.result;
+    ctx->eng.modified_at = run.modified_at;
+    return run.result;
+}
@@ -0,0 +1,69 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file cleanpar.h
+    Parallel cleaning of a single large regular file. */
+
+#ifndef CLEANPAR_H
+#define CLEANPAR_H
+
+#include <sys/types.h>
+
+/** Regular files with at least this many bytes left to read are cleaned
+    in parallel by #clean_stream, if the context allows more than one
+    thread. */
+#define CLEAN_PARALLEL_MIN_SIZE (32L * 1024 * 1024)
+
+/** Nominal length of the chunks that a file is split into for parallel
+    cleaning, in bytes */
+#define CLEAN_PARALLEL_CHUNK_SIZE (4L * 1024 * 1024)
+
+struct cleantxt_ctx;
+
+/** Works out how many threads a single stream may be cleaned with.
+
+    @param ctx The cleaning context.
+    @return The number of threads; @c 1 if parallel cleaning is disabled
+    or not supported on this platform. */
+extern unsigned long clean_parallel_threads(const struct cleantxt_ctx *ctx);
+
+/** Cleans the rest of a regular file on several threads at once. The
+    file is split into chunks of roughly @a chunk_size bytes, each
+    starting just after a LF character and at a non-whitespace
+    character, since the engine has no state at such a point other than
+    the end-of-line sequences it has collected. The output is identical
+    to that of #clean_stream.
+
+    @param ctx The cleaning context.
+    @param in_stream The input stream; must be a regular file. Reading
+    starts from its current position, and the stream is left at the end
+    of the input.
+    @param in_len Number of bytes to clean from the current position.
+    @param out_stream The output stream.
+    @param chunk_size Nominal chunk length, in bytes; normally
+    #CLEAN_PARALLEL_CHUNK_SIZE.
+    @param jmp_if_error Error handler invoked if an I/O error occurs.
+    The error indicator of whichever stream failed is set.
+    @returns As for #clean_stream. */
+extern clean_stream_result_t clean_stream_parallel(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    off_t in_len,
+    FILE *out_stream,
+    size_t chunk_size,
+    jmp_buf *jmp_if_error);
+
+#endif /* !CLEANPAR_H */
@@ -15,14 +15,45 @@
     along with this program. If not, see <http://www.gnu.org/licenses/>. */
 
 /** @file cleanstr.c
-    This is the gist of the text-cleaning algorithm. */
+    This is the gist of the text-cleaning algorithm. The actual work is
+    done by the block-oriented engine in cleaneng.c; this module feeds it
+    from and drains it to stdio streams. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <setjmp.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#   include <sys/mman.h>
+#   include <signal.h>
+#endif /* HAVE_SYS_MMAN_H */
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#ifdef HAVE_SPLICE
+#   include <fcntl.h>
+#endif /* HAVE_SPLICE */
+
+#if defined(HAVE_LINUX_FS_H) && defined(HAVE_SYS_IOCTL_H)
+#   include <sys/ioctl.h>
+#   include <linux/fs.h>
+#endif /* HAVE_LINUX_FS_H && HAVE_SYS_IOCTL_H */
 
 #include "cleanstr.h"
 #include "options.h"
-#include "streamio.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+#include "cleanpar.h"
 
 /** Definition for boolean constant @e false */
 #define FALSE 0
@@ -30,6 +61,22 @@
 /** Definition for boolean constant @e true */
 #define TRUE (!FALSE)
 
+/** Size of the buffer that #check_stream gives the engine for its
+    output, which is discarded, in bytes */
+#define CHECK_STREAM_SCRATCH_SIZE 4096
+
+/** Length of the pieces that mapped input is cleaned in when unchanged
+    stretches are passed through to the output, in bytes. This is also
+    the size of the output buffer, so that a whole piece's output can be
+    compared with its input before any of it is written. */
+#define PASS_THROUGH_PIECE_SIZE (1024L * 1024)
+
+/** Length of mapped input that the kernel is asked to read ahead of the
+    bytes being cleaned or checked, in bytes. Only this much is read
+    ahead, so a check that stops early does not read the rest of the
+    file, and a huge file does not flood the page cache. */
+#define MAP_READ_AHEAD_SIZE (4L * 1024 * 1024)
+
 /** Constant for ASCII tab character */
 #define CHAR_TAB 9
 
@@ -45,336 +92,1715 @@
 /** Constant for ASCII space character */
 #define CHAR_SPACE 32
 
-/** Computes the column position of the next tab stop.
-
-    @param column The column position on the line where the search for
-    the next tab stop should begin. @c 0 refers to the first column of
-    the line. Note that this expression may be evaluated multiple times.
-    @param tab_size The size of the tab stops. Note that this expression
-    may be evaluated multiple times.
-    @return The column position of the next tab stop after @a column. */
-#define NEXT_TAB_STOP(column, tab_size) \
-    ((column) + (tab_size) - (column) % (tab_size))
-
-/** End-of-line strings for end-of-line modes. Each element in this
-    array should correspond to the equivalent indexed value in
-    #eol_mode_t. */
-static const char *const EOL_STR[] =
-{
-    "\n",
-    "\r",
-    "\r\n"
+/** How unchanged stretches of mapped input are sent to the output */
+typedef enum
+{
+    /** Every byte is written through stdio */
+    PT_NONE,
+    /** Copied from file to file within the kernel by copy_file_range() */
+    PT_COPY,
+    /** Moved from the file into a pipe by splice() */
+    PT_SPLICE
+} pass_through_mode_t;
+
+/** State of the output while unchanged stretches of mapped input are
+    passed through to it */
+struct pass_through
+{
+    /** The output stream */
+    FILE *out_stream;
+    /** How unchanged stretches are sent; falls back to #PT_NONE if the
+        kernel turns out not to support it for these files */
+    pass_through_mode_t mode;
+    /** File descriptor of the input file */
+    int in_fd;
+    /** Offset within the input file of the stretch waiting to be sent */
+    long pending_start;
+    /** The stretch waiting to be sent, within the mapping */
+    const unsigned char *pending_data;
+    /** Length of the stretch waiting to be sent; zero if none */
+    size_t pending_len;
+    /** Set when the sink is drained; used to tell whether the sink
+        holds the whole output of the current piece */
+    int drained;
 };
 
-/** Flushes the collected sequence of whitespace to the output stream.
-
-    @param out_stream The output stream
-    @param in_col The current column position on the current line in the
-    input file. Note that columns are zero-based.
-    @param out_col The current column position on the current line in
-    the output file. Note that columns are zero-based.
-    @param collected_spaces The number of collected spaces
-    @param collected_tabs The number of collected tabs
-    @param collected_newlines The number of collected EOL sequences
-    @param new_out_col On return, the current column position of the
-    current line in the output file will be stored in the integer
-    variable pointed to by @a new_out_col. Note that columns are
-    zero-based. If an I/O error occurs, then the value of the integer
-    variable pointed to by @a new_out_col will be undefined.
-    @param csr If the filtering operation results in the stream content
-    being modified, then the #clean_stream_result_t variable pointed to
-    by @a csr will be set to #CSR_STREAM_MODIFIED. Otherwise the
-    variable will be left as-is.
-    @param jmp_if_error If an I/O error occurs, then a long jump will be made to the
-    location specified in the @c jmp_buf instance pointed to by @a jmp_if_error. */
-static void flush_whitespace(
-    FILE *out_stream,
-    int in_col,
-    int out_col,
-    int collected_spaces,
-    int collected_tabs,
-    int collected_newlines,
-    int *new_out_col,
-    clean_stream_result_t *csr,
-    jmp_buf *jmp_if_error)
+/** The rest of a regular input file, mapped into memory */
+struct input_map
+{
+    /** Start of the mapping, or @c NULL if the input is not mapped */
+    void *base;
+    /** Length of the mapping, in bytes */
+    size_t size;
+    /** The first byte of input; the mapping starts at a page boundary,
+        which may be before it */
+    const unsigned char *data;
+    /** Number of bytes of input */
+    size_t len;
+    /** Offset within the file of the first byte of input */
+    long start;
+    /** Granularity of mapping offsets, in bytes */
+    size_t page_size;
+    /** Offset within the mapping up to which reading ahead has been
+        asked for; a multiple of @a page_size, unless it is @a size */
+    size_t read_ahead;
+};
+
+#ifdef HAVE_SYS_MMAN_H
+
+/** Where a thread reading mapped input goes if a read faults, because
+    the file was cut short while it was mapped */
+struct map_guard
+{
+    /** Execution branches here on a fault */
+    sigjmp_buf on_fault;
+};
+
+/** The action for @c SIGBUS that was in place before #on_map_fault was
+    installed */
+static struct sigaction prev_sigbus_action;
+
+#ifdef HAVE_PTHREAD_H
+
+/** Makes sure that #on_map_fault is installed once only */
+static pthread_once_t map_guard_once = PTHREAD_ONCE_INIT;
+
+/** Holds each thread's current #map_guard */
+static pthread_key_t map_guard_key;
+
+#else
+
+/** Set once #on_map_fault has been installed */
+static int map_guard_installed = FALSE;
+
+/** The current #map_guard, or @c NULL */
+static struct map_guard *current_map_guard;
+
+#endif /* HAVE_PTHREAD_H */
+
+/** Handles @c SIGBUS. A fault while the thread has a #map_guard is
+    turned into a jump to it; any other fault is handed back to the
+    action that was in place before, by putting it back and letting the
+    faulting access happen again.
+
+    @param sig The signal number. */
+static void on_map_fault(int sig)
 {
-    /* Flush out any accumulated end-of-line sequences, using the character
-       sequence that the user specified on the command line. */
-    if(collected_newlines > 0)
+    /* guard: The thread's current guard, or NULL */
+#   ifdef HAVE_PTHREAD_H
+        struct map_guard *guard = pthread_getspecific(map_guard_key);
+#   else
+        struct map_guard *guard = current_map_guard;
+#   endif /* HAVE_PTHREAD_H */
+
+    if(guard)
     {
-        do
+        siglongjmp(guard->on_fault, TRUE);
+    }
+    sigaction(sig, &prev_sigbus_action, NULL);
+}
+
+/** Installs #on_map_fault as the handler for @c SIGBUS. */
+static void install_map_fault_handler(void)
+{
+    /* action: The new action for SIGBUS */
+    struct sigaction action;
+
+#   ifdef HAVE_PTHREAD_H
+        pthread_key_create(&map_guard_key, NULL);
+#   endif /* HAVE_PTHREAD_H */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_map_fault;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &prev_sigbus_action);
+}
+
+/** Sets the calling thread's #map_guard, installing #on_map_fault first
+    if need be.
+
+    @param guard The guard, which must have been set with @c sigsetjmp(),
+    or @c NULL to leave mapped input unguarded. */
+static void set_map_guard(struct map_guard *guard)
+{
+#   ifdef HAVE_PTHREAD_H
+        pthread_once(&map_guard_once, install_map_fault_handler);
+        pthread_setspecific(map_guard_key, guard);
+#   else
+        if(!map_guard_installed)
         {
-            fputs_jmp(EOL_STR[options.eol_mode], out_stream, jmp_if_error);
-            collected_newlines--;
+            install_map_fault_handler();
+            map_guard_installed = TRUE;
         }
-        while(collected_newlines > 0);
-        out_col = 0;
+        current_map_guard = guard;
+#   endif /* HAVE_PTHREAD_H */
+}
+
+#endif /* HAVE_SYS_MMAN_H */
+
+/** Drains a sink's buffer into the stdio stream given by its @a handle.
+
+    @param sink The sink to drain.
+    @return #CE_OK on success, or #CE_SINK_ERROR if writing failed. */
+static clean_engine_status_t flush_to_stream(struct clean_sink *sink)
+{
+    if(fwrite(sink->buf, 1, sink->len, (FILE *)sink->handle) < sink->len)
+    {
+        return CE_SINK_ERROR;
     }
+    sink->len = 0;
+    return CE_OK;
+}
+
+/** Discards the text held in a sink's buffer.
+
+    @param sink The sink to drain.
+    @return #CE_OK. */
+static clean_engine_status_t flush_to_nowhere(struct clean_sink *sink)
+{
+    sink->len = 0;
+    return CE_OK;
+}
+
+/** Reads the next block of input from a stream.
+
+    Regular files are read through stdio in whole blocks. Anything else
+    (pipes, terminals, sockets) is read straight from the underlying file
+    descriptor, which returns as soon as some data is available; this
+    keeps interactive use and slow producers responsive, and avoids
+    blocking on data past a ctrl-Z character that marks end-of-file.
+
+    @param in_stream The input stream.
+    @param is_regular Set if @a in_stream refers to a regular file.
+    @param buf Buffer to receive the input.
+    @param size Size of @a buf in bytes.
+    @param jmp_if_error If an I/O error occurs, then a long jump will be
+    made to the location specified in the @c jmp_buf instance pointed to
+    by @a jmp_if_error. The error indicator of @a in_stream will be set.
+    @return The number of bytes read, or @c 0 at end-of-file. */
+static size_t read_block(
+    FILE *in_stream,
+    int is_regular,
+    unsigned char *buf,
+    size_t size,
+    jmp_buf *jmp_if_error)
+{
+    /* n: Number of bytes read */
+    /* c: Character read through stdio after a failed read() */
+    ssize_t n;
+    int c;
 
-    /* If tab characters are enabled, we output as many tab characters
-       as possible to save disk space. Only expand tabs if the
-       whitespace gap is at least the minimum threshold for tab
-       insertion. */
-    if(options.whitespace_mode == WM_TAB && in_col - out_col >= options.tab_min)
+    if(is_regular)
     {
-        /* Keep inserting tab characters until the next tab stop is
-           beyond the current input stream column position. */
-        while(NEXT_TAB_STOP(out_col, options.tab_size) <= in_col)
+        n = fread(buf, 1, size, in_stream);
+        if(n == 0 && ferror(in_stream))
         {
-            /* Flush a collected tab character to the output stream */
-            fputc_jmp(CHAR_TAB, out_stream, jmp_if_error);
-            out_col = NEXT_TAB_STOP(out_col, options.tab_size);
-            collected_tabs--;
+            longjmp(*jmp_if_error, TRUE);
         }
+        return n;
     }
 
-    /* Fill up the rest of the gap with space characters */
-    while(out_col < in_col)
+    n = read(fileno(in_stream), buf, size);
+    if(n >= 0)
     {
-        fputc_jmp(CHAR_SPACE, out_stream, jmp_if_error);
-        out_col++;
-        collected_spaces--;
+        return n;
     }
 
-    /* If the whitespace gap was reformatted, then indicate to the
-       caller that the stream was modified. */
-    if(collected_spaces != 0 || collected_tabs != 0)
+    /* Retry the read through stdio, so that a persistent error is
+       recorded in the stream's error indicator for the caller's benefit
+       and a transient one is simply recovered from. */
+    c = fgetc(in_stream);
+    if(c == EOF)
+    {
+        if(ferror(in_stream))
+        {
+            longjmp(*jmp_if_error, TRUE);
+        }
+        return 0;
+    }
+    buf[0] = c;
+    return 1;
+}
+
+/** Maps the rest of a regular input file into memory, so that the
+    engine can read it straight from the page cache rather than have
+    stdio copy it into a buffer first. Nothing is read up front; pages
+    are read ahead of use a window at a time by #read_mapped_ahead, so
+    a scan that stops early reads no more of the file than it needs. The
+    caller must set a #map_guard while the mapping is read, because
+    reading past the end of a file that has since been cut short faults.
+
+    @param in_stream The input stream; must be a regular file.
+    @param in_stat Attributes of the input file.
+    @param map Receives the mapping. Its @a base is left @c NULL if the
+    input is not mapped.
+    @return Non-zero if the input was mapped; zero if it is empty, or
+    cannot be mapped and must be read instead. */
+static int map_input(
+    FILE *in_stream,
+    const struct stat *in_stat,
+    struct input_map *map)
+{
+    map->base = NULL;
+    map->data = NULL;
+    map->len = 0;
+    map->start = 0;
+#   ifdef HAVE_SYS_MMAN_H
     {
-        *csr = CSR_STREAM_MODIFIED;
+        /* page_size: Granularity of mapping offsets */
+        /* map_start: Offset of the mapping; a multiple of page_size */
+        long page_size = sysconf(_SC_PAGESIZE);
+        long map_start;
+
+        map->start = ftell(in_stream);
+        if(page_size <= 0 || map->start < 0
+            || in_stat->st_size <= map->start)
+        {
+            return FALSE;
+        }
+        map_start = map->start - map->start % page_size;
+        map->size = in_stat->st_size - map_start;
+        if((off_t)map->size != in_stat->st_size - map_start)
+        {
+            /* Too large to map into this address space */
+            return FALSE;
+        }
+        map->base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE,
+            fileno(in_stream), map_start);
+        if(map->base == MAP_FAILED)
+        {
+            map->base = NULL;
+            return FALSE;
+        }
+#       ifdef MADV_SEQUENTIAL
+            madvise(map->base, map->size, MADV_SEQUENTIAL);
+#       endif /* MADV_SEQUENTIAL */
+#       ifdef MADV_HUGEPAGE
+            /* Only a hint; most filesystems cannot back file mappings
+               with huge pages. */
+            madvise(map->base, map->size, MADV_HUGEPAGE);
+#       endif /* MADV_HUGEPAGE */
+        map->data = (const unsigned char *)map->base
+            + (map->start - map_start);
+        map->len = in_stat->st_size - map->start;
+        map->page_size = page_size;
+        map->read_ahead = 0;
+        return TRUE;
     }
+#   else
+        (void)in_stream;
+        (void)in_stat;
+        return FALSE;
+#   endif /* HAVE_SYS_MMAN_H */
+}
+
+/** Releases a mapping made by #map_input, if any, and the thread's
+    #map_guard with it.
+
+    @param map The mapping. */
+static void unmap_input(struct input_map *map)
+{
+#   ifdef HAVE_SYS_MMAN_H
+        if(map->base)
+        {
+            set_map_guard(NULL);
+            munmap(map->base, map->size);
+        }
+#   endif /* HAVE_SYS_MMAN_H */
+    map->base = NULL;
+}
+
+/** Asks the kernel to read a mapped input file ahead of the bytes about
+    to be used, a window of #MAP_READ_AHEAD_SIZE bytes at a time. A new
+    window is asked for once less than half of one is left ahead.
+
+    @param map The mapping.
+    @param pos Number of bytes of input handed out so far. */
+static void read_mapped_ahead(struct input_map *map, size_t pos)
+{
+#   ifdef HAVE_SYS_MMAN_H
+#       ifdef MADV_WILLNEED
+        {
+            /* offset: Offset within the mapping of the next byte */
+            /* start: Offset of the window; a multiple of page_size */
+            /* end: Offset of the end of the window */
+            size_t offset = (size_t)(map->data
+                - (const unsigned char *)map->base) + pos;
+            size_t start = map->read_ahead;
+            size_t end;
 
-    /* Update the caller's output column position */
-    *new_out_col = out_col;
+            if(map->read_ahead >= map->size
+                || map->read_ahead >= offset + MAP_READ_AHEAD_SIZE / 2)
+            {
+                return;
+            }
+            if(start < offset)
+            {
+                start = offset - offset % map->page_size;
+            }
+            end = offset + MAP_READ_AHEAD_SIZE;
+            if(end >= map->size)
+            {
+                end = map->size;
+            }
+            else
+            {
+                end -= end % map->page_size;
+            }
+            madvise((char *)map->base + start, end - start, MADV_WILLNEED);
+            map->read_ahead = end;
+        }
+#       else
+            (void)map;
+            (void)pos;
+#       endif /* MADV_WILLNEED */
+#   else
+        (void)map;
+        (void)pos;
+#   endif /* HAVE_SYS_MMAN_H */
+}
+
+/** Hands out the next block of a mapped input file.
+
+    @param map The mapping.
+    @param pos Number of bytes of input handed out so far; updated.
+    @param size Largest number of bytes to hand out.
+    @param block Receives the start of the block.
+    @return The number of bytes in the block, or @c 0 at end-of-file. */
+static size_t next_mapped_block(
+    struct input_map *map,
+    size_t *pos,
+    size_t size,
+    const unsigned char **block)
+{
+    /* n: Number of bytes in the block */
+    size_t n = map->len - *pos;
+
+    if(n > size)
+    {
+        n = size;
+    }
+    read_mapped_ahead(map, *pos);
+    *block = map->data + *pos;
+    *pos += n;
+    return n;
 }
 
-/** Collects up a sequence of whitespace from the given input stream.
-    The input stream will be left at either the next non-whitespace
-    character, or end-of-file. The filtered whitespace sequence will be
-    written to the output file if a non-whitespace character was
-    encountered on the input file.
+/** Finishes reading a mapped input file: releases the mapping, and moves
+    the input stream past the bytes that were handed out, as if they had
+    been read through it.
 
-    @param in_stream The input stream
-    @param out_stream The output stream
-    @param in_col The current column position on the current line in the
-    input file. Note that columns are zero-based.
-    @param new_out_col On return, the current column position of the
-    current line in the output file will be stored in the integer
-    variable pointed to by @a new_out_col. Note that columns are
-    zero-based. If an I/O error occurs, then the value of the integer
-    variable pointed to by @a new_out_col will be undefined.
-    @param csr If the filtering operation results in the stream content
-    being modified, then the #clean_stream_result_t variable pointed to
-    by @a csr will be set to #CSR_STREAM_MODIFIED.  Otherwise the
-    variable will be left as-is.
-    @param jmp_if_error If an I/O error occurs, then a long jump will be made to the
-    location specified in the @c jmp_buf instance pointed to by @a jmp_if_error. */
-static void collect_whitespace(
+    @param in_stream The input stream.
+    @param map The mapping.
+    @param pos Number of bytes of input handed out. */
+static void finish_mapped_input(
     FILE *in_stream,
-    FILE *out_stream,
-    int in_col,
-    int *new_out_col,
-    clean_stream_result_t *csr,
-    jmp_buf *jmp_if_error)
+    struct input_map *map,
+    size_t pos)
 {
-    /* c: Contains the current character read from the input stream */
-    /* collected_spaces: The number of spaces that have been read */
-    /* collected_tabs: The number of tab characters that have been read */
-    /* collected_newlines: The number of end-of-line sequences that have been read */
-    /* found_non_whitespace: Set this flag when non-whitespace character reached */
-    /* in_col: Save the current output column position in out_col */
-    int c = 0;
-    int collected_spaces = 0;
-    int collected_tabs = 0;
-    int collected_newlines = 0;
-    int found_non_whitespace = FALSE;
-    int out_col = in_col;
-
-    /* Continue reading characters in the input stream until we hit
-       a non-whitespace character */
-    do
+    unmap_input(map);
+    fseek(in_stream, map->start + (long)pos, SEEK_SET);
+}
+
+/** Works out how unchanged stretches of input can be sent to an output
+    stream without passing through user space.
+
+    @param out_stream The output stream.
+    @return The pass-through mode, or #PT_NONE if there is none for this
+    kind of output. */
+static pass_through_mode_t pass_through_mode(FILE *out_stream)
+{
+    /* out_stat: Attributes of the output file */
+    struct stat out_stat;
+
+    if(fstat(fileno(out_stream), &out_stat) != 0)
     {
-        /* found_eol: Set this flag when we encounter an end-of-line sequence */
-        /* eol_type: If found_eol is set, then this contains the type of
-           end-of-line sequence found. */
-        int found_eol = FALSE;
-        eol_mode_t eol_type;
+        return PT_NONE;
+    }
+#   ifdef HAVE_COPY_FILE_RANGE
+        if(S_ISREG(out_stat.st_mode))
+        {
+            return PT_COPY;
+        }
+#   endif /* HAVE_COPY_FILE_RANGE */
+#   ifdef HAVE_SPLICE
+        if(S_ISFIFO(out_stat.st_mode))
+        {
+            return PT_SPLICE;
+        }
+#   endif /* HAVE_SPLICE */
+    return PT_NONE;
+}
 
-        c = fgetc_jmp(in_stream, jmp_if_error);
-        switch(c)
+/** Has the kernel send as much as it can of the stretch of unchanged
+    input that is waiting, straight from the input file to the output.
+    If the kernel cannot send it, then the pass-through mode is dropped
+    to #PT_NONE so that the rest, and every later stretch, is written
+    through stdio instead.
+
+    @param pt The pass-through state. Its @a pending_start and @a
+    pending_len are advanced past whatever was sent.
+    @return Non-zero on success; zero if the output stream could not be
+    brought up to date. */
+static int send_in_kernel(struct pass_through *pt)
+{
+#   if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SPLICE)
+    if(pt->mode != PT_NONE && pt->pending_len > 0)
+    {
+        /* out_fd: File descriptor of the output stream */
+        /* moved_offset: Set if the output file's offset is being moved
+           behind the back of stdio */
+        /* out_off: The output file's offset afterwards */
+        int out_fd = fileno(pt->out_stream);
+        int moved_offset = pt->mode == PT_COPY;
+        off_t out_off;
+
+        if(fflush(pt->out_stream) != 0)
         {
-            case CHAR_SPACE:
-                /* Collect up individual spaces */
-                in_col++;
-                collected_spaces++;
-                break;
-            case CHAR_TAB:
-                /* Collect up tabs, compute number of spaces required to fill. */
-                in_col = NEXT_TAB_STOP(in_col, options.tab_size);
-                collected_tabs++;
-                if(collected_spaces > 0)
-                {
-                    /* If there are any spaces that precede this tab,
-                       then either they will get substituted with a tab
-                       character, or the tab character will get expanded
-                       into spaces. Either way, the stream is being
-                       modified, so indicate this to the caller. */
-                    *csr = CSR_STREAM_MODIFIED;
-                }
-                break;
-            case CHAR_CR:
-                /* Encountered a CR character. Check if the next
-                   character in the stream is a LF character. */
-                found_eol = TRUE;
-                if(ungetc(fgetc_jmp(in_stream, jmp_if_error), in_stream) == CHAR_LF)
+            return FALSE;
+        }
+        while(pt->pending_len > 0)
+        {
+            /* in_off: Offset within the input file to send from */
+            /* n: Number of bytes sent */
+            loff_t in_off = pt->pending_start;
+            ssize_t n = -1;
+
+#           ifdef HAVE_COPY_FILE_RANGE
+                if(pt->mode == PT_COPY)
                 {
-                    /* We found a CR+LF end-of-line sequence. Skip the
-                       LF character. */
-                    eol_type = EM_CRLF;
-                    fgetc(in_stream);
+                    n = copy_file_range(pt->in_fd, &in_off, out_fd, NULL,
+                        pt->pending_len, 0);
                 }
-                else
+#           endif /* HAVE_COPY_FILE_RANGE */
+#           ifdef HAVE_SPLICE
+                if(pt->mode == PT_SPLICE)
                 {
-                    /* Found a CR-only end-of-line sequence */
-                    eol_type = EM_CR;
+                    n = splice(pt->in_fd, &in_off, out_fd, NULL,
+                        pt->pending_len, 0);
                 }
+#           endif /* HAVE_SPLICE */
+            if(n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(n <= 0)
+            {
+                /* Not supported between these files; write the rest
+                   normally, which also reports any real error. */
+                pt->mode = PT_NONE;
                 break;
-            case CHAR_LF:
-                /* Found a LF-only end-of-line sequence */
-                found_eol = TRUE;
-                eol_type = EM_LF;
-                break;
-            case EOF:
-                /* We've either hit end-of-file or an I/O error */
-                break;
-            default:
-                /* Found a non-whitespace character. Stop reading and
-                   push the character back on to the input stream. */
-                found_non_whitespace = TRUE;
-                ungetc(c, in_stream);
-                break;
+            }
+            pt->pending_start += n;
+            pt->pending_len -= n;
+        }
+        if(moved_offset)
+        {
+            /* Bring the stream's idea of its position up to date */
+            out_off = lseek(out_fd, 0, SEEK_CUR);
+            if(out_off < 0 || fseek(pt->out_stream, out_off, SEEK_SET) != 0)
+            {
+                return FALSE;
+            }
         }
+    }
+#   else
+        (void)pt;
+#   endif /* HAVE_COPY_FILE_RANGE || HAVE_SPLICE */
+    return TRUE;
+}
+
+/** Sends the stretch of unchanged input that is waiting to the output.
+    If the kernel cannot send it directly, it is written through stdio
+    instead, and so is every later stretch.
+
+    @param pt The pass-through state.
+    @return Non-zero on success; zero if writing failed, in which case
+    the error indicator of the output stream is set. */
+static int send_pending(struct pass_through *pt)
+{
+    /* len: Length of the stretch */
+    size_t len = pt->pending_len;
+
+    if(!send_in_kernel(pt))
+    {
+        return FALSE;
+    }
+    if(pt->pending_len > 0
+        && fwrite(pt->pending_data + (len - pt->pending_len), 1,
+            pt->pending_len, pt->out_stream) < pt->pending_len)
+    {
+        return FALSE;
+    }
+    pt->pending_len = 0;
+    return TRUE;
+}
+
+/** Drains a sink's buffer into the output stream, after sending any
+    stretch of unchanged input that precedes it.
+
+    @param sink The sink to drain; its @a handle is the #pass_through.
+    @return #CE_OK on success, or #CE_SINK_ERROR if writing failed. */
+static clean_engine_status_t flush_passing_through(struct clean_sink *sink)
+{
+    /* pt: The pass-through state */
+    struct pass_through *pt = sink->handle;
+
+    pt->drained = TRUE;
+    if(!send_pending(pt)
+        || fwrite(sink->buf, 1, sink->len, pt->out_stream) < sink->len)
+    {
+        return CE_SINK_ERROR;
+    }
+    sink->len = 0;
+    return CE_OK;
+}
 
-        /* Check if we encountered an EOL sequence */
-        if(found_eol)
+/** Determines whether the engine writes a character straight out; i.e.
+    whether it is neither whitespace nor a ctrl-Z character.
+
+    @param c The character.
+    @return Non-zero if @a c is an ordinary character. */
+static int is_ordinary(int c)
+{
+    return c != CHAR_SPACE && c != CHAR_TAB && c != CHAR_LF
+        && c != CHAR_CR && c != CHAR_EOF;
+}
+
+/** Finds where to end a piece of mapped input: just after its last
+    character that the engine writes straight out, where the engine
+    holds nothing back, so that the output of the piece lines up with
+    its input.
+
+    @param data The start of the piece.
+    @param len The most bytes the piece may have.
+    @return The length of the piece; @a len if there is no such
+    character. */
+static size_t pass_through_cut(const unsigned char *data, size_t len)
+{
+    /* i: Length of the piece being considered */
+    size_t i = len;
+
+    while(i > 0 && !is_ordinary(data[i - 1]))
+    {
+        i--;
+    }
+    return i > 0 ? i : len;
+}
+
+/** Filters mapped input through the engine in pieces. The output of
+    each piece is compared with its input; where they are the same, the
+    input is sent to the output straight from the file instead, so that
+    clean stretches are not copied through user space again.
+
+    @param eng The engine state.
+    @param map The mapping.
+    @param map_pos Number of bytes of mapped input handed to the engine;
+    updated.
+    @param pt The pass-through state.
+    @param sink The sink, which must drain through
+    #flush_passing_through. Pieces whose output does not fit in it are
+    written normally.
+    @return #CE_OK on success, or #CE_SINK_ERROR if writing failed. */
+static clean_engine_status_t feed_passing_through(
+    struct clean_engine *eng,
+    struct input_map *map,
+    size_t *map_pos,
+    struct pass_through *pt,
+    struct clean_sink *sink)
+{
+    while(*map_pos < map->len && !eng->stopped)
+    {
+        /* piece: Start of the current piece */
+        /* n: Length of the current piece */
+        const unsigned char *piece = map->data + *map_pos;
+        size_t n = map->len - *map_pos;
+
+        read_mapped_ahead(map, *map_pos);
+        if(n > PASS_THROUGH_PIECE_SIZE)
+        {
+            n = pass_through_cut(piece, PASS_THROUGH_PIECE_SIZE);
+        }
+        pt->drained = FALSE;
+        if(clean_engine_feed(eng, piece, n, sink) != CE_OK)
         {
-            if(eol_type != options.eol_mode)
+            return CE_SINK_ERROR;
+        }
+        if(!pt->drained && sink->len == n && memcmp(sink->buf, piece, n) == 0)
+        {
+            /* The output is the input; send it from the file instead.
+               Consecutive pieces are sent together. */
+            if(pt->pending_len == 0)
             {
-                /* If the EOL sequence encountered is different to the
-                   one we are outputting, then it will get transformed;
-                   indicate to the caller that the stream will be
-                   modified. */
-                *csr = CSR_STREAM_MODIFIED;
+                pt->pending_start = map->start + (long)*map_pos;
+                pt->pending_data = piece;
             }
+            pt->pending_len += n;
+            sink->len = 0;
+        }
+        else if(clean_sink_flush(sink) != CE_OK)
+        {
+            return CE_SINK_ERROR;
+        }
+        *map_pos += n;
+    }
+    return send_pending(pt) ? CE_OK : CE_SINK_ERROR;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/** Number of buffers in each ring of a pipelined run */
+#define PIPE_RING_BLOCKS 8
+
+/** A ring of buffers handed from one stage of a pipelined run to the
+    next. The producer fills the buffers in turn and the consumer empties
+    them in the same order, each waiting for the other when the ring is
+    full or empty. */
+struct pipe_ring
+{
+    /** The buffers, each #CLEAN_STREAM_BUFFER_SIZE bytes long */
+    unsigned char *bufs[PIPE_RING_BLOCKS];
+    /** Number of bytes held in each buffer */
+    size_t lens[PIPE_RING_BLOCKS];
+    /** Number of buffers filled by the producer so far */
+    unsigned long filled;
+    /** Number of buffers emptied by the consumer so far */
+    unsigned long emptied;
+    /** Set once the producer has nothing more to hand over */
+    int closed;
+    /** Set once the consumer wants nothing more */
+    int abandoned;
+    /** Guards every other member except the buffers themselves */
+    pthread_mutex_t lock;
+    /** Signalled whenever anything guarded by @a lock changes */
+    pthread_cond_t changed;
+};
+
+/** State shared by the stages of a pipelined run */
+struct pipeline
+{
+    /** The input stream, read by the reader thread */
+    FILE *in_stream;
+    /** Set if @a in_stream refers to a regular file */
+    int is_regular;
+    /** The output stream, written by the writer thread */
+    FILE *out_stream;
+    /** Blocks of input, from the reader to the cleaner */
+    struct pipe_ring in_ring;
+    /** Blocks of output, from the cleaner to the writer */
+    struct pipe_ring out_ring;
+    /** Set if reading failed; the reader then closes @a in_ring */
+    int read_failed;
+    /** The @c errno value of the read error */
+    int read_errno;
+    /** Set if writing failed; the writer then abandons @a out_ring */
+    int write_failed;
+    /** The @c errno value of the write error */
+    int write_errno;
+};
+
+/** Sets up an empty ring.
+
+    @param ring The ring to set up.
+    @return Non-zero on success; zero if memory ran out. */
+static int ring_init(struct pipe_ring *ring)
+{
+    /* i: Index of the current buffer */
+    int i;
 
-            if(collected_spaces > 0 || collected_tabs > 0)
+    memset(ring, 0, sizeof(struct pipe_ring));
+    for(i = 0; i < PIPE_RING_BLOCKS; i++)
+    {
+        ring->bufs[i] = malloc(CLEAN_STREAM_BUFFER_SIZE);
+        if(!ring->bufs[i])
+        {
+            while(i-- > 0)
             {
-                /* If there are any trailing tabs or spaces, they will
-                   be deleted. Indicate to the caller that the stream
-                   will be modified. */
-                collected_spaces = 0;
-                collected_tabs = 0;
-                *csr = CSR_STREAM_MODIFIED;
+                free(ring->bufs[i]);
             }
+            return FALSE;
+        }
+    }
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->changed, NULL);
+    return TRUE;
+}
+
+/** Releases the resources held by a ring.
+
+    @param ring The ring. */
+static void ring_free(struct pipe_ring *ring)
+{
+    /* i: Index of the current buffer */
+    int i;
+
+    pthread_cond_destroy(&ring->changed);
+    pthread_mutex_destroy(&ring->lock);
+    for(i = 0; i < PIPE_RING_BLOCKS; i++)
+    {
+        free(ring->bufs[i]);
+    }
+}
+
+/** Waits for the next buffer in a ring to be free for the producer.
+
+    @param ring The ring.
+    @return The buffer, or @c NULL if the consumer has abandoned the
+    ring. */
+static unsigned char *ring_get_empty(struct pipe_ring *ring)
+{
+    /* buf: The buffer */
+    unsigned char *buf = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    while(ring->filled - ring->emptied == PIPE_RING_BLOCKS
+        && !ring->abandoned)
+    {
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    if(!ring->abandoned)
+    {
+        buf = ring->bufs[ring->filled % PIPE_RING_BLOCKS];
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return buf;
+}
+
+/** Hands the buffer returned by #ring_get_empty over to the consumer.
+
+    @param ring The ring.
+    @param len Number of bytes held in the buffer. */
+static void ring_put_full(struct pipe_ring *ring, size_t len)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->lens[ring->filled % PIPE_RING_BLOCKS] = len;
+    ring->filled++;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/** Waits for the next buffer in a ring to be handed over to the
+    consumer.
+
+    @param ring The ring.
+    @param len Receives the number of bytes held in the buffer.
+    @return The buffer, or @c NULL if the producer has closed the ring
+    and every buffer has been consumed. */
+static unsigned char *ring_get_full(struct pipe_ring *ring, size_t *len)
+{
+    /* buf: The buffer */
+    unsigned char *buf = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+    while(ring->filled == ring->emptied && !ring->closed)
+    {
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    if(ring->filled != ring->emptied)
+    {
+        buf = ring->bufs[ring->emptied % PIPE_RING_BLOCKS];
+        *len = ring->lens[ring->emptied % PIPE_RING_BLOCKS];
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return buf;
+}
 
-            /* Move the input column position back to the start and
-               collect the EOL sequence. */
-            in_col = 0;
-            collected_newlines++;
-            found_eol = FALSE;
+/** Hands the buffer returned by #ring_get_full back to the producer.
+
+    @param ring The ring. */
+static void ring_put_empty(struct pipe_ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->emptied++;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/** Marks a ring as closed by the producer, or abandoned by the consumer,
+    and wakes up the other side.
+
+    @param ring The ring.
+    @param flag Points to @a closed or @a abandoned in @a ring. */
+static void ring_end(struct pipe_ring *ring, int *flag)
+{
+    pthread_mutex_lock(&ring->lock);
+    *flag = TRUE;
+    pthread_cond_broadcast(&ring->changed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/** Reader stage of a pipelined run: reads blocks of input into the
+    input ring until end-of-file, or until the cleaner abandons it.
+
+    @param arg Points to the #pipeline.
+    @return @c NULL. */
+static void *pipeline_reader(void *arg)
+{
+    /* pl: The pipeline */
+    /* on_read_error: Execution branches here if reading fails */
+    /* buf: Buffer being filled */
+    /* n: Number of bytes read */
+    /* old_state: Previous cancellation state */
+    struct pipeline *pl = arg;
+    jmp_buf on_read_error;
+    unsigned char *buf;
+    size_t n;
+    int old_state;
+
+    /* The cleaner cancels this thread if it stops before end-of-file, so
+       that it does not wait for input that is no longer wanted. That may
+       only happen while waiting for input, not while holding a lock. */
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+    if(setjmp(on_read_error))
+    {
+        /* Execution branches here if an I/O error occurs */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+        pl->read_errno = errno;
+        pl->read_failed = TRUE;
+        ring_end(&pl->in_ring, &pl->in_ring.closed);
+        return NULL;
+    }
+    while((buf = ring_get_empty(&pl->in_ring)) != NULL)
+    {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+        n = read_block(pl->in_stream, pl->is_regular,
+            buf, CLEAN_STREAM_BUFFER_SIZE, &on_read_error);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+        if(n == 0)
+        {
+            break;
+        }
+        ring_put_full(&pl->in_ring, n);
+    }
+    ring_end(&pl->in_ring, &pl->in_ring.closed);
+    return NULL;
+}
+
+/** Writer stage of a pipelined run: writes blocks of output from the
+    output ring until the cleaner closes it.
+
+    @param arg Points to the #pipeline.
+    @return @c NULL. */
+static void *pipeline_writer(void *arg)
+{
+    /* pl: The pipeline */
+    /* buf: Buffer being written */
+    /* len: Number of bytes in the buffer */
+    struct pipeline *pl = arg;
+    unsigned char *buf;
+    size_t len;
+
+    while((buf = ring_get_full(&pl->out_ring, &len)) != NULL)
+    {
+        if(fwrite(buf, 1, len, pl->out_stream) < len)
+        {
+            pl->write_errno = errno;
+            pl->write_failed = TRUE;
+            ring_end(&pl->out_ring, &pl->out_ring.abandoned);
+            return NULL;
         }
+        ring_put_empty(&pl->out_ring);
+    }
+    return NULL;
+}
+
+/** Hands a sink's buffer over to the writer stage, and gives the sink
+    the next free buffer in the output ring.
+
+    @param sink The sink to drain; its @a handle is the #pipeline.
+    @return #CE_OK on success, or #CE_SINK_ERROR if writing failed. */
+static clean_engine_status_t flush_to_ring(struct clean_sink *sink)
+{
+    /* pl: The pipeline */
+    /* buf: The next free buffer */
+    struct pipeline *pl = sink->handle;
+    unsigned char *buf;
+
+    if(sink->len == 0)
+    {
+        return CE_OK;
+    }
+    ring_put_full(&pl->out_ring, sink->len);
+    buf = ring_get_empty(&pl->out_ring);
+    if(!buf)
+    {
+        return CE_SINK_ERROR;
+    }
+    sink->buf = buf;
+    sink->len = 0;
+    return CE_OK;
+}
+
+/** Cleans a stream with reading, cleaning and writing each done on its
+    own thread, so that stalls on either side overlap with the others.
+    The output is identical to that of the serial loop in
+    #clean_stream.
+
+    @param ctx The cleaning context.
+    @param in_stream The input stream.
+    @param is_regular Set if @a in_stream refers to a regular file.
+    @param out_stream The output stream.
+    @param result Receives the verdict, as for #clean_stream.
+    @param jmp_if_error Error handler, as for #clean_stream.
+    @return Non-zero if the stream was cleaned; zero if the threads could
+    not be set up, in which case nothing has been read or written. */
+static int clean_stream_pipelined(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    int is_regular,
+    FILE *out_stream,
+    clean_stream_result_t *result,
+    jmp_buf *jmp_if_error)
+{
+    /* eng: Cleaning engine state for this stream, held in ctx */
+    /* pl: State shared with the reader and writer */
+    /* reader: The reader thread; writer: The writer thread */
+    /* sink: Collects engine output in buffers of the output ring */
+    /* buf: Current block of input */
+    /* n: Number of bytes in the current block */
+    /* failed: Set if cleaning stopped because of an error */
+    struct clean_engine *eng = &ctx->eng;
+    struct pipeline pl;
+    pthread_t reader;
+    pthread_t writer;
+    struct clean_sink sink;
+    unsigned char *buf;
+    size_t n;
+    int failed = FALSE;
+
+    memset(&pl, 0, sizeof(pl));
+    pl.in_stream = in_stream;
+    pl.is_regular = is_regular;
+    pl.out_stream = out_stream;
+    if(!ring_init(&pl.in_ring))
+    {
+        return FALSE;
+    }
+    if(!ring_init(&pl.out_ring))
+    {
+        ring_free(&pl.in_ring);
+        return FALSE;
     }
-    while(c != EOF && !found_non_whitespace);
 
-    if(found_non_whitespace)
+    /* The writer is started first; it does nothing until there is
+       output, so it can be stopped again without losing anything if
+       the reader cannot be started. */
+    if(pthread_create(&writer, NULL, pipeline_writer, &pl) != 0)
     {
-        /* We've encountered a non-whitespace character. Flush all
-           pending whitespace to the output stream. */
-        flush_whitespace(out_stream, in_col, out_col,
-            collected_spaces, collected_tabs, collected_newlines,
-            new_out_col, csr, jmp_if_error);
+        ring_free(&pl.in_ring);
+        ring_free(&pl.out_ring);
+        return FALSE;
     }
-    /* We've encountered the end of the input stream */
-    else if(out_col > 0)
+    if(pthread_create(&reader, NULL, pipeline_reader, &pl) != 0)
+    {
+        ring_end(&pl.out_ring, &pl.out_ring.closed);
+        pthread_join(writer, NULL);
+        ring_free(&pl.in_ring);
+        ring_free(&pl.out_ring);
+        return FALSE;
+    }
+
+    clean_engine_init(eng, ctx);
+    sink.buf = ring_get_empty(&pl.out_ring);
+    sink.len = 0;
+    sink.size = CLEAN_STREAM_BUFFER_SIZE;
+    sink.flush = flush_to_ring;
+    sink.handle = &pl;
+
+    /* Output is handed to the writer after each block of input, as the
+       serial loop hands it to stdio. */
+    while(!eng->stopped && (buf = ring_get_full(&pl.in_ring, &n)) != NULL)
     {
-        /* If at least one non-whitespace character exists on the
-           current line, then write a final EOL sequence to the output
-           stream. This helps eliminate a common problem where shell
-           interpreters and compilers (like gcc) complain about a
-           missing newline character on the end of the last line of the
-           file, or worse yet completely ignore the last line of the
-           file. If the input stream is empty, or contains only
-           whitespace, then the output stream will remain blank. */
-        fputs_jmp(EOL_STR[options.eol_mode], out_stream, jmp_if_error);
+        /* status: Outcome of filtering the block */
+        clean_engine_status_t status = clean_engine_feed(eng, buf, n, &sink);
 
-        if(collected_newlines != 1
-            || collected_spaces != 0
-            || collected_tabs != 0)
+        ring_put_empty(&pl.in_ring);
+        if(status != CE_OK || clean_sink_flush(&sink) != CE_OK)
         {
-            /* If there is any whitespace other than a single EOL
-               sequence following the last non-whitespace character,
-               then this will be filtered out. Let the caller know. */
-            *csr = CSR_STREAM_MODIFIED;
+            failed = TRUE;
+            break;
         }
     }
+    if(!failed && !pl.read_failed
+        && (clean_engine_finish(eng, &sink) != CE_OK
+            || clean_sink_flush(&sink) != CE_OK))
+    {
+        failed = TRUE;
+    }
+
+    /* Stop the reader if it is still going; it may be waiting for input
+       past a significant ctrl-Z, or after a failure. */
+    ring_end(&pl.in_ring, &pl.in_ring.abandoned);
+    pthread_cancel(reader);
+    pthread_join(reader, NULL);
+    ring_end(&pl.out_ring, &pl.out_ring.closed);
+    pthread_join(writer, NULL);
+    ring_free(&pl.in_ring);
+    ring_free(&pl.out_ring);
+
+    if(pl.read_failed || pl.write_failed)
+    {
+        errno = pl.read_failed ? pl.read_errno : pl.write_errno;
+        longjmp(*jmp_if_error, TRUE);
+    }
+    *result = eng->result;
+    return TRUE;
 }
 
+#endif /* HAVE_PTHREAD_H */
+
 clean_stream_result_t clean_stream(
+    struct cleantxt_ctx *ctx,
     FILE *in_stream,
     FILE *out_stream,
     jmp_buf *jmp_if_error)
 {
-    /* csr: Value to return to the caller */
-    /* col: Current column position in the file */
-    /* c: Current non-whitespace character in the input stream */
-    /* last_c: Previous non-whitespace character in the input stream */
-    clean_stream_result_t csr = CSR_STREAM_UNMODIFIED;
-    int col = 0;
-    int c = 0;
-    int last_c = 0;
-
-    /* Continue filtering characters until either we reach
-       end-of-file, or we encounter a significant end-of-file
-       marker. If an I/O error is encountered, then a non-local exit
-       will be made to the error handler that the caller set up. */
-    do
+    /* eng: Cleaning engine state for this stream, held in ctx */
+    /* sink: Collects engine output before it is written to out_stream */
+    /* in_buf: Input buffer; out_buf: Output buffer for the sink */
+    /* on_io_error: Execution branches here on I/O errors, to free the
+       buffers before handing the error on to the caller */
+    /* in_stat: Attributes of the input file */
+    /* is_regular: Set if the input is a regular file */
+    /* in_pos: Current position within the input file */
+    /* map: The input file, if it is mapped into memory */
+    /* map_pos: Number of bytes of mapped input handed to the engine */
+    /* pt: State for passing unchanged mapped input through */
+    /* guard: Where to go if reading the mapping faults */
+    /* out_size: Size of out_buf */
+    /* block: Current block of input */
+    /* n: Number of bytes in the current block */
+    struct clean_engine *eng = &ctx->eng;
+    struct clean_sink sink;
+    unsigned char *volatile in_buf;
+    unsigned char *volatile out_buf;
+    jmp_buf on_io_error;
+    struct stat in_stat;
+    int is_regular;
+    long in_pos;
+    struct input_map map;
+    size_t map_pos;
+    struct pass_through pt;
+#   ifdef HAVE_SYS_MMAN_H
+        struct map_guard guard;
+#   endif /* HAVE_SYS_MMAN_H */
+    size_t out_size;
+    const unsigned char *block;
+    size_t n;
+
+    is_regular = fstat(fileno(in_stream), &in_stat) == 0
+        && S_ISREG(in_stat.st_mode);
+    if(is_regular
+        && (in_pos = ftell(in_stream)) >= 0
+        && in_stat.st_size - in_pos >= CLEAN_PARALLEL_MIN_SIZE
+        && clean_parallel_threads(ctx) > 1)
+    {
+        /* Large files are split up and cleaned on several threads */
+        return clean_stream_parallel(ctx, in_stream,
+            in_stat.st_size - in_pos, out_stream,
+            CLEAN_PARALLEL_CHUNK_SIZE, jmp_if_error);
+    }
+
+#   ifdef HAVE_PTHREAD_H
+    {
+        /* result: The verdict of a pipelined run */
+        clean_stream_result_t result;
+
+        if(ctx->pipeline
+            && clean_stream_pipelined(ctx, in_stream, is_regular,
+                out_stream, &result, jmp_if_error))
+        {
+            return result;
+        }
+    }
+#   endif /* HAVE_PTHREAD_H */
+
+    /* Regular files are read straight from a mapping where possible;
+       anything else, or a file that cannot be mapped, is read into a
+       buffer. */
+    if(!is_regular || !map_input(in_stream, &in_stat, &map))
+    {
+        map.base = NULL;
+    }
+    pt.mode = map.base ? pass_through_mode(out_stream) : PT_NONE;
+    out_size = CLEAN_STREAM_BUFFER_SIZE;
+    if(pt.mode != PT_NONE && map.len > out_size)
+    {
+        /* Room for the output of a whole piece */
+        out_size = map.len < PASS_THROUGH_PIECE_SIZE
+            ? map.len : PASS_THROUGH_PIECE_SIZE;
+    }
+    in_buf = map.base ? NULL : malloc(CLEAN_STREAM_BUFFER_SIZE);
+    out_buf = malloc(out_size);
+    if((!map.base && !in_buf) || !out_buf)
+    {
+        unmap_input(&map);
+        free(in_buf);
+        free(out_buf);
+        errno = ENOMEM;
+        longjmp(*jmp_if_error, TRUE);
+    }
+    if(setjmp(on_io_error))
     {
-        collect_whitespace(in_stream, out_stream, col, &col, &csr, jmp_if_error);
-        last_c = c;
-        c = fgetc_jmp(in_stream, jmp_if_error);
+        /* Execution branches here if an I/O error occurs */
+        /* save_errno: errno is preserved for the caller's error message */
+        int save_errno = errno;
 
-        if(c == CHAR_EOF && (options.remove_ctrl_z || options.stop_at_ctrl_z))
+        unmap_input(&map);
+        free(in_buf);
+        free(out_buf);
+        errno = save_errno;
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+#   ifdef HAVE_SYS_MMAN_H
+        if(map.base)
         {
-            /* Deleted a ctrl-z character. In the case of
-               stop_at_ctrl_z, we need to re-add it later. */
-            csr = CSR_STREAM_MODIFIED;
-            /* If ctrl-z characters mark explicit end-of-file, then marking
-               the file as modified (even if no changes were made up to this
-               point) causes any content that might be past the ctrl-z
-               character to be consistently discarded. This also spares us
-               from having to read past the ctrl-z character; in
-               extreme circumstances, say, if the input is coming over a
-               pipe and the sender intends to re-use the pipe for other
-               purposes afterwards, this could cause deadlock. */
+            if(sigsetjmp(guard.on_fault, TRUE))
+            {
+                /* Execution branches here if reading the mapped input
+                   faults, because the file was cut short while it was
+                   mapped */
+                errno = EIO;
+                longjmp(on_io_error, TRUE);
+                /* Non-local return */
+            }
+            set_map_guard(&guard);
         }
-        else if(c != EOF)
+#   endif /* HAVE_SYS_MMAN_H */
+
+    clean_engine_init(eng, ctx);
+    sink.buf = out_buf;
+    sink.len = 0;
+    sink.size = out_size;
+    sink.flush = flush_to_stream;
+    sink.handle = out_stream;
+    map_pos = 0;
+
+    if(pt.mode != PT_NONE)
+    {
+        /* Mapped input going to a file or pipe: clean stretches of it
+           can be sent on by the kernel. */
+        pt.out_stream = out_stream;
+        pt.in_fd = fileno(in_stream);
+        pt.pending_len = 0;
+        sink.flush = flush_passing_through;
+        sink.handle = &pt;
+        if(feed_passing_through(eng, &map, &map_pos, &pt, &sink) != CE_OK)
         {
-            fputc_jmp(c, out_stream, jmp_if_error);
-            col++;
+            longjmp(on_io_error, TRUE);
         }
     }
-    while(c != EOF && !(options.stop_at_ctrl_z && c == CHAR_EOF));
-
+    else
+    {
+        /* Continue filtering blocks until either we reach end-of-file, or
+           we encounter a significant end-of-file marker. Output is handed
+           to stdio after each block, so that the output stream's own
+           buffering policy (e.g. line buffering on a terminal) still
+           applies. */
+        do
+        {
+            if(map.base)
+            {
+                n = next_mapped_block(&map, &map_pos,
+                    CLEAN_STREAM_BUFFER_SIZE, &block);
+            }
+            else
+            {
+                n = read_block(in_stream, is_regular,
+                    in_buf, CLEAN_STREAM_BUFFER_SIZE, &on_io_error);
+                block = in_buf;
+            }
+            if(clean_engine_feed(eng, block, n, &sink) != CE_OK
+                || clean_sink_flush(&sink) != CE_OK)
+            {
+                longjmp(on_io_error, TRUE);
+            }
+        }
+        while(n > 0 && !eng->stopped);
+    }
 
     /* End of stream was reached */
-    if((options.add_ctrl_z && last_c != CHAR_EOF) || options.stop_at_ctrl_z)
+    if(clean_engine_finish(eng, &sink) != CE_OK
+        || clean_sink_flush(&sink) != CE_OK)
+    {
+        longjmp(on_io_error, TRUE);
+    }
+
+    if(map.base)
+    {
+        finish_mapped_input(in_stream, &map, map_pos);
+    }
+    free(in_buf);
+    free(out_buf);
+    return eng->result;
+}
+
+/** Reads part of a regular file at a given offset, without disturbing
+    its stream's position.
+
+    @param in_fd File descriptor of the file.
+    @param buf Receives the data.
+    @param offset Offset within the file to read from.
+    @param len Number of bytes to read.
+    @return Non-zero on success; zero on failure, with @c errno set. A
+    file that ends early is reported as @c EIO. */
+static int read_at(int in_fd, unsigned char *buf, long offset, size_t len)
+{
+    while(len > 0)
     {
-        if(col > 0 && options.stop_at_ctrl_z)
+        /* n: Number of bytes read */
+        ssize_t n = pread(in_fd, buf, len, offset);
+
+        if(n < 0 && errno == EINTR)
         {
-            fputs_jmp(EOL_STR[options.eol_mode], out_stream, jmp_if_error);
+            continue;
+        }
+        if(n <= 0)
+        {
+            if(n == 0)
+            {
+                errno = EIO;
+            }
+            return FALSE;
         }
-        fputc_jmp(CHAR_EOF, out_stream, jmp_if_error);
-        csr = CSR_STREAM_MODIFIED;
+        buf += n;
+        offset += n;
+        len -= n;
     }
+    return TRUE;
+}
+
+int find_restart_point(
+    int in_fd,
+    long start,
+    long limit,
+    unsigned char *buf,
+    long *restart)
+{
+    /* hi: End of the part of the stream still to be searched */
+    long hi = limit;
 
-    return csr;
+    *restart = 0;
+    /* Search backwards. Successive reads overlap by one byte, so that a
+       LF at the start of one read is paired with the character after
+       it. */
+    while(hi > 1)
+    {
+        /* lo: Start of the part being searched */
+        /* q: Candidate point */
+        long lo = hi > CLEAN_STREAM_BUFFER_SIZE
+            ? hi - CLEAN_STREAM_BUFFER_SIZE : 0;
+        long q;
+
+        if(!read_at(in_fd, buf, start + lo, hi - lo))
+        {
+            return FALSE;
+        }
+        for(q = hi - 1; q > lo; q--)
+        {
+            if(buf[q - lo - 1] == CHAR_LF && is_ordinary(buf[q - lo]))
+            {
+                *restart = q;
+                return TRUE;
+            }
+        }
+        hi = lo + 1;
+    }
+    return TRUE;
+}
+
+/** Clones the start of part of the input file into the output, so that
+    the two files share its data blocks rather than it being copied.
+    Only copy-on-write filesystems such as btrfs and XFS support this,
+    and only for whole blocks at block-aligned offsets; whatever cannot
+    be cloned is left to be copied.
+
+    @param in_fd File descriptor of the input file.
+    @param start Offset within the input file to clone from.
+    @param len Number of bytes that may be cloned.
+    @param out_stream The output stream.
+    @param cloned Receives the number of bytes cloned; zero if none.
+    @return Non-zero on success; zero if the output stream could not be
+    brought up to date. */
+static int clone_unchanged(
+    int in_fd,
+    long start,
+    long len,
+    FILE *out_stream,
+    long *cloned)
+{
+    *cloned = 0;
+#   ifdef FICLONERANGE
+    {
+        /* out_fd: File descriptor of the output stream */
+        /* out_stat: Attributes of the output file */
+        /* out_off: Offset within the output file to clone to */
+        /* block: Block size of the output file's filesystem */
+        /* range: Request to clone a range of blocks */
+        int out_fd = fileno(out_stream);
+        struct stat out_stat;
+        long out_off;
+        long block;
+        struct file_clone_range range;
+
+        if(fflush(out_stream) != 0)
+        {
+            return FALSE;
+        }
+        out_off = ftell(out_stream);
+        if(out_off < 0 || fstat(out_fd, &out_stat) != 0
+            || !S_ISREG(out_stat.st_mode))
+        {
+            return TRUE;
+        }
+        block = out_stat.st_blksize;
+        if(block <= 0 || len < block
+            || start % block != 0 || out_off % block != 0)
+        {
+            return TRUE;
+        }
+        range.src_fd = in_fd;
+        range.src_offset = start;
+        range.src_length = len - len % block;
+        range.dest_offset = out_off;
+        if(ioctl(out_fd, FICLONERANGE, &range) != 0)
+        {
+            /* Not supported here; the range is copied instead */
+            return TRUE;
+        }
+        /* Move past the cloned blocks, which do not go through stdio */
+        *cloned = (long)range.src_length;
+        if(fseek(out_stream, out_off + *cloned, SEEK_SET) != 0)
+        {
+            return FALSE;
+        }
+    }
+#   else
+        (void)in_fd;
+        (void)start;
+        (void)len;
+        (void)out_stream;
+#   endif /* FICLONERANGE */
+    return TRUE;
+}
+
+/** Copies part of the input file to the output unchanged, within the
+    kernel where it can, sharing its data blocks if possible.
+
+    @param in_fd File descriptor of the input file.
+    @param start Offset within the input file to copy from.
+    @param len Number of bytes to copy.
+    @param out_stream The output stream.
+    @param buf Buffer of #CLEAN_STREAM_BUFFER_SIZE bytes for copying
+    through stdio.
+    @return Non-zero on success; zero if reading or writing failed. */
+static int copy_unchanged(
+    int in_fd,
+    long start,
+    long len,
+    FILE *out_stream,
+    unsigned char *buf)
+{
+    /* cloned: Number of bytes cloned */
+    /* pt: Pass-through state for the rest of the copy */
+    long cloned;
+    struct pass_through pt;
+
+    if(!clone_unchanged(in_fd, start, len, out_stream, &cloned))
+    {
+        return FALSE;
+    }
+    pt.out_stream = out_stream;
+    pt.mode = pass_through_mode(out_stream);
+    pt.in_fd = in_fd;
+    pt.pending_start = start + cloned;
+    pt.pending_data = NULL;
+    pt.pending_len = len - cloned;
+    if(!send_in_kernel(&pt))
+    {
+        return FALSE;
+    }
+    while(pt.pending_len > 0)
+    {
+        /* n: Number of bytes to copy through buf */
+        size_t n = pt.pending_len < CLEAN_STREAM_BUFFER_SIZE
+            ? pt.pending_len : CLEAN_STREAM_BUFFER_SIZE;
+
+        if(!read_at(in_fd, buf, pt.pending_start, n)
+            || fwrite(buf, 1, n, out_stream) < n)
+        {
+            return FALSE;
+        }
+        pt.pending_start += n;
+        pt.pending_len -= n;
+    }
+    return TRUE;
+}
+
+clean_stream_result_t clean_stream_from(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    FILE *out_stream,
+    unsigned long modified_at,
+    jmp_buf *jmp_if_error)
+{
+    /* in_fd: File descriptor of the input file */
+    /* start: Offset within the file where the stream starts */
+    /* restart: Number of bytes copied before cleaning starts */
+    /* buf: Buffer for reading and copying */
+    /* ok: Set if the unchanged part was copied successfully */
+    /* save_errno: errno is preserved for the caller's error message */
+    int in_fd = fileno(in_stream);
+    long start = ftell(in_stream);
+    long restart;
+    unsigned char *buf;
+    int ok;
+    int save_errno;
+
+    if(start < 0)
+    {
+        longjmp(*jmp_if_error, TRUE);
+    }
+    buf = malloc(CLEAN_STREAM_BUFFER_SIZE);
+    if(!buf)
+    {
+        errno = ENOMEM;
+        longjmp(*jmp_if_error, TRUE);
+    }
+    ok = find_restart_point(in_fd, start, (long)modified_at, buf, &restart)
+        && copy_unchanged(in_fd, start, restart, out_stream, buf);
+    save_errno = errno;
+    free(buf);
+    errno = save_errno;
+    if(!ok || fseek(in_stream, start + restart, SEEK_SET) != 0)
+    {
+        longjmp(*jmp_if_error, TRUE);
+    }
+    return clean_stream(ctx, in_stream, out_stream, jmp_if_error);
+}
+
+int plan_tail_repair(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    unsigned long modified_at,
+    struct tail_repair *repair,
+    jmp_buf *jmp_if_error)
+{
+    /* eng: Cleaning engine state for the end of the stream */
+    /* sink: Receives the cleaned end of the stream */
+    /* in_fd: File descriptor of the input file */
+    /* in_stat: Attributes of the input file */
+    /* start: Offset within the file where the stream starts */
+    /* restart: Number of bytes before the end that is cleaned */
+    /* in_len: Length of the stream */
+    /* tail_len: Length of the end that is cleaned */
+    /* in_buf: Holds the end of the stream */
+    /* out_buf: Holds its cleaned text */
+    /* ok: Set if the end of the stream was read successfully */
+    /* save_errno: errno is preserved for the caller's error message */
+    struct clean_engine *eng = &ctx->eng;
+    struct clean_sink sink;
+    int in_fd = fileno(in_stream);
+    struct stat in_stat;
+    long start = ftell(in_stream);
+    long restart;
+    long in_len;
+    size_t tail_len;
+    unsigned char *in_buf;
+    unsigned char *out_buf;
+    int ok;
+    int save_errno;
+
+    if(start < 0 || fstat(in_fd, &in_stat) != 0)
+    {
+        longjmp(*jmp_if_error, TRUE);
+    }
+    if(!S_ISREG(in_stat.st_mode))
+    {
+        return FALSE;
+    }
+    in_buf = malloc(CLEAN_STREAM_BUFFER_SIZE);
+    out_buf = malloc(CLEAN_STREAM_BUFFER_SIZE + TAIL_REPAIR_APPEND_MAX);
+    if(!in_buf || !out_buf)
+    {
+        free(in_buf);
+        free(out_buf);
+        errno = ENOMEM;
+        longjmp(*jmp_if_error, TRUE);
+    }
+
+    /* Clean from the start of the line holding the first change, as
+       long as that is near the end. */
+    in_len = in_stat.st_size - start;
+    ok = find_restart_point(in_fd, start, (long)modified_at, in_buf,
+        &restart);
+    tail_len = in_len - restart;
+    if(ok && in_len - restart <= CLEAN_STREAM_BUFFER_SIZE)
+    {
+        ok = read_at(in_fd, in_buf, start + restart, tail_len);
+    }
+    else
+    {
+        tail_len = 0;
+    }
+    save_errno = errno;
+    if(!ok)
+    {
+        free(in_buf);
+        free(out_buf);
+        errno = save_errno;
+        longjmp(*jmp_if_error, TRUE);
+    }
+
+    /* The sink cannot be drained, so a stream whose end grows by too
+       much is turned away. */
+    ok = FALSE;
+    if(tail_len > 0)
+    {
+        clean_engine_init(eng, ctx);
+        sink.buf = out_buf;
+        sink.len = 0;
+        sink.size = CLEAN_STREAM_BUFFER_SIZE + TAIL_REPAIR_APPEND_MAX;
+        sink.flush = NULL;
+        sink.handle = NULL;
+        ok = clean_engine_feed(eng, in_buf, tail_len, &sink) == CE_OK
+            && clean_engine_finish(eng, &sink) == CE_OK;
+    }
+    if(ok && sink.len <= tail_len)
+    {
+        /* The end is only cut short */
+        ok = memcmp(out_buf, in_buf, sink.len) == 0;
+        repair->keep = restart + sink.len;
+        repair->append_len = 0;
+    }
+    else if(ok)
+    {
+        /* The end is only added to */
+        repair->append_len = sink.len - tail_len;
+        ok = repair->append_len <= TAIL_REPAIR_APPEND_MAX
+            && memcmp(out_buf, in_buf, tail_len) == 0;
+        if(ok)
+        {
+            memcpy(repair->append, out_buf + tail_len, repair->append_len);
+            repair->keep = in_len;
+        }
+    }
+    free(in_buf);
+    free(out_buf);
+    return ok;
+}
+
+clean_stream_result_t check_stream(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    unsigned long *modified_at,
+    jmp_buf *jmp_if_error)
+{
+    /* eng: Cleaning engine state for this stream, held in ctx */
+    /* sink: Receives engine output, which is thrown away */
+    /* in_buf: Input buffer */
+    /* scratch: Buffer for the sink */
+    /* on_io_error: Execution branches here on I/O errors, to free the
+       buffer before handing the error on to the caller */
+    /* in_stat: Attributes of the input file */
+    /* is_regular: Set if the input is a regular file */
+    /* map: The input file, if it is mapped into memory */
+    /* map_pos: Number of bytes of mapped input handed to the engine */
+    /* guard: Where to go if reading the mapping faults */
+    /* block: Current block of input */
+    /* n: Number of bytes in the current block */
+    struct clean_engine *eng = &ctx->eng;
+    struct clean_sink sink;
+    unsigned char *volatile in_buf;
+    unsigned char scratch[CHECK_STREAM_SCRATCH_SIZE];
+    jmp_buf on_io_error;
+    struct stat in_stat;
+    int is_regular;
+    struct input_map map;
+    size_t map_pos;
+#   ifdef HAVE_SYS_MMAN_H
+        struct map_guard guard;
+#   endif /* HAVE_SYS_MMAN_H */
+    const unsigned char *block;
+    size_t n;
+
+    is_regular = fstat(fileno(in_stream), &in_stat) == 0
+        && S_ISREG(in_stat.st_mode);
+    if(!is_regular || !map_input(in_stream, &in_stat, &map))
+    {
+        map.base = NULL;
+    }
+    in_buf = map.base ? NULL : malloc(CLEAN_STREAM_BUFFER_SIZE);
+    if(!map.base && !in_buf)
+    {
+        errno = ENOMEM;
+        longjmp(*jmp_if_error, TRUE);
+    }
+    if(setjmp(on_io_error))
+    {
+        /* Execution branches here if an I/O error occurs */
+        /* save_errno: errno is preserved for the caller's error message */
+        int save_errno = errno;
+
+        unmap_input(&map);
+        free(in_buf);
+        errno = save_errno;
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+#   ifdef HAVE_SYS_MMAN_H
+        if(map.base)
+        {
+            if(sigsetjmp(guard.on_fault, TRUE))
+            {
+                /* Execution branches here if reading the mapped input
+                   faults, because the file was cut short while it was
+                   mapped */
+                errno = EIO;
+                longjmp(on_io_error, TRUE);
+                /* Non-local return */
+            }
+            set_map_guard(&guard);
+        }
+#   endif /* HAVE_SYS_MMAN_H */
+
+    clean_engine_init(eng, ctx);
+    sink.buf = scratch;
+    sink.len = 0;
+    sink.size = sizeof(scratch);
+    sink.flush = flush_to_nowhere;
+    sink.handle = NULL;
+    map_pos = 0;
+
+    /* Stop reading as soon as the engine finds something to change; the
+       rest of the stream cannot alter that verdict. */
+    do
+    {
+        if(map.base)
+        {
+            n = next_mapped_block(&map, &map_pos,
+                CLEAN_STREAM_BUFFER_SIZE, &block);
+        }
+        else
+        {
+            n = read_block(in_stream, is_regular,
+                in_buf, CLEAN_STREAM_BUFFER_SIZE, &on_io_error);
+            block = in_buf;
+        }
+        clean_engine_feed(eng, block, n, &sink);
+    }
+    while(n > 0 && !eng->stopped && eng->result != CSR_STREAM_MODIFIED);
+
+    if(eng->result != CSR_STREAM_MODIFIED)
+    {
+        clean_engine_finish(eng, &sink);
+    }
+
+    if(map.base)
+    {
+        finish_mapped_input(in_stream, &map, map_pos);
+    }
+    free(in_buf);
+    *modified_at = eng->modified_at;
+    return eng->result;
 }
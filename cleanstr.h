@@ -27,11 +27,40 @@ typedef enum
     CSR_STREAM_UNMODIFIED   /**< The stream was unchanged */
 } clean_stream_result_t;
 
+/** Size of the input and output buffers used by #clean_stream, and of
+    the buffer that #find_restart_point reads into, in bytes */
+#define CLEAN_STREAM_BUFFER_SIZE 65536
+
+/** Most bytes that #plan_tail_repair will append to a stream */
+#define TAIL_REPAIR_APPEND_MAX 16
+
+/** Describes how to fix a stream whose only changes are at its end, as
+    worked out by #plan_tail_repair */
+struct tail_repair
+{
+    /** Number of bytes at the start of the stream to keep; the rest is
+        cut off */
+    unsigned long keep;
+    /** Bytes to append after those kept */
+    unsigned char append[TAIL_REPAIR_APPEND_MAX];
+    /** Number of bytes in @a append; zero if the stream is only cut
+        short */
+    size_t append_len;
+};
+
+struct cleantxt_ctx;
+
 /** Performs stream filtering. Input is read from @a in_stream and
     processed text is written to @a out_stream. Processing stops when the
     end-of-file is reached on @a in_stream, however both @a in_stream and
     @a out_stream are left open.
 
+    Input is processed in large blocks. If @a in_stream is not a regular
+    file, then it is read directly through its underlying file
+    descriptor, so it should not hold any buffered input beforehand.
+
+    @param ctx The cleaning context, which supplies the configuration
+    and holds the stream's state.
     @param in_stream The input stream
     @param out_stream The output stream
     @param jmp_if_error Error handler invoked if an I/O error occurs.
@@ -42,8 +71,97 @@ typedef enum
     modifications were made to the stream. The output stream contains
     the contents of the input stream. */
 extern clean_stream_result_t clean_stream(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    FILE *out_stream,
+    jmp_buf *jmp_if_error);
+
+/** Cleans a regular file that #check_stream has found would be
+    modified. The text before the start of the line holding the first
+    modification is known to be unchanged, so it is copied to the output
+    in bulk, and only the rest is cleaned.
+
+    @param ctx The cleaning context, as for #clean_stream. Offsets
+    recorded in its engine state are relative to where cleaning started.
+    @param in_stream The input stream; must be a regular file,
+    positioned where #check_stream started reading it.
+    @param out_stream The output stream.
+    @param modified_at The offset of the first modification reported by
+    #check_stream.
+    @param jmp_if_error Error handler invoked if an I/O error occurs.
+    @returns As for #clean_stream. */
+extern clean_stream_result_t clean_stream_from(
+    struct cleantxt_ctx *ctx,
     FILE *in_stream,
     FILE *out_stream,
+    unsigned long modified_at,
+    jmp_buf *jmp_if_error);
+
+/** Finds the last point before a given offset where cleaning can start
+    afresh: just after a LF character and at an ordinary character. The
+    engine has written everything before such a point and holds nothing
+    back, so a new engine started there produces the same output.
+
+    @param in_fd File descriptor of the input file; must be a regular
+    file. Its position is left unchanged.
+    @param start Offset within the file where the stream starts.
+    @param limit The point must lie before this many bytes into the
+    stream.
+    @param buf Buffer of #CLEAN_STREAM_BUFFER_SIZE bytes to read into.
+    @param restart Receives the number of bytes before the point; zero
+    if there is no such point.
+    @return Non-zero on success; zero if reading failed, with @c errno
+    set. */
+extern int find_restart_point(
+    int in_fd,
+    long start,
+    long limit,
+    unsigned char *buf,
+    long *restart);
+
+/** Works out whether a regular file that #check_stream has found would
+    be modified only needs its end changing: that is, whether its cleaned
+    text is either the input cut short or the input with a few bytes
+    appended. This covers a missing final end-of-line sequence, redundant
+    trailing blank lines and most ctrl-Z handling. Only the last line or
+    so of the file is cleaned to find out.
+
+    @param ctx The cleaning context, as for #check_stream.
+    @param in_stream The input stream; must be a regular file,
+    positioned where #check_stream started reading it. Its position is
+    left unchanged.
+    @param modified_at The offset of the first modification reported by
+    #check_stream.
+    @param repair Receives the fix, if there is one.
+    @param jmp_if_error Error handler invoked if an I/O error occurs.
+    @return Non-zero if @a repair describes the fix; zero if the stream
+    must be cleaned in full. */
+extern int plan_tail_repair(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    unsigned long modified_at,
+    struct tail_repair *repair,
+    jmp_buf *jmp_if_error);
+
+/** Determines whether #clean_stream would modify a stream, without
+    producing any output. Reading stops as soon as the first
+    modification is found.
+
+    @param ctx The cleaning context, as for #clean_stream.
+    @param in_stream The input stream. As with #clean_stream, it should
+    not hold any buffered input if it is not a regular file.
+    @param modified_at If the stream would be modified, then the offset
+    of the first byte affected is stored here. This is the start of the
+    run of whitespace and end-of-line sequences that would be rewritten,
+    the offset of a ctrl-Z character that would be removed, or the
+    length of the stream if something would be appended to it.
+    @param jmp_if_error Error handler invoked if an I/O error occurs.
+    @returns #CSR_STREAM_MODIFIED if the stream would be modified, or
+    #CSR_STREAM_UNMODIFIED if it is already clean. */
+extern clean_stream_result_t check_stream(
+    struct cleantxt_ctx *ctx,
+    FILE *in_stream,
+    unsigned long *modified_at,
     jmp_buf *jmp_if_error);
 
 #endif /* !CLEANSTR_H */
@@ -0,0 +1,365 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file durable.c
+    Replacement of cleaned files in batches that are flushed to disk
+    together, so that a crash can never leave a file empty or half
+    written without paying for a flush per file.
+
+    Renaming a cleaned copy over a file only survives a crash intact if
+    the copy's data reached the disk first; otherwise some filesystems
+    can leave the file empty. Flushing each copy before renaming it costs
+    a journal commit per file. A batch instead holds its copies open
+    until it is full, flushes all of their data, renames them all, and
+    then flushes each directory that holds them once. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "durable.h"
+#include "filemgmt.h"
+#include "report.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+void init_durable_batch(struct durable_batch *batch, unsigned long jobs)
+{
+    /* open_max: Limit on the number of open file descriptors */
+    long open_max = sysconf(_SC_OPEN_MAX);
+
+    batch->count = 0;
+    batch->dir_count = 0;
+    batch->capacity = DURABLE_BATCH_FILES;
+
+    /* A file in a batch holds at most two descriptors open, for its copy
+       and its directory. Leave at least half of them for everything
+       else. */
+    if(jobs < 1)
+    {
+        jobs = 1;
+    }
+    if(open_max > 0 && (unsigned long)open_max / 4 / jobs < batch->capacity)
+    {
+        batch->capacity = (unsigned long)open_max / 4 / jobs;
+    }
+    if(batch->capacity < 1)
+    {
+        batch->capacity = 1;
+    }
+}
+
+/** Finds the entry in a batch's list of directories for a directory,
+    adding it if need be.
+
+    @param batch The batch.
+    @param dir_fd Descriptor of the directory, or #NO_DIR_FD.
+    @return Index of the directory in @a batch->dir_fds, or -1 if it is
+    only known by name. */
+static int find_dir(struct durable_batch *batch, int dir_fd)
+{
+    /* dir_stat: Attributes of the directory */
+    /* i: Index of the directory being compared */
+    /* fd: The batch's own descriptor of the directory */
+    struct stat dir_stat;
+    size_t i;
+    int fd;
+
+    if(dir_fd == NO_DIR_FD || fstat(dir_fd, &dir_stat) != 0)
+    {
+        return -1;
+    }
+    for(i = 0; i < batch->dir_count; i++)
+    {
+        /* other_stat: Attributes of the directory being compared */
+        struct stat other_stat;
+
+        if(fstat(batch->dir_fds[i], &other_stat) == 0
+            && other_stat.st_dev == dir_stat.st_dev
+            && other_stat.st_ino == dir_stat.st_ino)
+        {
+            return (int)i;
+        }
+    }
+    fd = dup(dir_fd);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    batch->dir_fds[batch->dir_count] = fd;
+    return (int)batch->dir_count++;
+}
+
+int add_durable_file(
+    struct durable_batch *batch,
+    int dir_fd,
+    FILE *file,
+    const char *file_name,
+    FILE *temp_file,
+    const char *temp_file_name,
+    jmp_buf *jmp_if_error)
+{
+    /* f: Where the file is recorded in the batch */
+    /* temp_len: Length of the copy's name, including its terminator */
+    struct durable_file *f = &batch->files[batch->count];
+    size_t temp_len = strlen(temp_file_name) + 1;
+
+    /* Both names are kept in the one block */
+    f->temp_file_name = malloc(temp_len + strlen(file_name) + 1);
+    if(!f->temp_file_name)
+    {
+        report_error(ENOMEM, "%s", file_name);
+        close_remove_file(temp_file, temp_file_name, jmp_if_error);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    strcpy(f->temp_file_name, temp_file_name);
+    f->file_name = f->temp_file_name + temp_len;
+    strcpy(f->file_name, file_name);
+    copy_file_attributes(file, temp_file);
+    f->temp_file = temp_file;
+    f->dir = find_dir(batch, dir_fd);
+    f->messages = report_get_capture();
+    f->tag = NULL;
+    f->synced = FALSE;
+    f->failed = FALSE;
+    batch->count++;
+    return batch->count >= batch->capacity;
+}
+
+/** Returns the descriptor of a file's directory.
+
+    @param batch The batch holding the file.
+    @param f The file.
+    @return The descriptor, or #NO_DIR_FD. */
+static int dir_fd_of(const struct durable_batch *batch,
+    const struct durable_file *f)
+{
+    return (f->dir >= 0) ? batch->dir_fds[f->dir] : NO_DIR_FD;
+}
+
+/** Marks a file in a batch as failed, reporting an error about it and
+    discarding its copy.
+
+    @param f The file.
+    @param errnum The @c errno code describing the failure. */
+static void fail_file(struct durable_file *f, int errnum)
+{
+    report_capture(f->messages);
+    report_error(errnum, "%s", f->file_name);
+
+    /* A copy without a name vanishes when it is closed */
+    fclose(f->temp_file);
+    if(*f->temp_file_name)
+    {
+        remove(f->temp_file_name);
+    }
+    f->temp_file = NULL;
+    f->failed = TRUE;
+}
+
+/** Flushes the data of every copy in a batch to disk.
+
+    @param batch The batch. */
+static void sync_batch_data(struct durable_batch *batch)
+{
+    /* i: Index of the file being flushed */
+    size_t i;
+
+#   ifdef HAVE_SYNCFS
+        /* One syncfs() writes out every copy on the same filesystem at
+           once. It does not reliably report a failure to write any one
+           copy, so each copy is still flushed by itself below; with
+           nothing left to write, that is cheap, and it reports the
+           copy's own error. */
+        for(i = 0; i < batch->count; i++)
+        {
+            /* f: The file being flushed */
+            /* fs_stat: Attributes of the file's copy */
+            /* j: Index of an earlier file that may share the filesystem */
+            struct durable_file *f = &batch->files[i];
+            struct stat fs_stat;
+            size_t j;
+
+            if(f->failed || fstat(fileno(f->temp_file), &fs_stat) != 0)
+            {
+                continue;
+            }
+            for(j = 0; j < i; j++)
+            {
+                /* other_stat: Attributes of the other file's copy */
+                struct stat other_stat;
+
+                if(!batch->files[j].failed
+                    && fstat(fileno(batch->files[j].temp_file),
+                        &other_stat) == 0
+                    && other_stat.st_dev == fs_stat.st_dev)
+                {
+                    /* This filesystem has already been written out */
+                    break;
+                }
+            }
+            if(j == i)
+            {
+                syncfs(fileno(f->temp_file));
+            }
+        }
+#   endif /* HAVE_SYNCFS */
+
+    for(i = 0; i < batch->count; i++)
+    {
+        /* f: The file being flushed */
+        /* ok: Set if the file was flushed */
+        struct durable_file *f = &batch->files[i];
+        int ok;
+
+        if(f->failed || f->synced)
+        {
+            continue;
+        }
+#       ifdef HAVE_FDATASYNC
+            ok = fdatasync(fileno(f->temp_file)) == 0;
+#       else
+            ok = fsync(fileno(f->temp_file)) == 0;
+#       endif /* HAVE_FDATASYNC */
+        if(ok)
+        {
+            f->synced = TRUE;
+        }
+        else
+        {
+            fail_file(f, errno);
+        }
+    }
+}
+
+/** Replaces a file in a batch with its copy.
+
+    @param batch The batch.
+    @param f The file. */
+static void replace_from_copy(struct durable_batch *batch,
+    struct durable_file *f)
+{
+    /* on_error: Execution branches here if the copy cannot replace the
+       file, in which case commit_temp_file() has already reported the
+       error and discarded the copy */
+    jmp_buf on_error;
+
+    report_capture(f->messages);
+    if(setjmp(on_error))
+    {
+        f->temp_file = NULL;
+        f->failed = TRUE;
+        return;
+    }
+    commit_temp_file(dir_fd_of(batch, f), NULL, f->file_name,
+        f->temp_file, f->temp_file_name, &on_error);
+    f->temp_file = NULL;
+}
+
+void commit_durable_batch(struct durable_batch *batch)
+{
+    /* saved: The caller's capture buffer */
+    /* i: Index of the current file */
+    /* d: Index of the current directory */
+    struct report_buffer *saved = report_get_capture();
+    size_t i;
+    size_t d;
+
+    /* Pass what is still buffered to the operating system, then have it
+       all written out before any name changes. */
+    for(i = 0; i < batch->count; i++)
+    {
+        if(fflush(batch->files[i].temp_file) != 0)
+        {
+            fail_file(&batch->files[i], errno);
+        }
+    }
+    sync_batch_data(batch);
+
+    for(i = 0; i < batch->count; i++)
+    {
+        if(!batch->files[i].failed)
+        {
+            replace_from_copy(batch, &batch->files[i]);
+        }
+    }
+
+    /* Flush each directory once, so that the new names are on disk. A
+       file whose directory cannot be flushed has been replaced, but may
+       not survive a crash, so it is reported as failed. */
+    for(d = 0; d < batch->dir_count; d++)
+    {
+        /* errnum: Why the directory could not be flushed */
+        int errnum;
+
+        if(sync_file_dir(batch->dir_fds[d], NULL))
+        {
+            continue;
+        }
+        errnum = errno;
+        for(i = 0; i < batch->count; i++)
+        {
+            if(!batch->files[i].failed && batch->files[i].dir == (int)d)
+            {
+                report_capture(batch->files[i].messages);
+                report_error(errnum, "%s", batch->files[i].file_name);
+                batch->files[i].failed = TRUE;
+            }
+        }
+    }
+    for(i = 0; i < batch->count; i++)
+    {
+        /* f: The current file */
+        struct durable_file *f = &batch->files[i];
+
+        if(!f->failed && f->dir < 0 && !sync_file_dir(NO_DIR_FD, f->file_name))
+        {
+            report_capture(f->messages);
+            report_error(errno, "%s", f->file_name);
+            f->failed = TRUE;
+        }
+    }
+    report_capture(saved);
+}
+
+void clear_durable_batch(struct durable_batch *batch)
+{
+    /* i: Index of the current file or directory */
+    size_t i;
+
+    for(i = 0; i < batch->count; i++)
+    {
+        free(batch->files[i].temp_file_name);
+    }
+    for(i = 0; i < batch->dir_count; i++)
+    {
+        close(batch->dir_fds[i]);
+    }
+    batch->count = 0;
+    batch->dir_count = 0;
+}
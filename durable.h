@@ -0,0 +1,126 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file durable.h
+    Replacement of cleaned files in batches that are flushed to disk
+    together, so that a crash can never leave a file empty or half
+    written without paying for a flush per file. */
+
+#ifndef DURABLE_H
+#define DURABLE_H
+
+#include <stdio.h>
+#include <setjmp.h>
+
+/** Largest number of files that a batch holds before it is committed */
+#define DURABLE_BATCH_FILES 32
+
+struct report_buffer;
+
+/** A cleaned copy of a file that is waiting to replace it */
+struct durable_file
+{
+    /** Name of the file to be replaced, held in the same block as @a
+        temp_file_name */
+    char *file_name;
+    /** Stream object of the cleaned copy */
+    FILE *temp_file;
+    /** Name of the cleaned copy, as returned by #create_temp_file */
+    char *temp_file_name;
+    /** Index in the batch's @a dir_fds of the file's directory, or -1
+        if the directory is only known by name */
+    int dir;
+    /** Buffer that error messages about the file are captured in, or
+        @c NULL if they are printed straight away */
+    struct report_buffer *messages;
+    /** For the caller's use */
+    void *tag;
+    /** Set once the file's data has been flushed to disk */
+    int synced;
+    /** Set if the file could not be replaced */
+    int failed;
+};
+
+/** A batch of cleaned files waiting to replace the files they were made
+    from */
+struct durable_batch
+{
+    /** The files in the batch */
+    struct durable_file files[DURABLE_BATCH_FILES];
+    /** Number of files in the batch */
+    size_t count;
+    /** Number of files at which the batch is full */
+    size_t capacity;
+    /** Descriptors of the distinct directories that the files are in */
+    int dir_fds[DURABLE_BATCH_FILES];
+    /** Number of directories in @a dir_fds */
+    size_t dir_count;
+};
+
+/** Prepares an empty batch.
+
+    @param batch The batch to prepare.
+    @param jobs Number of batches that will be filled at once. Each file
+    in a batch holds a file descriptor open, so batches are made smaller
+    when there are many of them. */
+extern void init_durable_batch(struct durable_batch *batch, unsigned long jobs);
+
+/** Adds a complete cleaned copy of a file to a batch, to replace the
+    file when the batch is committed. The copy is given the permissions
+    and ownership of the file straight away, so that the file itself may
+    be closed. If any errors occur, then an error message will be
+    displayed, the copy will be removed and a non-local exit will be made
+    to the address configured by @a jmp_if_error.
+
+    @param batch The batch, which must not be full.
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD. The batch keeps its own duplicate.
+    @param file The stream object of the file to be replaced.
+    @param file_name The name of the file. The batch keeps its own
+    copy.
+    @param temp_file The stream object of the cleaned copy.
+    @param temp_file_name The name of the cleaned copy, as returned by
+    #create_temp_file.
+    @param jmp_if_error Exception handling address.
+    @return Non-zero if the batch is now full. */
+extern int add_durable_file(
+    struct durable_batch *batch,
+    int dir_fd,
+    FILE *file,
+    const char *file_name,
+    FILE *temp_file,
+    const char *temp_file_name,
+    jmp_buf *jmp_if_error);
+
+/** Commits a batch. The data of every copy is flushed to disk first,
+    with one @c syncfs() per filesystem where the platform has it, and
+    then with @c fdatasync() on each copy, which reports the copy's own
+    write errors. Only then does each copy replace its file, after which
+    each directory involved is flushed once. A file that cannot be
+    replaced has an error reported about it and its @a failed member
+    set; the others are still replaced. The files are left in the batch
+    for the caller to inspect, until #clear_durable_batch.
+
+    @param batch The batch to commit. */
+extern void commit_durable_batch(struct durable_batch *batch);
+
+/** Empties a batch after it has been committed, releasing what it
+    holds.
+
+    @param batch The batch to empty. */
+extern void clear_durable_batch(struct durable_batch *batch);
+
+#endif /* !DURABLE_H */
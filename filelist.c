@@ -0,0 +1,991 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file filelist.c
+    Produces the names of the files to be processed in a batch run, one
+    at a time, walking any directories among them and reading names from
+    a file as they are needed.
+
+    Directories waiting to be read are kept on a stack. A thread that
+    wants a file and finds none waiting takes the directory on top of the
+    stack and reads a chunk of its entries without holding the list's
+    lock, so that several threads read different directories at once.
+    The regular files found are queued for the taking, and the
+    subdirectories are pushed on the stack, underneath the rest of the
+    directory they were found in. A directory is therefore finished
+    before its subdirectories are started, and a single thread only ever
+    has one directory open. Where the platform reports the type of each
+    entry as it is read, no entry needs to be examined with @c stat().
+
+    Each directory carries the state of the exclusion rules that apply
+    to it, so every entry is checked as it is read, and an excluded
+    subdirectory is dropped without ever being opened. The rules of a
+    directory's @c .gitignore file are read when the directory is
+    opened, and kept until the list is closed, since the states of its
+    subdirectories refer to them.
+
+    Names read from a file are taken one at a time, with the list's lock
+    held, once the names given on the command line have run out. Only
+    the name being read is held in memory, so a list of any length can
+    be streamed through a pipe. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include "filelist.h"
+#include "ignore.h"
+#include "options.h"
+#include "report.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Number of entries that a thread reads from a directory before it
+    hands the files found over. Files reach processing soon after they
+    are found, and few names are held in memory at once. */
+#define WALK_CHUNK 64
+
+/** Name of the file in a directory that lists what to exclude from it */
+#define GITIGNORE_FILE_NAME ".gitignore"
+
+/** Name of the repository directory that git itself never lists, and
+    which is passed over whenever @c .gitignore files are obeyed */
+#define GIT_DIR_NAME ".git"
+
+/** A directory waiting to be read */
+struct walk_dir
+{
+    /** Path of the directory, which prefixes the names found in it */
+    char *path;
+    /** Stream of the directory's entries, or @c NULL if it has not been
+        opened yet */
+    DIR *stream;
+    /** Set if the directory was named by the user, in which case a
+        symbolic link to it is followed */
+    int given;
+    /** Which of the directory's entries are excluded, or @c NULL if
+        none can be */
+    struct ignore_state *ignore;
+    /** Next directory on the stack */
+    struct walk_dir *next;
+};
+
+/** Rules read from a @c .gitignore file during a walk */
+struct walk_rules
+{
+    /** The rules */
+    struct ignore_rules *rules;
+    /** Rules read before these */
+    struct walk_rules *next;
+};
+
+/** Names of regular files read from a directory in one go */
+struct walk_chunk
+{
+    /** The names, each allocated with @c malloc() */
+    char *names[WALK_CHUNK];
+    /** Number of names in @a names */
+    size_t count;
+    /** Number of names already taken from the list */
+    size_t taken;
+    /** Next chunk in the queue */
+    struct walk_chunk *next;
+};
+
+/** What an entry of a directory is, as far as a walk is concerned */
+typedef enum
+{
+    WE_SKIP,    /**< Neither a regular file nor a directory */
+    WE_FILE,    /**< A regular file, to be processed */
+    WE_DIR      /**< A directory, to be walked */
+} walk_entry_t;
+
+struct file_list
+{
+    /** The next name given by the user that has not been taken yet */
+    const char *const *file_names;
+    /** Stream that further names are read from, or @c NULL once it
+        has been read to the end */
+    FILE *names_file;
+    /** Name of @a names_file, for error messages */
+    const char *names_file_name;
+    /** Number of names read from @a names_file so far */
+    unsigned long names_read;
+    /** Set if reading a name from @a names_file may have to wait */
+    int may_wait;
+    /** The name last read from @a names_file */
+    char *name_buf;
+    /** Size of the memory allocated for @a name_buf, in bytes */
+    size_t name_buf_size;
+    /** Set if directories given by the user are to be walked */
+    int recursive;
+    /** Rules for what to exclude from every walk, or @c NULL if there
+        are none */
+    struct ignore_rules *excludes;
+    /** Set if @c .gitignore files are to be obeyed during walks */
+    int gitignore;
+    /** Rules read from @c .gitignore files so far */
+    struct walk_rules *loaded;
+    /** Queue of files found in directories, oldest first */
+    struct walk_chunk *found_first;
+    /** Newest chunk in the queue of found files */
+    struct walk_chunk *found_last;
+    /** Stack of directories waiting to be read */
+    struct walk_dir *dirs;
+    /** Number of threads currently reading a directory */
+    unsigned long readers;
+#   ifdef HAVE_PTHREAD_H
+        /** Guards all of the above */
+        pthread_mutex_t lock;
+        /** Signalled when a thread finishes reading a directory */
+        pthread_cond_t read_done;
+#   endif /* HAVE_PTHREAD_H */
+};
+
+/** Locks a list against other threads.
+
+    @param list The list. */
+static void lock_list(struct file_list *list)
+{
+#   ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock(&list->lock);
+#   else
+        (void)list;
+#   endif /* HAVE_PTHREAD_H */
+}
+
+/** Unlocks a list locked with #lock_list.
+
+    @param list The list. */
+static void unlock_list(struct file_list *list)
+{
+#   ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock(&list->lock);
+#   else
+        (void)list;
+#   endif /* HAVE_PTHREAD_H */
+}
+
+struct file_list *open_file_list(
+    const char *const *file_names,
+    FILE *names_file,
+    const char *names_file_name,
+    int recursive,
+    struct ignore_rules *excludes,
+    int gitignore)
+{
+    /* list: The new list */
+    /* names_stat: Attributes of the stream of names */
+    struct file_list *list = malloc(sizeof(struct file_list));
+    struct stat names_stat;
+
+    if(!list)
+    {
+        free_ignore_rules(excludes);
+        return NULL;
+    }
+    list->file_names = file_names;
+    list->names_file = names_file;
+    list->names_file_name = names_file_name;
+    list->names_read = 0;
+    list->may_wait = names_file
+        && (fstat(fileno(names_file), &names_stat) != 0
+            || !S_ISREG(names_stat.st_mode));
+    list->name_buf = NULL;
+    list->name_buf_size = 0;
+    list->recursive = recursive;
+    list->excludes = excludes;
+    list->gitignore = gitignore;
+    list->loaded = NULL;
+    list->found_first = NULL;
+    list->found_last = NULL;
+    list->dirs = NULL;
+    list->readers = 0;
+#   ifdef HAVE_PTHREAD_H
+        pthread_mutex_init(&list->lock, NULL);
+        pthread_cond_init(&list->read_done, NULL);
+#   endif /* HAVE_PTHREAD_H */
+    return list;
+}
+
+int list_may_wait(const struct file_list *list)
+{
+    return list->may_wait;
+}
+
+/** Makes a copy of a string.
+
+    @param s The string.
+    @return The copy, allocated with @c malloc(), or @c NULL if there is
+    not enough memory. */
+static char *copy_string(const char *s)
+{
+    /* copy: The copy */
+    char *copy = malloc(strlen(s) + 1);
+
+    if(copy)
+    {
+        strcpy(copy, s);
+    }
+    return copy;
+}
+
+/** Joins the path of a directory and the name of an entry in it.
+
+    @param dir_path Path of the directory.
+    @param name Name of the entry.
+    @return The path of the entry, allocated with @c malloc(), or
+    @c NULL if there is not enough memory. */
+static char *join_path(const char *dir_path, const char *name)
+{
+    /* dir_len: Length of the directory's path */
+    /* slash: Set if a separator must be put between the two */
+    /* path: The joined path */
+    size_t dir_len = strlen(dir_path);
+    int slash = dir_len > 0 && dir_path[dir_len - 1] != '/';
+    char *path = malloc(dir_len + slash + strlen(name) + 1);
+
+    if(path)
+    {
+        memcpy(path, dir_path, dir_len);
+        path[dir_len] = '/';
+        strcpy(path + dir_len + slash, name);
+    }
+    return path;
+}
+
+/** Releases a directory taken off the stack.
+
+    @param dir The directory. */
+static void free_walk_dir(struct walk_dir *dir)
+{
+    if(dir->stream)
+    {
+        closedir(dir->stream);
+    }
+    free_ignore_state(dir->ignore);
+    free(dir->path);
+    free(dir);
+}
+
+/** Makes a record of a directory waiting to be read.
+
+    @param path Path of the directory, which becomes owned by the
+    record.
+    @param given Set if the user named the directory.
+    @param ignore Which of the directory's entries are excluded, or
+    @c NULL if none can be. This also becomes owned by the record.
+    @return The record, or @c NULL if there is not enough memory, in
+    which case @a path and @a ignore are released. */
+static struct walk_dir *new_walk_dir(
+    char *path,
+    int given,
+    struct ignore_state *ignore)
+{
+    /* dir: The new record */
+    struct walk_dir *dir = malloc(sizeof(struct walk_dir));
+
+    if(!dir)
+    {
+        free_ignore_state(ignore);
+        free(path);
+        return NULL;
+    }
+    dir->path = path;
+    dir->stream = NULL;
+    dir->given = given;
+    dir->ignore = ignore;
+    dir->next = NULL;
+    return dir;
+}
+
+/** Opens a directory for reading. A subdirectory found during a walk is
+    opened without following symbolic links, in case it has been
+    replaced by one since it was read.
+
+    @param dir The directory.
+    @return Zero on success, or an @c errno code. */
+static int open_walk_dir(struct walk_dir *dir)
+{
+#   ifdef HAVE_FDOPENDIR
+        /* fd: Descriptor of the directory */
+        int fd = open(dir->path,
+            O_RDONLY | O_DIRECTORY | (dir->given ? 0 : O_NOFOLLOW));
+
+        if(fd < 0)
+        {
+            return errno;
+        }
+        dir->stream = fdopendir(fd);
+        if(!dir->stream)
+        {
+            /* errnum: Why the directory could not be opened */
+            int errnum = errno;
+
+            close(fd);
+            return errnum;
+        }
+#   else
+        dir->stream = opendir(dir->path);
+        if(!dir->stream)
+        {
+            return errno;
+        }
+#   endif /* HAVE_FDOPENDIR */
+    return 0;
+}
+
+/** Reads the @c .gitignore file of a directory that has just been
+    opened, and adds its rules to the directory's state. A directory
+    without one, or whose file cannot be read, is left as it is.
+
+    @param dir The directory.
+    @param loaded Receives the rules read, or @c NULL if there were none.
+    @return Zero on success, or @c ENOMEM. */
+static int load_gitignore(struct walk_dir *dir, struct walk_rules **loaded)
+{
+    /* file: The .gitignore file */
+    /* rules: The rules read from it */
+    /* state: The directory's state with the rules added */
+    /* errnum: Result of reading the rules */
+    FILE *file;
+    struct walk_rules *rules;
+    struct ignore_state *state;
+    int errnum;
+#   ifdef HAVE_OPENAT
+        /* fd: Descriptor of the .gitignore file */
+        int fd;
+#   else
+        /* path: Path of the .gitignore file */
+        char *path;
+#   endif /* HAVE_OPENAT */
+
+    *loaded = NULL;
+#   ifdef HAVE_OPENAT
+        fd = openat(dirfd(dir->stream), GITIGNORE_FILE_NAME,
+            O_RDONLY | O_NOFOLLOW);
+        file = (fd < 0) ? NULL : fdopen(fd, "r");
+        if(fd >= 0 && !file)
+        {
+            errnum = errno;
+            close(fd);
+            errno = errnum;
+        }
+#   else
+        path = join_path(dir->path, GITIGNORE_FILE_NAME);
+        if(!path)
+        {
+            return ENOMEM;
+        }
+        file = fopen(path, "r");
+        free(path);
+#   endif /* HAVE_OPENAT */
+    if(!file)
+    {
+        return (errno == ENOMEM) ? ENOMEM : 0;
+    }
+
+    rules = malloc(sizeof(struct walk_rules));
+    if(!rules || !(rules->rules = new_ignore_rules()))
+    {
+        free(rules);
+        fclose(file);
+        return ENOMEM;
+    }
+    errnum = read_ignore_rules(rules->rules, file);
+    fclose(file);
+    if(errnum || ignore_rules_empty(rules->rules))
+    {
+        free_ignore_rules(rules->rules);
+        free(rules);
+        return (errnum == ENOMEM) ? ENOMEM : 0;
+    }
+    state = push_ignore_rules(dir->ignore, rules->rules);
+    if(!state)
+    {
+        free_ignore_rules(rules->rules);
+        free(rules);
+        return ENOMEM;
+    }
+    free_ignore_state(dir->ignore);
+    dir->ignore = state;
+    *loaded = rules;
+    return 0;
+}
+
+/** Works out what an entry of a directory is. The type read along with
+    the entry is used where the platform provides one; otherwise, or if
+    the filesystem did not supply it, the entry is examined without
+    following it if it is a symbolic link.
+
+    @param dir The directory being read.
+    @param entry The entry.
+    @param path Path of the entry.
+    @return What the entry is. */
+static walk_entry_t walk_entry_type(
+    const struct walk_dir *dir,
+    const struct dirent *entry,
+    const char *path)
+{
+    /* entry_stat: Attributes of the entry */
+    /* res: Result of examining the entry */
+    struct stat entry_stat;
+    int res;
+
+#   ifdef HAVE_STRUCT_DIRENT_D_TYPE
+        switch(entry->d_type)
+        {
+            case DT_REG:
+                return WE_FILE;
+            case DT_DIR:
+                return WE_DIR;
+            case DT_UNKNOWN:
+                break;
+            default:
+                return WE_SKIP;
+        }
+#   endif /* HAVE_STRUCT_DIRENT_D_TYPE */
+
+#   ifdef HAVE_OPENAT
+        res = fstatat(dirfd(dir->stream), entry->d_name, &entry_stat,
+            AT_SYMLINK_NOFOLLOW);
+        (void)path;
+#   else
+        res = lstat(path, &entry_stat);
+        (void)dir;
+        (void)entry;
+#   endif /* HAVE_OPENAT */
+    if(res != 0)
+    {
+        /* The entry has gone since it was read */
+        return WE_SKIP;
+    }
+    if(S_ISREG(entry_stat.st_mode))
+    {
+        return WE_FILE;
+    }
+    return S_ISDIR(entry_stat.st_mode) ? WE_DIR : WE_SKIP;
+}
+
+/** Reads the next chunk of entries from a directory. This is done
+    without the list's lock held.
+
+    @param dir The directory, which is opened first if need be and
+    closed once every entry has been read.
+    @param gitignore Set if the directory's @c .gitignore file is to be
+    read when it is opened, and @c .git entries passed over.
+    @param loaded Receives the rules read from the @c .gitignore file,
+    or @c NULL if none were. Must point to @c NULL beforehand.
+    @param chunk Receives the names of the regular files found. Its @a
+    count must be zero beforehand.
+    @param subdirs Receives the subdirectories found, which are chained
+    together. Must point to @c NULL beforehand.
+    @param finished Set if every entry has now been read.
+    @return Zero on success, or an @c errno code. Whatever was found
+    before the error is still returned. */
+static int read_walk_dir(
+    struct walk_dir *dir,
+    int gitignore,
+    struct walk_rules **loaded,
+    struct walk_chunk *chunk,
+    struct walk_dir **subdirs,
+    int *finished)
+{
+    /* entries: Number of entries read so far */
+    /* errnum: Why the directory could not be read */
+    size_t entries;
+    int errnum;
+
+    *finished = FALSE;
+    if(!dir->stream)
+    {
+        errnum = open_walk_dir(dir);
+        if(!errnum && gitignore)
+        {
+            errnum = load_gitignore(dir, loaded);
+        }
+        if(errnum)
+        {
+            return errnum;
+        }
+    }
+    for(entries = 0; entries < WALK_CHUNK; entries++)
+    {
+        /* entry: The entry just read */
+        /* path: Path of the entry */
+        /* type: What the entry is */
+        struct dirent *entry;
+        char *path;
+        walk_entry_t type;
+
+        errno = 0;
+        entry = readdir(dir->stream);
+        if(!entry)
+        {
+            errnum = errno;
+            closedir(dir->stream);
+            dir->stream = NULL;
+            *finished = TRUE;
+            return errnum;
+        }
+        if(strcmp(entry->d_name, ".") == 0
+            || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+        path = join_path(dir->path, entry->d_name);
+        if(!path)
+        {
+            return ENOMEM;
+        }
+        type = walk_entry_type(dir, entry, path);
+        if(type != WE_SKIP
+            && ((gitignore && strcmp(entry->d_name, GIT_DIR_NAME) == 0)
+                || (dir->ignore && is_ignored(dir->ignore, entry->d_name,
+                    type == WE_DIR))))
+        {
+            type = WE_SKIP;
+        }
+        switch(type)
+        {
+            case WE_FILE:
+                chunk->names[chunk->count++] = path;
+                break;
+            case WE_DIR:
+                {
+                    /* ignore: Which of the subdirectory's entries are
+                       excluded */
+                    /* subdir: The subdirectory found */
+                    struct ignore_state *ignore = NULL;
+                    struct walk_dir *subdir;
+
+                    if(dir->ignore)
+                    {
+                        ignore = enter_ignore_dir(dir->ignore,
+                            entry->d_name);
+                        if(!ignore)
+                        {
+                            free(path);
+                            return ENOMEM;
+                        }
+                    }
+                    subdir = new_walk_dir(path, FALSE, ignore);
+                    if(!subdir)
+                    {
+                        return ENOMEM;
+                    }
+                    subdir->next = *subdirs;
+                    *subdirs = subdir;
+                }
+                break;
+            default:
+                free(path);
+                break;
+        }
+    }
+    return 0;
+}
+
+/** Takes the oldest name from the queue of files found in directories.
+    The list must be locked, and the queue must not be empty.
+
+    @param list The list.
+    @return The name. */
+static char *take_found(struct file_list *list)
+{
+    /* chunk: The oldest chunk in the queue */
+    /* name: The name taken */
+    struct walk_chunk *chunk = list->found_first;
+    char *name = chunk->names[chunk->taken++];
+
+    if(chunk->taken == chunk->count)
+    {
+        list->found_first = chunk->next;
+        if(!list->found_first)
+        {
+            list->found_last = NULL;
+        }
+        free(chunk);
+    }
+    return name;
+}
+
+/** Reads a chunk of the directory on top of a list's stack and files
+    away what is found. The list must be locked, and is unlocked while
+    the directory is read.
+
+    @param list The list.
+    @param failed_dir Receives the directory if it could not be read.
+    @return Zero on success, or an @c errno code, in which case the
+    directory has been taken off the stack and must be released by the
+    caller. */
+static int read_top_dir(struct file_list *list, struct walk_dir **failed_dir)
+{
+    /* dir: The directory being read */
+    /* chunk: Receives the files found */
+    /* subdirs: Receives the subdirectories found */
+    /* loaded: Receives the rules read from the directory's .gitignore */
+    /* finished: Set if the directory has been read to the end */
+    /* errnum: Why the directory could not be read */
+    struct walk_dir *dir = list->dirs;
+    struct walk_chunk *chunk = malloc(sizeof(struct walk_chunk));
+    struct walk_dir *subdirs = NULL;
+    struct walk_rules *loaded = NULL;
+    int finished = TRUE;
+    int errnum = ENOMEM;
+
+    list->dirs = dir->next;
+    list->readers++;
+    unlock_list(list);
+    if(chunk)
+    {
+        chunk->count = 0;
+        chunk->taken = 0;
+        chunk->next = NULL;
+        errnum = read_walk_dir(dir, list->gitignore, &loaded, chunk,
+            &subdirs, &finished);
+    }
+    lock_list(list);
+    list->readers--;
+
+    if(loaded)
+    {
+        loaded->next = list->loaded;
+        list->loaded = loaded;
+    }
+    /* The subdirectories go underneath the rest of their directory */
+    while(subdirs)
+    {
+        /* subdir: The subdirectory being pushed on the stack */
+        struct walk_dir *subdir = subdirs;
+
+        subdirs = subdir->next;
+        subdir->next = list->dirs;
+        list->dirs = subdir;
+    }
+    if(chunk && chunk->count > 0)
+    {
+        if(list->found_last)
+        {
+            list->found_last->next = chunk;
+        }
+        else
+        {
+            list->found_first = chunk;
+        }
+        list->found_last = chunk;
+    }
+    else
+    {
+        free(chunk);
+    }
+    if(errnum)
+    {
+        *failed_dir = dir;
+    }
+    else if(finished)
+    {
+        free_walk_dir(dir);
+    }
+    else
+    {
+        dir->next = list->dirs;
+        list->dirs = dir;
+    }
+#   ifdef HAVE_PTHREAD_H
+        pthread_cond_broadcast(&list->read_done);
+#   endif /* HAVE_PTHREAD_H */
+    return errnum;
+}
+
+/** Checks whether a name given by the user refers to a directory,
+    following symbolic links.
+
+    @param name The name.
+    @return Non-zero if it is a directory. */
+static int is_directory(const char *name)
+{
+    /* name_stat: Attributes of what the name refers to */
+    struct stat name_stat;
+
+    return strcmp(name, STDIN_FILE_NAME) != 0
+        && stat(name, &name_stat) == 0
+        && S_ISDIR(name_stat.st_mode);
+}
+
+/** Unlocks a list and makes a non-local exit, after an error has been
+    reported.
+
+    @param list The list, which must be locked.
+    @param jmp_if_error Exception handling address. */
+static void leave_list(struct file_list *list, jmp_buf *jmp_if_error)
+{
+    unlock_list(list);
+    longjmp(*jmp_if_error, TRUE);
+}
+
+/** Reads a list's stream up to the next null character, or to its end.
+    The list must be locked.
+
+    @param list The list.
+    @return The number of characters read, including the null character
+    if there was one, or zero at the end of the stream. A null character
+    is stored after those read in either case. The stream's error
+    indicator is set if it could not be read. */
+static size_t read_to_null(struct file_list *list)
+{
+#   ifdef HAVE_GETDELIM
+        /* res: Result of the read */
+        ssize_t res = getdelim(&list->name_buf, &list->name_buf_size, '\0',
+            list->names_file);
+
+        return (res > 0) ? (size_t)res : 0;
+#   else
+        /* len: Number of characters read */
+        size_t len = 0;
+
+        for(;;)
+        {
+            /* c: The character just read */
+            int c;
+
+            if(len + 1 >= list->name_buf_size)
+            {
+                /* new_size: Size of the enlarged buffer */
+                /* new_buf: The enlarged buffer */
+                size_t new_size = list->name_buf_size
+                    ? 2 * list->name_buf_size
+                    : 256;
+                char *new_buf = realloc(list->name_buf, new_size);
+
+                if(!new_buf)
+                {
+                    errno = ENOMEM;
+                    return 0;
+                }
+                list->name_buf = new_buf;
+                list->name_buf_size = new_size;
+            }
+            c = getc(list->names_file);
+            if(c == EOF)
+            {
+                break;
+            }
+            list->name_buf[len++] = (char)c;
+            if(c == '\0')
+            {
+                return len;
+            }
+        }
+        list->name_buf[len] = '\0';
+        return len;
+#   endif /* HAVE_GETDELIM */
+}
+
+/** Reads the next name from a list's stream. The list must be locked.
+    If the stream cannot be read, or the name is invalid, then an error
+    message will be displayed and a non-local exit will be made to the
+    address configured by @a jmp_if_error, with the list unlocked.
+
+    @param list The list.
+    @param jmp_if_error Exception handling address.
+    @return The name, which is overwritten by the next one, or @c NULL
+    at the end of the stream. */
+static const char *read_stream_name(
+    struct file_list *list,
+    jmp_buf *jmp_if_error)
+{
+    errno = 0;
+    if(read_to_null(list) == 0)
+    {
+        /* errnum: Why the stream could not be read, if it couldn't */
+        int errnum = errno;
+
+        if(ferror(list->names_file) || errnum == ENOMEM)
+        {
+            list->names_file = NULL;
+            report_error(errnum, "%s", list->names_file_name);
+            leave_list(list, jmp_if_error);
+        }
+        list->names_file = NULL;
+        return NULL;
+    }
+    list->names_read++;
+    if(list->name_buf[0] == '\0')
+    {
+        report_error(0, "%s:%lu: invalid zero-length file name",
+            list->names_file_name, list->names_read);
+        leave_list(list, jmp_if_error);
+    }
+    if(list->names_file == stdin
+        && strcmp(list->name_buf, STDIN_FILE_NAME) == 0)
+    {
+        report_error(0, "%s:%lu: file name `%s' is not allowed when names "
+            "are read from standard input",
+            list->names_file_name, list->names_read, STDIN_FILE_NAME);
+        leave_list(list, jmp_if_error);
+    }
+    return list->name_buf;
+}
+
+char *next_list_file(struct file_list *list, jmp_buf *jmp_if_error)
+{
+    /* name: The name handed out */
+    char *name = NULL;
+
+    lock_list(list);
+    for(;;)
+    {
+        /* given: The next name given by the user */
+        const char *given;
+
+        if(list->found_first)
+        {
+            name = take_found(list);
+            break;
+        }
+        if(list->dirs)
+        {
+            /* failed_dir: The directory that could not be read */
+            /* errnum: Why it could not be read */
+            struct walk_dir *failed_dir;
+            int errnum = read_top_dir(list, &failed_dir);
+
+            if(errnum)
+            {
+                report_error(errnum, "%s", failed_dir->path);
+                free_walk_dir(failed_dir);
+                leave_list(list, jmp_if_error);
+            }
+            continue;
+        }
+
+        if(*list->file_names)
+        {
+            given = *list->file_names++;
+        }
+        else if(list->names_file)
+        {
+            given = read_stream_name(list, jmp_if_error);
+            if(!given)
+            {
+                continue;
+            }
+        }
+        else if(list->readers == 0)
+        {
+            /* Every file has been taken */
+            break;
+        }
+        else
+        {
+            /* Another thread may yet find more files */
+#           ifdef HAVE_PTHREAD_H
+                pthread_cond_wait(&list->read_done, &list->lock);
+#           endif /* HAVE_PTHREAD_H */
+            continue;
+        }
+
+        name = copy_string(given);
+        if(name && list->recursive && is_directory(given))
+        {
+            /* ignore: What is excluded from the walk, if anything can be */
+            /* dir: The directory to be walked */
+            struct ignore_state *ignore = NULL;
+            struct walk_dir *dir = NULL;
+
+            if(list->excludes || list->gitignore)
+            {
+                ignore = new_ignore_state(list->excludes);
+                if(!ignore)
+                {
+                    free(name);
+                    name = NULL;
+                }
+            }
+            if(name)
+            {
+                dir = new_walk_dir(name, TRUE, ignore);
+            }
+            name = NULL;
+            if(dir)
+            {
+                dir->next = list->dirs;
+                list->dirs = dir;
+                continue;
+            }
+        }
+        if(!name)
+        {
+            report_error(ENOMEM, "%s", given);
+            leave_list(list, jmp_if_error);
+        }
+        break;
+    }
+    unlock_list(list);
+    return name;
+}
+
+void close_file_list(struct file_list *list)
+{
+    while(list->found_first)
+    {
+        free(take_found(list));
+    }
+    while(list->dirs)
+    {
+        /* dir: The directory being released */
+        struct walk_dir *dir = list->dirs;
+
+        list->dirs = dir->next;
+        free_walk_dir(dir);
+    }
+    while(list->loaded)
+    {
+        /* rules: The rules being released */
+        struct walk_rules *rules = list->loaded;
+
+        list->loaded = rules->next;
+        free_ignore_rules(rules->rules);
+        free(rules);
+    }
+    free_ignore_rules(list->excludes);
+    free(list->name_buf);
+#   ifdef HAVE_PTHREAD_H
+        pthread_cond_destroy(&list->read_done);
+        pthread_mutex_destroy(&list->lock);
+#   endif /* HAVE_PTHREAD_H */
+    free(list);
+}
@@ -0,0 +1,95 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file filelist.h
+    Produces the names of the files to be processed in a batch run, one
+    at a time, walking any directories among them and reading names from
+    a file as they are needed. */
+
+#ifndef FILELIST_H
+#define FILELIST_H
+
+#include <stdio.h>
+#include <setjmp.h>
+
+struct file_list;
+struct ignore_rules;
+
+/** Opens a list of files.
+
+    @param file_names The names given by the user. The array must be
+    terminated with a @c NULL element, and must remain valid until the
+    list is closed.
+    @param names_file A stream of further names, each terminated by a
+    null character, which are read as they are needed once the names in
+    @a file_names have been taken; or @c NULL if there are none. The
+    stream must remain open until the list is closed. If it is @c stdin,
+    then @c "-" may not appear among the names read from it.
+    @param names_file_name Name of @a names_file, for error messages.
+    @param recursive If non-zero, then a name that refers to a directory
+    stands for every regular file within it and its subdirectories.
+    Symbolic links found inside a directory are not followed.
+    @param excludes Rules for what to leave out when walking a
+    directory, anchored to each directory given, or @c NULL if there are
+    none. An excluded subdirectory is not read at all. Names that are
+    given, rather than found, are never excluded. The rules become owned
+    by the list, and are released along with it, or straight away if
+    the list cannot be opened.
+    @param gitignore If non-zero, then the rules in the @c .gitignore
+    file of each directory walked also apply, to it and to everything
+    below it, and @c .git entries are left out. Rules in deeper
+    directories take precedence over those further up, while @a excludes
+    takes precedence over both.
+    @return The list, or @c NULL if there is not enough memory. */
+extern struct file_list *open_file_list(
+    const char *const *file_names,
+    FILE *names_file,
+    const char *names_file_name,
+    int recursive,
+    struct ignore_rules *excludes,
+    int gitignore);
+
+/** Checks whether taking a file from a list may have to wait for its
+    name to arrive, as is the case when names are read from a pipe or a
+    terminal. Names are then best taken only when they are needed.
+
+    @param list The list.
+    @return Non-zero if taking a file may wait. */
+extern int list_may_wait(const struct file_list *list);
+
+/** Takes the next file from a list. Directories are read a little at a
+    time as files are taken, so processing can start on the first file
+    found straight away. Several threads may take files from the same
+    list at once; each file is handed out once, and threads that find no
+    file waiting read different directories at the same time. If a
+    directory cannot be read, or a name read from the list's stream is
+    invalid, then an error message will be displayed and a non-local exit
+    will be made to the address configured by @a jmp_if_error; the next
+    call carries on with the rest of the list. A read error on the
+    stream is reported in the same way, and ends the stream.
+
+    @param list The list.
+    @param jmp_if_error Exception handling address.
+    @return The name of the file, which the caller must release with
+    @c free(), or @c NULL once every file has been taken. */
+extern char *next_list_file(struct file_list *list, jmp_buf *jmp_if_error);
+
+/** Closes a list, releasing everything it holds.
+
+    @param list The list to close. */
+extern void close_file_list(struct file_list *list);
+
+#endif /* !FILELIST_H */
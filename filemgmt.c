@@ -28,19 +28,15 @@
 #include <limits.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
-#ifdef HAVE_ERROR_H
-#   include <error.h>
-#else
-#   include <compat/error.h>
-#endif /* HAVE_ERROR_H */
-
 #ifdef HAVE_LIBGEN_H
 #include <libgen.h> /* for basename() */
 #endif /* HAVE_LIBGEN_H */
 
 #include "filemgmt.h"
+#include "report.h"
 
 /** Definition for boolean constant @e false */
 #define FALSE 0
@@ -48,6 +44,161 @@
 /** Definition for boolean constant @e true */
 #define TRUE (!FALSE)
 
+#if defined(HAVE_OPENAT) || defined(HAVE_LINKAT)
+
+/** Finds the length of the directory part of a file name, in an
+    OS-neutral manner, as #create_temp_file does.
+
+    @param file_name The file name.
+    @return The length, or @c (size_t)-1 if the name does not split
+    cleanly into a directory part and a base name. */
+static size_t dir_name_length(const char *file_name)
+{
+    /* scratch: Copy of file_name for basename() to work on */
+    /* base_name: Base name of file_name */
+    /* dir_len: Length of the directory part of file_name */
+    char scratch[PATH_MAX];
+    const char *base_name;
+    size_t dir_len;
+
+    if(strlen(file_name) >= PATH_MAX)
+    {
+        return (size_t)-1;
+    }
+    strcpy(scratch, file_name);
+    base_name = basename(scratch);
+    if(strlen(base_name) > strlen(file_name))
+    {
+        return (size_t)-1;
+    }
+    dir_len = strlen(file_name) - strlen(base_name);
+    return (strcmp(file_name + dir_len, base_name) == 0)
+        ? dir_len
+        : (size_t)-1;
+}
+
+/** Finds the name of a file relative to a directory descriptor.
+
+    @param dir_fd Descriptor of the file's directory, or #NO_DIR_FD.
+    @param file_name The full name of the file.
+    @return The name of the file relative to @a dir_fd. */
+static const char *file_name_in_dir(int dir_fd, const char *file_name)
+{
+    /* dir_len: Length of the directory part of file_name */
+    size_t dir_len = dir_name_length(file_name);
+
+    return (dir_fd == NO_DIR_FD || dir_len == (size_t)-1)
+        ? file_name
+        : file_name + dir_len;
+}
+
+/** Converts a directory descriptor to the form taken by @c openat() and
+    its relatives */
+#define AT_DIR(dir_fd) (((dir_fd) == NO_DIR_FD) ? AT_FDCWD : (dir_fd))
+
+#endif /* HAVE_OPENAT || HAVE_LINKAT */
+
+/** Renames a file within a directory.
+
+    @param dir_fd Descriptor of the directory, or #NO_DIR_FD.
+    @param old_name Full name of the file.
+    @param new_name Full new name of the file, in the same directory.
+    @return Zero on success, or -1 on failure. */
+static int rename_in_dir(int dir_fd, const char *old_name, const char *new_name)
+{
+#   ifdef HAVE_OPENAT
+        return renameat(AT_DIR(dir_fd), file_name_in_dir(dir_fd, old_name),
+            AT_DIR(dir_fd), file_name_in_dir(dir_fd, new_name));
+#   else
+        (void)dir_fd;
+        return rename(old_name, new_name);
+#   endif /* HAVE_OPENAT */
+}
+
+void init_file_dir(struct file_dir *dir)
+{
+    dir->fd = NO_DIR_FD;
+    dir->name[0] = 0;
+}
+
+int enter_file_dir(struct file_dir *dir, const char *file_name)
+{
+#   ifdef HAVE_OPENAT
+        /* dir_len: Length of the directory part of file_name */
+        /* flags: Flags for open() */
+        size_t dir_len = dir_name_length(file_name);
+        int flags = O_RDONLY;
+
+        if(dir->fd != NO_DIR_FD && dir_len == strlen(dir->name)
+            && memcmp(dir->name, file_name, dir_len) == 0)
+        {
+            return dir->fd;
+        }
+        close_file_dir(dir);
+        if(dir_len == (size_t)-1)
+        {
+            return NO_DIR_FD;
+        }
+        memcpy(dir->name, file_name, dir_len);
+        dir->name[dir_len] = 0;
+#       ifdef O_DIRECTORY
+            flags |= O_DIRECTORY;
+#       endif /* O_DIRECTORY */
+        dir->fd = open(dir_len > 0 ? dir->name : ".", flags);
+        if(dir->fd < 0)
+        {
+            dir->fd = NO_DIR_FD;
+        }
+        return dir->fd;
+#   else
+        (void)dir;
+        (void)file_name;
+        return NO_DIR_FD;
+#   endif /* HAVE_OPENAT */
+}
+
+void close_file_dir(struct file_dir *dir)
+{
+    if(dir->fd != NO_DIR_FD)
+    {
+        close(dir->fd);
+    }
+    init_file_dir(dir);
+}
+
+int open_in_dir(int dir_fd, const char *file_name, int flags)
+{
+#   ifdef HAVE_OPENAT
+        return openat(AT_DIR(dir_fd), file_name_in_dir(dir_fd, file_name),
+            flags);
+#   else
+        (void)dir_fd;
+        return open(file_name, flags);
+#   endif /* HAVE_OPENAT */
+}
+
+int create_in_dir(int dir_fd, const char *file_name, int flags)
+{
+#   ifdef HAVE_OPENAT
+        return openat(AT_DIR(dir_fd), file_name_in_dir(dir_fd, file_name),
+            flags | O_CREAT | O_EXCL, 0600);
+#   else
+        (void)dir_fd;
+        return open(file_name, flags | O_CREAT | O_EXCL, 0600);
+#   endif /* HAVE_OPENAT */
+}
+
+int unlink_in_dir(int dir_fd, const char *file_name)
+{
+#   ifdef HAVE_OPENAT
+        return unlinkat(AT_DIR(dir_fd), file_name_in_dir(dir_fd, file_name),
+            0);
+#   else
+        (void)dir_fd;
+        return unlink(file_name);
+#   endif /* HAVE_OPENAT */
+}
+
 void open_file(
     const char *file_name,
     const char *file_mode,
@@ -57,12 +208,139 @@ void open_file(
     *file = fopen(file_name, file_mode);
     if(!*file)
     {
-        error(0, errno, "%s", file_name);
+        report_error(errno, "%s", file_name);
+        longjmp(*jmp_if_error, TRUE);
+    }
+}
+
+void open_input_file(
+    int dir_fd,
+    const char *file_name,
+    const char *file_mode,
+    FILE **file,
+    jmp_buf *jmp_if_error)
+{
+    /* flags: Flags for open() */
+    /* fd: File descriptor of the file */
+    int flags = O_RDONLY;
+    int fd;
+
+#   ifdef O_NOATIME
+        /* Reading the file need not cost a write of its access time */
+        flags |= O_NOATIME;
+#   endif /* O_NOATIME */
+    fd = open_in_dir(dir_fd, file_name, flags);
+#   ifdef O_NOATIME
+        if(fd < 0 && errno == EPERM)
+        {
+            /* Only the file's owner may leave the access time alone */
+            fd = open_in_dir(dir_fd, file_name, flags & ~O_NOATIME);
+        }
+#   endif /* O_NOATIME */
+    *file = (fd >= 0) ? fdopen(fd, file_mode) : NULL;
+    if(!*file)
+    {
+        report_error(errno, "%s", file_name);
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        longjmp(*jmp_if_error, TRUE);
+    }
+}
+
+#if defined(O_TMPFILE) && defined(HAVE_LINKAT)
+
+/** Name under which the kernel shows the open file descriptors of the
+    calling process */
+#define PROC_FD_DIR "/proc/self/fd"
+
+/** Creates a file without a name in a directory. It can be given a
+    name later with @c linkat(), which needs #PROC_FD_DIR.
+
+    @param dir_fd Descriptor of the directory, or #NO_DIR_FD.
+    @param dir_name Name of the directory, which is empty for the current
+    directory or otherwise ends in a directory separator.
+    @return The file descriptor of the new file, or -1 if one could not
+    be created this way. */
+static int create_unnamed_file(int dir_fd, const char *dir_name)
+{
+    if(access(PROC_FD_DIR, X_OK) < 0)
+    {
+        return -1;
+    }
+    if(dir_fd != NO_DIR_FD)
+    {
+        return openat(dir_fd, ".", O_TMPFILE | O_RDWR, 0600);
+    }
+    return open(*dir_name ? dir_name : ".", O_TMPFILE | O_RDWR, 0600);
+}
+
+/** Gives a file created by #create_unnamed_file the name of a target
+    file, replacing it. Linux cannot link a file over an existing name,
+    so the file is first linked under a hidden name beside the target
+    and then renamed over it at once. If any errors occur, then an error
+    message will be displayed and a non-local exit will be made to the
+    address configured by @a jmp_if_error; the file is left without a
+    name.
+
+    @param dir_fd Descriptor of the target file's directory, or
+    #NO_DIR_FD.
+    @param fd File descriptor of the file.
+    @param target_file_name The name of the file to be replaced.
+    @param jmp_if_error Exception handling address. */
+static void link_unnamed_file(
+    int dir_fd,
+    int fd,
+    const char *target_file_name,
+    jmp_buf *jmp_if_error)
+{
+    /* proc_name: Name of the file under PROC_FD_DIR */
+    /* link_name: Hidden name the file is first linked under */
+    /* dir_len: Length of the directory part of target_file_name */
+    /* attempt: Number of hidden names tried so far */
+    char proc_name[sizeof(PROC_FD_DIR) + 32];
+    char link_name[PATH_MAX];
+    size_t dir_len = dir_name_length(target_file_name);
+    int attempt;
+
+    if(dir_len == (size_t)-1 || strlen(target_file_name) + 64 > PATH_MAX)
+    {
+        report_error(ENAMETOOLONG, "%s", target_file_name);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    sprintf(proc_name, "%s/%d", PROC_FD_DIR, fd);
+
+    /* The descriptor is unique within this process while it is open,
+       so with the process ID it keeps concurrent workers apart. */
+    for(attempt = 0; ; attempt++)
+    {
+        memcpy(link_name, target_file_name, dir_len);
+        sprintf(link_name + dir_len, ".cleantxt-%ld-%d-%d",
+            (long)getpid(), fd, attempt);
+        if(linkat(AT_FDCWD, proc_name, AT_DIR(dir_fd),
+            file_name_in_dir(dir_fd, link_name), AT_SYMLINK_FOLLOW) == 0)
+        {
+            break;
+        }
+        if(errno != EEXIST || attempt >= 100)
+        {
+            report_error(errno, "%s", target_file_name);
+            longjmp(*jmp_if_error, TRUE);
+        }
+    }
+    if(rename_in_dir(dir_fd, link_name, target_file_name) < 0)
+    {
+        report_error(errno, "%s", target_file_name);
+        unlinkat(AT_DIR(dir_fd), file_name_in_dir(dir_fd, link_name), 0);
         longjmp(*jmp_if_error, TRUE);
     }
 }
 
+#endif /* O_TMPFILE && HAVE_LINKAT */
+
 void create_temp_file(
+    int dir_fd,
     const char *input_file_name,
     const char *temp_file_mode,
     char *temp_file_name,
@@ -90,14 +368,30 @@ void create_temp_file(
     strncpy(input_file_base_name, basename(temp_file_name), PATH_MAX - 1);
     input_file_base_name[PATH_MAX - 1] = 0;
     strncpy(temp_file_name, input_file_name, PATH_MAX - 1);
-    strcpy(temp_file_name + strlen(input_file_name)
-        - strlen(input_file_base_name), "XXXXXX");
+    temp_file_name[strlen(input_file_name)
+        - strlen(input_file_base_name)] = 0;
+
+#   if defined(O_TMPFILE) && defined(HAVE_LINKAT)
+        /* Where the filesystem allows it, create the file without a
+           name, so that nothing else sees it and nothing is left
+           behind if we are interrupted. */
+        temp_fd = create_unnamed_file(dir_fd, temp_file_name);
+        if(temp_fd >= 0)
+        {
+            temp_file_name[0] = 0;
+            *temp_file = fdopen(temp_fd, temp_file_mode);
+            return;
+        }
+#   else
+        (void)dir_fd;
+#   endif /* O_TMPFILE && HAVE_LINKAT */
 
     /* Create the temporary file */
+    strcat(temp_file_name, "XXXXXX");
     temp_fd = mkstemp(temp_file_name);
     if(temp_fd < 0)
     {
-        error(0, errno, "unable to create temporary file `%s'", temp_file_name);
+        report_error(errno, "unable to create temporary file `%s'", temp_file_name);
         longjmp(*jmp_if_error, TRUE);
     }
     *temp_file = fdopen(temp_fd, temp_file_mode);
@@ -110,7 +404,7 @@ void close_file(
 {
     if(file != stdin && file != stdout && fclose(file) < 0)
     {
-        error(0, errno, "unable to close file `%s'", file_name);
+        report_error(errno, "unable to close file `%s'", file_name);
         longjmp(*jmp_if_error, TRUE);
     }
 }
@@ -119,14 +413,19 @@ void remove_file(const char *file_name, jmp_buf *jmp_if_error)
 {
     if(remove(file_name) < 0)
     {
-        error(0, errno, "unable to remove file `%s'", file_name);
+        report_error(errno, "unable to remove file `%s'", file_name);
         longjmp(*jmp_if_error, TRUE);
     }
 }
 
 void close_remove_file(FILE *file, const char *file_name, jmp_buf *jmp_if_error)
 {
-    if(file != stdin && file != stdout)
+    if(file != stdin && file != stdout && !*file_name)
+    {
+        /* The file has no name, so closing it discards it */
+        fclose(file);
+    }
+    else if(file != stdin && file != stdout)
     {
         close_file(file, file_name, jmp_if_error);
         remove_file(file_name, jmp_if_error);
@@ -146,7 +445,10 @@ void close_file_guarantee_complete_or_remove(
                usually means flushing the userspace buffer caused an I/O
                error and the contents are incomplete. Remove the file
                and report an error condition. */
-            remove_file(file_name, jmp_if_error);
+            if(*file_name)
+            {
+                remove_file(file_name, jmp_if_error);
+            }
             longjmp(*jmp_if_error, TRUE);
             /* Non-local return */
         }
@@ -174,8 +476,202 @@ void replace_file(
        to avoid security exploits in publicly-writable directories. */
     if(rename(source_file_name, target_file_name) < 0)
     {
-        error(0, errno, "%s", target_file_name);
+        report_error(errno, "%s", target_file_name);
         remove_file(source_file_name, jmp_if_error);
         longjmp(*jmp_if_error, TRUE);
     }
 }
+
+void copy_file_attributes(FILE *from_file, FILE *to_file)
+{
+    /* from_file_stat: Attributes of from_file */
+    struct stat from_file_stat;
+
+    /* Work through the descriptors, so that neither name has to be
+       looked up again. Ignore any errors, as replace_file() does. */
+    if(fstat(fileno(from_file), &from_file_stat) == 0)
+    {
+        fchmod(fileno(to_file), from_file_stat.st_mode);
+        fchown(fileno(to_file), from_file_stat.st_uid, from_file_stat.st_gid);
+    }
+}
+
+void commit_temp_file(
+    int dir_fd,
+    FILE *target_file,
+    const char *target_file_name,
+    FILE *temp_file,
+    const char *temp_file_name,
+    jmp_buf *jmp_if_error)
+{
+    if(target_file)
+    {
+        copy_file_attributes(target_file, temp_file);
+    }
+
+    if(*temp_file_name)
+    {
+        close_file_guarantee_complete_or_remove(
+            temp_file, temp_file_name, jmp_if_error);
+        if(rename_in_dir(dir_fd, temp_file_name, target_file_name) < 0)
+        {
+            report_error(errno, "%s", target_file_name);
+            remove_file(temp_file_name, jmp_if_error);
+            longjmp(*jmp_if_error, TRUE);
+        }
+        return;
+    }
+
+#   if defined(O_TMPFILE) && defined(HAVE_LINKAT)
+    {
+        /* on_link_error: Handler for errors in link_unnamed_file() */
+        jmp_buf on_link_error;
+
+        /* The contents must be complete before the file is given a
+           name. */
+        if(fflush(temp_file) != 0)
+        {
+            report_error(errno, "%s", target_file_name);
+            fclose(temp_file);
+            longjmp(*jmp_if_error, TRUE);
+        }
+        if(setjmp(on_link_error))
+        {
+            /* Closing the file discards it */
+            fclose(temp_file);
+            longjmp(*jmp_if_error, TRUE);
+            /* Non-local return */
+        }
+        link_unnamed_file(dir_fd, fileno(temp_file), target_file_name,
+            &on_link_error);
+        close_file(temp_file, target_file_name, jmp_if_error);
+    }
+#   endif /* O_TMPFILE && HAVE_LINKAT */
+}
+
+int sync_file_dir(int dir_fd, const char *file_name)
+{
+    /* dir_name: Name of the directory, found in the same OS-neutral way
+       as create_temp_file() does */
+    /* base_name: Base name of the file */
+    /* fd: File descriptor of the directory */
+    /* ok: Set if the directory was flushed */
+    char dir_name[PATH_MAX];
+    char base_name[PATH_MAX];
+    int fd = dir_fd;
+    int ok;
+
+    if(fd == NO_DIR_FD)
+    {
+        if(strlen(file_name) >= PATH_MAX)
+        {
+            errno = ENAMETOOLONG;
+            return FALSE;
+        }
+        strcpy(dir_name, file_name);
+        strcpy(base_name, basename(dir_name));
+        strcpy(dir_name, file_name);
+        dir_name[strlen(dir_name) - strlen(base_name)] = 0;
+
+        fd = open(*dir_name ? dir_name : ".", O_RDONLY);
+        if(fd < 0)
+        {
+            return FALSE;
+        }
+    }
+    /* Some filesystems cannot flush directories, and have no need to */
+    ok = fsync(fd) == 0 || errno == EINVAL;
+    if(fd != dir_fd)
+    {
+        close(fd);
+    }
+    return ok;
+}
+
+void repair_file_tail(
+    int dir_fd,
+    const char *file_name,
+    unsigned long keep,
+    const void *append,
+    size_t append_len,
+    int sync,
+    jmp_buf *jmp_if_error)
+{
+    /* fd: File descriptor of the file */
+    /* data: Bytes still to be appended */
+    /* ok: Set if the file was fixed successfully */
+    int fd = open_in_dir(dir_fd, file_name, O_WRONLY);
+    const char *data = append;
+    int ok;
+
+    if(fd < 0)
+    {
+        report_error(errno, "%s", file_name);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    ok = ftruncate(fd, (off_t)keep) == 0;
+    while(ok && append_len > 0)
+    {
+        /* n: Number of bytes written */
+        ssize_t n = pwrite(fd, data, append_len, (off_t)keep);
+
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        ok = n > 0;
+        if(ok)
+        {
+            data += n;
+            keep += n;
+            append_len -= n;
+        }
+    }
+    if(ok && sync)
+    {
+        ok = fsync(fd) == 0;
+    }
+    if(!ok)
+    {
+        report_error(errno, "%s", file_name);
+        close(fd);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    if(close(fd) < 0)
+    {
+        report_error(errno, "unable to close file `%s'", file_name);
+        longjmp(*jmp_if_error, TRUE);
+    }
+}
+
+void prefetch_file(int dir_fd, const char *file_name, size_t len)
+{
+#   ifdef HAVE_POSIX_FADVISE
+        /* fd: File descriptor used to give the hint */
+        /* file_stat: Attributes of the file */
+        /* flags: Flags for open() */
+        int fd;
+        struct stat file_stat;
+        int flags = O_RDONLY;
+
+#       ifdef O_NONBLOCK
+            /* Don't wait for a writer if the name refers to a FIFO */
+            flags |= O_NONBLOCK;
+#       endif /* O_NONBLOCK */
+        fd = open_in_dir(dir_fd, file_name, flags);
+        if(fd < 0)
+        {
+            return;
+        }
+        if(fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)
+            && file_stat.st_size > (off_t)len)
+        {
+            posix_fadvise(fd, 0, (off_t)len, POSIX_FADV_WILLNEED);
+        }
+        close(fd);
+#   else
+        (void)dir_fd;
+        (void)file_name;
+        (void)len;
+#   endif /* HAVE_POSIX_FADVISE */
+}
@@ -20,6 +20,77 @@
 #ifndef FILEMGMT_H
 #define FILEMGMT_H
 
+#include <limits.h>
+
+/** Value of a directory descriptor argument meaning that there is no
+    open directory, so that file names are looked up as given */
+#define NO_DIR_FD (-1)
+
+/** A directory kept open while the files in it are processed, so that
+    each operation on a file can name it relative to the directory
+    instead of looking up the directory's path again. */
+struct file_dir
+{
+    /** Descriptor of the directory, or #NO_DIR_FD if none is open */
+    int fd;
+    /** Name of the directory as it appears at the start of the names
+        of the files in it; empty for the current directory */
+    char name[PATH_MAX];
+};
+
+/** Initialises a #file_dir with no directory open.
+
+    @param dir The directory to initialise. */
+extern void init_file_dir(struct file_dir *dir);
+
+/** Makes a #file_dir refer to the directory holding a file. The
+    directory is only opened if it is not the one already open, so
+    files from the same directory that are processed one after another
+    share one descriptor. Nothing is reported if the directory cannot be
+    opened; its files are then named as given.
+
+    @param dir The directory.
+    @param file_name The name of the file.
+    @return The descriptor to pass with @a file_name to the functions
+    below, or #NO_DIR_FD. */
+extern int enter_file_dir(struct file_dir *dir, const char *file_name);
+
+/** Closes the directory of a #file_dir, if it is open.
+
+    @param dir The directory to close. */
+extern void close_file_dir(struct file_dir *dir);
+
+/** Opens a file with @c open(), looking it up relative to its directory
+    where a descriptor of the directory is given.
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD.
+    @param file_name The name of the file.
+    @param flags Flags for @c open(); @c O_CREAT is not allowed.
+    @return The file descriptor, or -1 on failure. */
+extern int open_in_dir(int dir_fd, const char *file_name, int flags);
+
+/** Creates a new file that only its owner may use, with @c open(),
+    looking it up relative to its directory where a descriptor of the
+    directory is given. The file must not already exist.
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD.
+    @param file_name The name of the file.
+    @param flags Flags for @c open(), to which @c O_CREAT and @c O_EXCL
+    are added.
+    @return The file descriptor, or -1 on failure. */
+extern int create_in_dir(int dir_fd, const char *file_name, int flags);
+
+/** Removes a file's name with @c unlink(), looking it up relative to
+    its directory where a descriptor of the directory is given.
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD.
+    @param file_name The name of the file.
+    @return Zero on success, or -1 on failure. */
+extern int unlink_in_dir(int dir_fd, const char *file_name);
+
 /** Opens a file. If opening the file fails, then an error message will
     be displayed and a non-local exit will be made to the address
     configured by @a jmp_if_error.
@@ -37,22 +108,49 @@ extern void open_file(
     FILE **file,
     jmp_buf *jmp_if_error);
 
+/** Opens a file for reading, relative to its directory where a
+    descriptor of the directory is given. Where the platform allows it,
+    reading the file does not update its access time. If opening the
+    file fails, then an error message will be displayed and a non-local
+    exit will be made to the address configured by @a jmp_if_error.
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD.
+    @param file_name Name of the file to open.
+    @param file_mode The open mode of the file, as for @c fopen(). Must
+    start with @c "r" and must not include @c "+".
+    @param file On return, the pointer to the stream object will be
+    stored here.
+    @param jmp_if_error Exception handling address. */
+extern void open_input_file(
+    int dir_fd,
+    const char *file_name,
+    const char *file_mode,
+    FILE **file,
+    jmp_buf *jmp_if_error);
+
 /** Creates a temporary file in the same directory that @a
     input_file_name resides in. If file creation fails, then an error
     message will be displayed and a non-local exit will be made to the address
     configured by @a jmp_if_error.
 
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    input_file_name, or #NO_DIR_FD.
     @param file_name The file in which to use as a basis for creating
     the temporary file name.
     @param temp_file_mode This is the open mode of the temporary file,
     passed to @c fopen(). Must start with @c "w".
     @param temp_file_name On return, the temporary file name will be
     stored in the character buffer pointed to by @a temp_file_name. The
-    character buffer must be at least @c PATH_MAX characters long.
+    character buffer must be at least @c PATH_MAX characters long. Where
+    the filesystem allows it, the file is created without a name, so
+    that no directory entry exists until #commit_temp_file gives it one;
+    the name is then empty.
     @param temp_file On return, the pointer to the stream object will be
     stored here.
     @param jmp_if_error Exception handling address. */
 extern void create_temp_file(
+    int dir_fd,
     const char *input_file_name,
     const char *temp_file_mode,
     char *temp_file_name,
@@ -136,4 +234,90 @@ extern void replace_file(
     const char *source_file_name,
     jmp_buf *jmp_if_error);
 
+/** Gives a file the permissions and ownership of another file wherever
+    possible. Any errors are ignored; in particular, only the superuser
+    may change the ownership of a file.
+
+    @param from_file The stream object of the file to copy from.
+    @param to_file The stream object of the file to copy to. */
+extern void copy_file_attributes(FILE *from_file, FILE *to_file);
+
+/** Replaces the given target file with a complete temporary file made
+    by #create_temp_file, then closes the temporary file. The temporary
+    file is given the permissions and ownership of the target file
+    wherever possible, and takes its name in an atomic manner. The
+    target file is left open.
+
+    If any errors occur, then an error message will be displayed, the
+    temporary file will be removed and a non-local exit will be made to
+    the address configured by @a jmp_if_error.
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    target_file_name, or #NO_DIR_FD.
+    @param target_file The stream object of the file to be replaced, or
+    @c NULL if #copy_file_attributes has already been used on the
+    temporary file.
+    @param target_file_name The name of the file to be replaced.
+    @param temp_file The stream object of the temporary file.
+    @param temp_file_name The name of the temporary file, as returned by
+    #create_temp_file.
+    @param jmp_if_error Exception handling address. */
+extern void commit_temp_file(
+    int dir_fd,
+    FILE *target_file,
+    const char *target_file_name,
+    FILE *temp_file,
+    const char *temp_file_name,
+    jmp_buf *jmp_if_error);
+
+/** Flushes the directory holding a file to disk, so that a change to
+    the file's name survives a crash.
+
+    @param dir_fd Descriptor of the directory, as returned by
+    #enter_file_dir, or #NO_DIR_FD to open it by name.
+    @param file_name The name of the file. Only used if @a dir_fd is
+    #NO_DIR_FD.
+    @return Non-zero on success; zero on failure, with @c errno set. */
+extern int sync_file_dir(int dir_fd, const char *file_name);
+
+/** Fixes the end of a file in place, by cutting it short or appending
+    to it, rather than by writing a new copy of it. The file keeps its
+    inode, so hard links to it see the change too. If any errors occur,
+    then an error message will be displayed and a non-local exit will be
+    made to the address configured by @a jmp_if_error.
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD.
+    @param file_name The name of the file to fix.
+    @param keep Number of bytes at the start of the file to keep; the
+    rest is cut off.
+    @param append Bytes to append after those kept.
+    @param append_len Number of bytes in @a append.
+    @param sync If non-zero, then the file is flushed to disk before
+    returning.
+    @param jmp_if_error Exception handling address. */
+extern void repair_file_tail(
+    int dir_fd,
+    const char *file_name,
+    unsigned long keep,
+    const void *append,
+    size_t append_len,
+    int sync,
+    jmp_buf *jmp_if_error);
+
+/** Asks the operating system to start reading the start of a file into
+    its cache in the background, so that the file can be started without
+    waiting once it is processed. Only the first @a len bytes are asked
+    for, so that a file skipped after its first block is not read in
+    full, and a huge file does not flood the cache. A file no longer
+    than @a len is left alone, as it is read in a single request anyway.
+    This is only a hint: nothing is reported if it fails, and nothing
+    happens on platforms without @c posix_fadvise().
+
+    @param dir_fd Descriptor returned by #enter_file_dir for @a
+    file_name, or #NO_DIR_FD.
+    @param file_name The name of the file to read ahead.
+    @param len Number of bytes at the start of the file to read ahead. */
+extern void prefetch_file(int dir_fd, const char *file_name, size_t len);
+
 #endif /* !FILEMGMT_H */
@@ -0,0 +1,1097 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file ignore.c
+    Decides which entries of the directories being walked are excluded,
+    following the rules of @c .gitignore files.
+
+    A set of rules is compiled into a trie over path components. Each
+    rule is a path from the root of the trie, one node per component,
+    and the node it ends at records its verdict. Rules that share leading
+    components share nodes, and a rule that matches at any depth starts
+    with a step that matches any number of components, as if it began
+    with @c ** /. Steps that match a name exactly, or any name ending in
+    some text, are found through one hash table keyed on the node they
+    leave and the text, so checking an entry against hundreds of names
+    and extensions costs a few hash lookups rather than a glob match per
+    rule. Only steps with other wildcards are matched with
+    @c fnmatch().
+
+    The state of a directory holds the nodes that its path has reached in
+    each set of rules that applies to it, so an entry is matched by
+    taking one step from each of them, and the state of a subdirectory
+    by keeping the nodes reached. Sets of rules with nothing left to
+    match drop out of the state as the walk goes deeper. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include "ignore.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Number of hash buckets that a set of rules starts with; this must be
+    a power of two */
+#define INITIAL_BUCKETS 64
+
+/** Size of the buffer that lines of a rules file are first read into */
+#define INITIAL_LINE_SIZE 256
+
+/** How a node of a trie is reached from the node before it */
+typedef enum
+{
+    IS_LITERAL,     /**< By a name equal to the node's text */
+    IS_SUFFIX,      /**< By a name ending in the node's text */
+    IS_GLOB,        /**< By a name that the node's text matches as a
+                         pattern for @c fnmatch() */
+    IS_ANY_DIRS     /**< By any number of components, as @c ** is */
+} ignore_step_t;
+
+/** The verdict of a rule, recorded at the node where the rule ends */
+struct ignore_verdict
+{
+    /** Position of the rule in its set, counting from one; zero if no
+        rule ends here */
+    unsigned long order;
+    /** Set if the rule re-includes what it matches */
+    int include;
+};
+
+/** A node of a trie of rules */
+struct ignore_node
+{
+    /** Number of the node within its set, used in hashing */
+    unsigned long id;
+    /** The node before this one, or @c NULL for the root */
+    const struct ignore_node *parent;
+    /** How this node is reached from its parent */
+    ignore_step_t step;
+    /** The text of the step, which is empty for #IS_ANY_DIRS */
+    char *text;
+    /** Length of @a text */
+    size_t text_len;
+    /** Next node in the same hash bucket */
+    struct ignore_node *hash_next;
+    /** First of the #IS_GLOB nodes that follow this one */
+    struct ignore_node *globs;
+    /** Next of the #IS_GLOB nodes that follow the same parent */
+    struct ignore_node *next_glob;
+    /** The #IS_ANY_DIRS node that follows this one, or @c NULL */
+    struct ignore_node *any_dirs;
+    /** Lengths of the texts of the #IS_SUFFIX nodes that follow this
+        one, each listed once */
+    size_t *suffix_lens;
+    /** Number of lengths in @a suffix_lens */
+    size_t suffix_len_count;
+    /** The last rule ending here that matches anything */
+    struct ignore_verdict any;
+    /** The last rule ending here that matches only directories */
+    struct ignore_verdict dir;
+    /** Next node in the chain of every node in the set */
+    struct ignore_node *next_node;
+};
+
+struct ignore_rules
+{
+    /** Root of the trie */
+    struct ignore_node *root;
+    /** Hash table of the #IS_LITERAL and #IS_SUFFIX nodes */
+    struct ignore_node **buckets;
+    /** Number of buckets in @a buckets, which is a power of two */
+    size_t bucket_count;
+    /** Number of nodes in the hash table */
+    size_t hashed_count;
+    /** Number of nodes created so far */
+    unsigned long node_count;
+    /** Number of rules added so far */
+    unsigned long rule_count;
+    /** Chain of every node, newest first */
+    struct ignore_node *nodes;
+};
+
+/** The nodes reached in one set of rules */
+struct ignore_frame
+{
+    /** The set of rules */
+    const struct ignore_rules *rules;
+    /** Set if the rules were added by #push_ignore_rules */
+    int pushed;
+    /** Index in the state's nodes of the first node reached */
+    size_t first;
+    /** Number of nodes reached */
+    size_t count;
+};
+
+struct ignore_state
+{
+    /** Number of frames in @a frames */
+    size_t frame_count;
+    /** The sets of rules that apply, in order of precedence */
+    struct ignore_frame *frames;
+    /** The nodes reached in every set of rules */
+    const struct ignore_node **nodes;
+};
+
+/** A growable list of distinct nodes */
+struct node_set
+{
+    /** The nodes, allocated with @c malloc() */
+    const struct ignore_node **nodes;
+    /** Number of nodes in the list */
+    size_t count;
+    /** Number of nodes that @a nodes has room for */
+    size_t size;
+};
+
+/** Hashes a step from one node to another.
+
+    @param parent The node the step leaves.
+    @param step How the step is taken.
+    @param text The text of the step.
+    @param len Length of @a text.
+    @return The hash. */
+static unsigned long hash_step(
+    const struct ignore_node *parent,
+    ignore_step_t step,
+    const char *text,
+    size_t len)
+{
+    /* h: The hash, built with the FNV-1a function */
+    /* i: Index of the character being added */
+    unsigned long h = 2166136261UL ^ (parent->id * 2 + (step == IS_SUFFIX));
+    size_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)text[i];
+        h *= 16777619UL;
+    }
+    return h ^ (h >> 15);
+}
+
+/** Finds the node that an exact or suffix step leads to.
+
+    @param rules The set of rules.
+    @param parent The node the step leaves.
+    @param step #IS_LITERAL or #IS_SUFFIX.
+    @param text The text of the step.
+    @param len Length of @a text.
+    @return The node, or @c NULL if there is none. */
+static const struct ignore_node *find_step(
+    const struct ignore_rules *rules,
+    const struct ignore_node *parent,
+    ignore_step_t step,
+    const char *text,
+    size_t len)
+{
+    /* node: The node being compared */
+    const struct ignore_node *node = rules->buckets[
+        hash_step(parent, step, text, len) & (rules->bucket_count - 1)];
+
+    for(; node; node = node->hash_next)
+    {
+        if(node->parent == parent && node->step == step
+            && node->text_len == len && memcmp(node->text, text, len) == 0)
+        {
+            break;
+        }
+    }
+    return node;
+}
+
+/** Doubles the number of buckets in a set's hash table, if there is
+    enough memory to.
+
+    @param rules The set of rules. */
+static void grow_buckets(struct ignore_rules *rules)
+{
+    /* count: Number of buckets in the new table */
+    /* buckets: The new table */
+    /* node: The node being moved */
+    /* i: Index of the old bucket being emptied */
+    size_t count = rules->bucket_count * 2;
+    struct ignore_node **buckets = calloc(count, sizeof(struct ignore_node *));
+    struct ignore_node *node;
+    size_t i;
+
+    if(!buckets)
+    {
+        /* The old table still works, only with longer chains */
+        return;
+    }
+    for(i = 0; i < rules->bucket_count; i++)
+    {
+        while((node = rules->buckets[i]) != NULL)
+        {
+            /* b: Index of the node's new bucket */
+            size_t b = hash_step(node->parent, node->step, node->text,
+                node->text_len) & (count - 1);
+
+            rules->buckets[i] = node->hash_next;
+            node->hash_next = buckets[b];
+            buckets[b] = node;
+        }
+    }
+    free(rules->buckets);
+    rules->buckets = buckets;
+    rules->bucket_count = count;
+}
+
+/** Makes a new node.
+
+    @param rules The set of rules it belongs to.
+    @param parent The node before it, or @c NULL for the root.
+    @param step How it is reached from @a parent.
+    @param text The text of the step.
+    @param len Length of @a text.
+    @return The node, or @c NULL if there is not enough memory. */
+static struct ignore_node *new_node(
+    struct ignore_rules *rules,
+    const struct ignore_node *parent,
+    ignore_step_t step,
+    const char *text,
+    size_t len)
+{
+    /* node: The new node */
+    struct ignore_node *node = malloc(sizeof(struct ignore_node));
+
+    if(!node)
+    {
+        return NULL;
+    }
+    node->text = malloc(len + 1);
+    if(!node->text)
+    {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->text, text, len);
+    node->text[len] = '\0';
+    node->text_len = len;
+    node->id = rules->node_count++;
+    node->parent = parent;
+    node->step = step;
+    node->hash_next = NULL;
+    node->globs = NULL;
+    node->next_glob = NULL;
+    node->any_dirs = NULL;
+    node->suffix_lens = NULL;
+    node->suffix_len_count = 0;
+    node->any.order = 0;
+    node->any.include = FALSE;
+    node->dir = node->any;
+    node->next_node = rules->nodes;
+    rules->nodes = node;
+    return node;
+}
+
+/** Finds the node that a step leads to, adding it if need be.
+
+    @param rules The set of rules.
+    @param parent The node the step leaves.
+    @param step How the step is taken.
+    @param text The text of the step.
+    @param len Length of @a text.
+    @return The node, or @c NULL if there is not enough memory. */
+static struct ignore_node *add_step(
+    struct ignore_rules *rules,
+    struct ignore_node *parent,
+    ignore_step_t step,
+    const char *text,
+    size_t len)
+{
+    /* node: The node the step leads to */
+    struct ignore_node *node;
+
+    switch(step)
+    {
+        case IS_ANY_DIRS:
+            if(!parent->any_dirs)
+            {
+                parent->any_dirs = new_node(rules, parent, step, "", 0);
+            }
+            return parent->any_dirs;
+        case IS_GLOB:
+            for(node = parent->globs; node; node = node->next_glob)
+            {
+                if(strcmp(node->text, text) == 0)
+                {
+                    return node;
+                }
+            }
+            node = new_node(rules, parent, step, text, len);
+            if(node)
+            {
+                node->next_glob = parent->globs;
+                parent->globs = node;
+            }
+            return node;
+        default:
+            break;
+    }
+
+    node = (struct ignore_node *)find_step(rules, parent, step, text, len);
+    if(node)
+    {
+        return node;
+    }
+    if(step == IS_SUFFIX)
+    {
+        /* i: Index of the length being compared */
+        /* lens: The enlarged list of lengths */
+        size_t i;
+        size_t *lens;
+
+        for(i = 0; i < parent->suffix_len_count; i++)
+        {
+            if(parent->suffix_lens[i] == len)
+            {
+                break;
+            }
+        }
+        if(i == parent->suffix_len_count)
+        {
+            lens = realloc(parent->suffix_lens, (i + 1) * sizeof(size_t));
+            if(!lens)
+            {
+                return NULL;
+            }
+            lens[i] = len;
+            parent->suffix_lens = lens;
+            parent->suffix_len_count++;
+        }
+    }
+    node = new_node(rules, parent, step, text, len);
+    if(node)
+    {
+        /* b: Index of the node's bucket */
+        size_t b = hash_step(parent, step, text, len)
+            & (rules->bucket_count - 1);
+
+        node->hash_next = rules->buckets[b];
+        rules->buckets[b] = node;
+        if(++rules->hashed_count > rules->bucket_count)
+        {
+            grow_buckets(rules);
+        }
+    }
+    return node;
+}
+
+struct ignore_rules *new_ignore_rules(void)
+{
+    /* rules: The new set */
+    struct ignore_rules *rules = malloc(sizeof(struct ignore_rules));
+
+    if(!rules)
+    {
+        return NULL;
+    }
+    rules->bucket_count = INITIAL_BUCKETS;
+    rules->buckets = calloc(rules->bucket_count,
+        sizeof(struct ignore_node *));
+    rules->hashed_count = 0;
+    rules->node_count = 0;
+    rules->rule_count = 0;
+    rules->nodes = NULL;
+    rules->root = rules->buckets
+        ? new_node(rules, NULL, IS_LITERAL, "", 0)
+        : NULL;
+    if(!rules->root)
+    {
+        free(rules->buckets);
+        free(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+/** Adds the step for one component of a rule.
+
+    @param rules The set of rules.
+    @param parent The node the step leaves.
+    @param text The component, as written in the rule.
+    @param len Length of @a text.
+    @return The node the step leads to, or @c NULL if there is not
+    enough memory. */
+static struct ignore_node *add_component(
+    struct ignore_rules *rules,
+    struct ignore_node *parent,
+    const char *text,
+    size_t len)
+{
+    /* wild: Set if the component has an unquoted wildcard */
+    /* plain_tail: Set if nothing after the first character is special */
+    /* literal: The component with its quoting removed */
+    /* node: The node the step leads to */
+    /* i, j: Indices into text and literal */
+    int wild = FALSE;
+    int plain_tail = TRUE;
+    char *literal;
+    struct ignore_node *node;
+    size_t i;
+    size_t j;
+
+    if(len == 2 && text[0] == '*' && text[1] == '*')
+    {
+        return add_step(rules, parent, IS_ANY_DIRS, "", 0);
+    }
+    for(i = 0; i < len; i++)
+    {
+        if(strchr("*?[\\", text[i]))
+        {
+            if(i > 0)
+            {
+                plain_tail = FALSE;
+            }
+            if(text[i] == '\\')
+            {
+                i++;
+            }
+            else
+            {
+                wild = TRUE;
+            }
+        }
+    }
+    if(wild && text[0] == '*' && plain_tail)
+    {
+        /* A star followed by plain text, such as `*.o', is by far the
+           most common wildcard, and is looked up by the text. */
+        return add_step(rules, parent, IS_SUFFIX, text + 1, len - 1);
+    }
+    if(wild)
+    {
+        /* fnmatch() wants the pattern on its own, and honours the
+           quoting itself */
+        literal = malloc(len + 1);
+        if(!literal)
+        {
+            return NULL;
+        }
+        memcpy(literal, text, len);
+        literal[len] = '\0';
+        node = add_step(rules, parent, IS_GLOB, literal, len);
+        free(literal);
+        return node;
+    }
+
+    literal = malloc(len + 1);
+    if(!literal)
+    {
+        return NULL;
+    }
+    for(i = 0, j = 0; i < len; i++)
+    {
+        if(text[i] == '\\')
+        {
+            if(++i == len)
+            {
+                /* A backslash at the end quotes nothing */
+                break;
+            }
+        }
+        literal[j++] = text[i];
+    }
+    node = add_step(rules, parent, IS_LITERAL, literal, j);
+    free(literal);
+    return node;
+}
+
+int add_ignore_rule(struct ignore_rules *rules, const char *line, int include)
+{
+    /* len: Length of the rule left to parse */
+    /* dir_only: Set if the rule only matches directories */
+    /* anchored: Set if the rule matches relative to the rules' directory */
+    /* node: The node reached by the components parsed so far */
+    /* verdict: Where the rule's verdict is recorded */
+    size_t len = strlen(line);
+    int dir_only = FALSE;
+    int anchored;
+    struct ignore_node *node = rules->root;
+    struct ignore_verdict *verdict;
+
+    if(len > 0 && line[len - 1] == '\r')
+    {
+        len--;
+    }
+    while(len > 0 && line[len - 1] == ' '
+        && !(len > 1 && line[len - 2] == '\\'))
+    {
+        len--;
+    }
+    if(len == 0 || line[0] == '#')
+    {
+        return 0;
+    }
+    if(line[0] == '!')
+    {
+        include = !include;
+        line++;
+        len--;
+    }
+    while(len > 0 && line[len - 1] == '/')
+    {
+        dir_only = TRUE;
+        len--;
+    }
+    if(len == 0)
+    {
+        return 0;
+    }
+    anchored = memchr(line, '/', len) != NULL;
+    if(!anchored)
+    {
+        node = add_step(rules, node, IS_ANY_DIRS, "", 0);
+        if(!node)
+        {
+            return ENOMEM;
+        }
+    }
+    while(len > 0)
+    {
+        /* slash: End of the next component */
+        /* part_len: Length of the next component */
+        const char *slash = memchr(line, '/', len);
+        size_t part_len = slash ? (size_t)(slash - line) : len;
+
+        if(part_len > 0)
+        {
+            node = add_component(rules, node, line, part_len);
+            if(!node)
+            {
+                return ENOMEM;
+            }
+        }
+        line += part_len;
+        len -= part_len;
+        if(len > 0)
+        {
+            /* Step over the slash */
+            line++;
+            len--;
+        }
+    }
+    if(node == rules->root)
+    {
+        /* Nothing but slashes */
+        return 0;
+    }
+    verdict = dir_only ? &node->dir : &node->any;
+    verdict->order = ++rules->rule_count;
+    verdict->include = include;
+    return 0;
+}
+
+int read_ignore_rules(struct ignore_rules *rules, FILE *file)
+{
+    /* line: The line being read */
+    /* size: Size of the memory allocated for line */
+    /* len: Number of characters read into line */
+    /* c: The character just read */
+    /* errnum: The outcome */
+    char *line = malloc(INITIAL_LINE_SIZE);
+    size_t size = INITIAL_LINE_SIZE;
+    size_t len = 0;
+    int c;
+    int errnum = 0;
+
+    if(!line)
+    {
+        return ENOMEM;
+    }
+    do
+    {
+        c = getc(file);
+        if(c != EOF && c != '\n')
+        {
+            if(len + 1 >= size)
+            {
+                /* new_line: The enlarged line */
+                char *new_line = realloc(line, size * 2);
+
+                if(!new_line)
+                {
+                    errnum = ENOMEM;
+                    break;
+                }
+                line = new_line;
+                size *= 2;
+            }
+            line[len++] = (char)c;
+            continue;
+        }
+        line[len] = '\0';
+        errnum = add_ignore_rule(rules, line, FALSE);
+        len = 0;
+    }
+    while(c != EOF && !errnum);
+    if(!errnum && ferror(file))
+    {
+        errnum = errno ? errno : EIO;
+    }
+    free(line);
+    return errnum;
+}
+
+int ignore_rules_empty(const struct ignore_rules *rules)
+{
+    return rules->rule_count == 0;
+}
+
+void free_ignore_rules(struct ignore_rules *rules)
+{
+    if(!rules)
+    {
+        return;
+    }
+    while(rules->nodes)
+    {
+        /* node: The node being released */
+        struct ignore_node *node = rules->nodes;
+
+        rules->nodes = node->next_node;
+        free(node->suffix_lens);
+        free(node->text);
+        free(node);
+    }
+    free(rules->buckets);
+    free(rules);
+}
+
+/** Adds a node to a set, unless it is there already.
+
+    @param set The set.
+    @param first Index in the set of the first node to compare with.
+    @param node The node.
+    @return @c TRUE on success, or @c FALSE if there is not enough
+    memory. */
+static int add_to_set(
+    struct node_set *set,
+    size_t first,
+    const struct ignore_node *node)
+{
+    /* i: Index of the node being compared */
+    size_t i;
+
+    for(i = first; i < set->count; i++)
+    {
+        if(set->nodes[i] == node)
+        {
+            return TRUE;
+        }
+    }
+    if(set->count == set->size)
+    {
+        /* size: Room in the enlarged set */
+        /* nodes: The enlarged set */
+        size_t size = set->size ? set->size * 2 : 16;
+        const struct ignore_node **nodes = realloc((void *)set->nodes,
+            size * sizeof(const struct ignore_node *));
+
+        if(!nodes)
+        {
+            return FALSE;
+        }
+        set->nodes = nodes;
+        set->size = size;
+    }
+    set->nodes[set->count++] = node;
+    return TRUE;
+}
+
+/** Adds to a set the #IS_ANY_DIRS nodes that follow those in it, which
+    match without taking up a component.
+
+    @param set The set.
+    @param first Index in the set of the first node to look at.
+    @return @c TRUE on success, or @c FALSE if there is not enough
+    memory. */
+static int close_set(struct node_set *set, size_t first)
+{
+    /* i: Index of the node being looked at */
+    size_t i;
+
+    for(i = first; i < set->count; i++)
+    {
+        if(set->nodes[i]->any_dirs
+            && !add_to_set(set, first, set->nodes[i]->any_dirs))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/** Takes a node's verdict into account, if it is later than the best
+    found so far.
+
+    @param node The node reached.
+    @param is_dir Set if the entry matched is a directory.
+    @param best The latest verdict found so far. */
+static void weigh_verdict(
+    const struct ignore_node *node,
+    int is_dir,
+    struct ignore_verdict *best)
+{
+    if(node->any.order > best->order)
+    {
+        *best = node->any;
+    }
+    if(is_dir && node->dir.order > best->order)
+    {
+        *best = node->dir;
+    }
+}
+
+/** Takes every step that an entry's name allows from a node.
+
+    @param rules The set of rules that the node belongs to.
+    @param node The node.
+    @param name Name of the entry.
+    @param len Length of @a name.
+    @param is_dir Set if the entry is a directory.
+    @param best The latest verdict found so far, which is updated with
+    those of the nodes reached.
+    @param reached Receives the nodes reached, or @c NULL if they are not
+    wanted.
+    @param first Index in @a reached of the first node reached in this
+    set of rules.
+    @return @c TRUE on success, or @c FALSE if there is not enough
+    memory. */
+static int step_node(
+    const struct ignore_rules *rules,
+    const struct ignore_node *node,
+    const char *name,
+    size_t len,
+    int is_dir,
+    struct ignore_verdict *best,
+    struct node_set *reached,
+    size_t first)
+{
+    /* next: A node reached */
+    /* i: Index of the suffix length being tried */
+    const struct ignore_node *next;
+    size_t i;
+
+    if(node->step == IS_ANY_DIRS)
+    {
+        /* The name is one more of the components that it matches */
+        weigh_verdict(node, is_dir, best);
+        if(reached && !add_to_set(reached, first, node))
+        {
+            return FALSE;
+        }
+    }
+    next = find_step(rules, node, IS_LITERAL, name, len);
+    if(next)
+    {
+        weigh_verdict(next, is_dir, best);
+        if(reached && !add_to_set(reached, first, next))
+        {
+            return FALSE;
+        }
+    }
+    for(i = 0; i < node->suffix_len_count; i++)
+    {
+        if(node->suffix_lens[i] <= len)
+        {
+            next = find_step(rules, node, IS_SUFFIX,
+                name + len - node->suffix_lens[i], node->suffix_lens[i]);
+            if(next)
+            {
+                weigh_verdict(next, is_dir, best);
+                if(reached && !add_to_set(reached, first, next))
+                {
+                    return FALSE;
+                }
+            }
+        }
+    }
+    for(next = node->globs; next; next = next->next_glob)
+    {
+        if(fnmatch(next->text, name, 0) == 0)
+        {
+            weigh_verdict(next, is_dir, best);
+            if(reached && !add_to_set(reached, first, next))
+            {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+/** Makes a state from the nodes gathered for each of its frames.
+
+    @param frames The frames, whose @a first and @a count refer to
+    @a set.
+    @param frame_count Number of frames.
+    @param set The nodes.
+    @return The state, or @c NULL if there is not enough memory. */
+static struct ignore_state *make_state(
+    const struct ignore_frame *frames,
+    size_t frame_count,
+    const struct node_set *set)
+{
+    /* state: The new state, with its frames and nodes in the same block */
+    /* i: Index of the frame being copied */
+    struct ignore_state *state = malloc(sizeof(struct ignore_state)
+        + frame_count * sizeof(struct ignore_frame)
+        + set->count * sizeof(const struct ignore_node *));
+    size_t i;
+
+    if(!state)
+    {
+        return NULL;
+    }
+    state->frame_count = frame_count;
+    state->frames = (struct ignore_frame *)(state + 1);
+    state->nodes = (const struct ignore_node **)
+        (state->frames + frame_count);
+    for(i = 0; i < frame_count; i++)
+    {
+        state->frames[i] = frames[i];
+    }
+    if(set->count > 0)
+    {
+        memcpy((void *)state->nodes, (const void *)set->nodes,
+            set->count * sizeof(const struct ignore_node *));
+    }
+    return state;
+}
+
+/** Copies a frame of one state into the frames of another.
+
+    @param state The state copied from.
+    @param from The frame copied.
+    @param to Receives the copy.
+    @param set Receives the frame's nodes.
+    @return @c TRUE on success, or @c FALSE if there is not enough
+    memory. */
+static int copy_frame(
+    const struct ignore_state *state,
+    const struct ignore_frame *from,
+    struct ignore_frame *to,
+    struct node_set *set)
+{
+    /* i: Index of the node being copied */
+    size_t i;
+
+    *to = *from;
+    to->first = set->count;
+    for(i = 0; i < from->count; i++)
+    {
+        if(!add_to_set(set, to->first, state->nodes[from->first + i]))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/** Builds a state from an existing one, adding a set of rules to it.
+    The rules go before every set added by an earlier push, but after
+    those the walk started with.
+
+    @param state The existing state, or @c NULL for none.
+    @param rules The rules to add, or @c NULL for none.
+    @param pushed Set if the rules are to be marked as added by
+    #push_ignore_rules.
+    @return The new state, or @c NULL if there is not enough memory. */
+static struct ignore_state *extend_state(
+    const struct ignore_state *state,
+    const struct ignore_rules *rules,
+    int pushed)
+{
+    /* old_count: Number of frames in the existing state */
+    /* insert_at: Index of the frame that the rules go before */
+    /* frames: The new state's frames */
+    /* frame_count: Number of frames in the new state */
+    /* set: The new state's nodes */
+    /* result: The new state */
+    /* ok: Cleared if memory runs out */
+    /* i: Index of the old frame being copied */
+    size_t old_count = state ? state->frame_count : 0;
+    size_t insert_at = 0;
+    struct ignore_frame *frames;
+    size_t frame_count = 0;
+    struct node_set set;
+    struct ignore_state *result = NULL;
+    int ok = TRUE;
+    size_t i;
+
+    set.nodes = NULL;
+    set.count = 0;
+    set.size = 0;
+    frames = malloc((old_count + 1) * sizeof(struct ignore_frame));
+    if(!frames)
+    {
+        return NULL;
+    }
+    while(insert_at < old_count && !state->frames[insert_at].pushed)
+    {
+        insert_at++;
+    }
+    for(i = 0; ok && i <= old_count; i++)
+    {
+        if(i == insert_at && rules)
+        {
+            /* frame: The new frame */
+            struct ignore_frame *frame = &frames[frame_count++];
+
+            frame->rules = rules;
+            frame->pushed = pushed;
+            frame->first = set.count;
+            ok = add_to_set(&set, frame->first, rules->root)
+                && close_set(&set, frame->first);
+            frame->count = set.count - frame->first;
+        }
+        if(ok && i < old_count)
+        {
+            ok = copy_frame(state, &state->frames[i], &frames[frame_count++],
+                &set);
+        }
+    }
+    if(ok)
+    {
+        result = make_state(frames, frame_count, &set);
+    }
+    free(frames);
+    free((void *)set.nodes);
+    return result;
+}
+
+struct ignore_state *new_ignore_state(const struct ignore_rules *rules)
+{
+    return extend_state(NULL, rules, FALSE);
+}
+
+struct ignore_state *push_ignore_rules(
+    const struct ignore_state *state,
+    const struct ignore_rules *rules)
+{
+    return extend_state(state, rules, TRUE);
+}
+
+int is_ignored(const struct ignore_state *state, const char *name, int is_dir)
+{
+    /* len: Length of the name */
+    /* i: Index of the frame being consulted */
+    size_t len = strlen(name);
+    size_t i;
+
+    for(i = 0; i < state->frame_count; i++)
+    {
+        /* frame: The frame being consulted */
+        /* best: The latest verdict of the frame's rules */
+        /* j: Index of the node being stepped from */
+        const struct ignore_frame *frame = &state->frames[i];
+        struct ignore_verdict best;
+        size_t j;
+
+        best.order = 0;
+        best.include = FALSE;
+        for(j = 0; j < frame->count; j++)
+        {
+            step_node(frame->rules, state->nodes[frame->first + j], name,
+                len, is_dir, &best, NULL, 0);
+        }
+        if(best.order > 0)
+        {
+            return !best.include;
+        }
+    }
+    return FALSE;
+}
+
+struct ignore_state *enter_ignore_dir(
+    const struct ignore_state *state,
+    const char *name)
+{
+    /* len: Length of the name */
+    /* frames: The new state's frames */
+    /* frame_count: Number of frames in the new state */
+    /* set: The new state's nodes */
+    /* result: The new state */
+    /* ok: Cleared if memory runs out */
+    /* i: Index of the frame being stepped */
+    size_t len = strlen(name);
+    struct ignore_frame *frames;
+    size_t frame_count = 0;
+    struct node_set set;
+    struct ignore_state *result = NULL;
+    int ok = TRUE;
+    size_t i;
+
+    set.nodes = NULL;
+    set.count = 0;
+    set.size = 0;
+    frames = malloc((state->frame_count + 1) * sizeof(struct ignore_frame));
+    if(!frames)
+    {
+        return NULL;
+    }
+    for(i = 0; ok && i < state->frame_count; i++)
+    {
+        /* frame: The frame being stepped */
+        /* best: Verdict of the frame's rules, which is not needed here */
+        /* j: Index of the node being stepped from */
+        const struct ignore_frame *frame = &state->frames[i];
+        struct ignore_verdict best;
+        size_t j;
+
+        best.order = 0;
+        best.include = FALSE;
+        frames[frame_count] = *frame;
+        frames[frame_count].first = set.count;
+        for(j = 0; ok && j < frame->count; j++)
+        {
+            ok = step_node(frame->rules, state->nodes[frame->first + j],
+                name, len, TRUE, &best, &set, frames[frame_count].first);
+        }
+        ok = ok && close_set(&set, frames[frame_count].first);
+        frames[frame_count].count = set.count - frames[frame_count].first;
+        if(frames[frame_count].count > 0)
+        {
+            /* Frames with nothing left to match are dropped */
+            frame_count++;
+        }
+    }
+    if(ok)
+    {
+        result = make_state(frames, frame_count, &set);
+    }
+    free(frames);
+    free((void *)set.nodes);
+    return result;
+}
+
+void free_ignore_state(struct ignore_state *state)
+{
+    free(state);
+}
@@ -0,0 +1,125 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file ignore.h
+    Decides which entries of the directories being walked are excluded,
+    following the rules of @c .gitignore files. */
+
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <stdio.h>
+
+struct ignore_rules;
+struct ignore_state;
+
+/** Creates an empty set of rules.
+
+    @return The rules, or @c NULL if there is not enough memory. */
+extern struct ignore_rules *new_ignore_rules(void);
+
+/** Adds a rule to a set. The rule is written as a line of a
+    @c .gitignore file: blank lines and lines starting with @c # are
+    passed over, a leading @c ! makes the rule re-include what earlier
+    rules excluded, a trailing @c / limits the rule to directories, and a
+    rule containing any other @c / is anchored to the directory that the
+    rules apply to, while one without matches at any depth. Within a
+    component, @c *, @c ? and bracket expressions match as for
+    @c fnmatch(), and @c ** matches any number of whole components. A
+    backslash quotes the character after it.
+
+    @param rules The set.
+    @param line The rule. A trailing carriage return is ignored.
+    @param include If non-zero, then the meaning of the rule is reversed,
+    as though @c ! had been put in front of it.
+    @return Zero on success, or @c ENOMEM. */
+extern int add_ignore_rule(
+    struct ignore_rules *rules,
+    const char *line,
+    int include);
+
+/** Adds each line of a file to a set of rules, as for #add_ignore_rule.
+
+    @param rules The set.
+    @param file The file, which is read to its end.
+    @return Zero on success, or an @c errno code. */
+extern int read_ignore_rules(struct ignore_rules *rules, FILE *file);
+
+/** Checks whether a set of rules holds any that can match.
+
+    @param rules The set.
+    @return Non-zero if the set is empty. */
+extern int ignore_rules_empty(const struct ignore_rules *rules);
+
+/** Releases a set of rules. Every state that refers to it must have
+    been released first.
+
+    @param rules The set, or @c NULL. */
+extern void free_ignore_rules(struct ignore_rules *rules);
+
+/** Creates the state for a directory at the top of a walk.
+
+    @param rules Rules that apply throughout the walk, anchored to this
+    directory, and that take precedence over any added with
+    #push_ignore_rules; or @c NULL if there are none. The rules must
+    remain valid until every state derived from this one is released.
+    @return The state, or @c NULL if there is not enough memory. */
+extern struct ignore_state *new_ignore_state(const struct ignore_rules *rules);
+
+/** Adds the rules read from a directory to its state. Those rules are
+    anchored to the directory, and take precedence over the rules read
+    from the directories above it.
+
+    @param state The directory's state, which is left unchanged.
+    @param rules The rules, which must remain valid until every state
+    derived from the new one is released.
+    @return The new state for the directory, or @c NULL if there is not
+    enough memory. */
+extern struct ignore_state *push_ignore_rules(
+    const struct ignore_state *state,
+    const struct ignore_rules *rules);
+
+/** Checks whether an entry of a directory is excluded. The sets of
+    rules are consulted in order of precedence, and the last rule in the
+    first set with a matching rule decides.
+
+    @param state The directory's state.
+    @param name Name of the entry.
+    @param is_dir Non-zero if the entry is a directory.
+    @return Non-zero if the entry is excluded. */
+extern int is_ignored(
+    const struct ignore_state *state,
+    const char *name,
+    int is_dir);
+
+/** Works out the state for a subdirectory. Only the patterns that can
+    still match something within it are carried over, so the state
+    stays small however deep the walk goes.
+
+    @param state The state of the directory holding the subdirectory.
+    @param name Name of the subdirectory.
+    @return The subdirectory's state, or @c NULL if there is not enough
+    memory. */
+extern struct ignore_state *enter_ignore_dir(
+    const struct ignore_state *state,
+    const char *name);
+
+/** Releases a state.
+
+    @param state The state, or @c NULL. */
+extern void free_ignore_state(struct ignore_state *state);
+
+#endif /* !IGNORE_H */
@@ -45,9 +45,33 @@
 #   include <compat/progname.h>
 #endif
 
+#ifdef HAVE_ERROR_H
+#   include <error.h>
+#else
+#   include <compat/error.h>
+#endif
+
+#include "cleanstr.h"
 #include "options.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+#include "bytescan.h"
 #include "procfile.h"
 
+/** Tells the user how many files were skipped because they look
+    binary, if any were. */
+static void report_binary_skipped(void)
+{
+    /* skipped: Number of files skipped */
+    unsigned long skipped = binary_files_skipped();
+
+    if(skipped > 0)
+    {
+        error(0, 0, "%lu binary file%s skipped", skipped,
+            (skipped == 1) ? "" : "s");
+    }
+}
+
 /** Program entry point.
 
     @param argc Number of command-line arguments, including program name.
@@ -58,7 +82,9 @@ int main(int argc, char *const *argv)
 {
     /* jmp_on_error: Records state information for an exception jump to
        be made if an error occurs. */
+    /* ctx: Cleaning context built from the command-line options */
     jmp_buf jmp_on_error;
+    struct cleantxt_ctx ctx;
 
 #   ifndef HAVE_PROGRAM_INVOCATION_SHORT_NAME
         init_program_invocation_short_name(argv[0]);
@@ -68,10 +94,18 @@ int main(int argc, char *const *argv)
     if(setjmp(jmp_on_error))
     {
         /* Execution will branch here if an error occurs */
+        report_binary_skipped();
         return EXIT_FAILURE;
     }
 
     parse_options(argc, argv, &jmp_on_error);
+    if(!select_byte_scanner(options.simd_mode))
+    {
+        error(0, 0, "SIMD variant not supported by this processor: %s",
+            SIMD_MODE_NAMES[options.simd_mode]);
+        return EXIT_FAILURE;
+    }
+    cleantxt_ctx_from_options(&ctx, &options);
     switch(options.program_mode)
     {
         case PM_SHOW_HELP:
@@ -81,14 +115,39 @@ int main(int argc, char *const *argv)
             puts(VERSION);
             break;
         case PM_PROCESS_STREAM:
+            if(options.check_only)
+            {
+                /* list: File name list holding just the input file */
+                /* modified_count: Number of files that need cleaning */
+                const char *list[2];
+                unsigned long modified_count;
+
+                list[0] = options.input_file_name;
+                list[1] = NULL;
+                modified_count = check_file_list(&ctx, list, &jmp_on_error);
+                report_binary_skipped();
+                return modified_count ? EXIT_FAILURE : EXIT_SUCCESS;
+            }
             /* User specified at most one input file and one output file.
                Filter the input file and write the contents to the output
                file. */
-            process_file(options.input_file_name, options.output_file_name, &jmp_on_error);
+            process_file(&ctx, options.input_file_name, options.output_file_name, &jmp_on_error);
             break;
         case PM_PROCESS_FILE_LIST:
+            if(options.check_only)
+            {
+                /* modified_count: Number of files that need cleaning */
+                unsigned long modified_count;
+
+                /* Only report which files need cleaning */
+                modified_count = check_file_list(&ctx,
+                    options.file_name_list, &jmp_on_error);
+                report_binary_skipped();
+                return modified_count ? EXIT_FAILURE : EXIT_SUCCESS;
+            }
             /* Process each input file in-place */
-            process_file_list(options.file_name_list, &jmp_on_error);
+            process_file_list(&ctx, options.file_name_list, &jmp_on_error);
+            report_binary_skipped();
             break;
         default:
             /* Execution should not reach here */
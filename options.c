@@ -51,9 +51,69 @@
 /** Definition for boolean constant @e true */
 #define TRUE (!FALSE)
 
+/** Value returned by @c getopt_long() for the @c --simd option, which
+    has no short form */
+#define OPT_SIMD 256
+
+/** Value returned by @c getopt_long() for the @c --check option, which
+    has no short form */
+#define OPT_CHECK 257
+
+/** Value returned by @c getopt_long() for the @c --pipeline option,
+    which has no short form */
+#define OPT_PIPELINE 258
+
+/** Value returned by @c getopt_long() for the @c --fix-tail option,
+    which has no short form */
+#define OPT_FIX_TAIL 259
+
+/** Value returned by @c getopt_long() for the @c --overwrite option,
+    which has no short form */
+#define OPT_OVERWRITE 260
+
+/** Value returned by @c getopt_long() for the @c --durable option,
+    which has no short form */
+#define OPT_DURABLE 261
+
+/** Value returned by @c getopt_long() for the @c --recursive option,
+    which has no short form */
+#define OPT_RECURSIVE 262
+
+/** Value returned by @c getopt_long() for the @c --files0-from option,
+    which has no short form */
+#define OPT_FILES0_FROM 263
+
+/** Value returned by @c getopt_long() for the @c --text option, which
+    has no short form */
+#define OPT_TEXT 264
+
+/** Value returned by @c getopt_long() for the @c --exclude option,
+    which has no short form */
+#define OPT_EXCLUDE 265
+
+/** Value returned by @c getopt_long() for the @c --include option,
+    which has no short form */
+#define OPT_INCLUDE 266
+
+/** Value returned by @c getopt_long() for the @c --gitignore option,
+    which has no short form */
+#define OPT_GITIGNORE 267
+
 const char STDIN_FILE_NAME[] = "-";
 const char STDOUT_FILE_NAME[] = "-";
 
+const char *const SIMD_MODE_NAMES[] =
+{
+    "auto",
+    "scalar",
+    "sse2",
+    "avx2",
+    "avx512",
+    NULL
+};
+
+const char SIMD_ENV_NAME[] = "CLEANTXT_SIMD";
+
 /** Human-readable descriptions of each end-of-line mode */
 static const char *const EOL_DESC_STR[] =
 {
@@ -64,22 +124,36 @@ static const char *const EOL_DESC_STR[] =
 
 /** Short option string to supply to @c getopt() when parsing the
     command-line arguments. */
-static const char shortopts[] = "chlmo:RrsT:t:VZz";
+static const char shortopts[] = "chj:klmo:RrsT:t:VZz";
 
 /** Long option array to supply to @c getopt_long() when parsing the
     command-line arguments. */
 static const struct option longopts[] =
 {
+    { "check", no_argument, NULL, OPT_CHECK },
     { "crlf", no_argument, NULL, 'c' },
+    { "durable", no_argument, NULL, OPT_DURABLE },
+    { "exclude", required_argument, NULL, OPT_EXCLUDE },
+    { "files0-from", required_argument, NULL, OPT_FILES0_FROM },
+    { "fix-tail", optional_argument, NULL, OPT_FIX_TAIL },
+    { "gitignore", no_argument, NULL, OPT_GITIGNORE },
     { "help", no_argument, NULL, 'h' },
+    { "include", required_argument, NULL, OPT_INCLUDE },
+    { "jobs", required_argument, NULL, 'j' },
+    { "keep-going", no_argument, NULL, 'k' },
     { "lf", no_argument, NULL, 'l' },
     { "cr", no_argument, NULL, 'm' },
     { "output", required_argument, NULL, 'o' },
+    { "overwrite", no_argument, NULL, OPT_OVERWRITE },
+    { "pipeline", no_argument, NULL, OPT_PIPELINE },
+    { "recursive", no_argument, NULL, OPT_RECURSIVE },
     { "remove-ctrl-z", no_argument, NULL, 'R' },
     { "tabs", no_argument, NULL, 'r' },
     { "spaces", no_argument, NULL, 's' },
     { "tab-min", required_argument, NULL, 'T' },
+    { "simd", required_argument, NULL, OPT_SIMD },
     { "tab-size", required_argument, NULL, 't' },
+    { "text", no_argument, NULL, OPT_TEXT },
     { "version", no_argument, NULL, 'V' },
     { "stop-at-ctrl-z", no_argument, NULL, 'Z' },
     { "add-ctrl-z", no_argument, NULL, 'z' },
@@ -88,30 +162,113 @@ static const struct option longopts[] =
 
 struct cleantxt_options options;
 
+/** Looks up the name of a scanner variant and stores it in
+    #options.simd_mode.
+
+    @param name Name of the variant, as listed in #SIMD_MODE_NAMES.
+    @param jmp_if_error If the name is not recognised, then a non-local
+    exit will be made to the address recorded by @c setjmp() here. */
+static void parse_simd_mode(const char *name, jmp_buf *jmp_if_error)
+{
+    /* i: Index into SIMD_MODE_NAMES */
+    int i;
+
+    for(i = 0; SIMD_MODE_NAMES[i]; i++)
+    {
+        if(!strcmp(name, SIMD_MODE_NAMES[i]))
+        {
+            options.simd_mode = (simd_mode_t)i;
+            return;
+        }
+    }
+    if(opterr)
+    {
+        error(0, 0, "Unknown SIMD variant (expected auto, scalar, sse2, avx2 or avx512): %s", name);
+    }
+    longjmp(*jmp_if_error, TRUE);
+}
+
+/** Adds a pattern to the end of #options.exclude_patterns.
+
+    @param pattern The pattern.
+    @param include Set if the pattern was given with @c --include.
+    @param jmp_if_error If there is not enough memory to hold the
+    pattern, then a non-local exit will be made to the address recorded
+    by @c setjmp() here. */
+static void add_exclude_pattern(
+    const char *pattern,
+    int include,
+    jmp_buf *jmp_if_error)
+{
+    /* patterns: The enlarged array of patterns */
+    struct exclude_pattern *patterns = realloc(options.exclude_patterns,
+        (options.exclude_count + 1) * sizeof(struct exclude_pattern));
+
+    if(!patterns)
+    {
+        if(opterr)
+        {
+            error(0, ENOMEM, "%s", pattern);
+        }
+        longjmp(*jmp_if_error, TRUE);
+    }
+    patterns[options.exclude_count].pattern = pattern;
+    patterns[options.exclude_count].include = include;
+    options.exclude_patterns = patterns;
+    options.exclude_count++;
+}
+
 void print_help_message(void)
 {
     /*             1111111111222222222233333333334444444444555555555566666666667777777777 */
     /*   01234567890123456789012345678901234567890123456789012345678901234567890123456789 */
     printf(
         "Usage: %s [OPTION]... [FILE]...\n"
+        "   or: %s [OPTION]... --files0-from=F\n"
         "   or: %s [OPTION]... -o OUTFILE INFILE\n"
         "Cleans up tab, space and end-of-line formatting in text files/streams.\n"
         "\n",
-        program_invocation_short_name, program_invocation_short_name);
+        program_invocation_short_name, program_invocation_short_name,
+        program_invocation_short_name);
     printf(
+        "      --check           Report files that need cleaning without modifying\n"
+        "                        them; exit status is non-zero if any are found\n"
         "  -c, --crlf            Use CR+LF for EOL seq. (default under DOS/MS-Windows)\n"
+        "      --durable         Flush files replaced in-place to disk, in batches\n"
+        "      --exclude=pat     Leave out what matches pat, written as a line of\n"
+        "                        a .gitignore file, when walking directories\n");
+    printf(
+        "      --files0-from=F   Process in-place the files named in F, each name\n"
+        "                        ending in a null; if F is `-', read standard input\n"
+        "      --fix-tail[=sync] Append to or truncate files in-place if only their\n"
+        "                        ends need fixing; `sync' flushes them to disk\n"
+        "      --gitignore       Also leave out what .gitignore files list\n"
+        "      --include=pat     Take back what an earlier --exclude left out\n");
+    printf(
+        "  -j, --jobs=n          Process up to n files in-place at once (default=%d)\n"
+        "  -k, --keep-going      Carry on with the remaining files after a failure\n"
         "  -l, --lf              Use LF for EOL character (default under Unix)\n"
         "  -m, --cr              Use CR for EOL character\n"
         "  -o, --output=file     Write filtered output to given file.\n"
-        "                        Only one input file may be given in this mode.\n");
+        "                        Only one input file may be given in this mode.\n",
+        DEFAULT_JOBS);
+    printf(
+        "      --overwrite       Rewrite files in-place without a temporary copy\n"
+        "                        where cleaning can only shorten them\n"
+        "      --pipeline        Read and write on separate threads while cleaning\n"
+        "      --recursive       Clean the files in any directories given, and\n"
+        "                        in their subdirectories\n"
+        "  -R, --remove-ctrl-z   Remove any ctrl-z characters encountered\n");
     printf(
-        "  -R, --remove-ctrl-z   Remove any ctrl-z characters encountered\n"
         "  -r, --tabs            Replace spaces with tab characters wherever possible\n"
         "  -s, --spaces          Expand tab characters into spaces (default action)\n"
         "  -T, --tab-min=n       Minimum whitespace gap for inserting tabs (default=%d)\n",
         DEFAULT_TAB_MIN);
     printf(
+        "      --simd=type       Force scanner variant: auto (default), scalar, sse2,\n"
+        "                        avx2 or avx512\n"
         "  -t, --tab-size=n      Interpret tab stops as n-columns wide (default=%d)\n"
+        "      --text            Clean files in-place even if they look binary\n"
         "  -Z, --stop-at-ctrl-z  Interpret ctrl-z characters as end-of-file\n"
         "  -z, --add-ctrl-z      Append a ctrl-z character at end-of-file\n"
         "\n",
@@ -120,14 +277,25 @@ void print_help_message(void)
         "\n"
         "If no input file names are given, or `-' is specified as a file name,\n"
         "then standard input is filtered to standard output. All files are\n"
-        "modified in-place unless the `-o' argument is given.\n",
-        EOL_DESC_STR[DEFAULT_EOL_MODE]);
+        "modified in-place unless the `-o' argument is given.\n"
+        "\n"
+        "The %s environment variable sets the default scanner variant.\n",
+        EOL_DESC_STR[DEFAULT_EOL_MODE], SIMD_ENV_NAME);
 }
 
 void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
 {
     /* c: Stores the short-option character version of the current option */
+    /* simd_env: Value of the scanner variant environment variable */
     int c;
+    const char *simd_env = getenv(SIMD_ENV_NAME);
+
+    /* The environment only supplies a default; an explicit --simd
+       option overrides it. */
+    if(simd_env && *simd_env)
+    {
+        parse_simd_mode(simd_env, jmp_if_error);
+    }
 
     /* Parse the command line options, one option per loop. Break out of
        the loop when no more options are found. If an error is
@@ -139,14 +307,71 @@ void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
 
         switch(c)
         {
+            case OPT_CHECK:
+                /* Only report which files need cleaning */
+                options.check_only = TRUE;
+                break;
             case 'c':
                 /* Use DOS-style CR+LF for end-of-line sequence */
                 options.eol_mode = EM_CRLF;
                 break;
+            case OPT_DURABLE:
+                /* Make replaced files survive a crash, in batches */
+                options.durable = TRUE;
+                break;
+            case OPT_EXCLUDE:
+                /* Leave out what the pattern matches when walking */
+                add_exclude_pattern(optarg, FALSE, jmp_if_error);
+                break;
+            case OPT_FILES0_FROM:
+                /* Argument names a file listing the files to process */
+                options.files0_from = optarg;
+                break;
+            case OPT_FIX_TAIL:
+                /* Fix the ends of files in place where that is enough,
+                   optionally flushing them to disk */
+                options.fix_tail = TRUE;
+                if(optarg)
+                {
+                    if(strcmp(optarg, "sync") != 0)
+                    {
+                        if(opterr)
+                        {
+                            error(0, 0, "Unknown --fix-tail argument (expected sync): %s", optarg);
+                        }
+                        longjmp(*jmp_if_error, TRUE);
+                    }
+                    options.sync_tail = TRUE;
+                }
+                break;
+            case OPT_GITIGNORE:
+                /* Obey .gitignore files when walking */
+                options.gitignore = TRUE;
+                break;
             case 'h':
                 /* User wants to see the help message */
                 options.program_mode = PM_SHOW_HELP;
                 return;
+            case OPT_INCLUDE:
+                /* Take back what earlier patterns left out */
+                add_exclude_pattern(optarg, TRUE, jmp_if_error);
+                break;
+            case 'j':
+                /* Argument contains number of files to process at once */
+                options.jobs = atoi(optarg);
+                if(options.jobs < 1)
+                {
+                    if(opterr)
+                    {
+                        error(0, 0, "Number of jobs must be a positive integer: %s", optarg);
+                    }
+                    longjmp(*jmp_if_error, TRUE);
+                }
+                break;
+            case 'k':
+                /* Carry on with the rest of the file list after a failure */
+                options.keep_going = TRUE;
+                break;
             case 'l':
                 /* Use UNIX-style LF for end-of-line sequence */
                 options.eol_mode = EM_LF;
@@ -159,6 +384,18 @@ void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
                 /* String argument contains output file */
                 options.output_file_name = optarg;
                 break;
+            case OPT_OVERWRITE:
+                /* Rewrite files where they lie when they only shrink */
+                options.overwrite = TRUE;
+                break;
+            case OPT_PIPELINE:
+                /* Overlap reading and writing with cleaning */
+                options.pipeline = TRUE;
+                break;
+            case OPT_RECURSIVE:
+                /* Walk directories given in the file list */
+                options.recursive = TRUE;
+                break;
             case 'R':
                 /* User wants to silently discard any ctrl-Z characters */
                 options.remove_ctrl_z = TRUE;
@@ -183,6 +420,10 @@ void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
                     longjmp(*jmp_if_error, TRUE);
                 }
                 break;
+            case OPT_SIMD:
+                /* Argument names the scanner variant to use */
+                parse_simd_mode(optarg, jmp_if_error);
+                break;
             case 't':
                 /* Argument contains tab margin size */
                 options.tab_size = atoi(optarg);
@@ -195,6 +436,10 @@ void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
                     longjmp(*jmp_if_error, TRUE);
                 }
                 break;
+            case OPT_TEXT:
+                /* Clean files that look binary as well */
+                options.text = TRUE;
+                break;
             case 'V':
                 /* User wants to see program version */
                 options.program_mode = PM_SHOW_VERSION;
@@ -221,7 +466,30 @@ void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
     while(c >= 0);
 
     /* Check if an output file name was supplied */
-    if(options.output_file_name)
+    if(options.output_file_name && options.check_only)
+    {
+        /* Check mode never writes any output */
+        if(opterr)
+        {
+            error(0, 0, "Output file may not be given in check mode");
+        }
+        longjmp(*jmp_if_error, TRUE);
+    }
+    else if(options.files0_from)
+    {
+        /* The files to process are named in a file, and nowhere else */
+        if(options.output_file_name || optind < argc)
+        {
+            if(opterr)
+            {
+                error(0, 0, "No other file names may be given with --files0-from");
+            }
+            longjmp(*jmp_if_error, TRUE);
+        }
+        options.file_name_list = (const char *const *)(argv + optind);
+        options.program_mode = PM_PROCESS_FILE_LIST;
+    }
+    else if(options.output_file_name)
     {
         /* Check how many non-option arguments were supplied */
         if(optind + 1 == argc)
@@ -267,12 +535,15 @@ void parse_options(int argc, char *const *argv, jmp_buf *jmp_if_error)
 
 void init_options(void)
 {
+    free(options.exclude_patterns);
     memset(&options, 0, sizeof(struct cleantxt_options));
     options.program_mode = PM_UNKNOWN;
     options.tab_size = DEFAULT_TAB_SIZE;
     options.tab_min = DEFAULT_TAB_MIN;
     options.whitespace_mode = DEFAULT_WHITESPACE_MODE;
     options.eol_mode = DEFAULT_EOL_MODE;
+    options.simd_mode = SM_AUTO;
+    options.jobs = DEFAULT_JOBS;
 }
 
 void print_try_help_message(void)
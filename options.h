@@ -29,6 +29,9 @@
 /** The default minimum whitespace gap length for inserting tabs */
 #define DEFAULT_TAB_MIN 2
 
+/** The default number of files in a list to process at once */
+#define DEFAULT_JOBS 1
+
 /** @def DEFAULT_EOL_MODE
     The default end-of-line sequence to use. Should be one of the values
     in #eol_mode_t. */
@@ -56,6 +59,17 @@ typedef enum
     EM_CRLF     /**< Use DOS-style CR+LF for end-of-line sequence */
 } eol_mode_t;
 
+/** Enumerations for the instruction set used to scan input text. The
+    vector variants are listed in order of increasing register width. */
+typedef enum
+{
+    SM_AUTO = 0,    /**< Use the best variant the processor supports */
+    SM_SCALAR,      /**< Portable code examining one byte at a time */
+    SM_SSE2,        /**< x86 SSE2 instructions, 16 bytes at a time */
+    SM_AVX2,        /**< x86 AVX2 instructions, 32 bytes at a time */
+    SM_AVX512       /**< x86 AVX-512BW instructions, 64 bytes at a time */
+} simd_mode_t;
+
 /** Program operation modes as determined by command line arguments */
 typedef enum
 {
@@ -72,10 +86,21 @@ typedef enum
         they correspond to standard input/output respectively. */
     PM_PROCESS_STREAM,
     /** User wants to process one or more files in-place, given in @a
-        options.file_name_list. */
+        options.file_name_list or named in the file @a
+        options.files0_from. */
     PM_PROCESS_FILE_LIST
 } program_mode_t;
 
+/** A pattern given with the @c --exclude or @c --include option */
+struct exclude_pattern
+{
+    /** The pattern, written as a line of a @c .gitignore file */
+    const char *pattern;
+    /** Set if the pattern was given with @c --include, which takes back
+        what earlier patterns excluded */
+    int include;
+};
+
 /** Command-line argument structure */
 struct cleantxt_options
 {
@@ -89,6 +114,10 @@ struct cleantxt_options
     whitespace_mode_t whitespace_mode;
     /** The character sequence to use for end-of-line */
     eol_mode_t eol_mode;
+    /** The scanner variant requested by the user */
+    simd_mode_t simd_mode;
+    /** The number of files in a list to process at once */
+    int jobs;
     /** If this flag is set, then a ctrl-Z character signifies the end
         of the input file. */
     unsigned int stop_at_ctrl_z:1;
@@ -98,6 +127,38 @@ struct cleantxt_options
     /** If this flag is set, then any ctrl-Z characters encountered will
         be silently discarded from the input. */
     unsigned int remove_ctrl_z:1;
+    /** If this flag is set, then files are only checked to see whether
+        they need cleaning; nothing is written. */
+    unsigned int check_only:1;
+    /** If this flag is set, then the remaining files in a list are still
+        processed after one of them fails. */
+    unsigned int keep_going:1;
+    /** If this flag is set, then streams are read and written on
+        threads of their own while they are cleaned. */
+    unsigned int pipeline:1;
+    /** If this flag is set, then files whose only changes are at their
+        end are fixed in place, by appending to or truncating them. */
+    unsigned int fix_tail:1;
+    /** If this flag is set, then files fixed in place are flushed to
+        disk straight afterwards. */
+    unsigned int sync_tail:1;
+    /** If this flag is set, then files that cleaning can only shorten
+        are overwritten in-place rather than replaced with a cleaned
+        copy. */
+    unsigned int overwrite:1;
+    /** If this flag is set, then files replaced in-place are flushed to
+        disk, together with their directories, in batches. */
+    unsigned int durable:1;
+    /** If this flag is set, then each directory in the file list is
+        walked, and the regular files within it and its subdirectories
+        are processed. */
+    unsigned int recursive:1;
+    /** If this flag is set, then files processed in-place are cleaned
+        even if they look binary; otherwise they are skipped. */
+    unsigned int text:1;
+    /** If this flag is set, then the entries listed in the
+        @c .gitignore file of each directory walked are left out. */
+    unsigned int gitignore:1;
     /** Points to the input file name. The value of this is only
         meaningful if @c file_name_list is @c NULL. If set to @c NULL,
         then the input file has not been supplied. */
@@ -112,6 +173,19 @@ struct cleantxt_options
         used for the input file name and @c output_file_name is used for
         the output file name. */
     const char *const *file_name_list;
+    /** Points to the name of a file that the names of the files to
+        process are read from, each terminated by a null character, or
+        @c NULL if there is none. @c "-" stands for standard input. When
+        this is set, @c file_name_list is empty. */
+    const char *files0_from;
+    /** Points to the patterns for what to leave out when walking
+        directories, in the order given, or @c NULL if none were given.
+        The array is allocated with @c malloc(), and is exclude_count
+        elements long. Where several patterns match, the last one
+        decides. */
+    struct exclude_pattern *exclude_patterns;
+    /** Number of elements in @c exclude_patterns */
+    int exclude_count;
 };
 
 /** File name used to represent standard input */
@@ -120,6 +194,13 @@ extern const char STDIN_FILE_NAME[];
 /** File name used to represent standard output */
 extern const char STDOUT_FILE_NAME[];
 
+/** Names accepted for each #simd_mode_t value, indexed by value */
+extern const char *const SIMD_MODE_NAMES[];
+
+/** Name of the environment variable that may be used to select the
+    scanner variant. The @c --simd option takes precedence over it. */
+extern const char SIMD_ENV_NAME[];
+
 /** Stores @c cleantxt options, as parsed from the command line. */
 extern struct cleantxt_options options;
 
@@ -129,7 +210,8 @@ extern void init_options(void);
 
 /** Parses command line arguments and stores them in the #options
     structure. Please call #init_options() before invoking this
-    function.
+    function. The scanner variant is also taken from the
+    #SIMD_ENV_NAME environment variable, if it is set.
 
     @param argc Number of command-line arguments, including program name.
     @param argv String array of command-line arguments, including
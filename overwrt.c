@@ -0,0 +1,895 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file overwrt.c
+    Cleaning of files by overwriting them where they lie, without a
+    temporary copy.
+
+    A file is rewritten one segment at a time. Each segment ends just
+    after a LF character and before an ordinary character, where a fresh
+    cleaning engine can carry on, so no engine state needs saving between
+    segments. Cleaned text is written back into the file behind the
+    input it was made from, which it never overtakes.
+
+    A journal kept beside the file records how far the rewrite has got.
+    It holds a header followed by two record slots that are written in
+    turn, so that a record torn by a crash leaves the one before it
+    intact. A record says that the cleaned text before its output
+    position is in place and that the input from its input position on
+    is still intact. Text is written freely as long as it stays below
+    the input position of the latest record. When a segment would go
+    past that point, the file is synced and a new record is written
+    first; if the segment would even go past the input that has been
+    read so far, then its text is stored in the record as well, so that
+    it can be written again after a crash. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "overwrt.h"
+#include "filemgmt.h"
+#include "cleanstr.h"
+#include "report.h"
+#include "options.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Definition for ASCII tab character */
+#define CHAR_TAB 9
+
+/** Definition for ASCII line-feed character */
+#define CHAR_LF 10
+
+/** Definition for ASCII carriage-return character */
+#define CHAR_CR 13
+
+/** Definition for ctrl-Z (DOS end-of-file) character */
+#define CHAR_EOF 26
+
+/** Definition for ASCII space character */
+#define CHAR_SPACE 32
+
+/** Most bytes that cleaning may add to the end of a file, such as a
+    final end-of-line sequence and a ctrl-Z character */
+#define OVERWRITE_APPEND_MAX 16
+
+/** Starting value for #checksum */
+#define CHECKSUM_INIT 2166136261UL
+
+/** Identifies a journal and the version of its layout */
+static const char JOURNAL_MAGIC[8] = "CTJRNL1";
+
+/** Start of a journal, written once when it is created */
+struct journal_header
+{
+    /** Set to #JOURNAL_MAGIC */
+    char magic[8];
+    /** Length of the file before it was overwritten */
+    unsigned long in_size;
+    /** Inode number of the file */
+    unsigned long inode;
+    /** Nominal segment length, which sets the size of the record slots */
+    unsigned long segment_size;
+    /** The size of the tab margins */
+    int tab_size;
+    /** The minimum length whitespace gaps for filling with tabs */
+    int tab_min;
+    /** The whitespace fill mode */
+    int whitespace_mode;
+    /** The character sequence to use for end-of-line */
+    int eol_mode;
+    /** Set if a ctrl-Z character signifies the end of the file */
+    int stop_at_ctrl_z;
+    /** Set if a ctrl-Z character is appended to the end of the file */
+    int add_ctrl_z;
+    /** Set if ctrl-Z characters are discarded */
+    int remove_ctrl_z;
+    /** Checksum of the header, computed with this member zeroed */
+    unsigned long checksum;
+};
+
+/** Progress of a rewrite, as stored in one of a journal's slots */
+struct journal_record
+{
+    /** Sequence number; the valid record with the highest one is the
+        latest */
+    unsigned long seq;
+    /** Offset within the file where the text held in the record goes.
+        The cleaned text before this point is in place. */
+    unsigned long out_pos;
+    /** Offset within the file from which the input is intact and
+        cleaning carries on */
+    unsigned long in_pos;
+    /** Number of bytes of cleaned text that follow the record */
+    unsigned long data_len;
+    /** Set once the whole file has been cleaned, so that it only needs
+        cutting short at @a out_pos */
+    int done;
+    /** Checksum of the record and the text that follows it, computed
+        with this member zeroed */
+    unsigned long checksum;
+};
+
+/** State of a file being overwritten */
+struct overwrite
+{
+    /** Descriptor of the file's directory, or #NO_DIR_FD */
+    int dir_fd;
+    /** Name of the file */
+    const char *file_name;
+    /** Name of its journal */
+    char journal_name[PATH_MAX];
+    /** File descriptor of the file, or -1 */
+    int fd;
+    /** File descriptor of the journal, or -1 */
+    int journal_fd;
+    /** The journal's header */
+    struct journal_header header;
+    /** The configuration the file is cleaned with */
+    struct cleantxt_ctx ctx;
+    /** Sequence number of the latest record */
+    unsigned long seq;
+    /** Offset within the file where the next cleaned text goes */
+    unsigned long out_pos;
+    /** Offset within the file of the next input to clean */
+    unsigned long in_pos;
+    /** Input position of the latest record; text may be written up to
+        here without a new record */
+    unsigned long safe_pos;
+    /** Holds a segment of input and the character after it */
+    unsigned char *in_buf;
+    /** Holds a record followed by the cleaned text of a segment */
+    unsigned char *slot_buf;
+};
+
+/** Determines whether a character may start a segment; i.e. whether it
+    is neither whitespace nor a ctrl-Z character.
+
+    @param c The character.
+    @return Non-zero if @a c is an ordinary character. */
+static int is_ordinary(int c)
+{
+    return c != CHAR_SPACE && c != CHAR_TAB && c != CHAR_LF
+        && c != CHAR_CR && c != CHAR_EOF;
+}
+
+/** Updates a 32-bit FNV-1a checksum with a run of bytes.
+
+    @param data The bytes.
+    @param len Number of bytes.
+    @param sum The checksum so far; #CHECKSUM_INIT to start.
+    @return The updated checksum. */
+static unsigned long checksum(const void *data, size_t len, unsigned long sum)
+{
+    /* p: Current byte */
+    const unsigned char *p = data;
+
+    while(len-- > 0)
+    {
+        sum = ((sum ^ *p++) * 16777619UL) & 0xffffffffUL;
+    }
+    return sum;
+}
+
+/** Works out the size of one of a journal's record slots.
+
+    @param segment_size Nominal segment length, in bytes.
+    @return The size of a slot, in bytes. */
+static size_t slot_size(unsigned long segment_size)
+{
+    return sizeof(struct journal_record) + segment_size + 1
+        + OVERWRITE_APPEND_MAX;
+}
+
+/** Reads part of a file at a given offset.
+
+    @param fd File descriptor of the file.
+    @param buf Receives the data.
+    @param offset Offset within the file to read from.
+    @param len Number of bytes to read.
+    @return Non-zero on success; zero on failure, with @c errno set. A
+    file that ends early is reported as @c EIO. */
+static int read_at(int fd, void *buf, unsigned long offset, size_t len)
+{
+    /* p: Where the next byte read goes */
+    unsigned char *p = buf;
+
+    while(len > 0)
+    {
+        /* n: Number of bytes read */
+        ssize_t n = pread(fd, p, len, (off_t)offset);
+
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            if(n == 0)
+            {
+                errno = EIO;
+            }
+            return FALSE;
+        }
+        p += n;
+        offset += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/** Writes data to a file at a given offset.
+
+    @param fd File descriptor of the file.
+    @param buf The data.
+    @param offset Offset within the file to write to.
+    @param len Number of bytes to write.
+    @return Non-zero on success; zero on failure, with @c errno set. */
+static int write_at(int fd, const void *buf, unsigned long offset, size_t len)
+{
+    /* p: Next byte to write */
+    const unsigned char *p = buf;
+
+    while(len > 0)
+    {
+        /* n: Number of bytes written */
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return FALSE;
+        }
+        p += n;
+        offset += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/** Prepares the state for overwriting a file.
+
+    @param ow The state to prepare.
+    @param dir_fd Descriptor of the file's directory, or #NO_DIR_FD.
+    @param file_name Name of the file.
+    @param segment_size Nominal segment length, in bytes.
+    @return Non-zero on success; zero on failure, with @c errno set. */
+static int init_overwrite(
+    struct overwrite *ow,
+    int dir_fd,
+    const char *file_name,
+    unsigned long segment_size)
+{
+    /* in_size: Size of the input buffer, which #find_restart_point also
+       reads into */
+    size_t in_size = segment_size + 1;
+
+    memset(ow, 0, sizeof(struct overwrite));
+    ow->dir_fd = dir_fd;
+    ow->file_name = file_name;
+    ow->fd = -1;
+    ow->journal_fd = -1;
+    if(strlen(file_name) + sizeof(OVERWRITE_JOURNAL_SUFFIX) > PATH_MAX)
+    {
+        errno = ENAMETOOLONG;
+        return FALSE;
+    }
+    strcpy(ow->journal_name, file_name);
+    strcat(ow->journal_name, OVERWRITE_JOURNAL_SUFFIX);
+
+    if(in_size < CLEAN_STREAM_BUFFER_SIZE)
+    {
+        in_size = CLEAN_STREAM_BUFFER_SIZE;
+    }
+    ow->in_buf = malloc(in_size);
+    ow->slot_buf = malloc(slot_size(segment_size));
+    if(!ow->in_buf || !ow->slot_buf)
+    {
+        errno = ENOMEM;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/** Closes the files and releases the memory held by the state for
+    overwriting a file. @c errno is preserved.
+
+    @param ow The state. */
+static void free_overwrite(struct overwrite *ow)
+{
+    /* save_errno: errno is preserved for the caller's error message */
+    int save_errno = errno;
+
+    if(ow->fd >= 0)
+    {
+        close(ow->fd);
+    }
+    if(ow->journal_fd >= 0)
+    {
+        close(ow->journal_fd);
+    }
+    free(ow->in_buf);
+    free(ow->slot_buf);
+    errno = save_errno;
+}
+
+/** Reports a failure to overwrite a file and hands it on to the caller.
+
+    @param ow The state, which is released.
+    @param jmp_if_error Error handler to invoke. */
+static void fail_overwrite(struct overwrite *ow, jmp_buf *jmp_if_error)
+{
+    report_error(errno, "%s", ow->file_name);
+    free_overwrite(ow);
+    longjmp(*jmp_if_error, TRUE);
+}
+
+/** Reads the next segment of input into the input buffer, followed by
+    the character after it.
+
+    @param ow The state.
+    @param pos Offset within the file where the segment starts.
+    @param len Receives the length of the segment; zero if no segment
+    ends within the nominal length, because a line is too long.
+    @param last Receives non-zero if the segment runs to the end of the
+    file.
+    @return Non-zero on success; zero on failure, with @c errno set. */
+static int read_segment(
+    struct overwrite *ow,
+    unsigned long pos,
+    size_t *len,
+    int *last)
+{
+    /* n: Number of bytes read */
+    /* q: Candidate end of the segment */
+    size_t n = ow->header.segment_size + 1;
+    size_t q;
+
+    *last = ow->header.in_size - pos <= n;
+    if(*last)
+    {
+        *len = ow->header.in_size - pos;
+        return read_at(ow->fd, ow->in_buf, pos, *len);
+    }
+    if(!read_at(ow->fd, ow->in_buf, pos, n))
+    {
+        return FALSE;
+    }
+    for(q = n - 1; q > 0; q--)
+    {
+        if(ow->in_buf[q - 1] == CHAR_LF && is_ordinary(ow->in_buf[q]))
+        {
+            break;
+        }
+    }
+    *len = q;
+    return TRUE;
+}
+
+/** Cleans the segment held in the input buffer into the slot buffer,
+    after the space for a record.
+
+    @param ow The state.
+    @param len Length of the segment.
+    @param last Non-zero if the segment runs to the end of the file; set
+    if the engine stops at a ctrl-Z character within the segment, since
+    the rest of the file is then discarded.
+    @param out_len Receives the length of the cleaned text.
+    @return Non-zero on success; zero if the cleaned text does not fit,
+    with @c errno set. */
+static int clean_segment(
+    struct overwrite *ow,
+    size_t len,
+    int *last,
+    size_t *out_len)
+{
+    /* eng: Cleaning engine state for the segment */
+    /* sink: Collects the cleaned text; it cannot be drained */
+    struct clean_engine eng;
+    struct clean_sink sink;
+
+    clean_engine_init(&eng, &ow->ctx);
+    sink.buf = ow->slot_buf + sizeof(struct journal_record);
+    sink.len = 0;
+    sink.size = ow->header.segment_size + 1 + OVERWRITE_APPEND_MAX;
+    sink.flush = NULL;
+    sink.handle = NULL;
+
+    /* The character after a segment that is not the last makes the
+       engine write out any end-of-line sequences it has collected,
+       followed by the character itself, which is then taken back out. */
+    if(clean_engine_feed(&eng, ow->in_buf, *last ? len : len + 1, &sink)
+        != CE_OK)
+    {
+        errno = EFBIG;
+        return FALSE;
+    }
+    if(eng.stopped)
+    {
+        *last = TRUE;
+    }
+    if(!*last)
+    {
+        sink.len--;
+    }
+    else if(clean_engine_finish(&eng, &sink) != CE_OK)
+    {
+        errno = EFBIG;
+        return FALSE;
+    }
+    *out_len = sink.len;
+    return TRUE;
+}
+
+/** Checks that a file can be overwritten from the current input
+    position: that every segment fits, and that none holds a tab
+    character unless tabs are allowed.
+
+    @param ow The state.
+    @param allow_tabs Non-zero if tab characters cannot lengthen the
+    text.
+    @param ok Receives non-zero if the file can be overwritten.
+    @return Non-zero on success; zero if reading failed, with @c errno
+    set. */
+static int check_segments(struct overwrite *ow, int allow_tabs, int *ok)
+{
+    /* pos: Offset within the file of the next segment */
+    unsigned long pos = ow->in_pos;
+
+    *ok = TRUE;
+    while(*ok && pos < ow->header.in_size)
+    {
+        /* len: Length of the segment */
+        /* last: Set if the segment runs to the end of the file */
+        size_t len;
+        int last;
+
+        if(!read_segment(ow, pos, &len, &last))
+        {
+            return FALSE;
+        }
+        *ok = len > 0
+            && (allow_tabs || !memchr(ow->in_buf, CHAR_TAB, len));
+        pos += len;
+    }
+    return TRUE;
+}
+
+/** Writes a record into the journal's next slot and flushes it to
+    disk. Any cleaned text it holds must already be in the slot buffer.
+
+    @param ow The state.
+    @param out_pos Offset within the file where the text goes.
+    @param in_pos Offset within the file from which the input is intact.
+    @param data_len Number of bytes of cleaned text the record holds.
+    @param done Non-zero if the whole file has been cleaned.
+    @return Non-zero on success; zero on failure, with @c errno set. */
+static int write_record(
+    struct overwrite *ow,
+    unsigned long out_pos,
+    unsigned long in_pos,
+    size_t data_len,
+    int done)
+{
+    /* record: The record */
+    /* slot: Offset of the slot within the journal */
+    struct journal_record record;
+    unsigned long slot;
+
+    memset(&record, 0, sizeof(record));
+    record.seq = ow->seq + 1;
+    record.out_pos = out_pos;
+    record.in_pos = in_pos;
+    record.data_len = data_len;
+    record.done = done;
+    record.checksum = checksum(ow->slot_buf + sizeof(record), data_len,
+        checksum(&record, sizeof(record), CHECKSUM_INIT));
+    memcpy(ow->slot_buf, &record, sizeof(record));
+
+    slot = sizeof(struct journal_header)
+        + (record.seq % 2) * slot_size(ow->header.segment_size);
+    if(!write_at(ow->journal_fd, ow->slot_buf, slot,
+            sizeof(record) + data_len)
+        || fsync(ow->journal_fd) != 0)
+    {
+        return FALSE;
+    }
+    ow->seq = record.seq;
+    ow->safe_pos = in_pos;
+    return TRUE;
+}
+
+/** Overwrites the rest of a file from the current input and output
+    positions, then cuts it short.
+
+    @param ow The state.
+    @return Non-zero on success; zero on failure, with @c errno set. */
+static int overwrite_segments(struct overwrite *ow)
+{
+    while(ow->in_pos < ow->header.in_size)
+    {
+        /* len: Length of the segment */
+        /* last: Set if the segment runs to the end of the file */
+        /* out_len: Length of its cleaned text */
+        /* next_pos: Offset within the file of the next segment */
+        size_t len;
+        int last;
+        size_t out_len;
+        unsigned long next_pos;
+
+        if(!read_segment(ow, ow->in_pos, &len, &last)
+            || !clean_segment(ow, len, &last, &out_len))
+        {
+            return FALSE;
+        }
+        if(len == 0)
+        {
+            /* The file grew a long line after it was checked */
+            errno = EFBIG;
+            return FALSE;
+        }
+        next_pos = last ? ow->header.in_size : ow->in_pos + len;
+        if(!last && ow->out_pos + out_len > next_pos)
+        {
+            /* The text would overtake its own input */
+            errno = EFBIG;
+            return FALSE;
+        }
+
+        if(ow->out_pos + out_len > ow->safe_pos)
+        {
+            /* The text would overwrite input that the latest record
+               relies on. Make the text written so far durable, then
+               move the record on. */
+            if(fsync(ow->fd) != 0
+                || (ow->out_pos + out_len <= ow->in_pos
+                    ? !write_record(ow, ow->out_pos, ow->in_pos, 0, FALSE)
+                    : !write_record(ow, ow->out_pos, next_pos, out_len,
+                        FALSE)))
+            {
+                return FALSE;
+            }
+        }
+        if(!write_at(ow->fd, ow->slot_buf + sizeof(struct journal_record),
+            ow->out_pos, out_len))
+        {
+            return FALSE;
+        }
+        ow->out_pos += out_len;
+        ow->in_pos = next_pos;
+    }
+
+    return fsync(ow->fd) == 0
+        && write_record(ow, ow->out_pos, ow->in_pos, 0, TRUE)
+        && ftruncate(ow->fd, (off_t)ow->out_pos) == 0
+        && fsync(ow->fd) == 0;
+}
+
+/** Closes and removes the journal once a rewrite is complete, and
+    closes the file.
+
+    @param ow The state, which is released.
+    @param jmp_if_error Error handler to invoke if closing fails. */
+static void end_overwrite(struct overwrite *ow, jmp_buf *jmp_if_error)
+{
+    /* fd: File descriptor of the file */
+    /* journal_fd: File descriptor of the journal */
+    int fd = ow->fd;
+    int journal_fd = ow->journal_fd;
+
+    ow->fd = -1;
+    ow->journal_fd = -1;
+    if(close(journal_fd) < 0
+        || unlink_in_dir(ow->dir_fd, ow->journal_name) < 0)
+    {
+        /* The journal only says that the file is done, so finishing it
+           again does no harm. */
+        report_error(errno, "unable to remove journal `%s'", ow->journal_name);
+        close(fd);
+        free_overwrite(ow);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    if(close(fd) < 0)
+    {
+        report_error(errno, "unable to close file `%s'", ow->file_name);
+        free_overwrite(ow);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    free_overwrite(ow);
+}
+
+int overwrite_file(
+    const struct cleantxt_ctx *ctx,
+    int dir_fd,
+    const char *file_name,
+    unsigned long modified_at,
+    size_t segment_size,
+    jmp_buf *jmp_if_error)
+{
+    /* ow: State of the rewrite */
+    /* file_stat: Attributes of the file */
+    /* restart: Offset of the start of the line holding the first change */
+    /* ok: Set if the file can be overwritten */
+    struct overwrite ow;
+    struct stat file_stat;
+    long restart;
+    int ok;
+
+    /* CR+LF is the one end-of-line sequence that can be longer than
+       what it replaces. */
+    if(ctx->eol_mode == EM_CRLF)
+    {
+        return FALSE;
+    }
+    if(!init_overwrite(&ow, dir_fd, file_name, segment_size))
+    {
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    ow.ctx = *ctx;
+    ow.fd = open_in_dir(dir_fd, file_name, O_RDWR);
+    if(ow.fd < 0 || fstat(ow.fd, &file_stat) != 0
+        || !find_restart_point(ow.fd, 0, (long)modified_at, ow.in_buf,
+            &restart))
+    {
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    if(!S_ISREG(file_stat.st_mode) || restart >= file_stat.st_size)
+    {
+        /* Only regular files can be overwritten, and an empty one has
+           nothing to overwrite; it can only be added to. */
+        free_overwrite(&ow);
+        return FALSE;
+    }
+
+    memcpy(ow.header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    ow.header.in_size = file_stat.st_size;
+    ow.header.inode = file_stat.st_ino;
+    ow.header.segment_size = segment_size;
+    ow.header.tab_size = ctx->tab_size;
+    ow.header.tab_min = ctx->tab_min;
+    ow.header.whitespace_mode = ctx->whitespace_mode;
+    ow.header.eol_mode = ctx->eol_mode;
+    ow.header.stop_at_ctrl_z = ctx->stop_at_ctrl_z;
+    ow.header.add_ctrl_z = ctx->add_ctrl_z;
+    ow.header.remove_ctrl_z = ctx->remove_ctrl_z;
+    ow.header.checksum = checksum(&ow.header, sizeof(ow.header),
+        CHECKSUM_INIT);
+    ow.out_pos = restart;
+    ow.in_pos = restart;
+
+    /* A whitespace gap filled with spaces is as wide as the tabs it
+       replaces; filled with tabs, it is never wider than what it
+       replaces as long as a gap of two columns takes a tab. Anything
+       else rules out overwriting. The whole file is read through to
+       make sure before anything is written. */
+    if(!check_segments(&ow,
+        ctx->whitespace_mode == WM_TAB && ctx->tab_min <= 2, &ok))
+    {
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    if(!ok)
+    {
+        free_overwrite(&ow);
+        return FALSE;
+    }
+
+    /* Create the journal, and make sure it will be found after a crash
+       before anything is overwritten. */
+    ow.journal_fd = create_in_dir(dir_fd, ow.journal_name, O_RDWR);
+    if(ow.journal_fd < 0)
+    {
+        report_error(errno, "unable to create journal `%s'", ow.journal_name);
+        free_overwrite(&ow);
+        longjmp(*jmp_if_error, TRUE);
+    }
+    if(!write_at(ow.journal_fd, &ow.header, 0, sizeof(ow.header))
+        || fsync(ow.journal_fd) != 0
+        || !write_record(&ow, ow.out_pos, ow.in_pos, 0, FALSE)
+        || !sync_file_dir(dir_fd, ow.journal_name))
+    {
+        unlink_in_dir(dir_fd, ow.journal_name);
+        ow.file_name = ow.journal_name;
+        fail_overwrite(&ow, jmp_if_error);
+    }
+
+    if(!overwrite_segments(&ow))
+    {
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    end_overwrite(&ow, jmp_if_error);
+    return TRUE;
+}
+
+/** Reads the latest valid record from a journal into the slot buffer.
+
+    @param ow The state, with the journal's header read.
+    @param record Receives the record.
+    @return Non-zero if a record was found; zero if there is none. */
+static int read_latest_record(
+    struct overwrite *ow,
+    struct journal_record *record)
+{
+    /* slot: Offset of each slot within the journal */
+    /* i: Index of the slot */
+    /* found: Index of the latest valid slot, or -1 */
+    /* max_data: Most cleaned text that a record can hold */
+    unsigned long slot[2];
+    int i;
+    int found = -1;
+    size_t max_data = ow->header.segment_size + 1 + OVERWRITE_APPEND_MAX;
+
+    memset(record, 0, sizeof(struct journal_record));
+    for(i = 0; i < 2; i++)
+    {
+        /* candidate: The record in the slot */
+        /* sum: Its stored checksum */
+        struct journal_record candidate;
+        unsigned long sum;
+
+        slot[i] = sizeof(struct journal_header)
+            + i * slot_size(ow->header.segment_size);
+        if(!read_at(ow->journal_fd, &candidate, slot[i], sizeof(candidate))
+            || candidate.data_len > max_data
+            || !read_at(ow->journal_fd,
+                ow->slot_buf + sizeof(struct journal_record),
+                slot[i] + sizeof(candidate), candidate.data_len))
+        {
+            continue;
+        }
+        sum = candidate.checksum;
+        candidate.checksum = 0;
+        if(sum == checksum(ow->slot_buf + sizeof(struct journal_record),
+                candidate.data_len,
+                checksum(&candidate, sizeof(candidate), CHECKSUM_INIT))
+            && (found < 0 || candidate.seq > record->seq))
+        {
+            *record = candidate;
+            found = i;
+        }
+    }
+    return found >= 0
+        && read_at(ow->journal_fd,
+            ow->slot_buf + sizeof(struct journal_record),
+            slot[found] + sizeof(struct journal_record), record->data_len);
+}
+
+int finish_overwrite(
+    int dir_fd,
+    const char *file_name,
+    jmp_buf *jmp_if_error)
+{
+    /* ow: State of the rewrite */
+    /* header: The journal's header */
+    /* journal_fd: File descriptor of the journal */
+    /* journal_name: Name of the journal */
+    /* sum: Checksum stored in the journal's header */
+    /* record: The latest record in the journal */
+    /* file_stat: Attributes of the file */
+    struct overwrite ow;
+    struct journal_header header;
+    int journal_fd;
+    char journal_name[PATH_MAX];
+    unsigned long sum;
+    struct journal_record record;
+    struct stat file_stat;
+
+    if(strlen(file_name) + sizeof(OVERWRITE_JOURNAL_SUFFIX) > PATH_MAX)
+    {
+        return FALSE;
+    }
+    strcpy(journal_name, file_name);
+    strcat(journal_name, OVERWRITE_JOURNAL_SUFFIX);
+    journal_fd = open_in_dir(dir_fd, journal_name, O_RDWR);
+    if(journal_fd < 0)
+    {
+        if(errno == ENOENT)
+        {
+            return FALSE;
+        }
+        report_error(errno, "%s", journal_name);
+        longjmp(*jmp_if_error, TRUE);
+    }
+
+    /* A journal without a valid header was cut short while it was being
+       created, before the file was touched. */
+    if(!read_at(journal_fd, &header, 0, sizeof(header)))
+    {
+        memset(&header, 0, sizeof(header));
+    }
+    sum = header.checksum;
+    header.checksum = 0;
+    if(memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+        || sum != checksum(&header, sizeof(header), CHECKSUM_INIT))
+    {
+        close(journal_fd);
+        unlink_in_dir(dir_fd, journal_name);
+        return FALSE;
+    }
+    header.checksum = sum;
+
+    if(!init_overwrite(&ow, dir_fd, file_name, header.segment_size))
+    {
+        close(journal_fd);
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    ow.header = header;
+    ow.journal_fd = journal_fd;
+    if(!read_latest_record(&ow, &record))
+    {
+        /* Likewise for a journal without a valid record */
+        free_overwrite(&ow);
+        unlink_in_dir(dir_fd, journal_name);
+        return FALSE;
+    }
+
+    ow.fd = open_in_dir(dir_fd, file_name, O_RDWR);
+    if(ow.fd < 0 || fstat(ow.fd, &file_stat) != 0)
+    {
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    if((unsigned long)file_stat.st_ino != header.inode)
+    {
+        report_error(0, "journal `%s' does not belong to file `%s'",
+            journal_name, file_name);
+        free_overwrite(&ow);
+        longjmp(*jmp_if_error, TRUE);
+    }
+
+    /* Finish the rewrite with the configuration it was started with */
+    cleantxt_ctx_init(&ow.ctx);
+    ow.ctx.tab_size = header.tab_size;
+    ow.ctx.tab_min = header.tab_min;
+    ow.ctx.whitespace_mode = (whitespace_mode_t)header.whitespace_mode;
+    ow.ctx.eol_mode = (eol_mode_t)header.eol_mode;
+    ow.ctx.stop_at_ctrl_z = header.stop_at_ctrl_z;
+    ow.ctx.add_ctrl_z = header.add_ctrl_z;
+    ow.ctx.remove_ctrl_z = header.remove_ctrl_z;
+
+    /* Write out any text held in the record, which may have been torn
+       by the crash, then carry on from where it leaves off. */
+    ow.seq = record.seq;
+    ow.safe_pos = record.in_pos;
+    ow.out_pos = record.out_pos + record.data_len;
+    ow.in_pos = record.done ? header.in_size : record.in_pos;
+    if(!write_at(ow.fd, ow.slot_buf + sizeof(struct journal_record),
+            record.out_pos, record.data_len)
+        || !overwrite_segments(&ow))
+    {
+        fail_overwrite(&ow, jmp_if_error);
+    }
+    end_overwrite(&ow, jmp_if_error);
+    return TRUE;
+}
@@ -0,0 +1,86 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file overwrt.h
+    Cleaning of files by overwriting them where they lie, without a
+    temporary copy. */
+
+#ifndef OVERWRT_H
+#define OVERWRT_H
+
+#include <stddef.h>
+
+/** Suffix appended to a file's name to name the journal that is kept
+    beside it while it is overwritten */
+#define OVERWRITE_JOURNAL_SUFFIX ".cleantxt-journal"
+
+/** Nominal length of the segments that a file is overwritten in, in
+    bytes. No line may be longer than this. */
+#define OVERWRITE_SEGMENT_SIZE (1024L * 1024)
+
+struct cleantxt_ctx;
+
+/** Cleans a file that #check_stream has found would be modified by
+    overwriting it in place, from the start of the line holding the
+    first modification, and then cutting it short. This is only done if
+    the cleaned text can never run ahead of the input it is made from:
+    the end-of-line sequence must not be CR+LF, and either the file must
+    hold no tab characters from that line on or tab characters must be
+    used to fill whitespace with a minimum gap of no more than two
+    columns. Every line must also fit in a segment.
+
+    A journal is kept beside the file while it is overwritten. If the
+    rewrite is interrupted, then #finish_overwrite completes it.
+
+    @param ctx The cleaning context, which supplies the configuration.
+    @param dir_fd Descriptor of the file's directory, as returned by
+    #enter_file_dir, or #NO_DIR_FD. The file and its journal are opened
+    relative to it.
+    @param file_name Name of the file.
+    @param modified_at The offset of the first modification reported by
+    #check_stream.
+    @param segment_size Nominal segment length, in bytes; normally
+    #OVERWRITE_SEGMENT_SIZE.
+    @param jmp_if_error Error handler invoked if an error occurs. An
+    error message will already have been reported.
+    @return Non-zero if the file was cleaned; zero if it cannot be
+    overwritten safely, in which case it is left untouched. */
+extern int overwrite_file(
+    const struct cleantxt_ctx *ctx,
+    int dir_fd,
+    const char *file_name,
+    unsigned long modified_at,
+    size_t segment_size,
+    jmp_buf *jmp_if_error);
+
+/** Completes an interrupted #overwrite_file on a file, if its journal
+    is present. The rewrite is finished with the configuration that it
+    was started with, which is recorded in the journal.
+
+    @param dir_fd Descriptor of the file's directory, as returned by
+    #enter_file_dir, or #NO_DIR_FD. The file and its journal are opened
+    relative to it.
+    @param file_name Name of the file.
+    @param jmp_if_error Error handler invoked if an error occurs. An
+    error message will already have been reported.
+    @return Non-zero if a rewrite was finished; zero if there was none
+    to finish. */
+extern int finish_overwrite(
+    int dir_fd,
+    const char *file_name,
+    jmp_buf *jmp_if_error);
+
+#endif /* !OVERWRT_H */
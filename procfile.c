@@ -29,16 +29,22 @@
 #include <errno.h>
 #include <setjmp.h>
 
-#ifdef HAVE_ERROR_H
-#   include <error.h>
-#else
-#   include <compat/error.h>
-#endif
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
 
 #include "procfile.h"
 #include "cleanstr.h"
 #include "filemgmt.h"
+#include "overwrt.h"
+#include "durable.h"
+#include "filelist.h"
+#include "ignore.h"
+#include "report.h"
 #include "options.h"
+#include "bytescan.h"
+#include "cleaneng.h"
+#include "cleanctx.h"
 
 /** Definition for boolean constant @e false */
 #define FALSE 0
@@ -58,48 +64,215 @@ static const char STDIN_DESCRIPTION[] = "<standard input>";
 /** String used to describe standard output to user */
 static const char STDOUT_DESCRIPTION[] = "<standard output>";
 
+/** Number of bytes at the start of a file that are examined to decide
+    whether it holds text */
+#define SNIFF_SIZE 4096
+
+/** Number of files skipped so far because they look binary */
+static unsigned long binary_skipped_count = 0;
+
+#ifdef HAVE_PTHREAD_H
+/** Guards #binary_skipped_count, which files processed at once on
+    several threads may update together */
+static pthread_mutex_t binary_skipped_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif /* HAVE_PTHREAD_H */
+
+/** Examines the first block of a file, leaving the file positioned at
+    its start again, to decide whether the file holds binary data that
+    cleaning would only mangle. This is skipped if #options.text is set.
+    If the file cannot be read, then an error message will be displayed,
+    the file will be closed and a non-local exit will be made.
+
+    @param input_file The file, which must be positioned at its start.
+    @param input_file_name Name of the file, for error messages.
+    @param jmp_if_error Exception handling address.
+    @return @c TRUE if the file looks binary, or @c FALSE if it should be
+    cleaned. */
+static int sniff_binary(
+    FILE *input_file,
+    const char *input_file_name,
+    jmp_buf *jmp_if_error)
+{
+    /* block: The first block of the file */
+    /* length: Number of bytes in block */
+    unsigned char block[SNIFF_SIZE];
+    size_t length;
+
+    if(options.text)
+    {
+        return FALSE;
+    }
+    length = fread(block, 1, sizeof(block), input_file);
+    if(ferror(input_file) || fseek(input_file, 0L, SEEK_SET) != 0)
+    {
+        report_error(errno, "%s", input_file_name);
+        fclose(input_file);
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+    return looks_binary(block, block + length);
+}
+
+/** Counts a file skipped because it looks binary. */
+static void count_binary_skipped(void)
+{
+#   ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock(&binary_skipped_lock);
+#   endif /* HAVE_PTHREAD_H */
+    binary_skipped_count++;
+#   ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock(&binary_skipped_lock);
+#   endif /* HAVE_PTHREAD_H */
+}
+
+unsigned long binary_files_skipped(void)
+{
+    return binary_skipped_count;
+}
+
 /** Filters a file in-place. This is performed by creating a temporary
     file, writing the output to the temporary file, then deleting the
     original file and renaming the temporary file to the original file.
 
-    To save unnecessary updation of time stamps, if no changes were made
-    to the original file, then the temporary file is deleted and the
-    original file is left as-is. If any errors occur, then an error
-    message will be displayed and the program will be terminated.
+    A file that looks binary is left alone, unless #options.text is set.
+    Most files are already clean, so the file is checked first, and the
+    temporary file is only created if a change is found. The unchanged
+    text before the change is then copied across in bulk rather than
+    cleaned again. With #options.fix_tail set, a file that only needs
+    its end changing is instead fixed where it lies, and with
+    #options.overwrite set, a file that cleaning can only shorten is
+    rewritten where it lies. A rewrite that was interrupted is finished
+    before the file is looked at. Given a batch, the temporary file is
+    left in it to replace the original file when the batch is committed.
+
+    To save unnecessary updation of time stamps, if no changes are made
+    to the original file, then it is left as-is. If any errors occur,
+    then an error message will be displayed and a non-local exit will be
+    made to the address configured by @a jmp_if_error.
 
+    @param ctx The cleaning context.
+    @param dir_fd Descriptor of the input file's directory, as returned
+    by #enter_file_dir, or #NO_DIR_FD.
+    @param batch The batch to add the temporary file to, which must not
+    be full, or @c NULL to replace the original file straight away.
     @param input_file_name Name of the input file. Must not be @c NULL.
-    Note that @c "-" is <b>NOT</b> recognised as standard input/output. */
+    Note that @c "-" is <b>NOT</b> recognised as standard input/output.
+    @param jmp_if_error Exception handling address. */
 static void process_file_in_place(
+    struct cleantxt_ctx *ctx,
+    int dir_fd,
+    struct durable_batch *batch,
     const char *input_file_name,
     jmp_buf *jmp_if_error)
 {
     /* temp_file_name: Name of the temporary file */
     /* input_file: Input file object stream */
     /* output_file: Temporary output file object stream */
+    /* modified_at: Offset of the first change to the input file */
+    /* repair: Fix for the end of the input file */
     /* on_clean_stream_error: Handler for I/O errors in clean_stream() */
     char temp_file_name[PATH_MAX];
     FILE *input_file;
     FILE *temp_file;
+    unsigned long modified_at;
+    struct tail_repair repair;
     jmp_buf on_clean_stream_error;
 
-    /* Open the input file and create a temporary output file. */
-    open_file(input_file_name, INPUT_MODE, &input_file, jmp_if_error);
-    create_temp_file(input_file_name, OUTPUT_MODE,
-        temp_file_name, &temp_file, jmp_if_error);
+    /* Finish off any rewrite of the file that was interrupted, so that
+       it is whole again. */
+    finish_overwrite(dir_fd, input_file_name, jmp_if_error);
 
-    /* Filter the input file contents into the temporary file. */
+    /* Open the input file and find the first change, if any. */
+    open_input_file(dir_fd, input_file_name, INPUT_MODE, &input_file,
+        jmp_if_error);
+    if(sniff_binary(input_file, input_file_name, jmp_if_error))
+    {
+        /* Cleaning would only mangle binary data, so leave the file be,
+           before anything has been written. */
+        count_binary_skipped();
+        close_file(input_file, input_file_name, jmp_if_error);
+        return;
+    }
+    if(setjmp(on_clean_stream_error))
+    {
+        /* Execution branches here if check_stream() or
+           plan_tail_repair() encounters an I/O error, or the input file
+           cannot be rewound in between */
+        report_error(errno, "%s", input_file_name);
+        fclose(input_file);
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+    if(check_stream(ctx, input_file, &modified_at, &on_clean_stream_error)
+        == CSR_STREAM_UNMODIFIED)
+    {
+        /* Nothing needs changing, so there is no need for a temporary
+           file at all. */
+        close_file(input_file, input_file_name, jmp_if_error);
+        return;
+    }
+    if(fseek(input_file, 0L, SEEK_SET) != 0)
+    {
+        longjmp(on_clean_stream_error, TRUE);
+    }
+    if(options.fix_tail
+        && plan_tail_repair(ctx, input_file, modified_at, &repair,
+            &on_clean_stream_error))
+    {
+        /* Only the end of the file changes, so append to it or cut it
+           short where it lies. */
+        close_file(input_file, input_file_name, jmp_if_error);
+        repair_file_tail(dir_fd, input_file_name, repair.keep,
+            repair.append, repair.append_len,
+            options.sync_tail || options.durable, jmp_if_error);
+        return;
+    }
+    if(options.overwrite)
+    {
+        if(setjmp(on_clean_stream_error))
+        {
+            /* Execution branches here if overwrite_file() fails, which
+               has already reported the error */
+            fclose(input_file);
+            longjmp(*jmp_if_error, TRUE);
+            /* Non-local return */
+        }
+        if(overwrite_file(ctx, dir_fd, input_file_name, modified_at,
+            OVERWRITE_SEGMENT_SIZE, &on_clean_stream_error))
+        {
+            /* The file was cleaned without a temporary copy */
+            close_file(input_file, input_file_name, jmp_if_error);
+            return;
+        }
+    }
+
+    /* Create a temporary output file and filter the input file contents
+       into it. */
+    if(setjmp(on_clean_stream_error))
+    {
+        /* Execution branches here if create_temp_file() fails, which has
+           already reported the error */
+        fclose(input_file);
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+    create_temp_file(dir_fd, input_file_name, OUTPUT_MODE,
+        temp_file_name, &temp_file, &on_clean_stream_error);
     if(setjmp(on_clean_stream_error))
     {
         /* Execution branches here if clean_stream() encounters an I/O error */
-        error(0, errno, "%s", input_file_name);
+        report_error(errno, "%s", input_file_name);
+        fclose(input_file);
         close_remove_file(temp_file, temp_file_name, jmp_if_error);
         longjmp(*jmp_if_error, TRUE);
         /* Non-local return */
     }
-    switch(clean_stream(input_file, temp_file, &on_clean_stream_error))
+    switch(clean_stream_from(ctx, input_file, temp_file, modified_at,
+        &on_clean_stream_error))
     {
         case CSR_STREAM_UNMODIFIED:
-            /* No modifications were made to the stream, so the
+            /* No modifications were made to the stream after all (the
+               file changed after it was checked), so the
                temporary file is identical to the input file. So we can
                avoid unnecessarily updating the time stamps on the input
                file, we'll close and remove the temporary file name
@@ -109,13 +282,30 @@ static void process_file_in_place(
             break;
         case CSR_STREAM_MODIFIED:
             /* Modifications were made to the stream content. The
-               temporary file and input files are not identical. Close
-               both files, then delete the input file and rename the
-               temporary file to the input file. */
-            close_file_guarantee_complete_or_remove(
-                temp_file, temp_file_name, jmp_if_error);
+               temporary file and input files are not identical. Put
+               the temporary file in place of the input file, then close
+               the input file. With a batch, leave the temporary file in
+               it instead. */
+            if(setjmp(on_clean_stream_error))
+            {
+                /* Execution branches here if commit_temp_file() or
+                   add_durable_file() fails, which has already reported
+                   the error */
+                fclose(input_file);
+                longjmp(*jmp_if_error, TRUE);
+                /* Non-local return */
+            }
+            if(batch)
+            {
+                add_durable_file(batch, dir_fd, input_file, input_file_name,
+                    temp_file, temp_file_name, &on_clean_stream_error);
+            }
+            else
+            {
+                commit_temp_file(dir_fd, input_file, input_file_name,
+                    temp_file, temp_file_name, &on_clean_stream_error);
+            }
             close_file(input_file, input_file_name, jmp_if_error);
-            replace_file(input_file_name, temp_file_name, jmp_if_error);
             break;
     }
 }
@@ -123,6 +313,7 @@ static void process_file_in_place(
 void process_file(
     /* Note: the extra `const' is to suppress GCC's warning that these
        arguments would be clobbered by the use of longjmp(). */
+    struct cleantxt_ctx *const ctx,
     const char *const input_file_name,
     const char *const output_file_name,
     jmp_buf *jmp_if_error)
@@ -166,13 +357,13 @@ void process_file(
         /* Execution branches here if clean_stream() encounters an I/O error */
         if(ferror(input_file))
         {
-            error(0, errno, "%s", ((input_file != stdin)
+            report_error(errno, "%s", ((input_file != stdin)
                 ? input_file_name
                 : STDIN_DESCRIPTION));
         }
         else
         {
-            error(0, errno, "%s", ((output_file != stdout)
+            report_error(errno, "%s", ((output_file != stdout)
                 ? output_file_name
                 : STDOUT_DESCRIPTION));
         }
@@ -180,30 +371,815 @@ void process_file(
         longjmp(*jmp_if_error, TRUE);
         /* Non-local return */
     }
-    clean_stream(input_file, output_file, &on_clean_stream_error);
+    clean_stream(ctx, input_file, output_file, &on_clean_stream_error);
     close_file_guarantee_complete_or_remove(
         output_file, output_file_name, jmp_if_error);
     close_file(input_file, input_file_name, jmp_if_error);
 }
 
-void process_file_list(
+/** Processes one entry of a file list. If the entry is @c "-", then
+    standard input is filtered to standard output; otherwise the file is
+    filtered in-place.
+
+    @param ctx The cleaning context.
+    @param dir The directory of the previous entry, which is reused if
+    the entry is in the same directory.
+    @param batch The batch to add a cleaned file to, or @c NULL.
+    @param file_name The list entry.
+    @param jmp_if_error Exception handling address. */
+static void process_list_entry(
+    struct cleantxt_ctx *ctx,
+    struct file_dir *dir,
+    struct durable_batch *batch,
+    const char *file_name,
+    jmp_buf *jmp_if_error)
+{
+    /* Check if the current file name is "-" */
+    if(strcmp(file_name, STDIN_FILE_NAME) == 0)
+    {
+        /* The user specified standard input as a file to replace.
+           Filter standard input to standard output. */
+        process_file(ctx, STDIN_FILE_NAME, STDOUT_FILE_NAME, jmp_if_error);
+    }
+    else
+    {
+        /* Process current file in-place */
+        process_file_in_place(ctx, enter_file_dir(dir, file_name), batch,
+            file_name, jmp_if_error);
+    }
+}
+
+/** Processes one entry of a file list, trapping any error. An error
+    message will already have been reported if processing fails.
+
+    @param ctx The cleaning context.
+    @param dir The directory of the previous entry, which is reused if
+    the entry is in the same directory.
+    @param batch The batch to add a cleaned file to, or @c NULL.
+    @param file_name The list entry.
+    @return @c TRUE on success, or @c FALSE on failure. */
+static int try_list_entry(
+    struct cleantxt_ctx *ctx,
+    struct file_dir *dir,
+    struct durable_batch *batch,
+    const char *file_name)
+{
+    /* on_error: Execution branches here if processing fails */
+    jmp_buf on_error;
+
+    if(setjmp(on_error))
+    {
+        return FALSE;
+    }
+    process_list_entry(ctx, dir, batch, file_name, &on_error);
+    return TRUE;
+}
+
+/** Takes the next file from a list, trapping any error. An error
+    message will already have been reported if the list could not go
+    on.
+
+    @param list The list.
+    @param file_name Receives the name of the file, to be released with
+    @c free(), or @c NULL once every file has been taken or if the list
+    could not go on.
+    @return @c TRUE on success, or @c FALSE on failure. */
+static int try_next_file(struct file_list *list, char **file_name)
+{
+    /* on_error: Execution branches here if the list cannot go on */
+    jmp_buf on_error;
+
+    *file_name = NULL;
+    if(setjmp(on_error))
+    {
+        return FALSE;
+    }
+    *file_name = next_list_file(list, &on_error);
+    return TRUE;
+}
+
+/** Number of files ahead of the current one that a serial run asks the
+    operating system to read the first block of in advance. The reads of
+    those blocks then proceed on the device while the current file is
+    cleaned, instead of starting only when each file is opened; the rest
+    of each file is read ahead as it is cleaned. */
+#define PREFETCH_FILES 8
+
+/** Commits a batch of cleaned files, then empties it.
+
+    @param batch The batch.
+    @return @c TRUE if every file in the batch was replaced, or @c FALSE
+    otherwise. */
+static int commit_batch(struct durable_batch *batch)
+{
+    /* all_ok: Cleared if any file could not be replaced */
+    /* i: Index of the current file */
+    int all_ok = TRUE;
+    size_t i;
+
+    commit_durable_batch(batch);
+    for(i = 0; i < batch->count; i++)
+    {
+        if(batch->files[i].failed)
+        {
+            all_ok = FALSE;
+        }
+    }
+    clear_durable_batch(batch);
+    return all_ok;
+}
+
+/** Processes a list of files one at a time. Consecutive files in the
+    same directory are named relative to it, so that its path is looked
+    up once rather than for every operation on every file. With
+    #options.durable set, cleaned files replace their originals in
+    batches. Files are read ahead, unless their names arrive through a
+    pipe, in which case each file is started as soon as its name has
+    been read.
+
+    @param ctx The cleaning context.
+    @param list The list of files.
+    @return @c TRUE if every file was processed successfully, or
+    @c FALSE otherwise. */
+static int process_file_list_serial(
+    struct cleantxt_ctx *ctx,
+    struct file_list *list)
+{
+    /* all_ok: Cleared once any file fails */
+    /* ahead: Names taken from the list and being read ahead, in a ring */
+    /* first: Index in ahead of the current file */
+    /* count: Number of names in ahead */
+    /* more: Cleared once no more names are to be taken from the list */
+    /* ahead_max: Number of names to hold, counting the current file */
+    /* dir: Directory of the current file */
+    /* ahead_dir: Directory of the file last read ahead */
+    /* durable: Storage for the batch of cleaned files */
+    /* batch: The batch of cleaned files, if there is one */
+    /* ok: Set if the current file was processed successfully */
+    int all_ok = TRUE;
+    char *ahead[PREFETCH_FILES];
+    size_t first = 0;
+    size_t count = 0;
+    int more = TRUE;
+    const size_t ahead_max = list_may_wait(list) ? 1 : PREFETCH_FILES;
+    struct file_dir dir;
+    struct file_dir ahead_dir;
+    struct durable_batch durable;
+    struct durable_batch *batch = NULL;
+    int ok;
+
+    init_file_dir(&dir);
+    init_file_dir(&ahead_dir);
+    if(options.durable)
+    {
+        init_durable_batch(&durable, 1);
+        batch = &durable;
+    }
+    for(;;)
+    {
+        /* file_name: Name of the current file */
+        char *file_name;
+
+        while(more && count < ahead_max)
+        {
+            if(!try_next_file(list, &file_name))
+            {
+                /* The files already taken come before the failure in
+                   the list, so they are still processed */
+                all_ok = FALSE;
+                more = options.keep_going;
+                continue;
+            }
+            if(!file_name)
+            {
+                more = FALSE;
+                break;
+            }
+            if(strcmp(file_name, STDIN_FILE_NAME) != 0)
+            {
+                prefetch_file(enter_file_dir(&ahead_dir, file_name),
+                    file_name, CLEAN_STREAM_BUFFER_SIZE);
+            }
+            ahead[(first + count) % PREFETCH_FILES] = file_name;
+            count++;
+        }
+        if(count == 0)
+        {
+            break;
+        }
+
+        file_name = ahead[first];
+        first = (first + 1) % PREFETCH_FILES;
+        count--;
+        ok = try_list_entry(ctx, &dir, batch, file_name);
+        free(file_name);
+        if(ok && batch && batch->count >= batch->capacity)
+        {
+            ok = commit_batch(batch);
+        }
+        if(!ok)
+        {
+            all_ok = FALSE;
+            if(!options.keep_going)
+            {
+                break;
+            }
+        }
+    }
+    while(count > 0)
+    {
+        free(ahead[first]);
+        first = (first + 1) % PREFETCH_FILES;
+        count--;
+    }
+    if(batch && !commit_batch(batch))
+    {
+        all_ok = FALSE;
+    }
+    close_file_dir(&ahead_dir);
+    close_file_dir(&dir);
+    return all_ok;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/** Number of files that may be in flight for each worker thread; i.e.
+    handed out to a worker but not yet reported on. Allowing more than
+    one keeps the workers busy while the outcome of a slow file is
+    awaited, while still bounding the memory held by pending error
+    messages. */
+#define FILES_IN_FLIGHT_PER_JOB 4
+
+/** Outcome of processing one file in a parallel run */
+struct file_slot
+{
+    /** Set once the file has been processed */
+    int done;
+    /** Set if processing the file failed */
+    int failed;
+    /** Error messages reported while processing the file */
+    struct report_buffer messages;
+};
+
+/** State shared by the threads of a parallel run */
+struct file_pool
+{
+    /** The cleaning context that each worker makes its own copy of */
+    const struct cleantxt_ctx *ctx;
+    /** The list of files to process */
+    struct file_list *list;
+    /** Outcome of each file in flight, indexed by position in the run
+        modulo @a window */
+    struct file_slot *slots;
+    /** Maximum number of files in flight */
+    unsigned long window;
+    /** Number of worker threads */
+    unsigned long jobs;
+    /** Position in the run of the next file to hand out to a worker */
+    unsigned long next_file;
+    /** Position in the run of the next file whose outcome is to be
+        reported */
+    unsigned long next_report;
+    /** Set once no more files are to be handed out */
+    int stop;
+    /** Set once a worker has found that every file has been taken from
+        the list */
+    int exhausted;
+    /** Guards all of the above */
+    pthread_mutex_t lock;
+    /** Signalled by a worker when it has finished with a file */
+    pthread_cond_t file_done;
+    /** Signalled when a slot has been reported on and may be reused */
+    pthread_cond_t slot_free;
+};
+
+/** Commits a worker's batch of cleaned files, marks each of their
+    slots as done, then empties the batch. Each file's slot is its tag.
+
+    @param pool The shared state of the run, which must not be locked.
+    @param batch The batch. */
+static void commit_pool_batch(
+    struct file_pool *pool,
+    struct durable_batch *batch)
+{
+    /* i: Index of the current file */
+    size_t i;
+
+    commit_durable_batch(batch);
+    pthread_mutex_lock(&pool->lock);
+    for(i = 0; i < batch->count; i++)
+    {
+        /* slot: Where the outcome of the file is recorded */
+        struct file_slot *slot = batch->files[i].tag;
+
+        slot->failed = batch->files[i].failed;
+        slot->done = TRUE;
+    }
+    pthread_cond_signal(&pool->file_done);
+    pthread_mutex_unlock(&pool->lock);
+    clear_durable_batch(batch);
+}
+
+/** Worker thread of a parallel run. Each worker repeatedly claims the
+    next position in the run, takes the next file from the list and
+    processes it, capturing its error messages so that they can be
+    reported in the order the positions were claimed. With
+    #options.durable set, each worker keeps its own batch of cleaned
+    files; a file in the batch is not done until the batch is committed,
+    which happens before the worker waits for a free slot.
+
+    @param arg Points to the #file_pool.
+    @return @c NULL. */
+static void *file_pool_worker(void *arg)
+{
+    /* pool: The shared state of the run */
+    /* ctx: This worker's own copy of the cleaning context */
+    /* dir: Directory of the worker's current file */
+    /* durable: Storage for the worker's batch of cleaned files */
+    /* batch: The worker's batch of cleaned files, if it has one */
+    struct file_pool *pool = arg;
+    struct cleantxt_ctx ctx = *pool->ctx;
+    struct file_dir dir;
+    struct durable_batch durable;
+    struct durable_batch *batch = NULL;
+
+    /* The files themselves are already being processed in parallel */
+    ctx.threads = 1;
+    ctx.pipeline = FALSE;
+
+    init_file_dir(&dir);
+    if(options.durable)
+    {
+        init_durable_batch(&durable, pool->jobs);
+        batch = &durable;
+    }
+    pthread_mutex_lock(&pool->lock);
+    for(;;)
+    {
+        /* i: Position in the run of the file being processed */
+        /* slot: Where the outcome of the file is recorded */
+        /* file_name: Name of the file, or NULL if there is none */
+        /* found: Set if a file was taken from the list */
+        /* failed: Set if processing the file failed */
+        /* batched: Number of files in the batch before this one */
+        unsigned long i;
+        struct file_slot *slot;
+        char *file_name;
+        int found;
+        int failed;
+        size_t batched;
+
+        /* Wait until the file is no more than the window's width ahead
+           of the reporting, so that its slot is free. The files in this
+           worker's batch may be holding up the reporting, so commit
+           them first. */
+        while(!pool->stop && !pool->exhausted
+            && pool->next_file - pool->next_report >= pool->window)
+        {
+            if(batch && batch->count > 0)
+            {
+                pthread_mutex_unlock(&pool->lock);
+                commit_pool_batch(pool, batch);
+                pthread_mutex_lock(&pool->lock);
+                continue;
+            }
+            pthread_cond_wait(&pool->slot_free, &pool->lock);
+        }
+        if(pool->stop || pool->exhausted)
+        {
+            break;
+        }
+        i = pool->next_file++;
+        slot = &pool->slots[i % pool->window];
+        pthread_mutex_unlock(&pool->lock);
+
+        /* The list may be walking a directory, and this thread may end
+           up reading it, so the file is only taken once the position in
+           the run is claimed. Errors from the list are reported in that
+           position too. */
+        report_capture(&slot->messages);
+        batched = batch ? batch->count : 0;
+        failed = !try_next_file(pool->list, &file_name);
+        found = file_name != NULL;
+        if(found)
+        {
+            failed = !try_list_entry(&ctx, &dir, batch, file_name);
+            free(file_name);
+        }
+        report_capture(NULL);
+
+        if(batch && batch->count > batched)
+        {
+            /* The file is done once its batch is committed */
+            batch->files[batched].tag = slot;
+            if(batch->count >= batch->capacity)
+            {
+                commit_pool_batch(pool, batch);
+            }
+            pthread_mutex_lock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if(!found && !failed)
+        {
+            /* The position is left empty, as are any claimed after it */
+            pool->exhausted = TRUE;
+            pthread_cond_broadcast(&pool->slot_free);
+        }
+        slot->failed = failed;
+        slot->done = TRUE;
+        pthread_cond_signal(&pool->file_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if(batch)
+    {
+        commit_pool_batch(pool, batch);
+    }
+    close_file_dir(&dir);
+    return NULL;
+}
+
+/** Processes a list of files on several threads at once. Error messages
+    are printed in the order that the files were taken from the list.
+    Unless #options.keep_going is set, no further files are started once
+    a file fails; files already started are completed and reported on.
+
+    @param ctx The cleaning context. Each worker thread uses its own copy.
+    @param list The list of files.
+    @param jobs Number of worker threads to use.
+    @return @c TRUE if every file was processed successfully, or
+    @c FALSE otherwise. */
+static int process_file_list_parallel(
+    struct cleantxt_ctx *ctx,
+    struct file_list *list,
+    unsigned long jobs)
+{
+    /* pool: The shared state of the run */
+    /* threads: The worker threads */
+    /* started: Number of worker threads successfully started */
+    /* i: Index of the current thread */
+    /* all_ok: Cleared once any file fails */
+    struct file_pool pool;
+    pthread_t *threads;
+    unsigned long started;
+    unsigned long i;
+    int all_ok = TRUE;
+
+    pool.ctx = ctx;
+    pool.list = list;
+    pool.window = jobs * (options.durable
+        ? DURABLE_BATCH_FILES
+        : FILES_IN_FLIGHT_PER_JOB);
+    pool.jobs = jobs;
+    pool.slots = calloc(pool.window, sizeof(struct file_slot));
+    threads = malloc(jobs * sizeof(pthread_t));
+    if(!pool.slots || !threads)
+    {
+        free(pool.slots);
+        free(threads);
+        return process_file_list_serial(ctx, list);
+    }
+    pool.next_file = 0;
+    pool.next_report = 0;
+    pool.stop = FALSE;
+    pool.exhausted = FALSE;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.file_done, NULL);
+    pthread_cond_init(&pool.slot_free, NULL);
+
+    for(started = 0; started < jobs; started++)
+    {
+        if(pthread_create(&threads[started], NULL, file_pool_worker, &pool))
+        {
+            break;
+        }
+    }
+    if(started == 0)
+    {
+        /* Nothing has been taken from the list yet */
+        all_ok = process_file_list_serial(ctx, list);
+    }
+
+    /* Report on each file in turn, as soon as it is done */
+    pthread_mutex_lock(&pool.lock);
+    while(started > 0)
+    {
+        /* slot: Where the outcome of the next file is recorded */
+        struct file_slot *slot = &pool.slots[pool.next_report % pool.window];
+
+        /* Unless no more files are to be handed out, the next one will
+           be done in time even if it has not been claimed yet */
+        while(!slot->done && (pool.next_report < pool.next_file
+            || !(pool.stop || pool.exhausted)))
+        {
+            pthread_cond_wait(&pool.file_done, &pool.lock);
+        }
+        if(!slot->done)
+        {
+            break;
+        }
+        pthread_mutex_unlock(&pool.lock);
+        report_release(&slot->messages);
+        pthread_mutex_lock(&pool.lock);
+        if(slot->failed)
+        {
+            all_ok = FALSE;
+            if(!options.keep_going)
+            {
+                pool.stop = TRUE;
+            }
+        }
+        slot->done = FALSE;
+        pool.next_report++;
+        pthread_cond_broadcast(&pool.slot_free);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    for(i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool.slot_free);
+    pthread_cond_destroy(&pool.file_done);
+    pthread_mutex_destroy(&pool.lock);
+    free(threads);
+    free(pool.slots);
+    return all_ok;
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/** Compiles the patterns in #options.exclude_patterns into a set of
+    rules.
+
+    @param excludes Receives the rules, or @c NULL if no patterns were
+    given.
+    @return Zero on success, or @c ENOMEM. */
+static int compile_excludes(struct ignore_rules **excludes)
+{
+    /* rules: The rules compiled */
+    /* i: Index of the pattern being compiled */
+    struct ignore_rules *rules;
+    int i;
+
+    *excludes = NULL;
+    if(options.exclude_count == 0)
+    {
+        return 0;
+    }
+    rules = new_ignore_rules();
+    if(!rules)
+    {
+        return ENOMEM;
+    }
+    for(i = 0; i < options.exclude_count; i++)
+    {
+        if(add_ignore_rule(rules, options.exclude_patterns[i].pattern,
+            options.exclude_patterns[i].include) != 0)
+        {
+            free_ignore_rules(rules);
+            return ENOMEM;
+        }
+    }
+    *excludes = rules;
+    return 0;
+}
+
+/** Opens the list of files named by the user, walking directories if
+    #options.recursive is set, and reading further names from the file
+    named by #options.files0_from if that is set. What is walked is
+    subject to #options.exclude_patterns and #options.gitignore.
+
+    @param file_name_index The names given by the user, terminated with
+    a @c NULL element.
+    @param names_file Receives the stream that further names are read
+    from, or @c NULL if there is none.
+    @param jmp_if_error Exception handling address.
+    @return The list. */
+static struct file_list *open_user_list(
     const char *const *file_name_index,
+    FILE **names_file,
     jmp_buf *jmp_if_error)
 {
-    while(*file_name_index)
+    /* names_desc: Name of the stream as reported to the user */
+    /* excludes: Rules for what to leave out of walks */
+    /* list: The list */
+    const char *names_desc = options.files0_from;
+    struct ignore_rules *excludes;
+    struct file_list *list = NULL;
+
+    *names_file = NULL;
+    if(options.files0_from
+        && strcmp(options.files0_from, STDIN_FILE_NAME) == 0)
+    {
+        *names_file = stdin;
+        names_desc = STDIN_DESCRIPTION;
+    }
+    else if(options.files0_from)
+    {
+        open_file(options.files0_from, INPUT_MODE, names_file, jmp_if_error);
+    }
+    if(compile_excludes(&excludes) == 0)
     {
-        /* Check if the current file name is "-" */
-        if(strcmp(*file_name_index, STDIN_FILE_NAME) == 0)
+        list = open_file_list(file_name_index, *names_file, names_desc,
+            options.recursive, excludes, options.gitignore);
+    }
+    if(!list)
+    {
+        if(*names_file && *names_file != stdin)
         {
-            /* The user specified standard input as a file to replace.
-               Filter standard input to standard output. */
-            process_file(STDIN_FILE_NAME, STDOUT_FILE_NAME, jmp_if_error);
+            fclose(*names_file);
+        }
+        report_error(ENOMEM, "Unable to start the file list");
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+    return list;
+}
+
+/** Closes a list opened with #open_user_list.
+
+    @param list The list.
+    @param names_file The stream that further names were read from, or
+    @c NULL. */
+static void close_user_list(struct file_list *list, FILE *names_file)
+{
+    close_file_list(list);
+    if(names_file && names_file != stdin)
+    {
+        fclose(names_file);
+    }
+}
+
+void process_file_list(
+    struct cleantxt_ctx *ctx,
+    const char *const *file_name_index,
+    jmp_buf *jmp_if_error)
+{
+    /* names_file: Stream that further names are read from */
+    /* list: The files to process */
+    /* all_ok: Set if every file was processed successfully */
+    FILE *names_file;
+    struct file_list *list = open_user_list(file_name_index, &names_file,
+        jmp_if_error);
+    int all_ok;
+
+#   ifdef HAVE_PTHREAD_H
+        if(options.jobs > 1)
+        {
+            all_ok = process_file_list_parallel(ctx, list, options.jobs);
         }
         else
+#   endif /* HAVE_PTHREAD_H */
+    {
+        all_ok = process_file_list_serial(ctx, list);
+    }
+    close_user_list(list, names_file);
+    if(!all_ok)
+    {
+        longjmp(*jmp_if_error, TRUE);
+    }
+}
+
+/** Checks one entry of a file list, and reports it if it needs
+    cleaning. If the entry is @c "-", then standard input is checked.
+    Other files that look binary are skipped, as when cleaning them.
+
+    @param ctx The cleaning context.
+    @param file_name The list entry.
+    @param jmp_if_error Exception handling address.
+    @return Non-zero if the file needs cleaning. */
+static int check_list_entry(
+    struct cleantxt_ctx *ctx,
+    const char *file_name,
+    jmp_buf *jmp_if_error)
+{
+    /* is_stdin: Set if the entry is "-" */
+    /* file_desc: Name of the input file as reported to the user */
+    /* input_file: Stream object associated with the input file */
+    /* modified_at: Offset of the first byte that would change */
+    /* modified: Set if the file needs cleaning */
+    /* on_check_stream_error: Handler for I/O errors in check_stream() */
+    const int is_stdin = strcmp(file_name, STDIN_FILE_NAME) == 0;
+    const char *const file_desc = is_stdin ? STDIN_DESCRIPTION : file_name;
+    FILE *input_file;
+    unsigned long modified_at;
+    int modified;
+    jmp_buf on_check_stream_error;
+
+    if(is_stdin)
+    {
+        input_file = stdin;
+    }
+    else
+    {
+        open_file(file_name, INPUT_MODE, &input_file, jmp_if_error);
+        if(sniff_binary(input_file, file_name, jmp_if_error))
+        {
+            count_binary_skipped();
+            close_file(input_file, file_name, jmp_if_error);
+            return FALSE;
+        }
+    }
+
+    if(setjmp(on_check_stream_error))
+    {
+        /* Execution branches here if check_stream() encounters an
+           I/O error */
+        report_error(errno, "%s", file_desc);
+        if(!is_stdin)
+        {
+            fclose(input_file);
+        }
+        longjmp(*jmp_if_error, TRUE);
+        /* Non-local return */
+    }
+    modified = check_stream(ctx, input_file, &modified_at,
+        &on_check_stream_error) == CSR_STREAM_MODIFIED;
+    if(modified)
+    {
+        printf("%s: needs cleaning from offset %lu\n",
+            file_desc, modified_at);
+    }
+    if(!is_stdin)
+    {
+        close_file(input_file, file_name, jmp_if_error);
+    }
+    return modified;
+}
+
+/** Checks one entry of a file list, trapping any error. An error
+    message will already have been reported if checking fails.
+
+    @param ctx The cleaning context.
+    @param file_name The list entry.
+    @param modified Receives non-zero if the file needs cleaning.
+    @return @c TRUE on success, or @c FALSE on failure. */
+static int try_check_entry(
+    struct cleantxt_ctx *ctx,
+    const char *file_name,
+    int *modified)
+{
+    /* on_error: Execution branches here if checking fails */
+    jmp_buf on_error;
+
+    if(setjmp(on_error))
+    {
+        return FALSE;
+    }
+    *modified = check_list_entry(ctx, file_name, &on_error);
+    return TRUE;
+}
+
+unsigned long check_file_list(
+    struct cleantxt_ctx *ctx,
+    const char *const *file_name_index,
+    jmp_buf *jmp_if_error)
+{
+    /* modified_count: Number of files that need cleaning */
+    /* names_file: Stream that further names are read from */
+    /* list: The files to check */
+    /* all_ok: Cleared once any file fails */
+    /* more: Cleared once no more names are to be taken from the list */
+    /* file_name: Name of the current file */
+    /* modified: Set if the current file needs cleaning */
+    unsigned long modified_count = 0;
+    FILE *names_file;
+    struct file_list *list = open_user_list(file_name_index, &names_file,
+        jmp_if_error);
+    int all_ok = TRUE;
+    int more = TRUE;
+    char *file_name;
+    int modified;
+
+    while(more)
+    {
+        if(!try_next_file(list, &file_name))
         {
-            /* Process current file in-place */
-            process_file_in_place(*file_name_index, jmp_if_error);
+            all_ok = FALSE;
+            more = options.keep_going;
+            continue;
         }
-        file_name_index++;
+        if(!file_name)
+        {
+            break;
+        }
+        if(!try_check_entry(ctx, file_name, &modified))
+        {
+            all_ok = FALSE;
+            more = options.keep_going;
+        }
+        else if(modified)
+        {
+            modified_count++;
+        }
+        free(file_name);
+    }
+    close_user_list(list, names_file);
+    if(!all_ok)
+    {
+        longjmp(*jmp_if_error, TRUE);
     }
+    return modified_count;
 }
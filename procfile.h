@@ -20,11 +20,14 @@
 #ifndef PROCFILE_H
 #define PROCFILE_H
 
+struct cleantxt_ctx;
+
 /** Reads an input file and writes filtered output to a given output
     file. If any errors are encountered during the operation, then an
     error message will be displayed and the program will terminate with
     failure status.
 
+    @param ctx The cleaning context.
     @param input_file_name The name of the input file. If @a
     input_file_name is @c "-", then standard input will be used. Must
     not be @c NULL.
@@ -32,20 +35,55 @@
     output_file_name is @c "-", then standard output will be used. Must
     not be @c NULL. */
 extern void process_file(
+    struct cleantxt_ctx *ctx,
     const char *input_file_name,
     const char *output_file_name,
     jmp_buf *jmp_if_error);
 
 /** Processes a list of files in-place. If an error occurs while
     processing any of the files, then an error message will be displayed
-    and the program will terminate with failure status.
+    and the program will terminate with failure status. Up to
+    #options.jobs files are processed at once; error messages are
+    displayed in list order regardless. Unless #options.keep_going is
+    set, no further files are started once one fails. If
+    #options.recursive is set, then a directory in the list stands for
+    the regular files within it and its subdirectories, which are
+    processed as they are found.
 
+    @param ctx The cleaning context. When several files are processed at
+    once, each thread uses its own copy.
     @param file_name_index An array containing the file name of each
     file to filter in-place. The array must be terminated with a @c NULL
     element. If an element contains @c "-", then standard input will be
     filtered to standard output. */
 extern void process_file_list(
+    struct cleantxt_ctx *ctx,
+    const char *const *file_name_index,
+    jmp_buf *jmp_if_error);
+
+/** Checks whether each file in a list needs cleaning, without modifying
+    any of them. For each file that does, its name and the offset of the
+    first byte that would change are written to standard output. If an
+    error occurs while reading any of the files, then an error message
+    will be displayed and the program will terminate with failure
+    status. Unless #options.keep_going is set, no further files are
+    checked once one fails.
+
+    @param ctx The cleaning context.
+    @param file_name_index An array containing the file name of each
+    file to check. The array must be terminated with a @c NULL element.
+    If an element contains @c "-", then standard input will be checked.
+    Directories are walked as for #process_file_list.
+    @return The number of files that need cleaning. */
+extern unsigned long check_file_list(
+    struct cleantxt_ctx *ctx,
     const char *const *file_name_index,
     jmp_buf *jmp_if_error);
 
+/** Reports how many files have been skipped so far, by
+    #process_file_list and #check_file_list, because they look binary.
+
+    @return The number of files skipped. */
+extern unsigned long binary_files_skipped(void);
+
 #endif /* !PROCFILE_H */
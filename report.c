@@ -0,0 +1,183 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file report.c
+    Reporting of error messages about the files being processed.
+
+    When several files are processed at once, each worker thread
+    captures the messages about its current file, so that they can be
+    printed in the same order as the files were given no matter which
+    file finishes first. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#ifdef HAVE_ERROR_H
+#   include <error.h>
+#else
+#   include <compat/error.h>
+#endif /* HAVE_ERROR_H */
+
+#ifndef HAVE_PROGRAM_INVOCATION_SHORT_NAME
+#   include <compat/progname.h>
+#endif
+
+#include "report.h"
+
+/** Maximum length of a formatted message, not counting the program
+    name or error description. Messages usually quote a file name. */
+#define REPORT_MESSAGE_MAX (PATH_MAX + 256)
+
+#ifdef HAVE_PTHREAD_H
+
+/** Key for each thread's capture buffer */
+static pthread_key_t capture_key;
+
+/** Ensures that #capture_key is created exactly once */
+static pthread_once_t capture_key_once = PTHREAD_ONCE_INIT;
+
+/** Creates #capture_key */
+static void create_capture_key(void)
+{
+    pthread_key_create(&capture_key, NULL);
+}
+
+struct report_buffer *report_get_capture(void)
+{
+    pthread_once(&capture_key_once, create_capture_key);
+    return pthread_getspecific(capture_key);
+}
+
+void report_capture(struct report_buffer *buffer)
+{
+    pthread_once(&capture_key_once, create_capture_key);
+    pthread_setspecific(capture_key, buffer);
+}
+
+#else
+
+/** The capture buffer; there is only one thread */
+static struct report_buffer *capture;
+
+struct report_buffer *report_get_capture(void)
+{
+    return capture;
+}
+
+void report_capture(struct report_buffer *buffer)
+{
+    capture = buffer;
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/** Appends a string to a capture buffer, enlarging it as needed.
+
+    @param buffer The buffer to append to.
+    @param str The string to append.
+    @return Non-zero on success; zero if memory ran out. */
+static int append(struct report_buffer *buffer, const char *str)
+{
+    /* len: Length of str */
+    size_t len = strlen(str);
+
+    if(buffer->len + len + 1 > buffer->size)
+    {
+        /* size: New size of the buffer */
+        /* text: The enlarged buffer */
+        size_t size = (buffer->len + len + 1) * 2;
+        char *text = realloc(buffer->text, size);
+
+        if(!text)
+        {
+            return 0;
+        }
+        buffer->text = text;
+        buffer->size = size;
+    }
+    memcpy(buffer->text + buffer->len, str, len + 1);
+    buffer->len += len;
+    return 1;
+}
+
+void report_error(int errnum, const char *format, ...)
+{
+    /* message: The formatted message */
+    /* ap: Variable argument pointer */
+    /* buffer: The calling thread's capture buffer */
+    char message[REPORT_MESSAGE_MAX];
+    va_list ap;
+    struct report_buffer *buffer = report_get_capture();
+
+    va_start(ap, format);
+    vsnprintf(message, sizeof(message), format, ap);
+    va_end(ap);
+
+    if(buffer)
+    {
+        /* len: Length of the captured text before this message */
+        size_t len = buffer->len;
+
+        if(append(buffer, program_invocation_short_name)
+            && append(buffer, ": ")
+            && append(buffer, message)
+            && (!errnum
+                || (append(buffer, ": ") && append(buffer, strerror(errnum))))
+            && append(buffer, "\n"))
+        {
+            return;
+        }
+
+        /* Memory ran out; print the message straight away rather than
+           lose it. */
+        buffer->len = len;
+        if(buffer->text)
+        {
+            buffer->text[len] = 0;
+        }
+    }
+    error(0, errnum, "%s", message);
+}
+
+void report_release(struct report_buffer *buffer)
+{
+    if(buffer->len > 0)
+    {
+        fflush(stdout);
+        fputs(buffer->text, stderr);
+    }
+    report_discard(buffer);
+}
+
+void report_discard(struct report_buffer *buffer)
+{
+    free(buffer->text);
+    buffer->text = NULL;
+    buffer->len = 0;
+    buffer->size = 0;
+}
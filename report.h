@@ -0,0 +1,83 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file report.h
+    Reporting of error messages about the files being processed. */
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stddef.h>
+
+/** @def REPORT_FORMAT
+    Lets GCC check the arguments of #report_error against its format
+    string. */
+#ifdef __GNUC__
+#   define REPORT_FORMAT __attribute__((format(printf, 2, 3)))
+#else
+#   define REPORT_FORMAT /* Intentionally left blank */
+#endif
+
+/** Holds error messages that have been captured rather than printed */
+struct report_buffer
+{
+    /** The captured text, or @c NULL if nothing has been captured */
+    char *text;
+    /** Length of the captured text, in bytes */
+    size_t len;
+    /** Size of the memory allocated for @a text, in bytes */
+    size_t size;
+};
+
+/** Prints an error message to standard error, in the same format as
+    GNU libc's @c error() function. If the calling thread is capturing
+    messages, then the message is appended to its capture buffer
+    instead.
+
+    @param errnum If non-zero, then a description of the @c errno code
+    in @a errnum is appended to the message.
+    @param format The @c printf() style format string for the message.
+    Arguments for the format string should follow afterwards. */
+extern void report_error(int errnum, const char *format, ...)
+    REPORT_FORMAT;
+
+/** Starts or stops capturing the calling thread's error messages.
+    Other threads are not affected.
+
+    @param buffer The buffer that subsequent messages reported by this
+    thread are appended to, or @c NULL to print them straight away. Its
+    members must be zeroed before it is first used. */
+extern void report_capture(struct report_buffer *buffer);
+
+/** Finds the buffer that the calling thread's error messages are
+    being captured in.
+
+    @return The buffer, or @c NULL if the thread is not capturing. */
+extern struct report_buffer *report_get_capture(void);
+
+/** Prints the messages held in a capture buffer to standard error, then
+    releases its memory and empties it.
+
+    @param buffer The buffer to print. */
+extern void report_release(struct report_buffer *buffer);
+
+/** Releases the memory held by a capture buffer and empties it, without
+    printing anything.
+
+    @param buffer The buffer to discard. */
+extern void report_discard(struct report_buffer *buffer);
+
+#endif /* !REPORT_H */
@@ -0,0 +1,209 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckbytscn.c
+    Test suite for bytescan module. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <check.h>
+
+#include "../options.h"
+#include "../bytescan.h"
+
+/** Length of the test buffer. This covers the unrolled vector loops,
+    the single-register loops and the byte-at-a-time tail. */
+#define BUF_LEN 200
+
+/** The bytes that #scan_special_bytes must stop at */
+static const unsigned char SPECIAL[] = { ' ', '\t', '\n', '\r', 26 };
+
+/** Selects the next scanner variant that the processor supports.
+
+    @param variant Points to the previously tested variant, or #SM_AUTO
+    to start with the first; updated to the newly selected variant.
+    @return Non-zero if a variant was selected; zero once every variant
+    has been tried. */
+static int next_variant(simd_mode_t *variant)
+{
+    while(*variant < SM_AVX512)
+    {
+        (*variant)++;
+        if(select_byte_scanner(*variant))
+        {
+            ck_assert(selected_byte_scanner() == *variant);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** Fills a buffer with ordinary characters, including some that lie
+    close in value to the special bytes. */
+static void fill_ordinary(unsigned char *buf, size_t len)
+{
+    /* ORDINARY: Ordinary characters to cycle through */
+    /* i: Index into buf */
+    static const unsigned char ORDINARY[] =
+        { 'a', 0, 8, 11, 12, 14, 25, 27, 31, 33, 0x89, 0xa0, 0xff };
+    size_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        buf[i] = ORDINARY[i % sizeof(ORDINARY)];
+    }
+}
+
+START_TEST(no_special_bytes)
+{
+    unsigned char buf[BUF_LEN];
+    size_t len;
+    simd_mode_t variant = SM_AUTO;
+
+    fill_ordinary(buf, BUF_LEN);
+    while(next_variant(&variant))
+    {
+        for(len = 0; len <= BUF_LEN; len++)
+        {
+            ck_assert(scan_special_bytes(buf, buf + len) == buf + len);
+        }
+    }
+}
+END_TEST
+
+START_TEST(each_special_byte_at_each_position)
+{
+    unsigned char buf[BUF_LEN];
+    size_t i;
+    size_t pos;
+    simd_mode_t variant = SM_AUTO;
+
+    while(next_variant(&variant))
+    {
+        for(i = 0; i < sizeof(SPECIAL); i++)
+        {
+            for(pos = 0; pos < BUF_LEN; pos++)
+            {
+                fill_ordinary(buf, BUF_LEN);
+                buf[pos] = SPECIAL[i];
+                ck_assert(scan_special_bytes(buf, buf + BUF_LEN) == buf + pos);
+                /* A special byte just past the end of the span must not
+                   be reported. */
+                ck_assert(scan_special_bytes(buf, buf + pos) == buf + pos);
+            }
+        }
+    }
+}
+END_TEST
+
+START_TEST(first_of_several)
+{
+    unsigned char buf[BUF_LEN];
+    size_t start;
+    simd_mode_t variant = SM_AUTO;
+
+    fill_ordinary(buf, BUF_LEN);
+    buf[70] = '\n';
+    buf[100] = ' ';
+    buf[101] = '\r';
+    while(next_variant(&variant))
+    {
+        for(start = 0; start <= 70; start++)
+        {
+            ck_assert(scan_special_bytes(buf + start, buf + BUF_LEN)
+                == buf + 70);
+        }
+        ck_assert(scan_special_bytes(buf + 71, buf + BUF_LEN) == buf + 100);
+        ck_assert(scan_special_bytes(buf + 101, buf + BUF_LEN) == buf + 101);
+    }
+}
+END_TEST
+
+START_TEST(binary_detection)
+{
+    /* TEXT_BYTES: Bytes found in text, including the control characters
+       allowed in it and bytes with the top bit set */
+    /* BINARY_BYTES: Control characters that text does not contain */
+    static const unsigned char TEXT_BYTES[] =
+        { 'a', ' ', 8, 9, 10, 11, 12, 13, 26, 27, 0x7f, 0xc3, 0xa9, 0xff };
+    static const unsigned char BINARY_BYTES[] = { 1, 7, 14, 25, 28, 31 };
+    unsigned char buf[BUF_LEN];
+    size_t i;
+    size_t pos;
+    simd_mode_t variant = SM_AUTO;
+
+    while(next_variant(&variant))
+    {
+        for(i = 0; i < BUF_LEN; i++)
+        {
+            buf[i] = TEXT_BYTES[i % sizeof(TEXT_BYTES)];
+        }
+        ck_assert(!looks_binary(buf, buf));
+        ck_assert(!looks_binary(buf, buf + BUF_LEN));
+
+        /* One null anywhere makes the span binary */
+        for(pos = 0; pos < BUF_LEN; pos++)
+        {
+            buf[pos] = 0;
+            ck_assert(looks_binary(buf, buf + BUF_LEN));
+            ck_assert(!looks_binary(buf, buf + pos));
+            buf[pos] = TEXT_BYTES[pos % sizeof(TEXT_BYTES)];
+        }
+
+        /* Up to one byte in 16 may be a stray control character, wherever
+           it falls */
+        for(i = 0; i < BUF_LEN / 16; i++)
+        {
+            buf[i * 13 + 5] = BINARY_BYTES[i % sizeof(BINARY_BYTES)];
+        }
+        ck_assert(!looks_binary(buf, buf + BUF_LEN));
+        buf[BUF_LEN - 1] = BINARY_BYTES[0];
+        ck_assert(looks_binary(buf, buf + BUF_LEN));
+    }
+}
+END_TEST
+
+START_TEST(auto_selects_supported_variant)
+{
+    ck_assert(byte_scanner_supported(SM_SCALAR));
+    ck_assert(select_byte_scanner(SM_AUTO));
+    ck_assert(selected_byte_scanner() != SM_AUTO);
+    ck_assert(byte_scanner_supported(selected_byte_scanner()));
+    /* Nothing wider than the automatic choice may be supported */
+    if(selected_byte_scanner() < SM_AVX512)
+    {
+        ck_assert(!byte_scanner_supported(selected_byte_scanner() + 1));
+    }
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("bytescan");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_test(tc_core, no_special_bytes);
+    tcase_add_test(tc_core, each_special_byte_at_each_position);
+    tcase_add_test(tc_core, first_of_several);
+    tcase_add_test(tc_core, binary_detection);
+    tcase_add_test(tc_core, auto_selects_supported_variant);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
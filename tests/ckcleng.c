@@ -0,0 +1,298 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckcleng.c
+    Test suite for cleaneng module. These tests concentrate on the
+    engine's handling of span and buffer boundaries; the filtering rules
+    themselves are covered by the cleanstr test suite. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <check.h>
+
+#include "../cleanstr.h"
+#include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
+
+/** Size of the output buffer used by the tests. This is deliberately
+    tiny so that the sink has to be drained many times. */
+#define SINK_SIZE 3
+
+/** Cleaning context whose configuration the tests use */
+static struct cleantxt_ctx ctx;
+
+/** Accumulates everything drained from the test sink */
+static char drained[256];
+
+/** Number of bytes in #drained */
+static size_t drained_len;
+
+/** Sink flush function that appends to #drained */
+static clean_engine_status_t flush_to_drained(struct clean_sink *sink)
+{
+    ck_assert(drained_len + sink->len < sizeof(drained));
+    memcpy(drained + drained_len, sink->buf, sink->len);
+    drained_len += sink->len;
+    sink->len = 0;
+    return CE_OK;
+}
+
+/** Feeds @a input through a fresh engine in spans of @a span_len bytes
+    and checks that the output matches @a expect_str.
+
+    @param input_str Input text.
+    @param expect_str Expected output text.
+    @param span_len Length of each span fed to the engine.
+    @return The engine's verdict on whether the stream was modified. */
+static clean_stream_result_t try_spans(
+    const char *input_str,
+    const char *expect_str,
+    size_t span_len)
+{
+    /* eng: Engine under test */
+    /* sink: Output sink with a tiny buffer */
+    /* buf: Storage for the sink */
+    /* input_len: Length of the input text */
+    /* pos: Position of the next span in the input text */
+    struct clean_engine eng;
+    struct clean_sink sink;
+    unsigned char buf[SINK_SIZE];
+    size_t input_len = strlen(input_str);
+    size_t pos;
+
+    drained_len = 0;
+    sink.buf = buf;
+    sink.len = 0;
+    sink.size = SINK_SIZE;
+    sink.flush = flush_to_drained;
+    sink.handle = NULL;
+
+    clean_engine_init(&eng, &ctx);
+    for(pos = 0; pos < input_len; pos += span_len)
+    {
+        /* len: Length of the current span */
+        size_t len = (input_len - pos < span_len) ? input_len - pos : span_len;
+
+        ck_assert(clean_engine_feed(&eng,
+            (const unsigned char *)input_str + pos, len, &sink) == CE_OK);
+    }
+    ck_assert(clean_engine_finish(&eng, &sink) == CE_OK);
+    ck_assert(clean_sink_flush(&sink) == CE_OK);
+    ck_assert(drained_len == strlen(expect_str));
+    ck_assert(memcmp(drained, expect_str, drained_len) == 0);
+    return eng.result;
+}
+
+START_TEST(spans_match_whole_input)
+{
+    static const char INPUT[] = "ab \t cd\r\n\r\n  ef\t\n\n";
+    static const char EXPECT[] = "ab   cd\n\n  ef\n";
+    size_t span_len;
+
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ctx.tab_size = 4;
+    for(span_len = 1; span_len <= sizeof(INPUT); span_len++)
+    {
+        ck_assert(try_spans(INPUT, EXPECT, span_len) == CSR_STREAM_MODIFIED);
+    }
+}
+END_TEST
+
+START_TEST(cr_split_across_spans)
+{
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_CRLF;
+    ck_assert(try_spans("one\r\ntwo\r\n", "one\r\ntwo\r\n", 4)
+        == CSR_STREAM_UNMODIFIED);
+    ck_assert(try_spans("one\rtwo\r", "one\r\ntwo\r\n", 4)
+        == CSR_STREAM_MODIFIED);
+}
+END_TEST
+
+START_TEST(unmodified_across_spans)
+{
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ctx.whitespace_mode = WM_TAB;
+    ck_assert(try_spans("\tx  y\n\n\tz\n", "\tx  y\n\n\tz\n", 2)
+        == CSR_STREAM_UNMODIFIED);
+}
+END_TEST
+
+START_TEST(input_after_ctrl_z_ignored)
+{
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ctx.stop_at_ctrl_z = 1;
+    ck_assert(try_spans("abc\032 def\n", "abc\n\032", 1)
+        == CSR_STREAM_MODIFIED);
+}
+END_TEST
+
+START_TEST(tab_sizes_agree)
+{
+    /* TABBED: Input text containing tabs */
+    /* expanded: TABBED with its tabs expanded into spaces */
+    /* tab_size: Tab size under test; both powers of two and others */
+    static const char TABBED[] = "a\tbc\t\tdef\t!\n";
+    char expanded[128];
+    int tab_size;
+
+    for(tab_size = 1; tab_size <= 17; tab_size++)
+    {
+        /* i: Index into TABBED */
+        /* col: Column position within expanded */
+        size_t i;
+        size_t col = 0;
+
+        for(i = 0; TABBED[i]; i++)
+        {
+            if(TABBED[i] == '\t')
+            {
+                do
+                {
+                    expanded[col++] = ' ';
+                }
+                while(col % tab_size != 0);
+            }
+            else
+            {
+                expanded[col++] = TABBED[i];
+            }
+        }
+        expanded[col] = 0;
+
+        cleantxt_ctx_init(&ctx);
+        ctx.eol_mode = EM_LF;
+        ctx.tab_size = tab_size;
+        ctx.tab_min = 1;
+        ck_assert(try_spans(TABBED, expanded, 5) == CSR_STREAM_MODIFIED);
+        ctx.whitespace_mode = WM_TAB;
+        ck_assert(try_spans(expanded, TABBED, 5) == CSR_STREAM_MODIFIED);
+        ck_assert(try_spans(TABBED, TABBED, 5) == CSR_STREAM_UNMODIFIED);
+    }
+}
+END_TEST
+
+/** Feeds @a input_str through a fresh engine in spans of @a span_len
+    bytes, checking that it is modified from offset @a expect_offset. */
+static void assert_modified_at(
+    const char *input_str,
+    size_t span_len,
+    unsigned long expect_offset)
+{
+    /* eng: Engine under test */
+    /* sink: Output sink with a tiny buffer */
+    /* buf: Storage for the sink */
+    /* input_len: Length of the input text */
+    /* pos: Position of the next span in the input text */
+    struct clean_engine eng;
+    struct clean_sink sink;
+    unsigned char buf[SINK_SIZE];
+    size_t input_len = strlen(input_str);
+    size_t pos;
+
+    drained_len = 0;
+    sink.buf = buf;
+    sink.len = 0;
+    sink.size = SINK_SIZE;
+    sink.flush = flush_to_drained;
+    sink.handle = NULL;
+
+    clean_engine_init(&eng, &ctx);
+    for(pos = 0; pos < input_len; pos += span_len)
+    {
+        /* len: Length of the current span */
+        size_t len = (input_len - pos < span_len) ? input_len - pos : span_len;
+
+        ck_assert(clean_engine_feed(&eng,
+            (const unsigned char *)input_str + pos, len, &sink) == CE_OK);
+    }
+    ck_assert(clean_engine_finish(&eng, &sink) == CE_OK);
+    ck_assert(eng.result == CSR_STREAM_MODIFIED);
+    ck_assert_msg(eng.modified_at == expect_offset,
+        "\"%s\" modified at %lu, expected %lu",
+        input_str, eng.modified_at, expect_offset);
+}
+
+START_TEST(modification_offsets)
+{
+    size_t span_len;
+
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ctx.tab_size = 4;
+    for(span_len = 1; span_len <= 8; span_len++)
+    {
+        /* Trailing whitespace, reported from its start */
+        assert_modified_at("abc\ndef  \nghi\n", span_len, 7);
+        assert_modified_at("abc\n\n  \nghi\n", span_len, 5);
+        /* Foreign end-of-line sequence */
+        assert_modified_at("abc\ndef\r\n", span_len, 7);
+        /* Tab expanded into spaces */
+        assert_modified_at("abc\n\tdef\n", span_len, 4);
+        /* Missing final end-of-line sequence */
+        assert_modified_at("abc\ndef", span_len, 7);
+        /* Excess blank lines at the end */
+        assert_modified_at("abc\n\n\n", span_len, 4);
+    }
+
+    ctx.remove_ctrl_z = 1;
+    assert_modified_at("abc\nd\032ef\n", 3, 5);
+}
+END_TEST
+
+START_TEST(sink_without_flush_overflows)
+{
+    struct clean_engine eng;
+    struct clean_sink sink;
+    unsigned char buf[SINK_SIZE];
+
+    sink.buf = buf;
+    sink.len = 0;
+    sink.size = SINK_SIZE;
+    sink.flush = NULL;
+    sink.handle = NULL;
+
+    cleantxt_ctx_init(&ctx);
+    clean_engine_init(&eng, &ctx);
+    ck_assert(clean_engine_feed(&eng,
+        (const unsigned char *)"abcdef", 6, &sink) == CE_SINK_ERROR);
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("cleaneng");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_test(tc_core, spans_match_whole_input);
+    tcase_add_test(tc_core, cr_split_across_spans);
+    tcase_add_test(tc_core, unmodified_across_spans);
+    tcase_add_test(tc_core, input_after_ctrl_z_ignored);
+    tcase_add_test(tc_core, tab_sizes_agree);
+    tcase_add_test(tc_core, modification_offsets);
+    tcase_add_test(tc_core, sink_without_flush_overflows);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
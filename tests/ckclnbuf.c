@@ -0,0 +1,389 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckclnbuf.c
+    Test suite for cleanbuf module. The filtering rules themselves are
+    covered by the cleanstr test suite; these tests check that the
+    buffer interface agrees with it and honours the output size. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <check.h>
+
+#include "../cleanstr.h"
+#include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
+#include "../cleanbuf.h"
+#include "helpers/io.h"
+
+/** Length of each generated input text */
+#define INPUT_LEN 64
+
+/** Number of generated input texts tried with each configuration */
+#define INPUT_COUNT 200
+
+/** Size of the output buffers; enough for the worst case of
+    #INPUT_LEN bytes with the largest tab size tried */
+#define OUTPUT_SIZE 1024
+
+/** Characters that generated input texts are made of, weighted
+    towards the ones the engine treats specially */
+static const char INPUT_CHARS[] = "  \t\t\r\n\nab\032";
+
+/** Fills a buffer with pseudo-random text.
+
+    @param buf The buffer to fill.
+    @param len Number of bytes to fill. */
+static void random_text(char *buf, size_t len)
+{
+    /* i: Index into buf */
+    size_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        buf[i] = INPUT_CHARS[rand() % (sizeof(INPUT_CHARS) - 1)];
+    }
+}
+
+/** Configures a context for one of the combinations of options tried.
+
+    @param ctx The context to configure.
+    @param n Number of the combination. */
+static void configure(struct cleantxt_ctx *ctx, int n)
+{
+    /* TAB_SIZES: Tab sizes to cycle through */
+    static const int TAB_SIZES[] = { 1, 2, 3, 4, 8, 13 };
+
+    cleantxt_ctx_init(ctx);
+    ctx->tab_size = TAB_SIZES[n % 6];
+    ctx->tab_min = 1 + n % 3;
+    ctx->whitespace_mode = (n / 6) % 2 ? WM_TAB : WM_SPACE;
+    ctx->eol_mode = (eol_mode_t)((n / 12) % 3);
+    ctx->add_ctrl_z = (n / 36) % 2;
+    ctx->stop_at_ctrl_z = (n / 72) % 2;
+    ctx->remove_ctrl_z = (n / 144) % 2;
+}
+
+/** Number of combinations of options that #configure knows */
+#define CONFIG_COUNT 288
+
+/** Cleans a text through #clean_stream.
+
+    @param ctx The cleaning context.
+    @param input The text to clean.
+    @param input_len Length of @a input.
+    @param out Receives the cleaned text.
+    @param out_len Receives the length of the cleaned text.
+    @return The verdict of #clean_stream. */
+static clean_stream_result_t clean_via_stream(
+    struct cleantxt_ctx *ctx,
+    char *input,
+    size_t input_len,
+    char *out,
+    size_t *out_len)
+{
+    FILE *input_file = create_input_file_from_buf(input, input_len);
+    FILE *output_file = tmpfile();
+    jmp_buf on_io_error;
+    clean_stream_result_t res;
+
+    ck_assert(output_file != NULL);
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    res = clean_stream(ctx, input_file, output_file, &on_io_error);
+    rewind(output_file);
+    *out_len = fread(out, 1, OUTPUT_SIZE, output_file);
+    ck_assert(fclose(output_file) == 0);
+    ck_assert(fclose(input_file) == 0);
+    return res;
+}
+
+START_TEST(matches_clean_stream)
+{
+    struct cleantxt_ctx ctx;
+    char input[INPUT_LEN];
+    char expect[OUTPUT_SIZE];
+    char actual[OUTPUT_SIZE];
+    size_t expect_len;
+    size_t actual_len;
+    clean_stream_result_t expect_res;
+    clean_stream_result_t actual_res;
+    int n;
+    int i;
+
+    srand(1);
+    for(n = 0; n < CONFIG_COUNT; n++)
+    {
+        configure(&ctx, n);
+        for(i = 0; i < INPUT_COUNT / 10; i++)
+        {
+            random_text(input, INPUT_LEN);
+            expect_res = clean_via_stream(&ctx, input, INPUT_LEN,
+                expect, &expect_len);
+            ck_assert(clean_buffer(&ctx, input, INPUT_LEN,
+                actual, OUTPUT_SIZE, &actual_len, &actual_res) == CB_OK);
+            ck_assert(actual_len == expect_len);
+            ck_assert(memcmp(actual, expect, expect_len) == 0);
+            ck_assert(actual_res == expect_res);
+        }
+    }
+}
+END_TEST
+
+START_TEST(bound_is_sufficient)
+{
+    struct cleantxt_ctx ctx;
+    char input[INPUT_LEN];
+    char *out = malloc(OUTPUT_SIZE);
+    size_t bound;
+    size_t out_len;
+    size_t len;
+    int n;
+    int i;
+
+    ck_assert(out != NULL);
+    srand(2);
+    for(n = 0; n < CONFIG_COUNT; n++)
+    {
+        configure(&ctx, n);
+        for(i = 0; i < INPUT_COUNT; i++)
+        {
+            random_text(input, INPUT_LEN);
+            len = rand() % (INPUT_LEN + 1);
+            bound = clean_buffer_bound(&ctx, len);
+            ck_assert(bound <= OUTPUT_SIZE);
+            ck_assert(clean_buffer(&ctx, input, len,
+                out, bound, &out_len, NULL) == CB_OK);
+            ck_assert(out_len <= bound);
+        }
+    }
+
+    /* The worst cases for growth: every tab expanded into a whole tab
+       stop, and every LF or CR turned into CR+LF. */
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 8;
+    ck_assert(clean_buffer(&ctx, "\t\t\ta", 4, out, clean_buffer_bound(&ctx, 4),
+        &out_len, NULL) == CB_OK);
+    ck_assert(out_len == 26);
+    ctx.eol_mode = EM_CRLF;
+    ctx.tab_size = 1;
+    ck_assert(clean_buffer(&ctx, "a\n\nb\r", 5, out, clean_buffer_bound(&ctx, 5),
+        &out_len, NULL) == CB_OK);
+    ck_assert(out_len == 8);
+
+    ck_assert(clean_buffer_bound(&ctx, (size_t)-1) == (size_t)-1);
+    free(out);
+}
+END_TEST
+
+START_TEST(output_too_small)
+{
+    static const char INPUT[] = "\tone  \r\ntwo";
+    static const char EXPECT[] = "        one\ntwo\n";
+    struct cleantxt_ctx ctx;
+    char out[sizeof(EXPECT)];
+    size_t out_len;
+    size_t size;
+    clean_stream_result_t res;
+
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    for(size = 0; size < sizeof(EXPECT) - 1; size++)
+    {
+        ck_assert(clean_buffer(&ctx, INPUT, sizeof(INPUT) - 1,
+            out, size, &out_len, NULL) == CB_OUTPUT_TOO_SMALL);
+        ck_assert(out_len == size);
+        ck_assert(memcmp(out, EXPECT, out_len) == 0);
+    }
+    ck_assert(clean_buffer(&ctx, INPUT, sizeof(INPUT) - 1,
+        out, size, &out_len, &res) == CB_OK);
+    ck_assert(out_len == sizeof(EXPECT) - 1);
+    ck_assert(memcmp(out, EXPECT, out_len) == 0);
+    ck_assert(res == CSR_STREAM_MODIFIED);
+
+    /* Text that is already clean is reported as such */
+    ck_assert(clean_buffer(&ctx, EXPECT, sizeof(EXPECT) - 1,
+        out, sizeof(out), &out_len, &res) == CB_OK);
+    ck_assert(res == CSR_STREAM_UNMODIFIED);
+}
+END_TEST
+
+/** Cleans a text by pushing it in pieces of random length, each with
+    an output buffer of exactly #clean_push_bound bytes.
+
+    @param ctx The cleaning context.
+    @param input The text to clean.
+    @param input_len Length of @a input.
+    @param out Receives the cleaned text; #OUTPUT_SIZE bytes long.
+    @param out_len Receives the length of the cleaned text.
+    @return The verdict of #clean_push_finish. */
+static clean_stream_result_t clean_via_push(
+    struct cleantxt_ctx *ctx,
+    const char *input,
+    size_t input_len,
+    char *out,
+    size_t *out_len)
+{
+    size_t pos = 0;
+    size_t piece_len;
+    size_t len;
+    clean_stream_result_t res;
+
+    *out_len = 0;
+    ck_assert(clean_push_start(ctx) == CB_OK);
+    while(pos < input_len)
+    {
+        piece_len = 1 + rand() % 9;
+        if(piece_len > input_len - pos)
+        {
+            piece_len = input_len - pos;
+        }
+        ck_assert(*out_len + clean_push_bound(ctx, piece_len) <= OUTPUT_SIZE);
+        ck_assert(clean_push(ctx, input + pos, piece_len, out + *out_len,
+            clean_push_bound(ctx, piece_len), &len) == CB_OK);
+        *out_len += len;
+        pos += piece_len;
+    }
+    ck_assert(clean_push_finish(ctx, out + *out_len, clean_push_bound(ctx, 0),
+        &len, &res) == CB_OK);
+    *out_len += len;
+    return res;
+}
+
+START_TEST(push_matches_clean_buffer)
+{
+    struct cleantxt_ctx ctx;
+    char input[INPUT_LEN];
+    char expect[OUTPUT_SIZE];
+    char actual[OUTPUT_SIZE];
+    size_t expect_len;
+    size_t actual_len;
+    clean_stream_result_t expect_res;
+    int n;
+    int i;
+
+    srand(3);
+    for(n = 0; n < CONFIG_COUNT; n++)
+    {
+        configure(&ctx, n);
+        for(i = 0; i < INPUT_COUNT; i++)
+        {
+            random_text(input, INPUT_LEN);
+            ck_assert(clean_buffer(&ctx, input, INPUT_LEN,
+                expect, OUTPUT_SIZE, &expect_len, &expect_res) == CB_OK);
+            ck_assert(clean_via_push(&ctx, input, INPUT_LEN,
+                actual, &actual_len) == expect_res);
+            ck_assert(actual_len == expect_len);
+            ck_assert(memcmp(actual, expect, expect_len) == 0);
+        }
+    }
+}
+END_TEST
+
+START_TEST(push_holds_back_whitespace)
+{
+    struct cleantxt_ctx ctx;
+    char out[64];
+    size_t out_len;
+    size_t bound;
+    int i;
+
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ck_assert(clean_push_start(&ctx) == CB_OK);
+    ck_assert(clean_push(&ctx, "one", 3, out, sizeof(out), &out_len) == CB_OK);
+    ck_assert(out_len == 3);
+    for(i = 0; i < 4; i++)
+    {
+        /* Whitespace produces no output until it is known whether it
+           is trailing whitespace. */
+        ck_assert(clean_push(&ctx, " \t", 2, out, sizeof(out), &out_len)
+            == CB_OK);
+        ck_assert(out_len == 0);
+    }
+
+    /* The held-back gap now spans 29 columns, which the next piece has
+       to make room for; a smaller buffer is refused without consuming
+       anything. */
+    bound = clean_push_bound(&ctx, 1);
+    ck_assert(bound >= 30);
+    ck_assert(clean_push(&ctx, "x", 1, out, bound - 1, &out_len)
+        == CB_OUTPUT_TOO_SMALL);
+    ck_assert(out_len == 0);
+    ck_assert(clean_push(&ctx, "x", 1, out, bound, &out_len) == CB_OK);
+    ck_assert(out_len == 30);
+    ck_assert(memcmp(out, "                             x", 30) == 0);
+
+    /* Trailing whitespace is dropped, and a CR split from its LF is
+       still recognised as one end-of-line sequence. */
+    ck_assert(clean_push(&ctx, "  \r", 3, out, sizeof(out), &out_len)
+        == CB_OK);
+    ck_assert(out_len == 0);
+    ck_assert(clean_push(&ctx, "\ntwo", 4, out, sizeof(out), &out_len)
+        == CB_OK);
+    ck_assert(out_len == 4);
+    ck_assert(memcmp(out, "\ntwo", 4) == 0);
+    ck_assert(clean_push_finish(&ctx, out, 0, &out_len, NULL)
+        == CB_OUTPUT_TOO_SMALL);
+    ck_assert(clean_push_finish(&ctx, out, sizeof(out), &out_len, NULL)
+        == CB_OK);
+    ck_assert(out_len == 1);
+    ck_assert(out[0] == '\n');
+}
+END_TEST
+
+START_TEST(bad_config)
+{
+    struct cleantxt_ctx ctx;
+    char out[16];
+    size_t out_len;
+
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 0;
+    ck_assert(clean_buffer(&ctx, "a\tb\n", 4, out, sizeof(out), &out_len,
+        NULL) == CB_BAD_CONFIG);
+    ck_assert(out_len == 0);
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_min = 0;
+    ck_assert(clean_buffer(&ctx, "a\tb\n", 4, out, sizeof(out), &out_len,
+        NULL) == CB_BAD_CONFIG);
+    ck_assert(clean_push_start(&ctx) == CB_BAD_CONFIG);
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("cleanbuf");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_test(tc_core, matches_clean_stream);
+    tcase_add_test(tc_core, bound_is_sufficient);
+    tcase_add_test(tc_core, output_too_small);
+    tcase_add_test(tc_core, push_matches_clean_buffer);
+    tcase_add_test(tc_core, push_holds_back_whitespace);
+    tcase_add_test(tc_core, bad_config);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
@@ -0,0 +1,200 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckclnctx.c
+    Test suite for cleanctx module. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <check.h>
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include "../cleanstr.h"
+#include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
+#include "helpers/io.h"
+
+/** Input text used by the tests */
+static const char INPUT[] = "if(x)\r\n{\r\n        y;  \r\n\t}\r\n";
+
+/** Expected output from #INPUT with the #space_lf configuration */
+static const char EXPECT_SPACE_LF[] = "if(x)\n{\n        y;\n    }\n";
+
+/** Expected output from #INPUT with the #tab_crlf configuration */
+static const char EXPECT_TAB_CRLF[] = "if(x)\r\n{\r\n\t\ty;\r\n\t}\r\n";
+
+/** Configures a context to expand tabs to 4 columns and use LF */
+static void space_lf(struct cleantxt_ctx *ctx)
+{
+    cleantxt_ctx_init(ctx);
+    ctx->tab_size = 4;
+    ctx->whitespace_mode = WM_SPACE;
+    ctx->eol_mode = EM_LF;
+}
+
+/** Configures a context to fill with 4-column tabs and use CR+LF */
+static void tab_crlf(struct cleantxt_ctx *ctx)
+{
+    cleantxt_ctx_init(ctx);
+    ctx->tab_size = 4;
+    ctx->whitespace_mode = WM_TAB;
+    ctx->eol_mode = EM_CRLF;
+}
+
+/** Cleans #INPUT with a context and checks the output.
+
+    @param ctx The context to clean with.
+    @param expect_str The expected output.
+    @return Non-zero if the output matched; zero otherwise. */
+static int clean_input(struct cleantxt_ctx *ctx, const char *expect_str)
+{
+    /* input_file: File prepared with the input text */
+    /* actual_file: Temporary file that will contain actual output */
+    /* actual: Contents of actual_file */
+    /* len: Length of the actual output */
+    /* on_io_error: Execution jumps here if an I/O error is encountered */
+    FILE *input_file = create_input_file_from_str(INPUT);
+    FILE *actual_file = tmpfile();
+    char actual[sizeof(INPUT) * 2];
+    size_t len;
+    jmp_buf on_io_error;
+
+    if(!actual_file || setjmp(on_io_error))
+    {
+        return 0;
+    }
+    clean_stream(ctx, input_file, actual_file, &on_io_error);
+    rewind(actual_file);
+    len = fread(actual, 1, sizeof(actual), actual_file);
+    fclose(actual_file);
+    fclose(input_file);
+    return len == strlen(expect_str) && memcmp(actual, expect_str, len) == 0;
+}
+
+START_TEST(defaults_match_options)
+{
+    struct cleantxt_ctx ctx;
+
+    cleantxt_ctx_init(&ctx);
+    ck_assert(ctx.tab_size == DEFAULT_TAB_SIZE);
+    ck_assert(ctx.tab_min == DEFAULT_TAB_MIN);
+    ck_assert(ctx.whitespace_mode == DEFAULT_WHITESPACE_MODE);
+    ck_assert(ctx.eol_mode == DEFAULT_EOL_MODE);
+    ck_assert(!ctx.stop_at_ctrl_z && !ctx.add_ctrl_z && !ctx.remove_ctrl_z);
+
+    init_options();
+    options.tab_size = 3;
+    options.tab_min = 5;
+    options.whitespace_mode = WM_TAB;
+    options.eol_mode = EM_CR;
+    options.remove_ctrl_z = 1;
+    cleantxt_ctx_from_options(&ctx, &options);
+    ck_assert(ctx.tab_size == 3);
+    ck_assert(ctx.tab_min == 5);
+    ck_assert(ctx.whitespace_mode == WM_TAB);
+    ck_assert(ctx.eol_mode == EM_CR);
+    ck_assert(ctx.remove_ctrl_z);
+    ck_assert(!ctx.stop_at_ctrl_z && !ctx.add_ctrl_z);
+}
+END_TEST
+
+START_TEST(contexts_are_independent)
+{
+    struct cleantxt_ctx a;
+    struct cleantxt_ctx b;
+
+    /* Each context keeps its own configuration, no matter what the
+       global options say. */
+    space_lf(&a);
+    tab_crlf(&b);
+    init_options();
+    options.tab_size = 7;
+    ck_assert(clean_input(&a, EXPECT_SPACE_LF));
+    ck_assert(clean_input(&b, EXPECT_TAB_CRLF));
+    ck_assert(clean_input(&a, EXPECT_SPACE_LF));
+}
+END_TEST
+
+#ifdef HAVE_PTHREAD_H
+
+/** Number of times each thread in #concurrent_contexts cleans #INPUT */
+#define CONCURRENT_ROUNDS 200
+
+/** Cleans #INPUT repeatedly with the #tab_crlf configuration.
+
+    @param arg Unused.
+    @return @c NULL on success, or non-@c NULL on failure. */
+static void *clean_tab_crlf(void *arg)
+{
+    /* ctx: This thread's context */
+    /* i: Round counter */
+    struct cleantxt_ctx ctx;
+    int i;
+
+    (void)arg;
+    tab_crlf(&ctx);
+    for(i = 0; i < CONCURRENT_ROUNDS; i++)
+    {
+        if(!clean_input(&ctx, EXPECT_TAB_CRLF))
+        {
+            return &ctx;
+        }
+    }
+    return NULL;
+}
+
+START_TEST(concurrent_contexts)
+{
+    struct cleantxt_ctx ctx;
+    pthread_t thread;
+    void *thread_result;
+    int i;
+
+    ck_assert(pthread_create(&thread, NULL, clean_tab_crlf, NULL) == 0);
+    space_lf(&ctx);
+    for(i = 0; i < CONCURRENT_ROUNDS; i++)
+    {
+        ck_assert(clean_input(&ctx, EXPECT_SPACE_LF));
+    }
+    ck_assert(pthread_join(thread, &thread_result) == 0);
+    ck_assert(thread_result == NULL);
+}
+END_TEST
+
+#endif /* HAVE_PTHREAD_H */
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("cleanctx");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_test(tc_core, defaults_match_options);
+    tcase_add_test(tc_core, contexts_are_independent);
+#   ifdef HAVE_PTHREAD_H
+        tcase_add_test(tc_core, concurrent_contexts);
+#   endif /* HAVE_PTHREAD_H */
+    suite_add_tcase(s, tc_core);
+    return s;
+}
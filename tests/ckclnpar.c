@@ -0,0 +1,274 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckclnpar.c
+    Test suite for cleanpar module. The filtering rules themselves are
+    covered by the cleanstr test suite; these tests check that splitting
+    a file into chunks gives the same result as cleaning it in one go. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <check.h>
+
+#include "../cleanstr.h"
+#include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
+#include "../cleanpar.h"
+#include "helpers/io.h"
+
+/** Length of each generated input text */
+#define INPUT_LEN 200
+
+/** Number of generated input texts tried with each configuration */
+#define INPUT_COUNT 6
+
+/** Size of the output buffers; enough for the worst case of
+    #INPUT_LEN bytes with the largest tab size tried */
+#define OUTPUT_SIZE 4096
+
+/** Characters that generated input texts are made of. There are enough
+    ordinary characters after LF characters for the text to be split
+    into many chunks. */
+static const char INPUT_CHARS[] = "  \t\r\n\n\nabcd\032";
+
+/** Fills a buffer with pseudo-random text.
+
+    @param buf The buffer to fill.
+    @param len Number of bytes to fill. */
+static void random_text(char *buf, size_t len)
+{
+    /* i: Index into buf */
+    size_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        buf[i] = INPUT_CHARS[rand() % (sizeof(INPUT_CHARS) - 1)];
+    }
+}
+
+/** Configures a context for one of the combinations of options tried.
+
+    @param ctx The context to configure.
+    @param n Number of the combination. */
+static void configure(struct cleantxt_ctx *ctx, int n)
+{
+    /* TAB_SIZES: Tab sizes to cycle through */
+    static const int TAB_SIZES[] = { 1, 2, 3, 4, 8, 13 };
+
+    cleantxt_ctx_init(ctx);
+    ctx->tab_size = TAB_SIZES[n % 6];
+    ctx->tab_min = 1 + n % 3;
+    ctx->whitespace_mode = (n / 6) % 2 ? WM_TAB : WM_SPACE;
+    ctx->eol_mode = (eol_mode_t)((n / 12) % 3);
+    ctx->add_ctrl_z = (n / 36) % 2;
+    ctx->stop_at_ctrl_z = (n / 72) % 2;
+    ctx->remove_ctrl_z = (n / 144) % 2;
+}
+
+/** Number of combinations of options that #configure knows */
+#define CONFIG_COUNT 288
+
+/** The outcome of cleaning a text */
+struct outcome
+{
+    /** The cleaned text */
+    char text[OUTPUT_SIZE];
+    /** Length of the cleaned text */
+    size_t len;
+    /** The verdict */
+    clean_stream_result_t res;
+    /** Offset of the first modification, if modified */
+    unsigned long modified_at;
+};
+
+/** Cleans the part of a text after a prefix, either through
+    #clean_stream or through #clean_stream_parallel.
+
+    @param ctx The cleaning context.
+    @param input The text, including the prefix.
+    @param input_len Length of @a input.
+    @param skip Length of the prefix, which is not cleaned.
+    @param chunk_size Chunk size for #clean_stream_parallel, or zero to
+    use #clean_stream.
+    @param out Receives the outcome. */
+static void clean_text(
+    struct cleantxt_ctx *ctx,
+    char *input,
+    size_t input_len,
+    size_t skip,
+    size_t chunk_size,
+    struct outcome *out)
+{
+    FILE *input_file = create_input_file_from_buf(input, input_len);
+    FILE *output_file = tmpfile();
+    jmp_buf on_io_error;
+
+    ck_assert(output_file != NULL);
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    ck_assert(fseek(input_file, skip, SEEK_SET) == 0);
+    if(chunk_size > 0)
+    {
+        out->res = clean_stream_parallel(ctx, input_file,
+            (off_t)(input_len - skip), output_file, chunk_size,
+            &on_io_error);
+    }
+    else
+    {
+        out->res = clean_stream(ctx, input_file, output_file, &on_io_error);
+    }
+    out->modified_at = out->res == CSR_STREAM_MODIFIED
+        ? ctx->eng.modified_at : 0;
+    /* Both leave the input at the end of the text, unless a ctrl-Z
+       stopped cleaning early. */
+    if(!ctx->eng.stopped)
+    {
+        ck_assert(ftell(input_file) == (long)input_len);
+    }
+    rewind(output_file);
+    out->len = fread(out->text, 1, OUTPUT_SIZE, output_file);
+    ck_assert(fclose(output_file) == 0);
+    ck_assert(fclose(input_file) == 0);
+}
+
+/** Checks that two outcomes are the same.
+
+    @param expect The expected outcome.
+    @param actual The actual outcome. */
+static void assert_same_outcome(
+    const struct outcome *expect,
+    const struct outcome *actual)
+{
+    ck_assert(actual->len == expect->len);
+    ck_assert(memcmp(actual->text, expect->text, expect->len) == 0);
+    ck_assert(actual->res == expect->res);
+    ck_assert(actual->modified_at == expect->modified_at);
+}
+
+START_TEST(matches_clean_stream)
+{
+    static struct outcome expect;
+    static struct outcome actual;
+    struct cleantxt_ctx ctx;
+    char input[INPUT_LEN];
+    size_t len;
+    int n;
+    int i;
+
+    srand(1);
+    for(n = 0; n < CONFIG_COUNT; n++)
+    {
+        configure(&ctx, n);
+        for(i = 0; i < INPUT_COUNT; i++)
+        {
+            random_text(input, INPUT_LEN);
+            len = rand() % (INPUT_LEN + 1);
+            ctx.threads = 1;
+            clean_text(&ctx, input, len, 0, 0, &expect);
+            ctx.threads = 1 + i % 4;
+            clean_text(&ctx, input, len, 0, 1 + rand() % 13, &actual);
+            assert_same_outcome(&expect, &actual);
+        }
+    }
+}
+END_TEST
+
+START_TEST(starts_mid_file)
+{
+    static struct outcome expect;
+    static struct outcome actual;
+    struct cleantxt_ctx ctx;
+    char input[INPUT_LEN];
+    size_t skip;
+    int n;
+
+    srand(2);
+    for(n = 0; n < CONFIG_COUNT; n++)
+    {
+        configure(&ctx, n);
+        random_text(input, INPUT_LEN);
+        skip = rand() % (INPUT_LEN + 1);
+        ctx.threads = 1;
+        clean_text(&ctx, input, INPUT_LEN, skip, 0, &expect);
+        ctx.threads = 3;
+        clean_text(&ctx, input, INPUT_LEN, skip, 5, &actual);
+        assert_same_outcome(&expect, &actual);
+    }
+}
+END_TEST
+
+START_TEST(single_long_line)
+{
+    /* A line that spans many chunks leaves the chunks after its first
+       empty. */
+    static struct outcome expect;
+    static struct outcome actual;
+    struct cleantxt_ctx ctx;
+    char input[INPUT_LEN];
+
+    memset(input, 'a', INPUT_LEN);
+    memcpy(input + 20, "  \t b\n\n", 7);
+    memcpy(input + INPUT_LEN - 8, "\tc \r\n\r\n\n", 8);
+    cleantxt_ctx_init(&ctx);
+    ctx.whitespace_mode = WM_TAB;
+    ctx.eol_mode = EM_CRLF;
+    clean_text(&ctx, input, INPUT_LEN, 0, 0, &expect);
+    ctx.threads = 4;
+    clean_text(&ctx, input, INPUT_LEN, 0, 3, &actual);
+    assert_same_outcome(&expect, &actual);
+    ck_assert(actual.res == CSR_STREAM_MODIFIED);
+    ck_assert(actual.modified_at == 20);
+}
+END_TEST
+
+START_TEST(thread_count)
+{
+    struct cleantxt_ctx ctx;
+
+    cleantxt_ctx_init(&ctx);
+    ck_assert(ctx.threads == 0);
+    ck_assert(clean_parallel_threads(&ctx) >= 1);
+    ctx.threads = 1;
+    ck_assert(clean_parallel_threads(&ctx) == 1);
+#ifdef HAVE_PTHREAD_H
+    ctx.threads = 3;
+    ck_assert(clean_parallel_threads(&ctx) == 3);
+#endif /* HAVE_PTHREAD_H */
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("cleanpar");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_test(tc_core, matches_clean_stream);
+    tcase_add_test(tc_core, starts_mid_file);
+    tcase_add_test(tc_core, single_long_line);
+    tcase_add_test(tc_core, thread_count);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
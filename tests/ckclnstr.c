@@ -33,6 +33,9 @@
 
 #include "../cleanstr.h"
 #include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
+#include "../cleanbuf.h"
 #include "helpers/io.h"
 
 #ifndef __GNUC__
@@ -101,6 +104,7 @@ static clean_stream_result_t try_cleanstr(
     /* actual_file: Temporary file that will contain actual output */
     /* res: Return result of clean_stream() */
     /* ap: Points to current argument on the arguments list */
+    /* ctx: Cleaning context built from the parsed options */
     int argc = 1;
     /* The volatile requirement is needed to force GCC's -O2 optimiser
        to make argv an automatic (stack) rather than register variable,
@@ -113,6 +117,7 @@ static clean_stream_result_t try_cleanstr(
     FILE *actual_file;
     clean_stream_result_t res;
     va_list ap;
+    struct cleantxt_ctx ctx;
 
     optind = 1; /* Reset getopt's state in case invoked multiple times */
 
@@ -128,6 +133,7 @@ static clean_stream_result_t try_cleanstr(
     }
     parse_options(argc, argv, &on_cmdline_error);
     free(argv);
+    cleantxt_ctx_from_options(&ctx, &options);
 
     input_file = create_input_file_from_str(input_str);
     actual_file = tmpfile();
@@ -140,7 +146,7 @@ static clean_stream_result_t try_cleanstr(
         /* Execution will branch here if an I/O error is encountered */
         ck_abort_msg("I/O error encountered: %s", strerror(errno));
     }
-    res = clean_stream(input_file, actual_file, &on_io_error);
+    res = clean_stream(&ctx, input_file, actual_file, &on_io_error);
     assert_output_file_contents_match_str(expect_str, actual_file);
     ck_assert(fclose(actual_file) == 0);
     ck_assert(fclose(input_file) == 0);
@@ -490,6 +496,547 @@ START_TEST(destroy_a_whitespace_program)
 }
 END_TEST
 
+START_TEST(read_from_pipe)
+{
+    /* Pipes cannot be mapped into memory, so they are read instead */
+    static const char INPUT[] = "a  \t\nb\r\n\n\n";
+    int fds[2];
+    FILE *input_file;
+    FILE *actual_file = tmpfile();
+    jmp_buf on_io_error;
+    struct cleantxt_ctx ctx;
+
+    ck_assert(actual_file != NULL);
+    ck_assert(pipe(fds) == 0);
+    ck_assert(write(fds[1], INPUT, strlen(INPUT)) == (ssize_t)strlen(INPUT));
+    ck_assert(close(fds[1]) == 0);
+    input_file = fdopen(fds[0], "rb");
+    ck_assert(input_file != NULL);
+
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ck_assert(clean_stream(&ctx, input_file, actual_file, &on_io_error)
+        == CSR_STREAM_MODIFIED);
+    assert_output_file_contents_match_str("a\nb\n", actual_file);
+    ck_assert(fclose(actual_file) == 0);
+    ck_assert(fclose(input_file) == 0);
+}
+END_TEST
+
+START_TEST(read_from_file_offset)
+{
+    /* Cleaning starts from the current position, which need not be on a
+       page boundary, and leaves the input at the end. */
+    static char input[10000];
+    FILE *input_file;
+    FILE *actual_file = tmpfile();
+    jmp_buf on_io_error;
+    struct cleantxt_ctx ctx;
+
+    memset(input, 'x', sizeof(input));
+    memcpy(input + sizeof(input) - 7, "\nfoo  \n", 7);
+    input_file = create_input_file_from_buf(input, sizeof(input));
+    ck_assert(actual_file != NULL);
+    ck_assert(fseek(input_file, sizeof(input) - 12, SEEK_SET) == 0);
+
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ck_assert(clean_stream(&ctx, input_file, actual_file, &on_io_error)
+        == CSR_STREAM_MODIFIED);
+    ck_assert(ctx.eng.modified_at == 9);
+    ck_assert(ftell(input_file) == (long)sizeof(input));
+    assert_output_file_contents_match_str("xxxxx\nfoo\n", actual_file);
+    ck_assert(fclose(actual_file) == 0);
+    ck_assert(fclose(input_file) == 0);
+}
+END_TEST
+
+/** Length of the text used to compare pipelined and serial runs; long
+    enough to pass through every buffer in the rings several times */
+#define PIPELINE_TEXT_LEN 1500000
+
+/** Cleans a stream into a temporary file, and reads the result back.
+
+    @param ctx The cleaning context.
+    @param input_file The input stream.
+    @param out Receives the cleaned text.
+    @param out_size Size of @a out.
+    @param out_len Receives the length of the cleaned text.
+    @return The verdict of #clean_stream. */
+static clean_stream_result_t clean_to_buf(
+    struct cleantxt_ctx *ctx,
+    FILE *input_file,
+    char *out,
+    size_t out_size,
+    size_t *out_len)
+{
+    FILE *output_file = tmpfile();
+    jmp_buf on_io_error;
+    clean_stream_result_t res;
+
+    ck_assert(output_file != NULL);
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    res = clean_stream(ctx, input_file, output_file, &on_io_error);
+    rewind(output_file);
+    *out_len = fread(out, 1, out_size, output_file);
+    ck_assert(fclose(output_file) == 0);
+    return res;
+}
+
+START_TEST(pipeline_matches_serial)
+{
+    static const char CHARS[] = "  \t\r\n\nabcdefgh\032";
+    char *input = malloc(PIPELINE_TEXT_LEN);
+    char *expect = malloc(PIPELINE_TEXT_LEN * 2);
+    char *actual = malloc(PIPELINE_TEXT_LEN * 2);
+    size_t expect_len;
+    size_t actual_len;
+    clean_stream_result_t expect_res;
+    unsigned long expect_at;
+    struct cleantxt_ctx ctx;
+    FILE *input_file;
+    size_t i;
+    int n;
+
+    ck_assert(input && expect && actual);
+    srand(3);
+    for(i = 0; i < PIPELINE_TEXT_LEN; i++)
+    {
+        input[i] = CHARS[rand() % (sizeof(CHARS) - 1)];
+    }
+    input_file = create_input_file_from_buf(input, PIPELINE_TEXT_LEN);
+    for(n = 0; n < 8; n++)
+    {
+        cleantxt_ctx_init(&ctx);
+        ctx.threads = 1;
+        ctx.whitespace_mode = n % 2 ? WM_TAB : WM_SPACE;
+        ctx.eol_mode = n % 4 < 2 ? EM_CRLF : EM_LF;
+        ctx.remove_ctrl_z = n < 4;
+        ctx.stop_at_ctrl_z = n == 7;
+        rewind(input_file);
+        expect_res = clean_to_buf(&ctx, input_file,
+            expect, PIPELINE_TEXT_LEN * 2, &expect_len);
+        expect_at = ctx.eng.modified_at;
+        ctx.pipeline = 1;
+        rewind(input_file);
+        ck_assert(clean_to_buf(&ctx, input_file,
+            actual, PIPELINE_TEXT_LEN * 2, &actual_len) == expect_res);
+        ck_assert(ctx.eng.modified_at == expect_at);
+        ck_assert(actual_len == expect_len);
+        ck_assert(memcmp(actual, expect, expect_len) == 0);
+    }
+    ck_assert(fclose(input_file) == 0);
+    free(input);
+    free(expect);
+    free(actual);
+}
+END_TEST
+
+START_TEST(pipeline_stops_at_ctrl_z)
+{
+    /* The writer end of the pipe is left open, so the reader would wait
+       forever for the input after the ctrl-Z. */
+    static const char INPUT[] = "ab  \n\032more";
+    char actual[64];
+    size_t actual_len;
+    int fds[2];
+    FILE *input_file;
+    struct cleantxt_ctx ctx;
+
+    ck_assert(pipe(fds) == 0);
+    ck_assert(write(fds[1], INPUT, strlen(INPUT)) == (ssize_t)strlen(INPUT));
+    input_file = fdopen(fds[0], "rb");
+    ck_assert(input_file != NULL);
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ctx.stop_at_ctrl_z = 1;
+    ctx.pipeline = 1;
+    ck_assert(clean_to_buf(&ctx, input_file, actual, sizeof(actual),
+        &actual_len) == CSR_STREAM_MODIFIED);
+    ck_assert(actual_len == 4);
+    ck_assert(memcmp(actual, "ab\n\032", 4) == 0);
+    ck_assert(fclose(input_file) == 0);
+    ck_assert(close(fds[1]) == 0);
+}
+END_TEST
+
+/** Length of the text used to test passing unchanged input through;
+    several times the length of the pieces it is cleaned in */
+#define PASS_THROUGH_TEXT_LEN 3500000
+
+START_TEST(pass_through_to_file)
+{
+    /* Mostly clean text, with a few changes scattered through it */
+    static const char LINE[] = "if(x)\n\ty = 1;\n";
+    char *input = malloc(PASS_THROUGH_TEXT_LEN);
+    char *expect = malloc(PASS_THROUGH_TEXT_LEN + 16);
+    size_t expect_len;
+    FILE *input_file;
+    FILE *actual_file;
+    jmp_buf on_io_error;
+    struct cleantxt_ctx ctx;
+    size_t i;
+    int n;
+
+    ck_assert(input && expect);
+    for(i = 0; i < PASS_THROUGH_TEXT_LEN; i++)
+    {
+        input[i] = LINE[i % (sizeof(LINE) - 1)];
+    }
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    for(n = 0; n < 3; n++)
+    {
+        /* First unchanged, then with trailing spaces in the middle of
+           a piece, then with a CR+LF at the end of the text */
+        cleantxt_ctx_init(&ctx);
+        ctx.eol_mode = EM_LF;
+        ctx.whitespace_mode = WM_TAB;
+        ctx.threads = 1;
+        if(n == 1)
+        {
+            memcpy(input + 1500005, "  ", 2);
+            memcpy(input + 2900020, " ", 1);
+        }
+        if(n == 2)
+        {
+            memcpy(input + PASS_THROUGH_TEXT_LEN - 2, "\r\n", 2);
+        }
+        ck_assert(clean_buffer(&ctx, input, PASS_THROUGH_TEXT_LEN,
+            expect, PASS_THROUGH_TEXT_LEN + 16, &expect_len, NULL) == CB_OK);
+        memcpy(expect + expect_len, "END", 3);
+
+        input_file = create_input_file_from_buf(input, PASS_THROUGH_TEXT_LEN);
+        actual_file = tmpfile();
+        ck_assert(actual_file != NULL);
+        ck_assert(clean_stream(&ctx, input_file, actual_file, &on_io_error)
+            == (n == 0 ? CSR_STREAM_UNMODIFIED : CSR_STREAM_MODIFIED));
+        /* The stream carries on from the end of the output */
+        ck_assert(fputs("END", actual_file) >= 0);
+        assert_output_file_contents_match_buf(expect, expect_len + 3,
+            actual_file);
+        ck_assert(fclose(actual_file) == 0);
+        ck_assert(fclose(input_file) == 0);
+    }
+    free(input);
+    free(expect);
+}
+END_TEST
+
+START_TEST(pass_through_to_pipe)
+{
+    static const char *const INPUTS[] = { "abc\ndef\n", "abc \ndef\n" };
+    char actual[16];
+    ssize_t actual_len;
+    int fds[2];
+    FILE *input_file;
+    FILE *output_file;
+    jmp_buf on_io_error;
+    struct cleantxt_ctx ctx;
+    int n;
+
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    for(n = 0; n < 2; n++)
+    {
+        ck_assert(pipe(fds) == 0);
+        output_file = fdopen(fds[1], "wb");
+        ck_assert(output_file != NULL);
+        input_file = create_input_file_from_str(INPUTS[n]);
+        cleantxt_ctx_init(&ctx);
+        ctx.eol_mode = EM_LF;
+        clean_stream(&ctx, input_file, output_file, &on_io_error);
+        ck_assert(fclose(output_file) == 0);
+        ck_assert(fclose(input_file) == 0);
+        actual_len = read(fds[0], actual, sizeof(actual));
+        ck_assert(actual_len == 8);
+        ck_assert(memcmp(actual, "abc\ndef\n", 8) == 0);
+        ck_assert(close(fds[0]) == 0);
+    }
+}
+END_TEST
+
+#ifdef HAVE_SYS_MMAN_H
+
+/** Length of the text used to test input that is cut short while it is
+    being cleaned; longer than a couple of read-ahead windows */
+#define SHRINKING_TEXT_LEN (10L * 1024 * 1024)
+
+/** Amount of output after which the input is cut short; past the first
+    read-ahead window */
+#define SHRINK_AFTER (5L * 1024 * 1024)
+
+/** State of an output stream that cuts its input short part way */
+struct shrinking_output
+{
+    /** The input file */
+    FILE *input_file;
+    /** Number of bytes written so far */
+    size_t written;
+};
+
+/** Write function for an output stream that throws its output away, but
+    cuts the input down to a single page once #SHRINK_AFTER bytes have
+    been written. */
+static ssize_t write_shrinking(void *cookie, const char *buf, size_t len)
+{
+    struct shrinking_output *out = cookie;
+
+    (void)buf;
+    if(out->written < SHRINK_AFTER && out->written + len >= SHRINK_AFTER)
+    {
+        ck_assert(ftruncate(fileno(out->input_file), 4096) == 0);
+    }
+    out->written += len;
+    return len;
+}
+
+START_TEST(input_shrinks_while_mapped)
+{
+    /* Reading the part of a mapping beyond the new end of the file
+       faults; that must be reported as an I/O error, after which the
+       next stream is cleaned normally. */
+    static const char LINE[] = "clean line\n";
+    static cookie_io_functions_t shrinking_io =
+        { NULL, write_shrinking, NULL, NULL };
+    char *input = malloc(SHRINKING_TEXT_LEN);
+    struct shrinking_output out;
+    FILE *input_file;
+    FILE *output_file;
+    FILE *actual_file = tmpfile();
+    jmp_buf on_io_error;
+    struct cleantxt_ctx ctx;
+    size_t i;
+
+    ck_assert(input != NULL && actual_file != NULL);
+    for(i = 0; i < SHRINKING_TEXT_LEN; i++)
+    {
+        input[i] = LINE[i % (sizeof(LINE) - 1)];
+    }
+    input_file = create_input_file_from_buf(input, SHRINKING_TEXT_LEN);
+    out.input_file = input_file;
+    out.written = 0;
+    output_file = fopencookie(&out, "wb", shrinking_io);
+    ck_assert(output_file != NULL);
+    cleantxt_ctx_init(&ctx);
+    ctx.threads = 1;
+    if(!setjmp(on_io_error))
+    {
+        clean_stream(&ctx, input_file, output_file, &on_io_error);
+        ck_abort_msg("Cleaning input that was cut short did not fail");
+    }
+    ck_assert(errno == EIO);
+    ck_assert(out.written >= SHRINK_AFTER);
+    ck_assert(fclose(output_file) == 0);
+    ck_assert(fclose(input_file) == 0);
+
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    input_file = create_input_file_from_str("foo  \n");
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ck_assert(clean_stream(&ctx, input_file, actual_file, &on_io_error)
+        == CSR_STREAM_MODIFIED);
+    assert_output_file_contents_match_str("foo\n", actual_file);
+    ck_assert(fclose(actual_file) == 0);
+    ck_assert(fclose(input_file) == 0);
+    free(input);
+}
+END_TEST
+
+#endif /* HAVE_SYS_MMAN_H */
+
+/** Length of the long text used to test #clean_stream_from; longer than
+    the blocks that the input is searched backwards in */
+#define CLEAN_FROM_TEXT_LEN 200000
+
+START_TEST(clean_from_first_change)
+{
+    /* Inputs whose first change lies in the first line, in a later one
+       after lines with leading whitespace, and at the very end */
+    static const char *const INPUTS[] = {
+        "ab \ncd\n", "ab\ncd\n  e       f  \ng\n",
+        "  a\n\tb\n  c        d\n", "a\r\nb\r\n", "a\r\nb  \r\n", "ab\ncd"
+    };
+    char *input = malloc(CLEAN_FROM_TEXT_LEN);
+    char *expect = malloc(CLEAN_FROM_TEXT_LEN + 16);
+    size_t input_len;
+    size_t expect_len;
+    unsigned long modified_at;
+    FILE *input_file;
+    FILE *actual_file;
+    jmp_buf on_io_error;
+    struct cleantxt_ctx ctx;
+    size_t i;
+    int n;
+
+    ck_assert(input && expect);
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    for(n = 0; n < 6 + 4; n++)
+    {
+        cleantxt_ctx_init(&ctx);
+        ctx.eol_mode = EM_LF;
+        ctx.whitespace_mode = WM_TAB;
+        ctx.threads = 1;
+        if(n < 6)
+        {
+            input_len = strlen(INPUTS[n]);
+            memcpy(input, INPUTS[n], input_len);
+            ctx.eol_mode = n == 4 ? EM_CRLF : EM_LF;
+            ctx.add_ctrl_z = n == 5;
+        }
+        else
+        {
+            /* Indented lines with one unindented line, whose LF falls
+               around the edge of a block searched backwards from the
+               change in the last line */
+            input_len = CLEAN_FROM_TEXT_LEN;
+            for(i = 0; i < input_len; i++)
+            {
+                input[i] = "\tx\tyzwv\n"[i % 8];
+            }
+            memcpy(input + input_len - 8 - 65536 + (n - 7) * 8, "ab", 2);
+            input[input_len - 7] = ' ';
+        }
+        ck_assert(clean_buffer(&ctx, input, input_len,
+            expect, CLEAN_FROM_TEXT_LEN + 16, &expect_len, NULL) == CB_OK);
+
+        input_file = create_input_file_from_buf(input, input_len);
+        actual_file = tmpfile();
+        ck_assert(actual_file != NULL);
+        ck_assert(check_stream(&ctx, input_file, &modified_at, &on_io_error)
+            == CSR_STREAM_MODIFIED);
+        ck_assert(fseek(input_file, 0L, SEEK_SET) == 0);
+        ck_assert(clean_stream_from(&ctx, input_file, actual_file,
+            modified_at, &on_io_error) == CSR_STREAM_MODIFIED);
+        assert_output_file_contents_match_buf(expect, expect_len,
+            actual_file);
+        ck_assert(fclose(actual_file) == 0);
+        ck_assert(fclose(input_file) == 0);
+    }
+    free(input);
+    free(expect);
+}
+END_TEST
+
+/** Checks whether #plan_tail_repair finds a fix for a text, and that
+    the fix gives the same text as cleaning it in full.
+
+    @param input The text.
+    @param input_len Length of the text.
+    @param ctx The cleaning context.
+    @return Non-zero if a fix was found. */
+static int try_tail_repair(
+    const char *input,
+    size_t input_len,
+    struct cleantxt_ctx *ctx)
+{
+    /* expect: The text cleaned in full */
+    /* expect_len: Length of expect */
+    /* modified_at: Offset of the first change */
+    /* repair: The fix */
+    /* input_file: File holding the text */
+    /* on_io_error: Execution jumps here if an I/O error is encountered */
+    /* found: Set if a fix was found */
+    char *expect = malloc(input_len + 16);
+    size_t expect_len;
+    unsigned long modified_at;
+    struct tail_repair repair;
+    FILE *input_file;
+    jmp_buf on_io_error;
+    int found;
+
+    ck_assert(expect != NULL);
+    ck_assert(clean_buffer(ctx, input, input_len, expect, input_len + 16,
+        &expect_len, NULL) == CB_OK);
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    input_file = create_input_file_from_buf(input, input_len);
+    ck_assert(check_stream(ctx, input_file, &modified_at, &on_io_error)
+        == CSR_STREAM_MODIFIED);
+    ck_assert(fseek(input_file, 0L, SEEK_SET) == 0);
+    found = plan_tail_repair(ctx, input_file, modified_at, &repair,
+        &on_io_error);
+    ck_assert(ftell(input_file) == 0);
+    if(found)
+    {
+        ck_assert(repair.keep + repair.append_len == expect_len);
+        ck_assert(repair.keep <= input_len);
+        ck_assert(memcmp(expect, input, repair.keep) == 0);
+        ck_assert(memcmp(expect + repair.keep, repair.append,
+            repair.append_len) == 0);
+    }
+    ck_assert(fclose(input_file) == 0);
+    free(expect);
+    return found;
+}
+
+/** Length of the long texts used to test #plan_tail_repair */
+#define TAIL_REPAIR_TEXT_LEN 100000
+
+START_TEST(tail_repair)
+{
+    char *input = malloc(TAIL_REPAIR_TEXT_LEN);
+    struct cleantxt_ctx ctx;
+    size_t i;
+
+    ck_assert(input != NULL);
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    ctx.threads = 1;
+
+    /* Only the end changes */
+    ck_assert(try_tail_repair("abc", 3, &ctx));
+    ck_assert(try_tail_repair("abc\ndef\n\n\n", 10, &ctx));
+    ck_assert(try_tail_repair("  abc\n \n\t\n", 10, &ctx));
+    ctx.stop_at_ctrl_z = 1;
+    ck_assert(try_tail_repair("abc\n\032xyz \n", 10, &ctx));
+    ctx.stop_at_ctrl_z = 0;
+    ctx.add_ctrl_z = 1;
+    ck_assert(try_tail_repair("abc\n", 4, &ctx));
+    ctx.add_ctrl_z = 0;
+
+    /* Changes elsewhere, or that both cut the end short and add to it,
+       need the text cleaning in full */
+    ck_assert(!try_tail_repair("ab \ncd\n", 7, &ctx));
+    ck_assert(!try_tail_repair("abc\r\n", 5, &ctx));
+    ck_assert(!try_tail_repair("abc\ndef \t", 9, &ctx));
+
+    /* A long text is only cleaned from its last line */
+    for(i = 0; i < TAIL_REPAIR_TEXT_LEN; i++)
+    {
+        input[i] = i % 2 ? '\n' : 'x';
+    }
+    ck_assert(try_tail_repair(input, TAIL_REPAIR_TEXT_LEN - 1, &ctx));
+    /* ... unless that line is too long */
+    memset(input, 'x', TAIL_REPAIR_TEXT_LEN);
+    ck_assert(!try_tail_repair(input, TAIL_REPAIR_TEXT_LEN, &ctx));
+    free(input);
+}
+END_TEST
+
 Suite *init_suite(void)
 {
     Suite *s = suite_create("cleanstr");
@@ -513,6 +1060,17 @@ Suite *init_suite(void)
     tcase_add_test(tc_core, relocate_ctrl_z);
     tcase_add_test(tc_core, dont_add_spurious_ctrl_z);
     tcase_add_test(tc_core, destroy_a_whitespace_program);
+    tcase_add_test(tc_core, read_from_pipe);
+    tcase_add_test(tc_core, read_from_file_offset);
+    tcase_add_test(tc_core, pipeline_matches_serial);
+    tcase_add_test(tc_core, pipeline_stops_at_ctrl_z);
+    tcase_add_test(tc_core, pass_through_to_file);
+    tcase_add_test(tc_core, pass_through_to_pipe);
+#   ifdef HAVE_SYS_MMAN_H
+        tcase_add_test(tc_core, input_shrinks_while_mapped);
+#   endif /* HAVE_SYS_MMAN_H */
+    tcase_add_test(tc_core, clean_from_first_change);
+    tcase_add_test(tc_core, tail_repair);
     suite_add_tcase(s, tc_core);
     return s;
 }
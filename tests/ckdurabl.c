@@ -0,0 +1,237 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckdurabl.c
+    Test suite for durable module. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <check.h>
+
+#include "../filemgmt.h"
+#include "../durable.h"
+
+/** Temporary directory name template; this must be copied, not used
+    directly with the @c mkdtemp() library call. */
+static const char MKDTEMP_TEMPLATE[] = "tmXXXXXX";
+
+/** Redirect stderr to this file during testing to suppress error
+    messages from intefering with the test results output. */
+static const char STDERR_SINK[] = "/dev/null";
+
+/** Contents of each file before it is replaced */
+static const char OLD_TEXT[] = "old\n";
+
+/** Contents of each file's replacement */
+static const char NEW_TEXT[] = "new text\n";
+
+/** Number of files replaced in one batch */
+#define FILE_COUNT 3
+
+static void setup(void)
+{
+    freopen(STDERR_SINK, "w", stderr);
+}
+
+static void teardown(void)
+{
+    fclose(stderr);
+    stderr = fdopen(STDERR_FILENO, "w");
+}
+
+/** Creates a file holding #OLD_TEXT.
+
+    @param name Name of the file.
+    @param mode Permissions to give the file. */
+static void make_file(const char *name, mode_t mode)
+{
+    FILE *f = fopen(name, "wb");
+
+    ck_assert(f != NULL);
+    ck_assert(fputs(OLD_TEXT, f) >= 0);
+    ck_assert(fclose(f) == 0);
+    ck_assert(chmod(name, mode) == 0);
+}
+
+/** Checks that a file holds the given text and has the given
+    permissions.
+
+    @param name Name of the file.
+    @param text The expected contents.
+    @param mode The expected permissions. */
+static void assert_file(const char *name, const char *text, mode_t mode)
+{
+    char line[64];
+    struct stat file_stat;
+    FILE *f = fopen(name, "rb");
+
+    ck_assert(f != NULL);
+    ck_assert(fgets(line, sizeof(line), f) != NULL);
+    ck_assert(strcmp(line, text) == 0);
+    ck_assert(fclose(f) == 0);
+    ck_assert(stat(name, &file_stat) == 0);
+    ck_assert((file_stat.st_mode & 0777) == mode);
+}
+
+/** Adds a replacement holding #NEW_TEXT for a file to a batch.
+
+    @param batch The batch.
+    @param dir The directory of the file.
+    @param name Name of the file.
+    @return Non-zero if the batch is now full. */
+static int add_replacement(
+    struct durable_batch *batch,
+    struct file_dir *dir,
+    const char *name)
+{
+    jmp_buf on_io_error;
+    char temp_file_name[PATH_MAX];
+    int dir_fd = enter_file_dir(dir, name);
+    FILE *file;
+    FILE *temp_file;
+    int full;
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here upon an I/O error */
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+    open_input_file(dir_fd, name, "rb", &file, &on_io_error);
+    create_temp_file(dir_fd, name, "wb", temp_file_name, &temp_file,
+        &on_io_error);
+    ck_assert(fputs(NEW_TEXT, temp_file) >= 0);
+    full = add_durable_file(batch, dir_fd, file, name, temp_file,
+        temp_file_name, &on_io_error);
+    ck_assert(fclose(file) == 0);
+    return full;
+}
+
+START_TEST(test_batch_replaces_files)
+{
+    /* Every file must be replaced, keeping its permissions, and nothing
+       else may be left in the directory. Files in the same directory
+       share one directory entry in the batch. */
+    char *dir_name = strdup(MKDTEMP_TEMPLATE);
+    char names[FILE_COUNT][PATH_MAX];
+    struct durable_batch batch;
+    struct file_dir dir;
+    int i;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    for(i = 0; i < FILE_COUNT; i++)
+    {
+        sprintf(names[i], "%s/f%d", dir_name, i);
+        make_file(names[i], 0600 + i * 040);
+    }
+
+    init_durable_batch(&batch, 1);
+    ck_assert(batch.capacity >= 1 && batch.capacity <= DURABLE_BATCH_FILES);
+    batch.capacity = FILE_COUNT;
+    init_file_dir(&dir);
+    for(i = 0; i < FILE_COUNT; i++)
+    {
+        ck_assert(add_replacement(&batch, &dir, names[i]) == (i == FILE_COUNT - 1));
+        assert_file(names[i], OLD_TEXT, 0600 + i * 040);
+    }
+    ck_assert(batch.count == FILE_COUNT);
+    if(dir.fd != NO_DIR_FD)
+    {
+        ck_assert(batch.dir_count == 1);
+    }
+    close_file_dir(&dir);
+
+    commit_durable_batch(&batch);
+    for(i = 0; i < FILE_COUNT; i++)
+    {
+        ck_assert(!batch.files[i].failed);
+        assert_file(names[i], NEW_TEXT, 0600 + i * 040);
+    }
+    clear_durable_batch(&batch);
+    ck_assert(batch.count == 0);
+    ck_assert(batch.dir_count == 0);
+
+    for(i = 0; i < FILE_COUNT; i++)
+    {
+        ck_assert(unlink(names[i]) == 0);
+    }
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+END_TEST
+
+START_TEST(test_batch_failure_is_per_file)
+{
+    /* A file that cannot be replaced must be reported as failed without
+       holding up the rest of the batch. Here the second file's name is
+       taken by a non-empty directory before the batch is committed. */
+    char *dir_name = strdup(MKDTEMP_TEMPLATE);
+    char good_name[PATH_MAX];
+    char bad_name[PATH_MAX];
+    char blocker_name[PATH_MAX];
+    struct durable_batch batch;
+    struct file_dir dir;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    sprintf(good_name, "%s/good", dir_name);
+    sprintf(bad_name, "%s/bad", dir_name);
+    sprintf(blocker_name, "%s/bad/blocker", dir_name);
+    make_file(good_name, 0644);
+    make_file(bad_name, 0644);
+
+    init_durable_batch(&batch, 1);
+    init_file_dir(&dir);
+    add_replacement(&batch, &dir, good_name);
+    add_replacement(&batch, &dir, bad_name);
+    close_file_dir(&dir);
+    ck_assert(unlink(bad_name) == 0);
+    ck_assert(mkdir(bad_name, 0700) == 0);
+    make_file(blocker_name, 0644);
+
+    commit_durable_batch(&batch);
+    ck_assert(!batch.files[0].failed);
+    ck_assert(batch.files[1].failed);
+    clear_durable_batch(&batch);
+    assert_file(good_name, NEW_TEXT, 0644);
+    assert_file(blocker_name, OLD_TEXT, 0644);
+
+    ck_assert(unlink(blocker_name) == 0);
+    ck_assert(rmdir(bad_name) == 0);
+    ck_assert(unlink(good_name) == 0);
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("durable");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_batch_replaces_files);
+    tcase_add_test(tc_core, test_batch_failure_is_per_file);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
@@ -0,0 +1,608 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckfllist.c
+    Test suite for filelist module. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <check.h>
+
+#ifdef HAVE_PTHREAD_H
+#   include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
+#include "../filelist.h"
+#include "../ignore.h"
+
+/** Temporary directory name template; this must be copied, not used
+    directly with the @c mkdtemp() library call. */
+static const char MKDTEMP_TEMPLATE[] = "tmXXXXXX";
+
+/** Redirect stderr to this file during testing to suppress error
+    messages from intefering with the test results output. */
+static const char STDERR_SINK[] = "/dev/null";
+
+/** A list of names given by the user with nothing in it */
+static const char *const NULL_LIST[] = { NULL };
+
+/** Number of files put in each subdirectory of a test tree; more than
+    are read from a directory at a time */
+#define FILES_PER_DIR 100
+
+/** Number of subdirectories in a test tree */
+#define SUBDIR_COUNT 6
+
+/** Number of regular files in a test tree */
+#define TREE_FILES (1 + SUBDIR_COUNT * FILES_PER_DIR)
+
+/** An entry of the tree walked by #test_walk_excludes */
+struct exclude_entry
+{
+    /** Path of the entry within the tree */
+    const char *path;
+    /** Contents of the file, or @c NULL for a directory */
+    const char *text;
+    /** Set if the walk must find the file */
+    int found;
+};
+
+/** The tree walked by #test_walk_excludes, each directory before its
+    contents */
+static const struct exclude_entry EXCLUDE_TREE[] =
+{
+    { ".gitignore", "gen/\n*.tmp\n", 1 },
+    { "keep.c", "", 1 },
+    { "skip.o", "", 0 },
+    { "important.o", "", 1 },
+    { "a.tmp", "", 0 },
+    { "gen", NULL, 0 },
+    { "gen/x.c", "", 0 },
+    { ".git", NULL, 0 },
+    { ".git/config", "", 0 },
+    { "sub", NULL, 0 },
+    { "sub/.gitignore", "!b.tmp\n", 1 },
+    { "sub/b.tmp", "", 1 },
+    { "sub/c.tmp", "", 0 },
+    { "sub/vendor", NULL, 0 },
+    { "sub/vendor/v.c", "", 0 },
+    { "sub/vendor.c", "", 1 }
+};
+
+/** Number of entries in #EXCLUDE_TREE */
+#define EXCLUDE_TREE_SIZE (sizeof(EXCLUDE_TREE) / sizeof(EXCLUDE_TREE[0]))
+
+static void setup(void)
+{
+    freopen(STDERR_SINK, "w", stderr);
+}
+
+static void teardown(void)
+{
+    fclose(stderr);
+    stderr = fdopen(STDERR_FILENO, "w");
+}
+
+/** Creates an empty file.
+
+    @param name Name of the file. */
+static void make_file(const char *name)
+{
+    FILE *f = fopen(name, "wb");
+
+    ck_assert(f != NULL);
+    ck_assert(fclose(f) == 0);
+}
+
+/** Compares two strings for @c qsort(). */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/** Builds a tree of files to walk: one file at the top, and
+    #SUBDIR_COUNT subdirectories nested two deep, each holding
+    #FILES_PER_DIR files. Symbolic links to a file and to a directory,
+    and an empty directory, are added as well; none of them may be
+    reported.
+
+    @param dir_name Receives the name of the top directory, which must
+    be released with @c free().
+    @param expected Receives the name of every regular file, sorted. */
+static void make_tree(char **dir_name, char *expected[TREE_FILES])
+{
+    char path[PATH_MAX];
+    int d;
+    int f;
+    int n = 0;
+
+    *dir_name = strdup(MKDTEMP_TEMPLATE);
+    ck_assert(mkdtemp(*dir_name) != NULL);
+    sprintf(path, "%s/top", *dir_name);
+    make_file(path);
+    expected[n++] = strdup(path);
+    for(d = 0; d < SUBDIR_COUNT; d++)
+    {
+        if(d % 2 == 0)
+        {
+            sprintf(path, "%s/d%d", *dir_name, d);
+        }
+        else
+        {
+            sprintf(path, "%s/d%d/d%d", *dir_name, d - 1, d);
+        }
+        ck_assert(mkdir(path, 0700) == 0);
+        for(f = 0; f < FILES_PER_DIR; f++)
+        {
+            char file_path[PATH_MAX];
+
+            sprintf(file_path, "%s/f%d", path, f);
+            make_file(file_path);
+            expected[n++] = strdup(file_path);
+        }
+    }
+    sprintf(path, "%s/empty", *dir_name);
+    ck_assert(mkdir(path, 0700) == 0);
+    sprintf(path, "%s/file-link", *dir_name);
+    ck_assert(symlink("top", path) == 0);
+    sprintf(path, "%s/dir-link", *dir_name);
+    ck_assert(symlink("d0", path) == 0);
+    ck_assert(n == TREE_FILES);
+    qsort(expected, TREE_FILES, sizeof(char *), compare_names);
+}
+
+/** Removes a tree built by #make_tree.
+
+    @param dir_name Name of the top directory, which is released.
+    @param expected The names of the regular files, which are released. */
+static void remove_tree(char *dir_name, char *expected[TREE_FILES])
+{
+    char path[PATH_MAX];
+    int d;
+    int i;
+
+    for(i = 0; i < TREE_FILES; i++)
+    {
+        ck_assert(unlink(expected[i]) == 0);
+        free(expected[i]);
+    }
+    for(d = SUBDIR_COUNT - 1; d >= 0; d--)
+    {
+        if(d % 2 == 0)
+        {
+            sprintf(path, "%s/d%d", dir_name, d);
+        }
+        else
+        {
+            sprintf(path, "%s/d%d/d%d", dir_name, d - 1, d);
+        }
+        ck_assert(rmdir(path) == 0);
+    }
+    sprintf(path, "%s/empty", dir_name);
+    ck_assert(rmdir(path) == 0);
+    sprintf(path, "%s/file-link", dir_name);
+    ck_assert(unlink(path) == 0);
+    sprintf(path, "%s/dir-link", dir_name);
+    ck_assert(unlink(path) == 0);
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+
+/** Checks that the names taken from a list are exactly the expected
+    ones, each once.
+
+    @param found The names taken, which are sorted and released.
+    @param expected The expected names, sorted. */
+static void assert_names(char *found[TREE_FILES], char *expected[TREE_FILES])
+{
+    int i;
+
+    qsort(found, TREE_FILES, sizeof(char *), compare_names);
+    for(i = 0; i < TREE_FILES; i++)
+    {
+        ck_assert_msg(strcmp(found[i], expected[i]) == 0,
+            "Expected `%s' but found `%s'", expected[i], found[i]);
+        free(found[i]);
+    }
+}
+
+START_TEST(test_names_given)
+{
+    /* Without walking, each name must come back as given, directories
+       and all, in order. */
+    static const char *const NAMES[] = { "b", ".", "-", "a", NULL };
+    jmp_buf on_error;
+    struct file_list *list;
+    char *name;
+    int i;
+
+    if(setjmp(on_error))
+    {
+        ck_abort_msg("Unexpected error: %s", strerror(errno));
+    }
+    list = open_file_list(NAMES, NULL, NULL, 0, NULL, 0);
+    ck_assert(list != NULL);
+    for(i = 0; NAMES[i]; i++)
+    {
+        name = next_list_file(list, &on_error);
+        ck_assert(name != NULL);
+        ck_assert(strcmp(name, NAMES[i]) == 0);
+        free(name);
+    }
+    ck_assert(next_list_file(list, &on_error) == NULL);
+    ck_assert(next_list_file(list, &on_error) == NULL);
+    close_file_list(list);
+}
+END_TEST
+
+START_TEST(test_walk)
+{
+    /* Every regular file in the tree must be found once, before the
+       name given after the directory, and symbolic links inside the
+       tree must be passed over. */
+    static const char OTHER_NAME[] = "tm-missing";
+    jmp_buf on_error;
+    char *dir_name;
+    char *expected[TREE_FILES];
+    char *found[TREE_FILES];
+    const char *names[3];
+    struct file_list *list;
+    char *name;
+    int i;
+
+    make_tree(&dir_name, expected);
+    names[0] = dir_name;
+    names[1] = OTHER_NAME;
+    names[2] = NULL;
+    if(setjmp(on_error))
+    {
+        ck_abort_msg("Unexpected error: %s", strerror(errno));
+    }
+    list = open_file_list(names, NULL, NULL, 1, NULL, 0);
+    ck_assert(list != NULL);
+    for(i = 0; i < TREE_FILES; i++)
+    {
+        found[i] = next_list_file(list, &on_error);
+        ck_assert(found[i] != NULL);
+    }
+    name = next_list_file(list, &on_error);
+    ck_assert(name != NULL);
+    ck_assert(strcmp(name, OTHER_NAME) == 0);
+    free(name);
+    ck_assert(next_list_file(list, &on_error) == NULL);
+    close_file_list(list);
+    assert_names(found, expected);
+    remove_tree(dir_name, expected);
+}
+END_TEST
+
+START_TEST(test_walk_error)
+{
+    /* A directory that cannot be read must be reported, and the walk
+       must carry on afterwards. Here a subdirectory is removed after it
+       has been found but before it is read. */
+    jmp_buf on_error;
+    char *dir_name = strdup(MKDTEMP_TEMPLATE);
+    char file_path[PATH_MAX];
+    char sub_path[PATH_MAX];
+    const char *names[2];
+    struct file_list *list;
+    char *name;
+    volatile int errors = 0;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    sprintf(file_path, "%s/f", dir_name);
+    sprintf(sub_path, "%s/sub", dir_name);
+    make_file(file_path);
+    ck_assert(mkdir(sub_path, 0700) == 0);
+    names[0] = dir_name;
+    names[1] = NULL;
+
+    list = open_file_list(names, NULL, NULL, 1, NULL, 0);
+    ck_assert(list != NULL);
+    if(setjmp(on_error))
+    {
+        errors++;
+    }
+    else
+    {
+        name = next_list_file(list, &on_error);
+        ck_assert(name != NULL);
+        ck_assert(strcmp(name, file_path) == 0);
+        free(name);
+        ck_assert(rmdir(sub_path) == 0);
+        next_list_file(list, &on_error);
+        ck_abort_msg("Missing directory was not reported");
+    }
+    ck_assert(errors == 1);
+    ck_assert(next_list_file(list, &on_error) == NULL);
+    close_file_list(list);
+    ck_assert(unlink(file_path) == 0);
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+END_TEST
+
+START_TEST(test_names_file)
+{
+    /* Names read from the stream must follow those given, in order,
+       with the last one accepted without a terminator. An empty name
+       must be reported without ending the stream. */
+    static const char NAMES_DATA[] = "a\0b/c\0\0last";
+    static const char *const GIVEN[] = { "x", NULL };
+    static const char *const EXPECTED[] = { "x", "a", "b/c", "last" };
+    jmp_buf on_error;
+    FILE *names_file = tmpfile();
+    struct file_list *list;
+    char *name;
+    volatile int i = 0;
+    volatile int errors = 0;
+
+    ck_assert(names_file != NULL);
+    ck_assert(fwrite(NAMES_DATA, 1, sizeof(NAMES_DATA) - 1, names_file)
+        == sizeof(NAMES_DATA) - 1);
+    rewind(names_file);
+    list = open_file_list(GIVEN, names_file, "names", 0, NULL, 0);
+    ck_assert(list != NULL);
+    ck_assert(!list_may_wait(list));
+    if(setjmp(on_error))
+    {
+        /* The empty name is the third read from the stream */
+        ck_assert(i == 3);
+        errors++;
+    }
+    while((name = next_list_file(list, &on_error)) != NULL)
+    {
+        ck_assert(i < 4);
+        ck_assert_msg(strcmp(name, EXPECTED[i]) == 0,
+            "Expected `%s' but found `%s'", EXPECTED[i], name);
+        free(name);
+        i++;
+    }
+    ck_assert(i == 4);
+    ck_assert(errors == 1);
+    close_file_list(list);
+    ck_assert(fclose(names_file) == 0);
+}
+END_TEST
+
+START_TEST(test_names_file_pipe)
+{
+    /* Names from a pipe may have to wait, and each must be handed out
+       as soon as it has arrived. */
+    jmp_buf on_error;
+    int fds[2];
+    FILE *names_file;
+    struct file_list *list;
+    char *name;
+
+    if(setjmp(on_error))
+    {
+        ck_abort_msg("Unexpected error: %s", strerror(errno));
+    }
+    ck_assert(pipe(fds) == 0);
+    names_file = fdopen(fds[0], "rb");
+    ck_assert(names_file != NULL);
+    list = open_file_list(NULL_LIST, names_file, "pipe", 0, NULL, 0);
+    ck_assert(list != NULL);
+    ck_assert(list_may_wait(list));
+
+    /* The writing end stays open, so reading past the name would block */
+    ck_assert(write(fds[1], "first", 6) == 6);
+    name = next_list_file(list, &on_error);
+    ck_assert(name != NULL);
+    ck_assert(strcmp(name, "first") == 0);
+    free(name);
+    ck_assert(close(fds[1]) == 0);
+    ck_assert(next_list_file(list, &on_error) == NULL);
+    close_file_list(list);
+    ck_assert(fclose(names_file) == 0);
+}
+END_TEST
+
+START_TEST(test_walk_excludes)
+{
+    /* Excluded entries must be left out, with the rules given taking
+       precedence over .gitignore files, and deeper .gitignore files over
+       those further up. Excluded directories and .git must not be
+       walked. */
+    jmp_buf on_error;
+    char *dir_name = strdup(MKDTEMP_TEMPLATE);
+    char path[PATH_MAX];
+    const char *names[2];
+    struct ignore_rules *excludes = new_ignore_rules();
+    struct file_list *list;
+    char *name;
+    size_t i;
+    int count = 0;
+    int expected = 0;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    for(i = 0; i < EXCLUDE_TREE_SIZE; i++)
+    {
+        sprintf(path, "%s/%s", dir_name, EXCLUDE_TREE[i].path);
+        if(EXCLUDE_TREE[i].text)
+        {
+            FILE *f = fopen(path, "wb");
+
+            ck_assert(f != NULL);
+            ck_assert(fputs(EXCLUDE_TREE[i].text, f) >= 0);
+            ck_assert(fclose(f) == 0);
+            expected += EXCLUDE_TREE[i].found;
+        }
+        else
+        {
+            ck_assert(mkdir(path, 0700) == 0);
+        }
+    }
+    ck_assert(excludes != NULL);
+    ck_assert(add_ignore_rule(excludes, "*.o", 0) == 0);
+    ck_assert(add_ignore_rule(excludes, "vendor/", 0) == 0);
+    ck_assert(add_ignore_rule(excludes, "important.o", 1) == 0);
+    names[0] = dir_name;
+    names[1] = NULL;
+
+    if(setjmp(on_error))
+    {
+        ck_abort_msg("Unexpected error: %s", strerror(errno));
+    }
+    list = open_file_list(names, NULL, NULL, 1, excludes, 1);
+    ck_assert(list != NULL);
+    while((name = next_list_file(list, &on_error)) != NULL)
+    {
+        int known = 0;
+
+        for(i = 0; i < EXCLUDE_TREE_SIZE; i++)
+        {
+            sprintf(path, "%s/%s", dir_name, EXCLUDE_TREE[i].path);
+            if(strcmp(name, path) == 0)
+            {
+                ck_assert_msg(EXCLUDE_TREE[i].found,
+                    "`%s' should have been excluded", name);
+                known = 1;
+            }
+        }
+        ck_assert_msg(known, "Unexpected file `%s'", name);
+        free(name);
+        count++;
+    }
+    ck_assert(count == expected);
+    close_file_list(list);
+
+    for(i = EXCLUDE_TREE_SIZE; i-- > 0; )
+    {
+        sprintf(path, "%s/%s", dir_name, EXCLUDE_TREE[i].path);
+        ck_assert((EXCLUDE_TREE[i].text ? unlink(path) : rmdir(path)) == 0);
+    }
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+END_TEST
+
+#ifdef HAVE_PTHREAD_H
+
+/** Number of threads taking files from the list at once in
+    #test_walk_parallel */
+#define WALK_THREADS 4
+
+/** State shared by the threads of #test_walk_parallel */
+struct walk_test
+{
+    struct file_list *list;
+    char **found;
+    int count;
+    int overflow;
+    pthread_mutex_t lock;
+};
+
+/** Takes files from a list until it is exhausted.
+
+    @param arg Points to the #walk_test.
+    @return @c NULL. */
+static void *take_files(void *arg)
+{
+    struct walk_test *test = arg;
+    jmp_buf on_error;
+    char *name;
+
+    if(setjmp(on_error))
+    {
+        return NULL;
+    }
+    while((name = next_list_file(test->list, &on_error)) != NULL)
+    {
+        pthread_mutex_lock(&test->lock);
+        if(test->count < TREE_FILES)
+        {
+            test->found[test->count++] = name;
+        }
+        else
+        {
+            test->overflow = 1;
+            free(name);
+        }
+        pthread_mutex_unlock(&test->lock);
+    }
+    return NULL;
+}
+
+START_TEST(test_walk_parallel)
+{
+    /* Threads taking files from the same list at once must between them
+       be handed every file exactly once. */
+    char *dir_name;
+    char *expected[TREE_FILES];
+    char *found[TREE_FILES];
+    const char *names[2];
+    pthread_t threads[WALK_THREADS];
+    struct walk_test test;
+    int i;
+
+    make_tree(&dir_name, expected);
+    names[0] = dir_name;
+    names[1] = NULL;
+    test.list = open_file_list(names, NULL, NULL, 1, NULL, 0);
+    ck_assert(test.list != NULL);
+    test.found = found;
+    test.count = 0;
+    test.overflow = 0;
+    pthread_mutex_init(&test.lock, NULL);
+    for(i = 0; i < WALK_THREADS; i++)
+    {
+        ck_assert(pthread_create(&threads[i], NULL, take_files, &test) == 0);
+    }
+    for(i = 0; i < WALK_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&test.lock);
+    close_file_list(test.list);
+    ck_assert(!test.overflow);
+    ck_assert(test.count == TREE_FILES);
+    assert_names(found, expected);
+    remove_tree(dir_name, expected);
+}
+END_TEST
+
+#endif /* HAVE_PTHREAD_H */
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("filelist");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_names_given);
+    tcase_add_test(tc_core, test_walk);
+    tcase_add_test(tc_core, test_walk_error);
+    tcase_add_test(tc_core, test_walk_excludes);
+    tcase_add_test(tc_core, test_names_file);
+    tcase_add_test(tc_core, test_names_file_pipe);
+#   ifdef HAVE_PTHREAD_H
+        tcase_add_test(tc_core, test_walk_parallel);
+#   endif /* HAVE_PTHREAD_H */
+    suite_add_tcase(s, tc_core);
+    return s;
+}
@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <sys/stat.h>
 #include <check.h>
 
 #include "../filemgmt.h"
@@ -115,13 +116,14 @@ START_TEST(test_create_temp_file)
         /* Execution will branch here upon an I/O error */
         ck_abort_msg("I/O error occurred: %s", strerror(errno));
     }
-    create_temp_file(orig_file_name, "wb+", temp_file_name, &temp_file, &on_io_error);
+    create_temp_file(NO_DIR_FD, orig_file_name, "wb+", temp_file_name, &temp_file, &on_io_error);
     ck_assert(fputs(DATA, temp_file) >= 0);
     rewind(temp_file);
     ck_assert(fgets(line, line_size, temp_file) != NULL);
     ck_assert(strcmp(line, DATA) == 0);
     ck_assert(fclose(temp_file) == 0);
-    ck_assert(unlink(temp_file_name) == 0);
+    /* A temporary file created without a name vanishes when closed */
+    ck_assert(!*temp_file_name || unlink(temp_file_name) == 0);
     ck_assert(unlink(orig_file_name) == 0);
     free(line);
     free(orig_file_name);
@@ -166,6 +168,203 @@ START_TEST(test_replace_file)
 }
 END_TEST
 
+START_TEST(test_commit_temp_file)
+{
+    /* The temporary file must take the target's place and keep the
+       target's permissions. */
+    static const char DATA1[] = "Text1\n";
+    static const char DATA2[] = "Text2\n";
+    jmp_buf on_io_error;
+    char *target_name = strdup(MKSTEMP_TEMPLATE);
+    int target_fd = mkstemp(target_name);
+    size_t line_size = strlen(DATA2) + 1;
+    char *line = malloc(line_size);
+    char temp_file_name[PATH_MAX];
+    FILE *target_file;
+    FILE *temp_file;
+    struct stat target_stat;
+
+    ck_assert(target_fd >= 0);
+    ck_assert(write(target_fd, DATA1, strlen(DATA1)) == (ssize_t)strlen(DATA1));
+    ck_assert(fchmod(target_fd, 0640) == 0);
+    ck_assert(close(target_fd) == 0);
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here upon an I/O error */
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+
+    target_file = fopen(target_name, "rb");
+    ck_assert(target_file != NULL);
+    create_temp_file(NO_DIR_FD, target_name, "wb", temp_file_name, &temp_file, &on_io_error);
+    ck_assert(fputs(DATA2, temp_file) >= 0);
+    commit_temp_file(NO_DIR_FD, target_file, target_name, temp_file,
+        temp_file_name, &on_io_error);
+    ck_assert(fclose(target_file) == 0);
+
+    /* A named temporary file must be gone; it became the target */
+    ck_assert(!*temp_file_name || access(temp_file_name, F_OK) < 0);
+    ck_assert(stat(target_name, &target_stat) == 0);
+    ck_assert((target_stat.st_mode & 0777) == 0640);
+    target_file = fopen(target_name, "r");
+    ck_assert(target_file != NULL);
+    ck_assert(fgets(line, line_size, target_file) != NULL);
+    ck_assert(strcmp(line, DATA2) == 0);
+    ck_assert(fclose(target_file) == 0);
+    ck_assert(unlink(target_name) == 0);
+    free(target_name);
+    free(line);
+}
+END_TEST
+
+START_TEST(test_file_dir)
+{
+    /* Files in the same directory must share its descriptor, and a file
+       named relative to it must be read and replaced as if named in
+       full, leaving nothing else behind in the directory. */
+    static const char DATA1[] = "Text1\n";
+    static const char DATA2[] = "Text2\n";
+    jmp_buf on_io_error;
+    char *dir_name = strdup(MKSTEMP_TEMPLATE);
+    char target_name[PATH_MAX];
+    char other_name[PATH_MAX];
+    char temp_file_name[PATH_MAX];
+    size_t line_size = strlen(DATA2) + 1;
+    char *line = malloc(line_size);
+    struct file_dir dir;
+    int dir_fd;
+    FILE *target_file;
+    FILE *temp_file;
+    struct stat target_stat;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    sprintf(target_name, "%s/a", dir_name);
+    sprintf(other_name, "%s/b", dir_name);
+    target_file = fopen(target_name, "wb");
+    ck_assert(target_file != NULL);
+    ck_assert(fputs(DATA1, target_file) >= 0);
+    ck_assert(fclose(target_file) == 0);
+    ck_assert(chmod(target_name, 0640) == 0);
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here upon an I/O error */
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+
+    init_file_dir(&dir);
+    dir_fd = enter_file_dir(&dir, other_name);
+    ck_assert(enter_file_dir(&dir, target_name) == dir_fd);
+    open_input_file(dir_fd, target_name, "rb", &target_file, &on_io_error);
+    ck_assert(fgets(line, line_size, target_file) != NULL);
+    ck_assert(strcmp(line, DATA1) == 0);
+    create_temp_file(dir_fd, target_name, "wb", temp_file_name, &temp_file,
+        &on_io_error);
+    ck_assert(fputs(DATA2, temp_file) >= 0);
+    commit_temp_file(dir_fd, target_file, target_name, temp_file,
+        temp_file_name, &on_io_error);
+    ck_assert(fclose(target_file) == 0);
+    close_file_dir(&dir);
+    ck_assert(dir.fd == NO_DIR_FD);
+
+    ck_assert(stat(target_name, &target_stat) == 0);
+    ck_assert((target_stat.st_mode & 0777) == 0640);
+    target_file = fopen(target_name, "r");
+    ck_assert(target_file != NULL);
+    ck_assert(fgets(line, line_size, target_file) != NULL);
+    ck_assert(strcmp(line, DATA2) == 0);
+    ck_assert(fclose(target_file) == 0);
+    ck_assert(unlink(target_name) == 0);
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+    free(line);
+}
+END_TEST
+
+START_TEST(test_prefetch_file)
+{
+    /* Prefetching is only a hint; it must leave the file as it was, and
+       quietly ignore names that cannot be read ahead, and files too
+       short to be worth it. */
+    static const char DATA[] = "Text1\n";
+    char *f_name = strdup(MKSTEMP_TEMPLATE);
+    int f_fd = mkstemp(f_name);
+    size_t line_size = strlen(DATA) + 1;
+    char *line = malloc(line_size);
+    struct file_dir dir;
+    FILE *f;
+
+    ck_assert(f_fd >= 0);
+    ck_assert(write(f_fd, DATA, strlen(DATA)) == (ssize_t)strlen(DATA));
+    ck_assert(close(f_fd) == 0);
+
+    init_file_dir(&dir);
+    prefetch_file(NO_DIR_FD, f_name, 2);
+    prefetch_file(enter_file_dir(&dir, f_name), f_name, 2);
+    prefetch_file(NO_DIR_FD, f_name, strlen(DATA));
+    prefetch_file(NO_DIR_FD, ".", 2);
+    close_file_dir(&dir);
+    f = fopen(f_name, "r");
+    ck_assert(f != NULL);
+    ck_assert(fgets(line, line_size, f) != NULL);
+    ck_assert(strcmp(line, DATA) == 0);
+    ck_assert(fclose(f) == 0);
+
+    ck_assert(unlink(f_name) == 0);
+    prefetch_file(NO_DIR_FD, f_name, 2);
+    free(f_name);
+    free(line);
+}
+END_TEST
+
+START_TEST(test_repair_file_tail)
+{
+    static const char DATA[] = "Text1\nText2\n\n\n";
+    static const char EXPECT[] = "Text1\nText2\n\032";
+    jmp_buf on_io_error;
+    char *f_name = strdup(MKSTEMP_TEMPLATE);
+    int f_fd = mkstemp(f_name);
+    char buf[sizeof(DATA)];
+    struct file_dir dir;
+    struct stat before;
+    struct stat after;
+    FILE *f;
+
+    ck_assert(f_fd >= 0);
+    ck_assert(write(f_fd, DATA, strlen(DATA)) == (ssize_t)strlen(DATA));
+    ck_assert(close(f_fd) == 0);
+    ck_assert(stat(f_name, &before) == 0);
+
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+    /* Cut off the blank lines, then append a ctrl-Z, finding the file
+       through its directory */
+    init_file_dir(&dir);
+    repair_file_tail(NO_DIR_FD, f_name, 12, NULL, 0, 0, &on_io_error);
+    repair_file_tail(enter_file_dir(&dir, f_name), f_name, 12, "\032", 1,
+        1, &on_io_error);
+    close_file_dir(&dir);
+    ck_assert(stat(f_name, &after) == 0);
+    ck_assert(after.st_ino == before.st_ino);
+    f = fopen(f_name, "rb");
+    ck_assert(f != NULL);
+    ck_assert(fread(buf, 1, sizeof(buf), f) == strlen(EXPECT));
+    ck_assert(memcmp(buf, EXPECT, strlen(EXPECT)) == 0);
+    ck_assert(fclose(f) == 0);
+
+    ck_assert(unlink(f_name) == 0);
+    if(!setjmp(on_io_error))
+    {
+        repair_file_tail(NO_DIR_FD, f_name, 0, NULL, 0, 0, &on_io_error);
+        ck_abort_msg("Fixing a missing file did not fail");
+    }
+    free(f_name);
+}
+END_TEST
+
 Suite *init_suite(void)
 {
     Suite *s = suite_create("filemgmt");
@@ -175,6 +374,10 @@ Suite *init_suite(void)
     tcase_add_test(tc_core, test_open_file__failure);
     tcase_add_test(tc_core, test_create_temp_file);
     tcase_add_test(tc_core, test_replace_file);
+    tcase_add_test(tc_core, test_commit_temp_file);
+    tcase_add_test(tc_core, test_file_dir);
+    tcase_add_test(tc_core, test_prefetch_file);
+    tcase_add_test(tc_core, test_repair_file_tail);
     suite_add_tcase(s, tc_core);
     return s;
 }
@@ -0,0 +1,316 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckignore.c
+    Test suite for ignore module. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <check.h>
+
+#include "../ignore.h"
+
+/** Definition for boolean constant @e false */
+#define FALSE 0
+
+/** Definition for boolean constant @e true */
+#define TRUE (!FALSE)
+
+/** Longest path that the tests walk down */
+#define MAX_TEST_PATH 64
+
+/** Builds a set of rules from an array of lines.
+
+    @param lines The lines, ending with @c NULL.
+    @return The rules. */
+static struct ignore_rules *make_rules(const char *const *lines)
+{
+    struct ignore_rules *rules = new_ignore_rules();
+
+    ck_assert(rules != NULL);
+    for(; *lines; lines++)
+    {
+        ck_assert(add_ignore_rule(rules, *lines, FALSE) == 0);
+    }
+    return rules;
+}
+
+/** Walks down a path the way the file list does, checking each
+    directory on the way and finally the entry itself.
+
+    @param state State of the directory the path is relative to.
+    @param path The path, whose components are separated by @c /.
+    @param is_dir Set if the last component is a directory.
+    @return Non-zero if the entry, or a directory above it, is
+    excluded. */
+static int walk_ignored(
+    const struct ignore_state *state,
+    const char *path,
+    int is_dir)
+{
+    char name[MAX_TEST_PATH];
+    struct ignore_state *dir_state = NULL;
+    const char *slash;
+    int ignored = FALSE;
+
+    while(!ignored && (slash = strchr(path, '/')) != NULL)
+    {
+        struct ignore_state *next;
+
+        ck_assert(slash - path < MAX_TEST_PATH);
+        memcpy(name, path, slash - path);
+        name[slash - path] = '\0';
+        ignored = is_ignored(dir_state ? dir_state : state, name, TRUE);
+        next = enter_ignore_dir(dir_state ? dir_state : state, name);
+        ck_assert(next != NULL);
+        free_ignore_state(dir_state);
+        dir_state = next;
+        path = slash + 1;
+    }
+    if(!ignored)
+    {
+        ignored = is_ignored(dir_state ? dir_state : state, path, is_dir);
+    }
+    free_ignore_state(dir_state);
+    return ignored;
+}
+
+/** Checks a path against a set of rules of its own.
+
+    @param lines Lines of the rules, ending with @c NULL.
+    @param path The path, relative to where the rules apply.
+    @param is_dir Set if the last component is a directory.
+    @return Non-zero if the path is excluded. */
+static int rules_ignore(const char *const *lines, const char *path, int is_dir)
+{
+    struct ignore_rules *rules = make_rules(lines);
+    struct ignore_state *state = new_ignore_state(rules);
+    int ignored;
+
+    ck_assert(state != NULL);
+    ignored = walk_ignored(state, path, is_dir);
+    free_ignore_state(state);
+    free_ignore_rules(rules);
+    return ignored;
+}
+
+START_TEST(test_names_and_directories)
+{
+    /* A rule without a slash matches at any depth; a trailing slash
+       keeps it to directories, whose contents go with them. */
+    static const char *const lines[] = { "core", "build/", NULL };
+
+    ck_assert(rules_ignore(lines, "core", FALSE));
+    ck_assert(rules_ignore(lines, "a/b/core", FALSE));
+    ck_assert(rules_ignore(lines, "core/x.c", FALSE));
+    ck_assert(!rules_ignore(lines, "corex", FALSE));
+    ck_assert(rules_ignore(lines, "build", TRUE));
+    ck_assert(!rules_ignore(lines, "build", FALSE));
+    ck_assert(rules_ignore(lines, "src/build/x.c", FALSE));
+    ck_assert(!rules_ignore(lines, "src/x.c", FALSE));
+}
+END_TEST
+
+START_TEST(test_negation)
+{
+    /* The last matching rule decides. */
+    static const char *const lines[] = {
+        "*.log", "!keep.log", "keep.log.old", "!*.txt", "*.txt", NULL };
+
+    ck_assert(rules_ignore(lines, "a.log", FALSE));
+    ck_assert(!rules_ignore(lines, "keep.log", FALSE));
+    ck_assert(!rules_ignore(lines, "d/keep.log", FALSE));
+    ck_assert(rules_ignore(lines, "keep.log.old", FALSE));
+    ck_assert(rules_ignore(lines, "a.txt", FALSE));
+}
+END_TEST
+
+START_TEST(test_anchored)
+{
+    /* A rule with a slash is relative to where the rules apply. */
+    static const char *const lines[] = { "/top", "doc/*.html", NULL };
+
+    ck_assert(rules_ignore(lines, "top", FALSE));
+    ck_assert(!rules_ignore(lines, "a/top", FALSE));
+    ck_assert(rules_ignore(lines, "doc/index.html", FALSE));
+    ck_assert(!rules_ignore(lines, "a/doc/index.html", FALSE));
+    ck_assert(!rules_ignore(lines, "doc/sub/index.html", FALSE));
+}
+END_TEST
+
+START_TEST(test_any_dirs)
+{
+    /* A leading or middle ** matches zero or more directories; a
+       trailing one matches everything inside. */
+    static const char *const lines[] = {
+        "**/gen/out", "a/**/b", "tmp/**", NULL };
+
+    ck_assert(rules_ignore(lines, "gen/out", FALSE));
+    ck_assert(rules_ignore(lines, "x/y/gen/out", FALSE));
+    ck_assert(rules_ignore(lines, "a/b", FALSE));
+    ck_assert(rules_ignore(lines, "a/x/y/b", FALSE));
+    ck_assert(!rules_ignore(lines, "x/a/b", FALSE));
+    ck_assert(!rules_ignore(lines, "tmp", TRUE));
+    ck_assert(rules_ignore(lines, "tmp/x", FALSE));
+    ck_assert(rules_ignore(lines, "tmp/x/y", FALSE));
+}
+END_TEST
+
+START_TEST(test_wildcards)
+{
+    /* Suffixes, other globs and bracket expressions. */
+    static const char *const lines[] = {
+        "*.o", "*.tar.gz", "lib*.so", "file?.[ch]", "[!a-y]*z", NULL };
+
+    ck_assert(rules_ignore(lines, "x.o", FALSE));
+    ck_assert(rules_ignore(lines, ".o", FALSE));
+    ck_assert(!rules_ignore(lines, "x.oo", FALSE));
+    ck_assert(rules_ignore(lines, "d/x.tar.gz", FALSE));
+    ck_assert(!rules_ignore(lines, "x.gz", FALSE));
+    ck_assert(rules_ignore(lines, "libfoo.so", FALSE));
+    ck_assert(!rules_ignore(lines, "foo.so", FALSE));
+    ck_assert(rules_ignore(lines, "file1.c", FALSE));
+    ck_assert(rules_ignore(lines, "fileA.h", FALSE));
+    ck_assert(!rules_ignore(lines, "file12.c", FALSE));
+    ck_assert(rules_ignore(lines, "zoz", FALSE));
+    ck_assert(!rules_ignore(lines, "quiz", FALSE));
+}
+END_TEST
+
+START_TEST(test_syntax)
+{
+    /* Comments and blank lines are passed over, trailing spaces and
+       carriage returns dropped, and backslashes quote. */
+    static const char *const lines[] = {
+        "# comment", "", "   ", "\\#hash", "\\!bang", "spaced   ",
+        "kept\\ ", "crlf\r", "star\\*", NULL };
+
+    ck_assert(!rules_ignore(lines, "# comment", FALSE));
+    ck_assert(rules_ignore(lines, "#hash", FALSE));
+    ck_assert(rules_ignore(lines, "!bang", FALSE));
+    ck_assert(rules_ignore(lines, "spaced", FALSE));
+    ck_assert(rules_ignore(lines, "kept ", FALSE));
+    ck_assert(!rules_ignore(lines, "kept", FALSE));
+    ck_assert(rules_ignore(lines, "crlf", FALSE));
+    ck_assert(rules_ignore(lines, "star*", FALSE));
+    ck_assert(!rules_ignore(lines, "starry", FALSE));
+}
+END_TEST
+
+START_TEST(test_read_rules)
+{
+    /* Rules are read a line at a time, the last without a newline. */
+    struct ignore_rules *rules = new_ignore_rules();
+    struct ignore_state *state;
+    FILE *f = tmpfile();
+
+    ck_assert(rules != NULL && f != NULL);
+    ck_assert(fputs("# nothing\n\n", f) >= 0);
+    rewind(f);
+    ck_assert(read_ignore_rules(rules, f) == 0);
+    ck_assert(ignore_rules_empty(rules));
+    rewind(f);
+    ck_assert(fputs("*.bak\r\n!keep.bak\nlast", f) >= 0);
+    rewind(f);
+    ck_assert(read_ignore_rules(rules, f) == 0);
+    ck_assert(!ignore_rules_empty(rules));
+    ck_assert(fclose(f) == 0);
+
+    state = new_ignore_state(rules);
+    ck_assert(state != NULL);
+    ck_assert(is_ignored(state, "x.bak", FALSE));
+    ck_assert(!is_ignored(state, "keep.bak", FALSE));
+    ck_assert(is_ignored(state, "last", FALSE));
+    free_ignore_state(state);
+    free_ignore_rules(rules);
+}
+END_TEST
+
+START_TEST(test_precedence)
+{
+    /* The rules a walk starts with come first; rules pushed deeper come
+       before those pushed further up, and apply from where they were
+       pushed. */
+    static const char *const given_lines[] = { "*.c", NULL };
+    static const char *const outer_lines[] = { "*.h", "*.txt", NULL };
+    static const char *const inner_lines[] = { "!*.c", "!*.h", NULL };
+    struct ignore_rules *given = make_rules(given_lines);
+    struct ignore_rules *outer = make_rules(outer_lines);
+    struct ignore_rules *inner = make_rules(inner_lines);
+    struct ignore_state *top = new_ignore_state(given);
+    struct ignore_state *top_pushed;
+    struct ignore_state *sub;
+    struct ignore_state *sub_pushed;
+
+    ck_assert(top != NULL);
+    top_pushed = push_ignore_rules(top, outer);
+    ck_assert(top_pushed != NULL);
+    free_ignore_state(top);
+    ck_assert(is_ignored(top_pushed, "x.h", FALSE));
+    ck_assert(is_ignored(top_pushed, "x.c", FALSE));
+
+    sub = enter_ignore_dir(top_pushed, "sub");
+    ck_assert(sub != NULL);
+    ck_assert(is_ignored(sub, "x.h", FALSE));
+    sub_pushed = push_ignore_rules(sub, inner);
+    ck_assert(sub_pushed != NULL);
+    free_ignore_state(sub);
+    ck_assert(!is_ignored(sub_pushed, "x.h", FALSE));
+    ck_assert(is_ignored(sub_pushed, "x.c", FALSE));
+    ck_assert(is_ignored(sub_pushed, "x.txt", FALSE));
+    ck_assert(!is_ignored(sub_pushed, "x.md", FALSE));
+    ck_assert(!is_ignored(top_pushed, "sub", TRUE));
+
+    free_ignore_state(sub_pushed);
+    free_ignore_state(top_pushed);
+    free_ignore_rules(inner);
+    free_ignore_rules(outer);
+    free_ignore_rules(given);
+}
+END_TEST
+
+START_TEST(test_no_rules)
+{
+    /* A state without rules excludes nothing, however deep. */
+    struct ignore_state *state = new_ignore_state(NULL);
+
+    ck_assert(state != NULL);
+    ck_assert(!walk_ignored(state, "a/b/c", FALSE));
+    free_ignore_state(state);
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("ignore");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_test(tc_core, test_names_and_directories);
+    tcase_add_test(tc_core, test_negation);
+    tcase_add_test(tc_core, test_anchored);
+    tcase_add_test(tc_core, test_any_dirs);
+    tcase_add_test(tc_core, test_wildcards);
+    tcase_add_test(tc_core, test_syntax);
+    tcase_add_test(tc_core, test_read_rules);
+    tcase_add_test(tc_core, test_precedence);
+    tcase_add_test(tc_core, test_no_rules);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
@@ -363,6 +363,200 @@ START_TEST(test_tab_min)
 }
 END_TEST
 
+START_TEST(test_check_mode)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.check_only);
+    ck_assert(try_options("--check", "foo", "bar", NULL));
+    ck_assert(options.check_only);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(try_options("--check", NULL));
+    ck_assert(options.check_only);
+    ck_assert(options.program_mode == PM_PROCESS_STREAM);
+    ck_assert(!try_options("--check", "-o", "foo", "bar", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_jobs)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(options.jobs == DEFAULT_JOBS);
+    ck_assert(!options.keep_going);
+    ck_assert(!try_options("-j", NULL));
+    ck_assert(!try_options("-j", "baz", NULL));
+    ck_assert(!try_options("-j", "0", NULL));
+    ck_assert(!try_options("-j", "-4", NULL));
+    ck_assert(try_options("-j4", "foo", NULL));
+    ck_assert(options.jobs == 4);
+    ck_assert(try_options("--jobs", "2", "-k", "foo", "bar", NULL));
+    ck_assert(options.jobs == 2);
+    ck_assert(options.keep_going);
+    ck_assert(try_options("--keep-going", "foo", NULL));
+    ck_assert(options.keep_going);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+    assert_dfl_tab_size();
+    assert_dfl_tab_min();
+}
+END_TEST
+
+START_TEST(test_pipeline)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.pipeline);
+    ck_assert(try_options("--pipeline", NULL));
+    ck_assert(options.pipeline);
+    ck_assert(options.program_mode == PM_PROCESS_STREAM);
+    ck_assert(try_options("--pipeline", "-o", "bar", "foo", NULL));
+    ck_assert(options.pipeline);
+    ck_assert(options.program_mode == PM_PROCESS_STREAM);
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_fix_tail)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.fix_tail);
+    ck_assert(!options.sync_tail);
+    ck_assert(try_options("--fix-tail", "foo", NULL));
+    ck_assert(options.fix_tail);
+    ck_assert(!options.sync_tail);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(try_options("--fix-tail=sync", "foo", "bar", NULL));
+    ck_assert(options.fix_tail);
+    ck_assert(options.sync_tail);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(!try_options("--fix-tail=later", "foo", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_overwrite)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.overwrite);
+    ck_assert(try_options("--overwrite", "foo", "bar", NULL));
+    ck_assert(options.overwrite);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(!try_options("--overwrite=yes", "foo", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_durable)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.durable);
+    ck_assert(try_options("--durable", "foo", "bar", NULL));
+    ck_assert(options.durable);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(!try_options("--durable=yes", "foo", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_recursive)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.recursive);
+    ck_assert(try_options("--recursive", "foo", "bar", NULL));
+    ck_assert(options.recursive);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(!try_options("--recursive=yes", "foo", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_files0_from)
+{
+    ck_assert(try_options("--files0-from=names", NULL));
+    ck_assert(options.files0_from != NULL);
+    ck_assert(strcmp(options.files0_from, "names") == 0);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(options.file_name_list[0] == NULL);
+    ck_assert(try_options("--files0-from", "-", "--check", NULL));
+    ck_assert(strcmp(options.files0_from, "-") == 0);
+    ck_assert(options.check_only);
+    ck_assert(!try_options("--files0-from=names", "foo", NULL));
+    ck_assert(!try_options("--files0-from=names", "-o", "foo", NULL));
+    ck_assert(!try_options("--files0-from", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_text)
+{
+    ck_assert(try_options("foo", NULL));
+    ck_assert(!options.text);
+    ck_assert(try_options("--text", "foo", NULL));
+    ck_assert(options.text);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_exclude)
+{
+    ck_assert(try_options("--recursive", "foo", NULL));
+    ck_assert(options.exclude_count == 0);
+    ck_assert(!options.gitignore);
+    ck_assert(try_options("--exclude=*.o", "--include", "keep.o",
+        "--exclude", "build/", "--gitignore", "--recursive", "foo", NULL));
+    ck_assert(options.exclude_count == 3);
+    ck_assert(strcmp(options.exclude_patterns[0].pattern, "*.o") == 0);
+    ck_assert(!options.exclude_patterns[0].include);
+    ck_assert(strcmp(options.exclude_patterns[1].pattern, "keep.o") == 0);
+    ck_assert(options.exclude_patterns[1].include);
+    ck_assert(strcmp(options.exclude_patterns[2].pattern, "build/") == 0);
+    ck_assert(!options.exclude_patterns[2].include);
+    ck_assert(options.gitignore);
+    ck_assert(options.program_mode == PM_PROCESS_FILE_LIST);
+    ck_assert(!try_options("--exclude", NULL));
+    ck_assert(!try_options("--gitignore=yes", "foo", NULL));
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+}
+END_TEST
+
+START_TEST(test_simd_modes)
+{
+    unsetenv("CLEANTXT_SIMD");
+    ck_assert(try_options(NULL, NULL));
+    ck_assert(options.simd_mode == SM_AUTO);
+    ck_assert(!try_options("--simd", NULL));
+    ck_assert(!try_options("--simd", "mmx", NULL));
+    ck_assert(try_options("--simd", "scalar", NULL));
+    ck_assert(options.simd_mode == SM_SCALAR);
+    ck_assert(try_options("--simd=avx512", NULL));
+    ck_assert(options.simd_mode == SM_AVX512);
+    assert_dfl_whitespace_mode();
+    assert_dfl_eol_mode();
+    assert_dfl_tab_size();
+    assert_dfl_tab_min();
+
+    /* The environment supplies a default that the option overrides */
+    setenv("CLEANTXT_SIMD", "sse2", 1);
+    ck_assert(try_options(NULL, NULL));
+    ck_assert(options.simd_mode == SM_SSE2);
+    ck_assert(try_options("--simd=avx2", NULL));
+    ck_assert(options.simd_mode == SM_AVX2);
+    setenv("CLEANTXT_SIMD", "bogus", 1);
+    ck_assert(!try_options(NULL, NULL));
+    unsetenv("CLEANTXT_SIMD");
+}
+END_TEST
+
 START_TEST(test_invalid_option)
 {
     ck_assert(!try_options("-@", NULL));
@@ -386,6 +580,17 @@ Suite *init_suite(void)
     tcase_add_test(tc_core, test_ctrl_z_modes);
     tcase_add_test(tc_core, test_tab_sizes);
     tcase_add_test(tc_core, test_tab_min);
+    tcase_add_test(tc_core, test_check_mode);
+    tcase_add_test(tc_core, test_jobs);
+    tcase_add_test(tc_core, test_pipeline);
+    tcase_add_test(tc_core, test_fix_tail);
+    tcase_add_test(tc_core, test_overwrite);
+    tcase_add_test(tc_core, test_durable);
+    tcase_add_test(tc_core, test_recursive);
+    tcase_add_test(tc_core, test_files0_from);
+    tcase_add_test(tc_core, test_text);
+    tcase_add_test(tc_core, test_exclude);
+    tcase_add_test(tc_core, test_simd_modes);
     tcase_add_test(tc_core, test_invalid_option);
     suite_add_tcase(s, tc_core);
     return s;
@@ -0,0 +1,391 @@
+/*  cleantxt: Cleans up tab, space and end-of-line formatting in text files.
+    Copyright (C) 1999-2013 Bryan Rodgers <rodgersb@it.net.au>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or (at
+    your option) any later version.
+
+    This program is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. */
+
+/** @file tests/ckovrwrt.c
+    Test suite for overwrt module. The filtering rules themselves are
+    covered by the cleanstr test suite; these tests check that a file
+    overwritten in place ends up the same as its text cleaned in one go,
+    even if the rewrite is interrupted. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <check.h>
+
+#include "../cleanstr.h"
+#include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
+#include "../cleanbuf.h"
+#include "../filemgmt.h"
+#include "../overwrt.h"
+#include "helpers/io.h"
+
+/** Temporary filename template; this must be copied, not used directly
+    with the @c mkstemp() library call. */
+static const char MKSTEMP_TEMPLATE[] = "tmXXXXXX";
+
+/** Redirect stderr to this file during testing to suppress error
+    messages from intefering with the test results output. */
+static const char STDERR_SINK[] = "/dev/null";
+
+/** Length of the unchanged text at the start of each generated text */
+#define PREFIX_LEN 1000
+
+/** Length of each generated text, including its prefix */
+#define TEXT_LEN 20000
+
+/** Segment length that files are overwritten with; small, so that a
+    file is overwritten in many segments */
+#define SEGMENT_SIZE 128
+
+/** Length of the text whose rewrite is interrupted */
+#define LONG_TEXT_LEN 300000
+
+/** Number of points at which the rewrite of a file is interrupted */
+#define INTERRUPT_COUNT 8
+
+/** Characters that generated texts are mostly made of, with and
+    without tab characters. LF characters are common enough that every
+    segment has somewhere to end. */
+static const char TEXT_CHARS[] = "  \r\r\n\n\n\nabcde\t";
+
+/** One in this many characters of a generated text is a ctrl-Z, so that
+    some are found before the end even when they stop the text */
+#define CTRL_Z_RARITY 5000
+
+static void setup(void)
+{
+    freopen(STDERR_SINK, "w", stderr);
+}
+
+static void teardown(void)
+{
+    fclose(stderr);
+    stderr = fdopen(STDERR_FILENO, "w");
+}
+
+/** Fills a buffer with a line of clean text repeated, followed by
+    pseudo-random text.
+
+    @param buf The buffer to fill.
+    @param len Number of bytes to fill.
+    @param tabs Non-zero if the random text may hold tab characters. */
+static void make_text(char *buf, size_t len, int tabs)
+{
+    /* LINE: The clean line that the text starts with */
+    /* i: Index into buf */
+    static const char LINE[] = "A clean line\n";
+    size_t i;
+
+    for(i = 0; i < len; i++)
+    {
+        if(i < PREFIX_LEN)
+        {
+            buf[i] = LINE[i % (sizeof(LINE) - 1)];
+        }
+        else if(rand() % CTRL_Z_RARITY == 0)
+        {
+            buf[i] = '\032';
+        }
+        else
+        {
+            buf[i] = TEXT_CHARS[rand() % (sizeof(TEXT_CHARS) - (tabs ? 1 : 2))];
+        }
+    }
+}
+
+/** Writes a text to a new file.
+
+    @param text The text.
+    @param len Length of the text.
+    @return The name of the file, which the caller must free. */
+static char *write_file(const char *text, size_t len)
+{
+    /* name: Name of the file */
+    /* fd: File descriptor of the file */
+    char *name = strdup(MKSTEMP_TEMPLATE);
+    int fd = mkstemp(name);
+
+    ck_assert(fd >= 0);
+    ck_assert(write(fd, text, len) == (ssize_t)len);
+    ck_assert(close(fd) == 0);
+    return name;
+}
+
+/** Finds the first change that cleaning would make to a file.
+
+    @param ctx The cleaning context.
+    @param name Name of the file.
+    @param modified_at Receives the offset of the change.
+    @return Non-zero if the file would be modified. */
+static int find_change(
+    struct cleantxt_ctx *ctx,
+    const char *name,
+    unsigned long *modified_at)
+{
+    /* f: The file */
+    /* on_io_error: Execution branches here on I/O errors */
+    /* res: Whether the file would be modified */
+    FILE *f = fopen(name, "rb");
+    jmp_buf on_io_error;
+    clean_stream_result_t res;
+
+    ck_assert(f != NULL);
+    if(setjmp(on_io_error))
+    {
+        ck_abort_msg("I/O error encountered: %s", strerror(errno));
+    }
+    res = check_stream(ctx, f, modified_at, &on_io_error);
+    ck_assert(fclose(f) == 0);
+    return res == CSR_STREAM_MODIFIED;
+}
+
+/** Overwrites a file, failing the test on any error.
+
+    @param ctx The cleaning context.
+    @param name Name of the file, which must need cleaning.
+    @return As for #overwrite_file. */
+static int try_overwrite(struct cleantxt_ctx *ctx, const char *name)
+{
+    /* modified_at: Offset of the first change to the file */
+    /* on_error: Execution branches here on errors */
+    /* dir: The file's directory, which the file is opened through */
+    /* res: Result of overwrite_file() */
+    unsigned long modified_at;
+    jmp_buf on_error;
+    struct file_dir dir;
+    int res;
+
+    ck_assert(find_change(ctx, name, &modified_at));
+    if(setjmp(on_error))
+    {
+        ck_abort_msg("overwrite_file() failed");
+    }
+    init_file_dir(&dir);
+    res = overwrite_file(ctx, enter_file_dir(&dir, name), name, modified_at,
+        SEGMENT_SIZE, &on_error);
+    close_file_dir(&dir);
+    return res;
+}
+
+/** Checks that a file holds a text cleaned in one go, and that its
+    journal is gone.
+
+    @param ctx The cleaning context.
+    @param name Name of the file.
+    @param text The text before it was cleaned.
+    @param len Length of the text. */
+static void assert_cleaned(
+    struct cleantxt_ctx *ctx,
+    const char *name,
+    const char *text,
+    size_t len)
+{
+    /* journal_name: Name of the file's journal */
+    /* bound: Size of the buffer for the cleaned text */
+    /* expect: The cleaned text */
+    /* expect_len: Length of the cleaned text */
+    /* res: Whether the text was modified */
+    /* f: The file */
+    char journal_name[PATH_MAX];
+    size_t bound = clean_buffer_bound(ctx, len);
+    char *expect = malloc(bound);
+    size_t expect_len;
+    clean_stream_result_t res;
+    FILE *f;
+
+    ck_assert(expect != NULL);
+    ck_assert(clean_buffer(ctx, text, len, expect, bound, &expect_len, &res)
+        == CB_OK);
+    f = fopen(name, "rb");
+    ck_assert(f != NULL);
+    assert_output_file_contents_match_buf(expect, expect_len, f);
+    ck_assert(fclose(f) == 0);
+    free(expect);
+
+    strcpy(journal_name, name);
+    strcat(journal_name, OVERWRITE_JOURNAL_SUFFIX);
+    ck_assert(access(journal_name, F_OK) != 0);
+}
+
+START_TEST(overwrite_matches_clean_buffer)
+{
+    char *text = malloc(TEXT_LEN);
+    struct cleantxt_ctx ctx;
+    int n;
+
+    ck_assert(text != NULL);
+    srand(1);
+    /* Try each combination of options that can only shrink text */
+    for(n = 0; n < 64; n++)
+    {
+        char *name;
+
+        cleantxt_ctx_init(&ctx);
+        ctx.tab_size = n % 2 ? 4 : 8;
+        ctx.tab_min = 1 + (n / 2) % 2;
+        ctx.whitespace_mode = (n / 4) % 2 ? WM_TAB : WM_SPACE;
+        ctx.eol_mode = (n / 8) % 2 ? EM_CR : EM_LF;
+        ctx.add_ctrl_z = (n / 16) % 2;
+        ctx.stop_at_ctrl_z = (n / 32) % 2;
+        ctx.remove_ctrl_z = !ctx.stop_at_ctrl_z && ctx.add_ctrl_z;
+
+        make_text(text, TEXT_LEN, ctx.whitespace_mode == WM_TAB);
+        name = write_file(text, TEXT_LEN);
+        ck_assert(try_overwrite(&ctx, name));
+        assert_cleaned(&ctx, name, text, TEXT_LEN);
+        ck_assert(unlink(name) == 0);
+        free(name);
+    }
+    free(text);
+}
+END_TEST
+
+START_TEST(overwrite_refuses_growth)
+{
+    char *text = malloc(TEXT_LEN);
+    struct cleantxt_ctx ctx;
+    char *name;
+    FILE *f;
+
+    ck_assert(text != NULL);
+    srand(2);
+    make_text(text, TEXT_LEN, 1);
+    name = write_file(text, TEXT_LEN);
+
+    /* CR+LF line endings, tabs that may be expanded, a minimum gap that
+       may turn a tab into spaces and a line longer than a segment all
+       leave the file untouched. */
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_CRLF;
+    ctx.whitespace_mode = WM_TAB;
+    ck_assert(!try_overwrite(&ctx, name));
+    cleantxt_ctx_init(&ctx);
+    ck_assert(!try_overwrite(&ctx, name));
+    ctx.whitespace_mode = WM_TAB;
+    ctx.tab_min = 3;
+    ck_assert(!try_overwrite(&ctx, name));
+    f = fopen(name, "rb");
+    ck_assert(f != NULL);
+    assert_output_file_contents_match_buf(text, TEXT_LEN, f);
+    ck_assert(fclose(f) == 0);
+    ck_assert(unlink(name) == 0);
+    free(name);
+
+    memset(text + PREFIX_LEN, 'x', SEGMENT_SIZE + 1);
+    name = write_file(text, TEXT_LEN);
+    ctx.tab_min = 2;
+    ck_assert(!try_overwrite(&ctx, name));
+    ck_assert(unlink(name) == 0);
+    free(name);
+    free(text);
+}
+END_TEST
+
+START_TEST(finish_after_interruption)
+{
+    char *text = malloc(LONG_TEXT_LEN);
+    struct cleantxt_ctx ctx;
+    struct timeval start;
+    struct timeval end;
+    long duration;
+    char *name;
+    int i;
+
+    ck_assert(text != NULL);
+    srand(3);
+    make_text(text, LONG_TEXT_LEN, 1);
+    cleantxt_ctx_init(&ctx);
+    ctx.whitespace_mode = WM_TAB;
+
+    /* Time an uninterrupted rewrite */
+    name = write_file(text, LONG_TEXT_LEN);
+    gettimeofday(&start, NULL);
+    ck_assert(try_overwrite(&ctx, name));
+    gettimeofday(&end, NULL);
+    duration = (end.tv_sec - start.tv_sec) * 1000000L
+        + (end.tv_usec - start.tv_usec);
+    ck_assert(unlink(name) == 0);
+    free(name);
+
+    /* Kill rewrites at points spread across that time. The journal
+       must let each one be finished, after which the file is clean. */
+    for(i = 0; i < INTERRUPT_COUNT; i++)
+    {
+        pid_t pid;
+        jmp_buf on_error;
+        unsigned long modified_at;
+
+        name = write_file(text, LONG_TEXT_LEN);
+        ck_assert(find_change(&ctx, name, &modified_at));
+        pid = fork();
+        ck_assert(pid >= 0);
+        if(pid == 0)
+        {
+            if(!setjmp(on_error))
+            {
+                overwrite_file(&ctx, NO_DIR_FD, name, modified_at,
+                    SEGMENT_SIZE, &on_error);
+            }
+            _exit(0);
+        }
+        usleep(duration * i / INTERRUPT_COUNT);
+        kill(pid, SIGKILL);
+        ck_assert(waitpid(pid, NULL, 0) == pid);
+
+        if(setjmp(on_error))
+        {
+            ck_abort_msg("finish_overwrite() failed");
+        }
+        finish_overwrite(NO_DIR_FD, name, &on_error);
+        if(find_change(&ctx, name, &modified_at))
+        {
+            /* Killed before the journal was created */
+            ck_assert(try_overwrite(&ctx, name));
+        }
+        assert_cleaned(&ctx, name, text, LONG_TEXT_LEN);
+        ck_assert(!finish_overwrite(NO_DIR_FD, name, &on_error));
+        ck_assert(unlink(name) == 0);
+        free(name);
+    }
+    free(text);
+}
+END_TEST
+
+Suite *init_suite(void)
+{
+    Suite *s = suite_create("overwrite");
+    TCase *tc_core = tcase_create("core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, overwrite_matches_clean_buffer);
+    tcase_add_test(tc_core, overwrite_refuses_growth);
+    tcase_add_test(tc_core, finish_after_interruption);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
@@ -28,10 +28,17 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <check.h>
 
 #include "../procfile.h"
+#include "../cleanstr.h"
 #include "../options.h"
+#include "../cleaneng.h"
+#include "../cleanctx.h"
 #include "helpers/io.h"
 
 /** Temporary filename template; this must be copied, not used directly
@@ -39,6 +46,9 @@
     argument in-place. */
 static const char MKSTEMP_TEMPLATE[] = "tmXXXXXX";
 
+/** Cleaning context whose configuration the tests use */
+static struct cleantxt_ctx ctx;
+
 START_TEST(test_process_file)
 {
     static const char ORG_DATA[] = "\tHello world!\n";
@@ -58,17 +68,18 @@ START_TEST(test_process_file)
     ck_assert(close(out_fd) == 0);
 
     init_options();
-    options.tab_size = 4;
-    options.tab_min = 1;
-    options.whitespace_mode = WM_SPACE;
-    options.eol_mode = EM_LF;
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
 
     if(setjmp(on_io_error))
     {
         /* Execution will branch here on I/O error */
         ck_abort_msg("I/O error occurred: %s", strerror(errno));
     }
-    process_file(in_file_name, out_file_name, &on_io_error);
+    process_file(&ctx, in_file_name, out_file_name, &on_io_error);
     actual_file = fopen(out_file_name, "rb");
     ck_assert(actual_file != NULL);
     assert_output_file_contents_match_str(EXP_DATA, actual_file);
@@ -114,17 +125,18 @@ START_TEST(test_process_file_list)
     file_names[LIST_LEN] = NULL;
 
     init_options();
-    options.tab_size = 4;
-    options.tab_min = 1;
-    options.whitespace_mode = WM_SPACE;
-    options.eol_mode = EM_LF;
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
 
     if(setjmp(on_io_error))
     {
         /* Execution will branch here on I/O error */
         ck_abort_msg("I/O error occurred: %s", strerror(errno));
     }
-    process_file_list((const char *const *)file_names, &on_io_error);
+    process_file_list(&ctx, (const char *const *)file_names, &on_io_error);
     for(i = 0; i < LIST_LEN; i++)
     {
         FILE *actual_file;
@@ -146,12 +158,810 @@ START_TEST(test_process_file_list)
 }
 END_TEST
 
+START_TEST(test_check_file_list)
+{
+    static const char *const ORG_DATA[LIST_LEN] =
+        { "Unus\n",     "\tDuo\n",   "Tres \n" };
+    char *file_names[LIST_LEN + 1]; /* Must be null-terminated vector */
+    int i;
+    jmp_buf on_io_error;
+
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        size_t org_data_len = strlen(ORG_DATA[i]);
+        int fd;
+
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert_msg(fd >= 0, "Unable to create temp file `%s': %s",
+            file_names[i], strerror(errno));
+        ck_assert(write(fd, ORG_DATA[i], org_data_len)
+            == (ssize_t)org_data_len);
+        ck_assert(close(fd) == 0);
+    }
+    file_names[LIST_LEN] = NULL;
+
+    init_options();
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
+    options.check_only = 1;
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here on I/O error */
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+    /* The second and third files need cleaning */
+    ck_assert(check_file_list(&ctx, (const char *const *)file_names,
+        &on_io_error) == 2);
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        /* Every file must be left untouched */
+        FILE *actual_file = fopen(file_names[i], "rb");
+
+        ck_assert(actual_file != NULL);
+        assert_output_file_contents_match_str(ORG_DATA[i], actual_file);
+        ck_assert(fclose(actual_file) == 0);
+        ck_assert(unlink(file_names[i]) == 0);
+        free(file_names[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_check_file_list_keep_going)
+{
+    /* With keep_going, a file that cannot be checked must be reported as
+       a failure without stopping the files after it from being
+       checked. Standard output is captured to see which were. */
+    static const char DATA[] = "Tres \n";
+    static const char MISSING_FILE_NAME[] = "tm-missing";
+    char *file_names[LIST_LEN + 1]; /* Must be null-terminated vector */
+    char output[256];
+    size_t output_len;
+    FILE *output_file = tmpfile();
+    int saved_stdout = dup(STDOUT_FILENO);
+    int failed = 0;
+    int i;
+    jmp_buf on_io_error;
+
+    ck_assert(output_file != NULL && saved_stdout >= 0);
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        int fd;
+
+        if(i == 1)
+        {
+            file_names[i] = strdup(MISSING_FILE_NAME);
+            continue;
+        }
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert_msg(fd >= 0, "Unable to create temp file `%s': %s",
+            file_names[i], strerror(errno));
+        ck_assert(write(fd, DATA, strlen(DATA)) == (ssize_t)strlen(DATA));
+        ck_assert(close(fd) == 0);
+    }
+    file_names[LIST_LEN] = NULL;
+
+    init_options();
+    cleantxt_ctx_init(&ctx);
+    ctx.eol_mode = EM_LF;
+    options.check_only = 1;
+    options.keep_going = 1;
+
+    ck_assert(fflush(stdout) == 0);
+    ck_assert(dup2(fileno(output_file), STDOUT_FILENO) >= 0);
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here once every file has been tried */
+        failed = 1;
+    }
+    else
+    {
+        check_file_list(&ctx, (const char *const *)file_names,
+            &on_io_error);
+    }
+    ck_assert(fflush(stdout) == 0);
+    ck_assert(dup2(saved_stdout, STDOUT_FILENO) >= 0);
+    ck_assert(close(saved_stdout) == 0);
+    ck_assert(failed);
+
+    rewind(output_file);
+    output_len = fread(output, 1, sizeof(output) - 1, output_file);
+    output[output_len] = 0;
+    ck_assert(fclose(output_file) == 0);
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        if(i != 1)
+        {
+            ck_assert_msg(strstr(output, file_names[i]) != NULL,
+                "`%s' was not checked", file_names[i]);
+            ck_assert(unlink(file_names[i]) == 0);
+        }
+        free(file_names[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_process_file_list_binary)
+{
+    /* A file that looks binary must be left alone and counted, whether
+       files are processed one at a time, in parallel or only checked,
+       and must be cleaned like any other with --text. */
+    static const char TEXT_DATA[] = "\tText\n";
+    static const char TEXT_EXP_DATA[] = "    Text\n";
+    static const char BIN_DATA[] = "\tPNG\r\n\032\n\0\0\0\rIHDR \n";
+    static const int JOBS[] = { 1, 3 };
+    char *file_names[3]; /* Must be null-terminated vector */
+    unsigned long skipped;
+    int i;
+    int j;
+    FILE *f;
+    char contents[sizeof(BIN_DATA)];
+    jmp_buf on_io_error;
+
+    for(i = 0; i < 2; i++)
+    {
+        int fd;
+
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert(fd >= 0);
+        ck_assert(close(fd) == 0);
+    }
+    file_names[2] = NULL;
+
+    for(j = 0; j < (int)(sizeof(JOBS) / sizeof(JOBS[0])) + 2; j++)
+    {
+        /* Passes: one per entry in JOBS, then checking, then --text */
+        f = fopen(file_names[0], "wb");
+        ck_assert(f != NULL);
+        ck_assert(fputs(TEXT_DATA, f) >= 0);
+        ck_assert(fclose(f) == 0);
+        f = fopen(file_names[1], "wb");
+        ck_assert(f != NULL);
+        ck_assert(fwrite(BIN_DATA, 1, sizeof(BIN_DATA) - 1, f)
+            == sizeof(BIN_DATA) - 1);
+        ck_assert(fclose(f) == 0);
+
+        init_options();
+        cleantxt_ctx_init(&ctx);
+        ctx.tab_size = 4;
+        ctx.tab_min = 1;
+        ctx.whitespace_mode = WM_SPACE;
+        ctx.eol_mode = EM_LF;
+        if(j < (int)(sizeof(JOBS) / sizeof(JOBS[0])))
+        {
+            options.jobs = JOBS[j];
+        }
+        options.text = j == (int)(sizeof(JOBS) / sizeof(JOBS[0])) + 1;
+        skipped = binary_files_skipped();
+
+        if(setjmp(on_io_error))
+        {
+            /* Execution will branch here on I/O error */
+            ck_abort_msg("I/O error occurred: %s", strerror(errno));
+        }
+        if(j == (int)(sizeof(JOBS) / sizeof(JOBS[0])))
+        {
+            /* Only the text file needs cleaning */
+            options.check_only = 1;
+            ck_assert(check_file_list(&ctx, (const char *const *)file_names,
+                &on_io_error) == 1);
+        }
+        else
+        {
+            process_file_list(&ctx, (const char *const *)file_names,
+                &on_io_error);
+            f = fopen(file_names[0], "rb");
+            ck_assert(f != NULL);
+            assert_output_file_contents_match_str(TEXT_EXP_DATA, f);
+            ck_assert(fclose(f) == 0);
+        }
+
+        f = fopen(file_names[1], "rb");
+        ck_assert(f != NULL);
+        if(options.text)
+        {
+            ck_assert(binary_files_skipped() == skipped);
+            ck_assert(fread(contents, 1, sizeof(contents), f)
+                    != sizeof(BIN_DATA) - 1
+                || memcmp(contents, BIN_DATA, sizeof(BIN_DATA) - 1) != 0);
+        }
+        else
+        {
+            ck_assert(binary_files_skipped() == skipped + 1);
+            ck_assert(fread(contents, 1, sizeof(contents), f)
+                == sizeof(BIN_DATA) - 1);
+            ck_assert(memcmp(contents, BIN_DATA, sizeof(BIN_DATA) - 1) == 0);
+        }
+        ck_assert(fclose(f) == 0);
+    }
+
+    for(i = 0; i < 2; i++)
+    {
+        ck_assert(unlink(file_names[i]) == 0);
+        free(file_names[i]);
+    }
+}
+END_TEST
+
+/** Number of input files for #test_process_file_list_parallel; enough
+    to cycle through every in-flight slot more than once. */
+#define PARALLEL_LIST_LEN 40
+
+/** Position in the list of #test_process_file_list_parallel of a file
+    that does not exist */
+#define MISSING_FILE 7
+
+START_TEST(test_process_file_list_parallel)
+{
+    static const char ORG_DATA[] = "\tHello world!  \n";
+    static const char EXP_DATA[] = "    Hello world!\n";
+    static const char MISSING_FILE_NAME[] = "tm-missing";
+    char *file_names[PARALLEL_LIST_LEN + 1]; /* Must be null-terminated vector */
+    int i;
+    int failed = 0;
+    jmp_buf on_io_error;
+
+    for(i = 0; i < PARALLEL_LIST_LEN; i++)
+    {
+        size_t org_data_len = strlen(ORG_DATA);
+        int fd;
+
+        if(i == MISSING_FILE)
+        {
+            file_names[i] = strdup(MISSING_FILE_NAME);
+            continue;
+        }
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert_msg(fd >= 0, "Unable to create temp file `%s': %s",
+            file_names[i], strerror(errno));
+        ck_assert(write(fd, ORG_DATA, org_data_len)
+            == (ssize_t)org_data_len);
+        ck_assert(close(fd) == 0);
+    }
+    file_names[PARALLEL_LIST_LEN] = NULL;
+
+    init_options();
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
+    options.jobs = 3;
+    options.keep_going = 1;
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here once every file has been tried */
+        failed = 1;
+    }
+    else
+    {
+        process_file_list(&ctx, (const char *const *)file_names, &on_io_error);
+    }
+    /* The missing file must be reported as a failure, but every other
+       file must still have been processed. */
+    ck_assert(failed);
+    for(i = 0; i < PARALLEL_LIST_LEN; i++)
+    {
+        FILE *actual_file;
+
+        if(i != MISSING_FILE)
+        {
+            actual_file = fopen(file_names[i], "rb");
+            ck_assert(actual_file != NULL);
+            assert_output_file_contents_match_str(EXP_DATA, actual_file);
+            ck_assert(fclose(actual_file) == 0);
+            ck_assert(unlink(file_names[i]) == 0);
+        }
+        free(file_names[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_process_file_list_fix_tail)
+{
+    /* The first two files only need their ends fixing, so they keep
+       their inodes; the third is rewritten as a new file. */
+    static const char *const ORG_DATA[LIST_LEN] =
+        { "Unus",       "Duo\n\n\n", "\tTres\n" };
+    static const char *const EXP_DATA[LIST_LEN] =
+        { "Unus\n",     "Duo\n",     "    Tres\n" };
+    char *file_names[LIST_LEN + 1]; /* Must be null-terminated vector */
+    struct stat before[LIST_LEN];
+    struct stat after;
+    int i;
+    jmp_buf on_io_error;
+
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        size_t org_data_len = strlen(ORG_DATA[i]);
+        int fd;
+
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert(fd >= 0);
+        ck_assert(write(fd, ORG_DATA[i], org_data_len)
+            == (ssize_t)org_data_len);
+        ck_assert(fstat(fd, &before[i]) == 0);
+        ck_assert(close(fd) == 0);
+    }
+    file_names[LIST_LEN] = NULL;
+
+    init_options();
+    options.fix_tail = 1;
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here on I/O error */
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+    process_file_list(&ctx, (const char *const *)file_names, &on_io_error);
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        FILE *actual_file = fopen(file_names[i], "rb");
+
+        ck_assert(actual_file != NULL);
+        assert_output_file_contents_match_str(EXP_DATA[i], actual_file);
+        ck_assert(fclose(actual_file) == 0);
+        ck_assert(stat(file_names[i], &after) == 0);
+        ck_assert((after.st_ino == before[i].st_ino) == (i < 2));
+        ck_assert(unlink(file_names[i]) == 0);
+        free(file_names[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_process_file_list_overwrite)
+{
+    /* The first two files only get shorter, so they are overwritten and
+       keep their inodes; the third has a tab that gets expanded, so it
+       is rewritten as a new file. */
+    static const char *const ORG_DATA[LIST_LEN] =
+        { "Unus\r\nI \r\n", "Duo  \nII\n", "\tTres\r\n" };
+    static const char *const EXP_DATA[LIST_LEN] =
+        { "Unus\nI\n",     "Duo\nII\n",   "    Tres\n" };
+    char *file_names[LIST_LEN + 1]; /* Must be null-terminated vector */
+    struct stat before[LIST_LEN];
+    struct stat after;
+    int i;
+    jmp_buf on_io_error;
+
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        size_t org_data_len = strlen(ORG_DATA[i]);
+        int fd;
+
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert(fd >= 0);
+        ck_assert(write(fd, ORG_DATA[i], org_data_len)
+            == (ssize_t)org_data_len);
+        ck_assert(fstat(fd, &before[i]) == 0);
+        ck_assert(close(fd) == 0);
+    }
+    file_names[LIST_LEN] = NULL;
+
+    init_options();
+    options.overwrite = 1;
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here on I/O error */
+        ck_abort_msg("I/O error occurred: %s", strerror(errno));
+    }
+    process_file_list(&ctx, (const char *const *)file_names, &on_io_error);
+    for(i = 0; i < LIST_LEN; i++)
+    {
+        FILE *actual_file = fopen(file_names[i], "rb");
+
+        ck_assert(actual_file != NULL);
+        assert_output_file_contents_match_str(EXP_DATA[i], actual_file);
+        ck_assert(fclose(actual_file) == 0);
+        ck_assert(stat(file_names[i], &after) == 0);
+        ck_assert((after.st_ino == before[i].st_ino) == (i < 2));
+        ck_assert(unlink(file_names[i]) == 0);
+        free(file_names[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_process_file_list_durable)
+{
+    /* Batched replacement must give the same results as replacing each
+       file straight away, whether the files are processed one at a
+       time or in parallel, and a missing file must still fail alone. */
+    static const char ORG_DATA[] = "\tHello world!  \n";
+    static const char EXP_DATA[] = "    Hello world!\n";
+    static const char MISSING_FILE_NAME[] = "tm-missing";
+    static const int JOBS[] = { 1, 3 };
+    char *file_names[PARALLEL_LIST_LEN + 1]; /* Must be null-terminated vector */
+    int i;
+    int j;
+    jmp_buf on_io_error;
+
+    for(j = 0; j < (int)(sizeof(JOBS) / sizeof(JOBS[0])); j++)
+    {
+        int failed = 0;
+
+        for(i = 0; i < PARALLEL_LIST_LEN; i++)
+        {
+            size_t org_data_len = strlen(ORG_DATA);
+            int fd;
+
+            if(i == MISSING_FILE)
+            {
+                file_names[i] = strdup(MISSING_FILE_NAME);
+                continue;
+            }
+            file_names[i] = strdup(MKSTEMP_TEMPLATE);
+            fd = mkstemp(file_names[i]);
+            ck_assert(fd >= 0);
+            ck_assert(write(fd, ORG_DATA, org_data_len)
+                == (ssize_t)org_data_len);
+            ck_assert(close(fd) == 0);
+        }
+        file_names[PARALLEL_LIST_LEN] = NULL;
+
+        init_options();
+        cleantxt_ctx_init(&ctx);
+        ctx.tab_size = 4;
+        ctx.tab_min = 1;
+        ctx.whitespace_mode = WM_SPACE;
+        ctx.eol_mode = EM_LF;
+        options.jobs = JOBS[j];
+        options.keep_going = 1;
+        options.durable = 1;
+
+        if(setjmp(on_io_error))
+        {
+            /* Execution will branch here once every file has been tried */
+            failed = 1;
+        }
+        else
+        {
+            process_file_list(&ctx, (const char *const *)file_names,
+                &on_io_error);
+        }
+        ck_assert(failed);
+        for(i = 0; i < PARALLEL_LIST_LEN; i++)
+        {
+            FILE *actual_file;
+
+            if(i != MISSING_FILE)
+            {
+                actual_file = fopen(file_names[i], "rb");
+                ck_assert(actual_file != NULL);
+                assert_output_file_contents_match_str(EXP_DATA, actual_file);
+                ck_assert(fclose(actual_file) == 0);
+                ck_assert(unlink(file_names[i]) == 0);
+            }
+            free(file_names[i]);
+        }
+    }
+}
+END_TEST
+
+/** Number of files in each directory of the tree cleaned by
+    #test_process_file_list_recursive */
+#define TREE_DIR_FILES 30
+
+START_TEST(test_process_file_list_recursive)
+{
+    /* Every regular file in a tree of directories must be cleaned,
+       whether the files are processed one at a time or in parallel, and
+       a symbolic link inside the tree must be left alone. */
+    static const char ORG_DATA[] = "\tHello world!  \n";
+    static const char EXP_DATA[] = "    Hello world!\n";
+    static const int JOBS[] = { 1, 3 };
+    char *dir_name = strdup(MKSTEMP_TEMPLATE);
+    char sub_name[PATH_MAX];
+    char link_name[PATH_MAX];
+    char file_names[2 * TREE_DIR_FILES][PATH_MAX];
+    const char *list[2];
+    struct stat link_stat;
+    int i;
+    int j;
+    jmp_buf on_io_error;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    sprintf(sub_name, "%s/sub", dir_name);
+    ck_assert(mkdir(sub_name, 0700) == 0);
+    for(i = 0; i < 2 * TREE_DIR_FILES; i++)
+    {
+        sprintf(file_names[i], "%s/f%d",
+            i < TREE_DIR_FILES ? dir_name : sub_name, i);
+    }
+    sprintf(link_name, "%s/link", sub_name);
+    ck_assert(symlink("f0", link_name) == 0);
+    list[0] = dir_name;
+    list[1] = NULL;
+
+    for(j = 0; j < (int)(sizeof(JOBS) / sizeof(JOBS[0])); j++)
+    {
+        for(i = 0; i < 2 * TREE_DIR_FILES; i++)
+        {
+            FILE *f = fopen(file_names[i], "wb");
+
+            ck_assert(f != NULL);
+            ck_assert(fputs(ORG_DATA, f) >= 0);
+            ck_assert(fclose(f) == 0);
+        }
+
+        init_options();
+        cleantxt_ctx_init(&ctx);
+        ctx.tab_size = 4;
+        ctx.tab_min = 1;
+        ctx.whitespace_mode = WM_SPACE;
+        ctx.eol_mode = EM_LF;
+        options.jobs = JOBS[j];
+        options.recursive = 1;
+
+        if(setjmp(on_io_error))
+        {
+            /* Execution will branch here on I/O error */
+            ck_abort_msg("I/O error occurred: %s", strerror(errno));
+        }
+        process_file_list(&ctx, list, &on_io_error);
+        for(i = 0; i < 2 * TREE_DIR_FILES; i++)
+        {
+            FILE *actual_file = fopen(file_names[i], "rb");
+
+            ck_assert(actual_file != NULL);
+            assert_output_file_contents_match_str(EXP_DATA, actual_file);
+            ck_assert(fclose(actual_file) == 0);
+        }
+        ck_assert(lstat(link_name, &link_stat) == 0);
+        ck_assert(S_ISLNK(link_stat.st_mode));
+    }
+
+    for(i = 0; i < 2 * TREE_DIR_FILES; i++)
+    {
+        ck_assert(unlink(file_names[i]) == 0);
+    }
+    ck_assert(unlink(link_name) == 0);
+    ck_assert(rmdir(sub_name) == 0);
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+END_TEST
+
+START_TEST(test_process_file_list_files0)
+{
+    /* Every file named in a list of null-terminated names must be
+       cleaned, whether the files are processed one at a time or in
+       parallel. */
+    static const char ORG_DATA[] = "\tHello world!  \n";
+    static const char EXP_DATA[] = "    Hello world!\n";
+    static const int JOBS[] = { 1, 3 };
+    static const char *const NO_NAMES[] = { NULL };
+    char *dir_name = strdup(MKSTEMP_TEMPLATE);
+    char names_name[PATH_MAX];
+    char file_names[TREE_DIR_FILES][PATH_MAX];
+    FILE *names_file;
+    int i;
+    int j;
+    jmp_buf on_io_error;
+
+    ck_assert(mkdtemp(dir_name) != NULL);
+    sprintf(names_name, "%s/names", dir_name);
+    names_file = fopen(names_name, "wb");
+    ck_assert(names_file != NULL);
+    for(i = 0; i < TREE_DIR_FILES; i++)
+    {
+        sprintf(file_names[i], "%s/f %d", dir_name, i);
+        ck_assert(fwrite(file_names[i], 1, strlen(file_names[i]) + 1,
+            names_file) == strlen(file_names[i]) + 1);
+    }
+    ck_assert(fclose(names_file) == 0);
+
+    for(j = 0; j < (int)(sizeof(JOBS) / sizeof(JOBS[0])); j++)
+    {
+        for(i = 0; i < TREE_DIR_FILES; i++)
+        {
+            FILE *f = fopen(file_names[i], "wb");
+
+            ck_assert(f != NULL);
+            ck_assert(fputs(ORG_DATA, f) >= 0);
+            ck_assert(fclose(f) == 0);
+        }
+
+        init_options();
+        cleantxt_ctx_init(&ctx);
+        ctx.tab_size = 4;
+        ctx.tab_min = 1;
+        ctx.whitespace_mode = WM_SPACE;
+        ctx.eol_mode = EM_LF;
+        options.jobs = JOBS[j];
+        options.files0_from = names_name;
+
+        if(setjmp(on_io_error))
+        {
+            /* Execution will branch here on I/O error */
+            ck_abort_msg("I/O error occurred: %s", strerror(errno));
+        }
+        process_file_list(&ctx, NO_NAMES, &on_io_error);
+        for(i = 0; i < TREE_DIR_FILES; i++)
+        {
+            FILE *actual_file = fopen(file_names[i], "rb");
+
+            ck_assert(actual_file != NULL);
+            assert_output_file_contents_match_str(EXP_DATA, actual_file);
+            ck_assert(fclose(actual_file) == 0);
+        }
+    }
+
+    for(i = 0; i < TREE_DIR_FILES; i++)
+    {
+        ck_assert(unlink(file_names[i]) == 0);
+    }
+    ck_assert(unlink(names_name) == 0);
+    ck_assert(rmdir(dir_name) == 0);
+    free(dir_name);
+}
+END_TEST
+
+/** Number of lines in each file of #test_process_file_list_fd_leak,
+    whose cleaned copies are too big to be written */
+#define FAILING_FILE_LINES 4096
+
+/** Largest file that #test_process_file_list_fd_leak lets the process
+    write, in bytes */
+#define FAILING_FILE_SIZE_LIMIT 1024
+
+/** Number of descriptors that #test_process_file_list_fd_leak leaves
+    free for processing each file */
+#define SPARE_FDS 8
+
+/** Finds the lowest file descriptor that is not in use.
+
+    @return The descriptor. */
+static int lowest_free_fd(void)
+{
+    int fd = open("/dev/null", O_RDONLY);
+
+    ck_assert(fd >= 0);
+    ck_assert(close(fd) == 0);
+    return fd;
+}
+
+/** Counts the file descriptors in use within a range.
+
+    @param first The first descriptor of the range.
+    @param count Number of descriptors in the range.
+    @return The number in use. */
+static int count_open_fds(int first, int count)
+{
+    int open_fds = 0;
+    int fd;
+
+    for(fd = first; fd < first + count; fd++)
+    {
+        if(fcntl(fd, F_GETFD) != -1)
+        {
+            open_fds++;
+        }
+    }
+    return open_fds;
+}
+
+START_TEST(test_process_file_list_fd_leak)
+{
+    /* With -k, every file that fails must still have been closed, or a
+       long batch runs out of descriptors. Here each cleaned copy grows
+       past the file size limit while it is written, and few descriptors
+       are left spare. Every file must fail, stay as it was, and leave
+       no descriptor open. */
+    char *file_names[PARALLEL_LIST_LEN + 1]; /* Must be null-terminated vector */
+    struct rlimit old_nofile;
+    struct rlimit old_fsize;
+    struct rlimit limit;
+    void (*old_xfsz)(int);
+    int first_free;
+    int i;
+    volatile int failed = 0;
+    jmp_buf on_io_error;
+
+    for(i = 0; i < PARALLEL_LIST_LEN; i++)
+    {
+        FILE *f;
+        int fd;
+        int line;
+
+        file_names[i] = strdup(MKSTEMP_TEMPLATE);
+        fd = mkstemp(file_names[i]);
+        ck_assert(fd >= 0);
+        f = fdopen(fd, "wb");
+        ck_assert(f != NULL);
+        for(line = 0; line < FAILING_FILE_LINES; line++)
+        {
+            ck_assert(fputs("\tHello world!\n", f) >= 0);
+        }
+        ck_assert(fclose(f) == 0);
+    }
+    file_names[PARALLEL_LIST_LEN] = NULL;
+
+    init_options();
+    cleantxt_ctx_init(&ctx);
+    ctx.tab_size = 4;
+    ctx.tab_min = 1;
+    ctx.whitespace_mode = WM_SPACE;
+    ctx.eol_mode = EM_LF;
+    options.keep_going = 1;
+
+    first_free = lowest_free_fd();
+    ck_assert(getrlimit(RLIMIT_NOFILE, &old_nofile) == 0);
+    ck_assert(getrlimit(RLIMIT_FSIZE, &old_fsize) == 0);
+    limit = old_nofile;
+    limit.rlim_cur = first_free + SPARE_FDS;
+    ck_assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    limit = old_fsize;
+    limit.rlim_cur = FAILING_FILE_SIZE_LIMIT;
+    ck_assert(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+    old_xfsz = signal(SIGXFSZ, SIG_IGN);
+
+    if(setjmp(on_io_error))
+    {
+        /* Execution will branch here once every file has been tried */
+        failed = 1;
+    }
+    else
+    {
+        process_file_list(&ctx, (const char *const *)file_names, &on_io_error);
+    }
+
+    signal(SIGXFSZ, old_xfsz);
+    ck_assert(setrlimit(RLIMIT_FSIZE, &old_fsize) == 0);
+    ck_assert(setrlimit(RLIMIT_NOFILE, &old_nofile) == 0);
+    ck_assert(failed);
+    ck_assert_msg(count_open_fds(first_free, SPARE_FDS) == 0,
+        "File descriptors were left open");
+    for(i = 0; i < PARALLEL_LIST_LEN; i++)
+    {
+        struct stat file_stat;
+
+        /* The file must be untouched */
+        ck_assert(stat(file_names[i], &file_stat) == 0);
+        ck_assert(file_stat.st_size
+            == (off_t)(FAILING_FILE_LINES * strlen("\tHello world!\n")));
+        ck_assert(unlink(file_names[i]) == 0);
+        free(file_names[i]);
+    }
+}
+END_TEST
+
 Suite *init_suite(void)
 {
     Suite *s = suite_create("procfile");
     TCase *tc_core = tcase_create("core");
     tcase_add_test(tc_core, test_process_file);
     tcase_add_test(tc_core, test_process_file_list);
+    tcase_add_test(tc_core, test_check_file_list);
+    tcase_add_test(tc_core, test_check_file_list_keep_going);
+    tcase_add_test(tc_core, test_process_file_list_binary);
+    tcase_add_test(tc_core, test_process_file_list_parallel);
+    tcase_add_test(tc_core, test_process_file_list_fix_tail);
+    tcase_add_test(tc_core, test_process_file_list_overwrite);
+    tcase_add_test(tc_core, test_process_file_list_durable);
+    tcase_add_test(tc_core, test_process_file_list_recursive);
+    tcase_add_test(tc_core, test_process_file_list_files0);
+    tcase_add_test(tc_core, test_process_file_list_fd_leak);
     suite_add_tcase(s, tc_core);
     return s;
 }